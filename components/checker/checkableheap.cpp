@@ -0,0 +1,190 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "checker/checkableheap.h"
+#include "base/debug.h"
+
+using namespace icinga;
+
+/**
+ * Adds a checkable to the heap or updates its position if it is already in
+ * the heap.
+ *
+ * @param checkable The checkable.
+ * @param next_check The checkable's next check timestamp.
+ */
+void CheckableHeap::Push(const Checkable::Ptr& checkable, double next_check)
+{
+	boost::unordered_map<Checkable *, size_t>::iterator it = m_Index.find(checkable.get());
+
+	if (it != m_Index.end()) {
+		size_t index = it->second;
+		double old_next_check = m_Entries[index].NextCheck;
+
+		m_Entries[index].NextCheck = next_check;
+
+		if (next_check < old_next_check)
+			SiftUp(index);
+		else
+			SiftDown(index);
+
+		return;
+	}
+
+	HeapEntry entry;
+	entry.Object = checkable;
+	entry.NextCheck = next_check;
+
+	m_Entries.push_back(entry);
+	m_Index[checkable.get()] = m_Entries.size() - 1;
+
+	SiftUp(m_Entries.size() - 1);
+}
+
+/**
+ * Removes a checkable from the heap.
+ *
+ * @param checkable The checkable.
+ * @returns true if the checkable was in the heap, false otherwise.
+ */
+bool CheckableHeap::Remove(const Checkable::Ptr& checkable)
+{
+	boost::unordered_map<Checkable *, size_t>::iterator it = m_Index.find(checkable.get());
+
+	if (it == m_Index.end())
+		return false;
+
+	RemoveAt(it->second);
+
+	return true;
+}
+
+bool CheckableHeap::Contains(const Checkable::Ptr& checkable) const
+{
+	return (m_Index.find(checkable.get()) != m_Index.end());
+}
+
+/**
+ * Retrieves the checkable with the lowest next check timestamp.
+ *
+ * @returns The checkable.
+ */
+Checkable::Ptr CheckableHeap::GetTop(void) const
+{
+	ASSERT(!m_Entries.empty());
+
+	return m_Entries[0].Object;
+}
+
+/**
+ * Retrieves the lowest next check timestamp.
+ *
+ * @returns The timestamp.
+ */
+double CheckableHeap::GetTopKey(void) const
+{
+	ASSERT(!m_Entries.empty());
+
+	return m_Entries[0].NextCheck;
+}
+
+/**
+ * Removes the checkable with the lowest next check timestamp from the heap.
+ *
+ * @returns The checkable.
+ */
+Checkable::Ptr CheckableHeap::Pop(void)
+{
+	Checkable::Ptr checkable = GetTop();
+
+	RemoveAt(0);
+
+	return checkable;
+}
+
+bool CheckableHeap::IsEmpty(void) const
+{
+	return m_Entries.empty();
+}
+
+size_t CheckableHeap::GetLength(void) const
+{
+	return m_Entries.size();
+}
+
+void CheckableHeap::Swap(size_t a, size_t b)
+{
+	std::swap(m_Entries[a], m_Entries[b]);
+
+	m_Index[m_Entries[a].Object.get()] = a;
+	m_Index[m_Entries[b].Object.get()] = b;
+}
+
+void CheckableHeap::SiftUp(size_t index)
+{
+	while (index > 0) {
+		size_t parent = (index - 1) / 2;
+
+		if (m_Entries[parent].NextCheck <= m_Entries[index].NextCheck)
+			break;
+
+		Swap(parent, index);
+		index = parent;
+	}
+}
+
+void CheckableHeap::SiftDown(size_t index)
+{
+	for (;;) {
+		size_t left = 2 * index + 1;
+		size_t right = left + 1;
+		size_t smallest = index;
+
+		if (left < m_Entries.size() && m_Entries[left].NextCheck < m_Entries[smallest].NextCheck)
+			smallest = left;
+
+		if (right < m_Entries.size() && m_Entries[right].NextCheck < m_Entries[smallest].NextCheck)
+			smallest = right;
+
+		if (smallest == index)
+			break;
+
+		Swap(index, smallest);
+		index = smallest;
+	}
+}
+
+void CheckableHeap::RemoveAt(size_t index)
+{
+	size_t last = m_Entries.size() - 1;
+
+	m_Index.erase(m_Entries[index].Object.get());
+
+	if (index != last) {
+		m_Entries[index] = m_Entries[last];
+		m_Index[m_Entries[index].Object.get()] = index;
+	}
+
+	m_Entries.pop_back();
+
+	if (index < m_Entries.size()) {
+		SiftUp(index);
+		SiftDown(index);
+	}
+}
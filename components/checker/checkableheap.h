@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef CHECKABLEHEAP_H
+#define CHECKABLEHEAP_H
+
+#include "icinga/checkable.h"
+#include <vector>
+#include <boost/unordered_map.hpp>
+
+namespace icinga
+{
+
+/**
+ * An indexed binary min-heap of checkables which is ordered by the
+ * checkables' next check timestamps. Unlike an ordered set the heap keeps its
+ * own copy of the key so that a checkable's position can be updated in
+ * O(log n) when its next check timestamp changes.
+ *
+ * Note: This class is not thread-safe.
+ *
+ * @ingroup checker
+ */
+class CheckableHeap
+{
+public:
+	void Push(const Checkable::Ptr& checkable, double next_check);
+	bool Remove(const Checkable::Ptr& checkable);
+	bool Contains(const Checkable::Ptr& checkable) const;
+
+	Checkable::Ptr GetTop(void) const;
+	double GetTopKey(void) const;
+	Checkable::Ptr Pop(void);
+
+	bool IsEmpty(void) const;
+	size_t GetLength(void) const;
+
+private:
+	struct HeapEntry
+	{
+		Checkable::Ptr Object;
+		double NextCheck;
+	};
+
+	std::vector<HeapEntry> m_Entries;
+	boost::unordered_map<Checkable *, size_t> m_Index;
+
+	void Swap(size_t a, size_t b);
+	void SiftUp(size_t index);
+	void SiftDown(size_t index);
+	void RemoveAt(size_t index);
+};
+
+}
+
+#endif /* CHECKABLEHEAP_H */
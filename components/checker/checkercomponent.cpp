@@ -20,6 +20,7 @@
 #include "checker/checkercomponent.h"
 #include "icinga/icingaapplication.h"
 #include "icinga/cib.h"
+#include "icinga/checkcommand.h"
 #include "base/dynamictype.h"
 #include "base/objectlock.h"
 #include "base/utility.h"
@@ -28,6 +29,7 @@
 #include "base/convert.h"
 #include "base/statsfunction.h"
 #include <boost/foreach.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
@@ -35,23 +37,79 @@ REGISTER_TYPE(CheckerComponent);
 
 REGISTER_STATSFUNCTION(CheckerComponentStats, &CheckerComponent::StatsFunc);
 
+/* Overdue checks are spread out over at most this many seconds. */
+static const double l_CheckSpreadWindow = 60;
+
+/* How long we wait for a check result after the check command's timeout
+ * has expired before we reschedule the check anyway. */
+static const double l_CheckResultGracePeriod = 30;
+
 Value CheckerComponent::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& perfdata)
 {
 	Dictionary::Ptr nodes = make_shared<Dictionary>();
 
 	BOOST_FOREACH(const CheckerComponent::Ptr& checker, DynamicType::GetObjects<CheckerComponent>()) {
-		unsigned long idle = checker->GetIdleCheckables();
-		unsigned long pending = checker->GetPendingCheckables();
+		unsigned long idle = 0;
+		unsigned long pending = 0;
+
+		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
+
+		Array::Ptr shards = make_shared<Array>();
+
+		for (std::vector<shared_ptr<CheckerShard> >::size_type i = 0; i < checker->m_Shards.size(); i++) {
+			CheckerShard& shard = *checker->m_Shards[i];
+
+			unsigned long shard_idle, shard_pending, shard_checks;
+
+			{
+				boost::mutex::scoped_lock lock(shard.Mutex);
+
+				shard_idle = shard.IdleCheckables.GetLength();
+				shard_pending = shard.PendingCheckables.size();
+				shard_checks = shard.ChecksExecuted;
+			}
+
+			idle += shard_idle;
+			pending += shard_pending;
+
+			Dictionary::Ptr shard_stats = make_shared<Dictionary>();
+			shard_stats->Set("idle", shard_idle);
+			shard_stats->Set("pending", shard_pending);
+			shard_stats->Set("checks", shard_checks);
+			shards->Add(shard_stats);
+
+			String shard_prefix = perfdata_prefix + "shard" + Convert::ToString(static_cast<long>(i)) + "_";
+			perfdata->Set(shard_prefix + "idle", Convert::ToDouble(shard_idle));
+			perfdata->Set(shard_prefix + "pending", Convert::ToDouble(shard_pending));
+		}
+
+		int running;
+		unsigned long queued;
+		double wait_time;
+
+		{
+			boost::mutex::scoped_lock lock(checker->m_AdmissionMutex);
+			running = checker->m_RunningChecks;
+			queued = checker->m_CheckQueue.size();
+			wait_time = checker->m_AvgQueueWaitTime;
+		}
 
 		Dictionary::Ptr stats = make_shared<Dictionary>();
 		stats->Set("idle", idle);
 		stats->Set("pending", pending);
+		stats->Set("running", running);
+		stats->Set("max_concurrent_checks", checker->GetMaxConcurrentChecks());
+		stats->Set("queued", queued);
+		stats->Set("avg_queue_wait_time", wait_time);
+		stats->Set("shards", shards);
 
 		nodes->Set(checker->GetName(), stats);
 
-		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
 		perfdata->Set(perfdata_prefix + "idle", Convert::ToDouble(idle));
 		perfdata->Set(perfdata_prefix + "pending", Convert::ToDouble(pending));
+		perfdata->Set(perfdata_prefix + "running", Convert::ToDouble(running));
+		perfdata->Set(perfdata_prefix + "queued", Convert::ToDouble(queued));
+		perfdata->Set(perfdata_prefix + "avg_queue_wait_time", wait_time);
 	}
 
 	status->Set("checkercomponent", nodes);
@@ -66,6 +124,17 @@ void CheckerComponent::OnConfigLoaded(void)
 	DynamicObject::OnAuthorityChanged.connect(bind(&CheckerComponent::ObjectHandler, this, _1));
 
 	Checkable::OnNextCheckChanged.connect(bind(&CheckerComponent::NextCheckChangedHandler, this, _1));
+	Checkable::OnNewCheckResult.connect(bind(&CheckerComponent::NewCheckResultHandler, this, _1));
+
+	unsigned int count = boost::thread::hardware_concurrency();
+
+	if (count < 1)
+		count = 1;
+	else if (count > 16)
+		count = 16;
+
+	for (unsigned int i = 0; i < count; i++)
+		m_Shards.push_back(make_shared<CheckerShard>());
 }
 
 void CheckerComponent::Start(void)
@@ -73,8 +142,15 @@ void CheckerComponent::Start(void)
 	DynamicObject::Start();
 
 	m_Stopped = false;
-
-	m_Thread = boost::thread(boost::bind(&CheckerComponent::CheckThreadProc, this));
+	m_RunningChecks = 0;
+	m_QueueWaitTime = 0;
+	m_QueueWaitCount = 0;
+	m_AvgQueueWaitTime = 0;
+
+	for (std::vector<shared_ptr<CheckerShard> >::size_type i = 0; i < m_Shards.size(); i++) {
+		CheckerShard& shard = *m_Shards[i];
+		shard.Thread = boost::thread(boost::bind(&CheckerComponent::CheckThreadProc, this, boost::ref(shard), i));
+	}
 
 	m_ResultTimer = make_shared<Timer>();
 	m_ResultTimer->SetInterval(5);
@@ -86,55 +162,91 @@ void CheckerComponent::Stop(void)
 {
 	Log(LogInformation, "checker", "Checker stopped.");
 
+	BOOST_FOREACH(const shared_ptr<CheckerShard>& shard, m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		m_Stopped = true;
+		shard->CV.notify_all();
+	}
+
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		boost::mutex::scoped_lock lock(m_AdmissionMutex);
 		m_Stopped = true;
-		m_CV.notify_all();
+		m_CheckQueue.clear();
 	}
 
 	m_ResultTimer->Stop();
-	m_Thread.join();
+
+	BOOST_FOREACH(const shared_ptr<CheckerShard>& shard, m_Shards)
+		shard->Thread.join();
 
 	DynamicObject::Stop();
 }
 
-void CheckerComponent::CheckThreadProc(void)
+/**
+ * Determines which shard is responsible for the specified checkable.
+ *
+ * @param checkable The checkable.
+ * @returns The shard.
+ */
+CheckerShard& CheckerComponent::GetShard(const Checkable::Ptr& checkable)
 {
-	Utility::SetThreadName("Check Scheduler");
+	return *m_Shards[Utility::SDBM(checkable->GetName()) % m_Shards.size()];
+}
 
-	boost::mutex::scoped_lock lock(m_Mutex);
+void CheckerComponent::CheckThreadProc(CheckerShard& shard, int index)
+{
+	Utility::SetThreadName("Check Scheduler #" + Convert::ToString(index));
 
-	for (;;) {
-		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
-		CheckTimeView& idx = boost::get<1>(m_IdleCheckables);
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
-		while (idx.begin() == idx.end() && !m_Stopped)
-			m_CV.wait(lock);
+	for (;;) {
+		while (shard.IdleCheckables.IsEmpty() && !m_Stopped)
+			shard.CV.wait(lock);
 
 		if (m_Stopped)
 			break;
 
-		CheckTimeView::iterator it = idx.begin();
-		Checkable::Ptr checkable = *it;
+		Checkable::Ptr checkable = shard.IdleCheckables.GetTop();
 
 		if (!checkable->HasAuthority("checker")) {
-			m_IdleCheckables.erase(checkable);
+			shard.IdleCheckables.Pop();
 
 			continue;
 		}
 
-		double wait = checkable->GetNextCheck() - Utility::GetTime();
+		double next_check = shard.IdleCheckables.GetTopKey();
+		double now = Utility::GetTime();
+		double wait = next_check - now;
 
 		if (wait > 0) {
 			/* Wait for the next check. */
-			m_CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+			shard.CV.timed_wait(lock, boost::posix_time::milliseconds(static_cast<long>(wait * 1000)));
 
 			continue;
 		}
 
-		m_IdleCheckables.erase(checkable);
-
 		bool forced = checkable->GetForceNextCheck();
+		double interval = checkable->GetCheckInterval();
+
+		/* Checks which are overdue by more than a full check interval and by
+		 * more than the spread window (e.g. because the scheduler couldn't keep
+		 * up or the system was suspended) are spread out instead of being
+		 * started all at once. */
+		if (!forced && next_check < now - std::max(interval, l_CheckSpreadWindow)) {
+			double window = std::max(1.0, std::min(interval, l_CheckSpreadWindow));
+			double spread = (checkable->GetSchedulingOffset() % static_cast<long>(window * 100)) / 100.0;
+
+			lock.unlock();
+
+			checkable->SetNextCheck(now + spread);
+
+			lock.lock();
+
+			continue;
+		}
+
+		shard.IdleCheckables.Pop();
+
 		bool check = true;
 
 		if (!forced) {
@@ -166,7 +278,7 @@ void CheckerComponent::CheckThreadProc(void)
 
 		/* reschedule the checkable if checks are disabled */
 		if (!check) {
-			m_IdleCheckables.insert(checkable);
+			shard.IdleCheckables.Push(checkable, checkable->GetNextCheck());
 			lock.unlock();
 
 			checkable->UpdateNextCheck();
@@ -176,7 +288,9 @@ void CheckerComponent::CheckThreadProc(void)
 			continue;
 		}
 
-		m_PendingCheckables.insert(checkable);
+		/* The deadline is set once the check has been dispatched. */
+		shard.PendingCheckables[checkable] = 0;
+		shard.ChecksExecuted++;
 
 		lock.unlock();
 
@@ -185,12 +299,123 @@ void CheckerComponent::CheckThreadProc(void)
 			checkable->SetForceNextCheck(false);
 		}
 
+		EnqueueCheck(checkable);
+
+		lock.lock();
+	}
+}
+
+/**
+ * Adds a check to the check queue. Checks are started in the order they
+ * were queued in as long as there are fewer than max_concurrent_checks
+ * checks running.
+ *
+ * @param checkable The checkable.
+ */
+void CheckerComponent::EnqueueCheck(const Checkable::Ptr& checkable)
+{
+	boost::mutex::scoped_lock lock(m_AdmissionMutex);
+
+	if (m_Stopped)
+		return;
+
+	QueuedCheck qc;
+	qc.Object = checkable;
+	qc.Timestamp = Utility::GetTime();
+	m_CheckQueue.push_back(qc);
+
+	DispatchQueuedChecks(lock);
+}
+
+/**
+ * Removes a check from the check queue or, if it has already been
+ * dispatched, releases its check slot. Must be called while holding the
+ * lock for the checkable's shard right after the checkable has been
+ * removed from the shard's pending checkables.
+ *
+ * @param checkable The checkable.
+ */
+void CheckerComponent::ReleaseCheck(const Checkable::Ptr& checkable)
+{
+	boost::mutex::scoped_lock lock(m_AdmissionMutex);
+
+	for (std::deque<QueuedCheck>::iterator it = m_CheckQueue.begin(); it != m_CheckQueue.end(); it++) {
+		if (it->Object == checkable) {
+			m_CheckQueue.erase(it);
+			return;
+		}
+	}
+
+	m_RunningChecks--;
+}
+
+/**
+ * Starts queued checks until the concurrency limit is reached.
+ *
+ * @param lock The lock for m_AdmissionMutex; it is released by this function.
+ */
+void CheckerComponent::DispatchQueuedChecks(boost::mutex::scoped_lock& lock)
+{
+	std::vector<Checkable::Ptr> checkables;
+
+	int max_checks = GetMaxConcurrentChecks();
+	double now = Utility::GetTime();
+
+	while (!m_CheckQueue.empty() && (max_checks <= 0 || m_RunningChecks < max_checks)) {
+		const QueuedCheck& qc = m_CheckQueue.front();
+
+		m_QueueWaitTime += now - qc.Timestamp;
+		m_QueueWaitCount++;
+
+		checkables.push_back(qc.Object);
+		m_CheckQueue.pop_front();
+
+		m_RunningChecks++;
+	}
+
+	lock.unlock();
+
+	CheckerComponent::Ptr self = GetSelf();
+	bool released = false;
+
+	BOOST_FOREACH(const Checkable::Ptr& checkable, checkables) {
+		{
+			CheckerShard& shard = GetShard(checkable);
+
+			boost::mutex::scoped_lock slock(shard.Mutex);
+
+			std::map<Checkable::Ptr, double>::iterator it = shard.PendingCheckables.find(checkable);
+
+			/* The check was finished (e.g. by a passive check result) after
+			 * we've taken it off the queue; ReleaseCheck() has already released
+			 * its slot. */
+			if (it == shard.PendingCheckables.end())
+				continue;
+
+			/* The checkable was finished and queued again in the meantime and
+			 * the new check was dispatched first. */
+			if (it->second != 0) {
+				slock.unlock();
+
+				boost::mutex::scoped_lock alock(m_AdmissionMutex);
+				m_RunningChecks--;
+				released = true;
+
+				continue;
+			}
+
+			double timeout = checkable->GetCheckCommand()->GetTimeout();
+			it->second = Utility::GetTime() + timeout + l_CheckResultGracePeriod;
+		}
+
 		Log(LogDebug, "checker", "Executing check for '" + checkable->GetName() + "'");
 
-		CheckerComponent::Ptr self = GetSelf();
 		Utility::QueueAsyncCallback(boost::bind(&CheckerComponent::ExecuteCheckHelper, self, checkable));
+	}
 
+	if (released) {
 		lock.lock();
+		DispatchQueuedChecks(lock);
 	}
 }
 
@@ -216,24 +441,45 @@ void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 		Log(LogCritical, "checker", output);
 	}
 
+	/* Most check types run asynchronously and the check isn't finished
+	 * until we've received its check result. */
+	if (!checkable->IsCheckPending())
+		CheckFinished(checkable);
+}
+
+/**
+ * Moves a checkable from the list of pending checkables back into the
+ * scheduler and releases its check slot.
+ *
+ * @param checkable The checkable.
+ */
+void CheckerComponent::CheckFinished(const Checkable::Ptr& checkable)
+{
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		CheckerShard& shard = GetShard(checkable);
+
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		/* remove the object from the list of pending objects; if it's not in the
 		 * list this was a manual (i.e. forced) check and we must not re-add the
 		 * object to the list because it's already there. */
-		CheckerComponent::CheckableSet::iterator it;
-		it = m_PendingCheckables.find(checkable);
-		if (it != m_PendingCheckables.end()) {
-			m_PendingCheckables.erase(it);
+		std::map<Checkable::Ptr, double>::iterator it = shard.PendingCheckables.find(checkable);
 
-			if (checkable->IsActive() && checkable->HasAuthority("checker"))
-				m_IdleCheckables.insert(checkable);
+		if (it == shard.PendingCheckables.end())
+			return;
 
-			m_CV.notify_all();
-		}
+		shard.PendingCheckables.erase(it);
+		ReleaseCheck(checkable);
+
+		if (checkable->IsActive() && checkable->HasAuthority("checker"))
+			shard.IdleCheckables.Push(checkable, checkable->GetNextCheck());
+
+		shard.CV.notify_all();
 	}
 
+	boost::mutex::scoped_lock lock(m_AdmissionMutex);
+	DispatchQueuedChecks(lock);
+
 	Log(LogDebug, "checker", "Check finished for object '" + checkable->GetName() + "'");
 }
 
@@ -241,12 +487,55 @@ void CheckerComponent::ResultTimerHandler(void)
 {
 	std::ostringstream msgbuf;
 
+	unsigned long idle = 0, pending = 0;
+	std::vector<Checkable::Ptr> overdue;
+	double now = Utility::GetTime();
+
+	BOOST_FOREACH(const shared_ptr<CheckerShard>& shard, m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+
+		idle += shard->IdleCheckables.GetLength();
+		pending += shard->PendingCheckables.size();
+
+		typedef std::pair<Checkable::Ptr, double> kv_pair;
+		BOOST_FOREACH(const kv_pair& kv, shard->PendingCheckables) {
+			/* Queued checks don't time out. */
+			if (kv.second != 0 && kv.second < now)
+				overdue.push_back(kv.first);
+		}
+	}
+
+	/* Don't keep check slots reserved forever for checks whose results
+	 * never arrive (e.g. because they were executed by another node). */
+	BOOST_FOREACH(const Checkable::Ptr& checkable, overdue) {
+		Log(LogWarning, "checker", "Check result for object '" + checkable->GetName() + "' is overdue. Rescheduling check.");
+		CheckFinished(checkable);
+	}
+
+	CheckQueueStatistics cqs;
+
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		boost::mutex::scoped_lock lock(m_AdmissionMutex);
+
+		if (m_QueueWaitCount > 0)
+			m_AvgQueueWaitTime = m_QueueWaitTime / m_QueueWaitCount;
+		else
+			m_AvgQueueWaitTime = 0;
 
-		msgbuf << "Pending checkables: " << m_PendingCheckables.size() << "; Idle checkables: " << m_IdleCheckables.size() << "; Checks/s: " << CIB::GetActiveChecksStatistics(5) / 5.0;
+		m_QueueWaitTime = 0;
+		m_QueueWaitCount = 0;
+
+		cqs.running_checks = m_RunningChecks;
+		cqs.queue_length = m_CheckQueue.size();
+		cqs.avg_queue_wait_time = m_AvgQueueWaitTime;
 	}
 
+	CIB::UpdateCheckQueueStatistics(cqs);
+
+	msgbuf << "Pending checkables: " << pending << "; Idle checkables: " << idle
+	       << "; Queued checks: " << cqs.queue_length << "; Avg queue wait time: " << cqs.avg_queue_wait_time << "s"
+	       << "; Checks/s: " << CIB::GetActiveChecksStatistics(5) / 5.0;
+
 	Log(LogDebug, "checker", msgbuf.str());
 }
 
@@ -257,50 +546,78 @@ void CheckerComponent::ObjectHandler(const DynamicObject::Ptr& object)
 
 	Checkable::Ptr checkable = static_pointer_cast<Checkable>(object);
 
+	bool release = false;
+
 	{
-		boost::mutex::scoped_lock lock(m_Mutex);
+		CheckerShard& shard = GetShard(checkable);
+
+		boost::mutex::scoped_lock lock(shard.Mutex);
 
 		if (object->IsActive() && object->HasAuthority("checker")) {
-			if (m_PendingCheckables.find(checkable) != m_PendingCheckables.end())
+			if (shard.PendingCheckables.find(checkable) != shard.PendingCheckables.end())
 				return;
 
-			m_IdleCheckables.insert(checkable);
+			shard.IdleCheckables.Push(checkable, checkable->GetNextCheck());
 		} else {
-			m_IdleCheckables.erase(checkable);
-			m_PendingCheckables.erase(checkable);
+			shard.IdleCheckables.Remove(checkable);
+
+			if (shard.PendingCheckables.erase(checkable) > 0) {
+				ReleaseCheck(checkable);
+				release = true;
+			}
 		}
 
-		m_CV.notify_all();
+		shard.CV.notify_all();
+	}
+
+	if (release) {
+		boost::mutex::scoped_lock lock(m_AdmissionMutex);
+		DispatchQueuedChecks(lock);
 	}
 }
 
 void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	CheckerShard& shard = GetShard(checkable);
 
-	/* remove and re-insert the object from the set in order to force an index update */
-	typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
-	CheckableView& idx = boost::get<0>(m_IdleCheckables);
+	boost::mutex::scoped_lock lock(shard.Mutex);
 
-	CheckableView::iterator it = idx.find(checkable);
-	if (it == idx.end())
+	if (!shard.IdleCheckables.Contains(checkable))
 		return;
 
-	idx.erase(checkable);
-	idx.insert(checkable);
-	m_CV.notify_all();
+	/* update the checkable's position in the heap */
+	shard.IdleCheckables.Push(checkable, checkable->GetNextCheck());
+
+	/* only wake up the scheduler if the checkable is now the next one */
+	if (shard.IdleCheckables.GetTop() == checkable)
+		shard.CV.notify_all();
+}
+
+void CheckerComponent::NewCheckResultHandler(const Checkable::Ptr& checkable)
+{
+	CheckFinished(checkable);
 }
 
 unsigned long CheckerComponent::GetIdleCheckables(void)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
 
-	return m_IdleCheckables.size();
+	BOOST_FOREACH(const shared_ptr<CheckerShard>& shard, m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		count += shard->IdleCheckables.GetLength();
+	}
+
+	return count;
 }
 
 unsigned long CheckerComponent::GetPendingCheckables(void)
 {
-	boost::mutex::scoped_lock lock(m_Mutex);
+	unsigned long count = 0;
+
+	BOOST_FOREACH(const shared_ptr<CheckerShard>& shard, m_Shards) {
+		boost::mutex::scoped_lock lock(shard->Mutex);
+		count += shard->PendingCheckables.size();
+	}
 
-	return m_PendingCheckables.size();
+	return count;
 }
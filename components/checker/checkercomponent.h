@@ -21,34 +21,41 @@
 #define CHECKERCOMPONENT_H
 
 #include "checker/checkercomponent.th"
+#include "checker/checkableheap.h"
 #include "icinga/service.h"
 #include "base/dynamicobject.h"
 #include "base/timer.h"
 #include "base/utility.h"
+#include <deque>
+#include <map>
+#include <vector>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
 
 namespace icinga
 {
 
 /**
+ * A check scheduler shard. Each checkable is assigned to exactly one shard
+ * based on its name.
+ *
  * @ingroup checker
  */
-struct CheckableNextCheckExtractor
+struct CheckerShard
 {
-	typedef double result_type;
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	boost::thread Thread;
 
-	/**
-	 * @threadsafety Always.
-	 */
-	double operator()(const Checkable::Ptr& checkable)
-	{
-		return checkable->GetNextCheck();
-	}
+	CheckableHeap IdleCheckables;
+	std::map<Checkable::Ptr, double> PendingCheckables; /**< Maps checkables to the time when we give up waiting for their check result, 0 while the check is queued. */
+
+	unsigned long ChecksExecuted;
+
+	CheckerShard(void)
+		: ChecksExecuted(0)
+	{ }
 };
 
 /**
@@ -60,14 +67,6 @@ public:
 	DECLARE_PTR_TYPEDEFS(CheckerComponent);
 	DECLARE_TYPENAME(CheckerComponent);
 
-	typedef boost::multi_index_container<
-		Checkable::Ptr,
-		boost::multi_index::indexed_by<
-			boost::multi_index::ordered_unique<boost::multi_index::identity<Checkable::Ptr> >,
-			boost::multi_index::ordered_non_unique<CheckableNextCheckExtractor>
-		>
-	> CheckableSet;
-
 	virtual void OnConfigLoaded(void);
 	virtual void Start(void);
 	virtual void Stop(void);
@@ -77,27 +76,39 @@ public:
 	unsigned long GetPendingCheckables(void);
 
 private:
-	boost::mutex m_Mutex;
-	boost::condition_variable m_CV;
+	struct QueuedCheck
+	{
+		Checkable::Ptr Object;
+		double Timestamp;
+	};
+
+	std::vector<shared_ptr<CheckerShard> > m_Shards;
 	bool m_Stopped;
-	boost::thread m_Thread;
 
-	CheckableSet m_IdleCheckables;
-	CheckableSet m_PendingCheckables;
+	boost::mutex m_AdmissionMutex;
+	std::deque<QueuedCheck> m_CheckQueue;
+	int m_RunningChecks;
+	double m_QueueWaitTime;
+	unsigned long m_QueueWaitCount;
+	double m_AvgQueueWaitTime;
 
 	Timer::Ptr m_ResultTimer;
 
-	void CheckThreadProc(void);
+	CheckerShard& GetShard(const Checkable::Ptr& checkable);
+
+	void CheckThreadProc(CheckerShard& shard, int index);
 	void ResultTimerHandler(void);
 
-	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
+	void EnqueueCheck(const Checkable::Ptr& checkable);
+	void ReleaseCheck(const Checkable::Ptr& checkable);
+	void DispatchQueuedChecks(boost::mutex::scoped_lock& lock);
 
-	void AdjustCheckTimer(void);
+	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
+	void CheckFinished(const Checkable::Ptr& checkable);
 
 	void ObjectHandler(const DynamicObject::Ptr& object);
 	void NextCheckChangedHandler(const Checkable::Ptr& checkable);
-
-	void RescheduleCheckTimer(void);
+	void NewCheckResultHandler(const Checkable::Ptr& checkable);
 };
 
 }
@@ -18,7 +18,9 @@
  ******************************************************************************/
 
 #include "cluster/clusterlistener.h"
+#include "cluster/clusterlog.h"
 #include "remote/endpoint.h"
+#include "remote/jsonrpc.h"
 #include "icinga/cib.h"
 #include "icinga/domain.h"
 #include "icinga/icingaapplication.h"
@@ -36,6 +38,7 @@
 
 using namespace icinga;
 
+
 REGISTER_TYPE(ClusterListener);
 
 REGISTER_STATSFUNCTION(ClusterListenerStats, &ClusterListener::StatsFunc);
@@ -97,6 +100,13 @@ void ClusterListener::Start(void)
 	m_ClusterTimer->SetInterval(5);
 	m_ClusterTimer->Start();
 
+	if (GetBatchWindow() > 0) {
+		m_BatchTimer = make_shared<Timer>();
+		m_BatchTimer->OnTimerExpired.connect(boost::bind(&ClusterListener::BatchTimerHandler, this));
+		m_BatchTimer->SetInterval(GetBatchWindow());
+		m_BatchTimer->Start();
+	}
+
 	m_MessageQueue.SetExceptionCallback(&ClusterListener::MessageExceptionHandler);
 
 	Checkable::OnNewCheckResult.connect(boost::bind(&ClusterListener::CheckResultHandler, this, _1, _2, _3));
@@ -227,28 +237,18 @@ void ClusterListener::AsyncRelayMessage(const Endpoint::Ptr& source, const Endpo
 	m_RelayQueue.Enqueue(boost::bind(&ClusterListener::RelayMessage, this, source, destination, message, persistent));
 }
 
-void ClusterListener::PersistMessage(const Endpoint::Ptr& source, const Dictionary::Ptr& message)
+void ClusterListener::PersistMessage(const Endpoint::Ptr& source, const Dictionary::Ptr& message, const String& json)
 {
 	double ts = message->Get("ts");
 
 	ASSERT(ts != 0);
 
-	Dictionary::Ptr pmessage = make_shared<Dictionary>();
-	pmessage->Set("timestamp", ts);
-
-	if (source)
-		pmessage->Set("source", source->GetName());
-
-	pmessage->Set("message", JsonSerialize(message));
-	pmessage->Set("security", message->Get("security"));
-
 	ObjectLock olock(this);
-	if (m_LogFile) {
-		NetString::WriteStringToStream(m_LogFile, JsonSerialize(pmessage));
-		m_LogMessageCount++;
+	if (m_LogWriter.IsOpen()) {
+		m_LogWriter.Write(ts, source ? source->GetName() : String(), message->Get("security"), json);
 		SetLogMessageTimestamp(ts);
 
-		if (m_LogMessageCount > 50000) {
+		if (m_LogWriter.GetMessageCount() > 50000) {
 			CloseLogFile();
 			RotateLogFile();
 			OpenLogFile();
@@ -261,8 +261,14 @@ void ClusterListener::RelayMessage(const Endpoint::Ptr& source, const Endpoint::
 	double ts = Utility::GetTime();
 	message->Set("ts", ts);
 
-	if (persistent)
-		m_LogQueue.Enqueue(boost::bind(&ClusterListener::PersistMessage, this, source, message));
+	/* The message is serialized once and the result is shared by the
+	 * log and all endpoints the message is sent to. */
+	String json;
+
+	if (persistent) {
+		json = JsonSerialize(message);
+		m_LogQueue.Enqueue(boost::bind(&ClusterListener::PersistMessage, this, source, message, json));
+	}
 
 	Dictionary::Ptr security = message->Get("security");
 	DynamicObject::Ptr secobj;
@@ -289,6 +295,7 @@ void ClusterListener::RelayMessage(const Endpoint::Ptr& source, const Endpoint::
 	}
 
 	double now = Utility::GetTime();
+	shared_ptr<const String> data;
 
 	BOOST_FOREACH(const Endpoint::Ptr& endpoint, DynamicType::GetObjects<Endpoint>()) {
 		if (!endpoint->IsConnected())
@@ -311,15 +318,137 @@ void ClusterListener::RelayMessage(const Endpoint::Ptr& source, const Endpoint::
 			continue;
 		}
 
+		if (json.IsEmpty())
+			json = JsonSerialize(message);
+
+		bool batch = (GetBatchWindow() > 0 && endpoint->HasFeature("batch"));
+
+		if (!batch && !data)
+			data = make_shared<String>(JsonRpc::EncodeMessage(json));
+
 		{
 			ObjectLock olock(endpoint);
 
-			if (!endpoint->GetSyncing())
-				endpoint->SendMessage(message);
+			if (endpoint->GetSyncing())
+				continue;
+
+			if (CheckSendQueue(endpoint))
+				continue;
+
+			if (!batch)
+				endpoint->SendEncodedMessage(data);
 		}
+
+		if (batch)
+			BatchMessage(endpoint, json);
 	}
 }
 
+/**
+ * Stops sending messages to endpoints which can't keep up with us. They'll
+ * get the messages from the log once they've caught up. The caller must
+ * hold the endpoint's object lock.
+ *
+ * @param endpoint The endpoint.
+ * @returns true if the endpoint's send queue has grown beyond the high
+ *	    watermark and the endpoint was switched to syncing mode,
+ *	    false otherwise.
+ */
+bool ClusterListener::CheckSendQueue(const Endpoint::Ptr& endpoint)
+{
+	ASSERT(endpoint->OwnsLock());
+
+	if (endpoint->GetSendQueueBytes() <= static_cast<size_t>(GetSendQueueHighWatermark()))
+		return false;
+
+	Log(LogWarning, "cluster", "Endpoint '" + endpoint->GetName() + "' is falling behind. "
+	    "Messages are spilled to the cluster log until it has caught up.");
+
+	endpoint->SetSyncing(true);
+	Utility::QueueAsyncCallback(boost::bind(&ClusterListener::CatchUpEndpoint, this,
+	    endpoint, endpoint->GetClient()));
+
+	return true;
+}
+
+void ClusterListener::BatchTimerHandler(void)
+{
+	/* The batches are only ever touched by the relay queue's thread. */
+	m_RelayQueue.Enqueue(boost::bind(&ClusterListener::FlushBatches, this));
+}
+
+/**
+ * Adds a message to the endpoint's batch. The batch is sent right away
+ * if it has reached the maximum batch size.
+ */
+void ClusterListener::BatchMessage(const Endpoint::Ptr& endpoint, const String& json)
+{
+	ASSERT(boost::this_thread::get_id() == m_RelayQueue.GetThreadId());
+
+	ClusterBatch& batch = m_Batches[endpoint];
+	batch.Messages.push_back(json);
+	batch.Size += json.GetLength();
+
+	if (batch.Size >= static_cast<size_t>(GetBatchSize()))
+		SendBatch(endpoint, batch);
+}
+
+void ClusterListener::FlushBatches(void)
+{
+	ASSERT(boost::this_thread::get_id() == m_RelayQueue.GetThreadId());
+
+	std::map<Endpoint::Ptr, ClusterBatch>::iterator it;
+	for (it = m_Batches.begin(); it != m_Batches.end(); ) {
+		if (!it->first->IsConnected()) {
+			m_Batches.erase(it++);
+			continue;
+		}
+
+		if (!it->second.Messages.empty())
+			SendBatch(it->first, it->second);
+
+		it++;
+	}
+}
+
+void ClusterListener::SendBatch(const Endpoint::Ptr& endpoint, ClusterBatch& batch)
+{
+	std::vector<String> messages;
+	messages.swap(batch.Messages);
+	batch.Size = 0;
+
+	/* Persistent messages are replayed from the log when the endpoint reconnects. */
+	if (!endpoint->IsConnected())
+		return;
+
+	bool compress = GetCompressBatches() && endpoint->HasFeature("batch_zlib");
+	String json;
+
+	if (messages.size() == 1 && !compress)
+		json = messages[0];
+	else
+		json = JsonRpc::EncodeBatch("cluster::Batch", messages, compress);
+
+	endpoint->SendEncodedMessage(make_shared<String>(JsonRpc::EncodeMessage(json)));
+}
+
+/**
+ * Replays the log for an endpoint which has fallen behind once its
+ * send queue has shrunk to the low watermark.
+ */
+void ClusterListener::CatchUpEndpoint(const Endpoint::Ptr& endpoint, const Stream::Ptr& stream)
+{
+	endpoint->WaitForSendQueue(GetSendQueueLowWatermark());
+
+	/* The log is replayed anyway when the endpoint reconnects. */
+	if (endpoint->GetClient() != stream)
+		return;
+
+	Log(LogInformation, "cluster", "Endpoint '" + endpoint->GetName() + "' has caught up. Replaying log.");
+
+	ReplayLog(endpoint, stream);
+}
+
 String ClusterListener::GetClusterDir(void) const
 {
 	return Application::GetLocalStateDir() + "/lib/icinga2/cluster/";
@@ -331,20 +460,11 @@ void ClusterListener::OpenLogFile(void)
 
 	String path = GetClusterDir() + "log/current";
 
-	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::out | std::ofstream::app);
-
-	if (!fp->good()) {
+	if (!m_LogWriter.Open(path)) {
 		Log(LogWarning, "cluster", "Could not open spool file: " + path);
 		return;
 	}
 
-	StdioStream::Ptr logStream = make_shared<StdioStream>(fp, true);
-#ifdef HAVE_BIOZLIB
-	m_LogFile = make_shared<ZlibStream>(logStream);
-#else /* HAVE_BIOZLIB */
-	m_LogFile = logStream;
-#endif /* HAVE_BIOZLIB */
-	m_LogMessageCount = 0;
 	SetLogMessageTimestamp(0);
 }
 
@@ -352,12 +472,7 @@ void ClusterListener::CloseLogFile(void)
 {
 	ASSERT(OwnsLock());
 
-	if (!m_LogFile)
-		return;
-
-	m_LogFile->Close();
-	m_LogFile.reset();
-
+	m_LogWriter.Close();
 }
 
 void ClusterListener::RotateLogFile(void)
@@ -372,6 +487,7 @@ void ClusterListener::RotateLogFile(void)
 	String oldpath = GetClusterDir() + "log/current";
 	String newpath = GetClusterDir() + "log/" + Convert::ToString(static_cast<int>(ts) + 1);
 	(void) rename(oldpath.CStr(), newpath.CStr());
+	(void) rename((oldpath + ".idx").CStr(), (newpath + ".idx").CStr());
 }
 
 void ClusterListener::LogGlobHandler(std::vector<int>& files, const String& file)
@@ -396,6 +512,7 @@ void ClusterListener::ReplayLog(const Endpoint::Ptr& endpoint, const Stream::Ptr
 	int count = -1;
 	double peer_ts = endpoint->GetLocalLogPosition();
 	bool last_sync = false;
+	bool aborted = false;
 
 	ASSERT(!OwnsLock());
 
@@ -426,87 +543,115 @@ void ClusterListener::ReplayLog(const Endpoint::Ptr& endpoint, const Stream::Ptr
 
 			Log(LogInformation, "cluster", "Replaying log: " + path);
 
-			std::fstream *fp = new std::fstream(path.CStr(), std::fstream::in);
-			StdioStream::Ptr logStream = make_shared<StdioStream>(fp, true);
-#ifdef HAVE_BIOZLIB
-			ZlibStream::Ptr lstream = make_shared<ZlibStream>(logStream);
-#else /* HAVE_BIOZLIB */
-			Stream::Ptr lstream = logStream;
-#endif /* HAVE_BIOZLIB */
-
-			String message;
-			while (true) {
-				Dictionary::Ptr pmessage;
+			/* The final pass holds the listener's lock which PersistMessage()
+			 * needs, so it must not wait for a slow endpoint. It only has
+			 * to send the few messages logged since the previous pass. */
+			if (!ReplayLogFile(endpoint, stream, path, peer_ts, count, !last_sync)) {
+				aborted = true;
+				break;
+			}
+		}
 
-				try {
-					if (!NetString::ReadStringFromStream(lstream, &message))
-						break;
+		Log(LogInformation, "cluster", "Replayed " + Convert::ToString(count) + " messages.");
 
-					pmessage = JsonDeserialize(message);
-				} catch (std::exception&) {
-					Log(LogWarning, "cluster", "Unexpected end-of-file for cluster log: " + path);
+		if (aborted) {
+			if (last_sync)
+				OpenLogFile();
 
-					/* Log files may be incomplete or corrupted. This is perfectly OK. */
-					break;
-				}
+			break;
+		}
 
-				if (pmessage->Get("timestamp") < peer_ts)
-					continue;
+		if (last_sync) {
+			{
+				ObjectLock olock2(endpoint);
+				endpoint->SetSyncing(false);
+			}
 
-				if (pmessage->Get("source") == endpoint->GetName())
-					continue;
+			OpenLogFile();
 
-				Dictionary::Ptr security = pmessage->Get("security");
-				DynamicObject::Ptr secobj;
-				int privs;
+			break;
+		}
+	}
+}
 
-				if (security) {
-					String type = security->Get("type");
-					DynamicType::Ptr dtype = DynamicType::GetByName(type);
+/**
+ * Replays the records from a log segment which are newer than the
+ * peer's log position.
+ *
+ * @returns false if replaying was aborted because the endpoint has been
+ *	    disconnected.
+ */
+bool ClusterListener::ReplayLogFile(const Endpoint::Ptr& endpoint, const Stream::Ptr& stream, const String& path,
+    double& peer_ts, int& count, bool wait)
+{
+	ClusterLogReader reader(path, peer_ts);
+	ClusterLogRecord record;
 
-					if (!dtype) {
-						Log(LogDebug, "cluster", "Invalid type in security attribute: " + type);
-						continue;
-					}
+	while (reader.ReadRecord(record)) {
+		if (record.Timestamp < peer_ts)
+			continue;
 
-					String name = security->Get("name");
-					secobj = dtype->GetObject(name);
+		if (record.Source == endpoint->GetName())
+			continue;
 
-					if (!secobj) {
-						Log(LogDebug, "cluster", "Invalid object name in security attribute: " + name + " (of type '" + type + "')");
-						continue;
-					}
+		if (!ReplayLogMessage(endpoint, stream, record.Security, record.Message, count, wait))
+			return false;
 
-					privs = security->Get("privs");
-				}
+		peer_ts = record.Timestamp;
+	}
 
-				if (secobj && !secobj->HasPrivileges(endpoint->GetName(), privs)) {
-					Log(LogDebug, "cluster", "Not replaying message to endpoint '" + endpoint->GetName() + "': Insufficient privileges.");
-					continue;
-				}
+	return true;
+}
 
-				NetString::WriteStringToStream(stream, pmessage->Get("message"));
-				count++;
+/**
+ * Sends a message from the log to the endpoint unless the endpoint
+ * doesn't have the necessary privileges for the message.
+ *
+ * @param wait Whether to wait for the endpoint's send queue to shrink
+ *	       once it has reached the high watermark.
+ * @returns false if the endpoint has been disconnected.
+ */
+bool ClusterListener::ReplayLogMessage(const Endpoint::Ptr& endpoint, const Stream::Ptr& stream, const Dictionary::Ptr& security,
+    const shared_ptr<const String>& data, int& count, bool wait)
+{
+	DynamicObject::Ptr secobj;
+	int privs;
 
-				peer_ts = pmessage->Get("timestamp");
-			}
+	if (security) {
+		String type = security->Get("type");
+		DynamicType::Ptr dtype = DynamicType::GetByName(type);
 
-			lstream->Close();
+		if (!dtype) {
+			Log(LogDebug, "cluster", "Invalid type in security attribute: " + type);
+			return true;
 		}
 
-		Log(LogInformation, "cluster", "Replayed " + Convert::ToString(count) + " messages.");
+		String name = security->Get("name");
+		secobj = dtype->GetObject(name);
 
-		if (last_sync) {
-			{
-				ObjectLock olock2(endpoint);
-				endpoint->SetSyncing(false);
-			}
+		if (!secobj) {
+			Log(LogDebug, "cluster", "Invalid object name in security attribute: " + name + " (of type '" + type + "')");
+			return true;
+		}
 
-			OpenLogFile();
+		privs = security->Get("privs");
+	}
 
-			break;
-		}
+	if (secobj && !secobj->HasPrivileges(endpoint->GetName(), privs)) {
+		Log(LogDebug, "cluster", "Not replaying message to endpoint '" + endpoint->GetName() + "': Insufficient privileges.");
+		return true;
 	}
+
+	/* Messages are replayed through the endpoint's send queue
+	 * so they don't get mixed up with messages from the writer thread. */
+	endpoint->SendEncodedMessage(data);
+	count++;
+
+	if (wait && endpoint->GetSendQueueBytes() > static_cast<size_t>(GetSendQueueHighWatermark()))
+		endpoint->WaitForSendQueue(GetSendQueueLowWatermark());
+
+	/* The endpoint has been disconnected or has reconnected in the meantime. */
+	return (endpoint->GetClient() == stream);
 }
 
 void ClusterListener::ConfigGlobHandler(const Dictionary::Ptr& config, const String& file, bool basename)
@@ -601,7 +746,7 @@ void ClusterListener::NewClientHandler(const Socket::Ptr& client, TlsRole role)
 	message->Set("method", "cluster::Config");
 	message->Set("params", params);
 
-	NetString::WriteStringToStream(tlsStream, JsonSerialize(message));
+	endpoint->SendMessage(message);
 
 	ReplayLog(endpoint, tlsStream);
 }
@@ -677,6 +822,12 @@ void ClusterListener::ClusterTimerHandler(void)
 	features->Set("checker", SupportsChecks());
 	features->Set("notification", SupportsNotifications());
 
+	/* We can always receive batches, whether we send them depends on our config. */
+	features->Set("batch", true);
+#ifdef HAVE_BIOZLIB
+	features->Set("batch_zlib", true);
+#endif /* HAVE_BIOZLIB */
+
 	/* broadcast a heartbeat message */
 	BOOST_FOREACH(const Endpoint::Ptr& destination, DynamicType::GetObjects<Endpoint>()) {
 		std::set<String> connected_endpoints;
@@ -733,6 +884,8 @@ void ClusterListener::ClusterTimerHandler(void)
 	Utility::Glob(GetClusterDir() + "log/*", boost::bind(&ClusterListener::LogGlobHandler, boost::ref(files), _1), GlobFile);
 	std::sort(files.begin(), files.end());
 
+	/* Segments are named after the timestamp following their last record. They
+	 * can be removed once all endpoints have acknowledged a newer log position. */
 	BOOST_FOREACH(int ts, files) {
 		bool need = false;
 
@@ -752,6 +905,7 @@ void ClusterListener::ClusterTimerHandler(void)
 			String path = GetClusterDir() + "log/" + Convert::ToString(ts);
 			Log(LogInformation, "cluster", "Removing old log file: " + path);
 			(void) unlink(path.CStr());
+			(void) unlink((path + ".idx").CStr());
 		}
 	}
 
@@ -1125,6 +1279,23 @@ void ClusterListener::MessageHandler(const Endpoint::Ptr& sender, const Dictiona
 
 	sender->SetSeen(Utility::GetTime());
 
+	if (message->Get("method") == "cluster::Batch") {
+		Dictionary::Ptr params = message->Get("params");
+
+		if (!params)
+			return;
+
+		Array::Ptr messages = JsonRpc::DecodeBatch(params);
+
+		ObjectLock olock(messages);
+		BOOST_FOREACH(const Value& bmessage, messages) {
+			if (bmessage.IsObjectType<Dictionary>())
+				MessageHandler(sender, bmessage);
+		}
+
+		return;
+	}
+
 	if (message->Contains("ts")) {
 		double ts = message->Get("ts");
 
@@ -1848,10 +2019,24 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ClusterListener::GetClusterStatus(vo
 	double count_endpoints = 0;
 	Array::Ptr not_connected_endpoints = make_shared<Array>();
 	Array::Ptr connected_endpoints = make_shared<Array>();
+	Dictionary::Ptr send_queues = make_shared<Dictionary>();
 
 	BOOST_FOREACH(const Endpoint::Ptr& endpoint, DynamicType::GetObjects<Endpoint>()) {
 		count_endpoints++;
 
+		if (endpoint->IsConnected() && endpoint->GetName() != GetIdentity()) {
+			double length = endpoint->GetSendQueueLength();
+			double bytes = endpoint->GetSendQueueBytes();
+
+			Dictionary::Ptr send_queue = make_shared<Dictionary>();
+			send_queue->Set("length", length);
+			send_queue->Set("bytes", bytes);
+			send_queues->Set(endpoint->GetName(), send_queue);
+
+			perfdata->Set("send_queue_length_" + endpoint->GetName(), length);
+			perfdata->Set("send_queue_bytes_" + endpoint->GetName(), bytes);
+		}
+
 		if(!endpoint->IsAvailable() && endpoint->GetName() != GetIdentity())
 			not_connected_endpoints->Add(endpoint->GetName());
 		else if(endpoint->IsAvailable() && endpoint->GetName() != GetIdentity())
@@ -1863,6 +2048,7 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ClusterListener::GetClusterStatus(vo
 	status->Set("num_not_conn_endpoints", not_connected_endpoints->GetLength());
 	status->Set("conn_endpoints", connected_endpoints);
 	status->Set("not_conn_endpoints", not_connected_endpoints);
+	status->Set("send_queues", send_queues);
 
 	perfdata->Set("num_endpoints", count_endpoints);
 	perfdata->Set("num_conn_endpoints", Convert::ToDouble(connected_endpoints->GetLength()));
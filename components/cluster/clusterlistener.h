@@ -22,6 +22,7 @@
 
 #include "cluster/clusterlistener.th"
 #include "cluster/clusterlink.h"
+#include "cluster/clusterlog.h"
 #include "base/dynamicobject.h"
 #include "base/timer.h"
 #include "base/array.h"
@@ -33,6 +34,8 @@
 #include "base/workqueue.h"
 #include "icinga/service.h"
 #include "remote/endpoint.h"
+#include <boost/cstdint.hpp>
+#include <fstream>
 
 namespace icinga
 {
@@ -46,6 +49,21 @@ struct EndpointPeerInfo
 	Array::Ptr Peers;
 };
 
+/**
+ * Messages which are waiting to be sent to an endpoint as a single
+ * batch message.
+ *
+ * @ingroup cluster
+ */
+struct ClusterBatch
+{
+	ClusterBatch(void) : Size(0)
+	{ }
+
+	std::vector<String> Messages;
+	size_t Size;
+};
+
 /**
  * @ingroup cluster
  */
@@ -65,6 +83,8 @@ public:
 
         std::pair<Dictionary::Ptr, Dictionary::Ptr> GetClusterStatus(void);
 
+	bool CheckSendQueue(const Endpoint::Ptr& endpoint);
+
 private:
 	shared_ptr<SSL_CTX> m_SSLContext;
 
@@ -75,6 +95,13 @@ private:
 	Timer::Ptr m_ClusterTimer;
 	void ClusterTimerHandler(void);
 
+	std::map<Endpoint::Ptr, ClusterBatch> m_Batches;
+	Timer::Ptr m_BatchTimer;
+	void BatchTimerHandler(void);
+	void BatchMessage(const Endpoint::Ptr& endpoint, const String& json);
+	void FlushBatches(void);
+	void SendBatch(const Endpoint::Ptr& endpoint, ClusterBatch& batch);
+
 	std::set<TcpSocket::Ptr> m_Servers;
 
 	void AddListener(const String& service);
@@ -97,9 +124,12 @@ private:
 	void CloseLogFile(void);
 	static void LogGlobHandler(std::vector<int>& files, const String& file);
 	void ReplayLog(const Endpoint::Ptr& endpoint, const Stream::Ptr& stream);
+	bool ReplayLogFile(const Endpoint::Ptr& endpoint, const Stream::Ptr& stream, const String& path, double& peer_ts, int& count, bool wait);
+	bool ReplayLogMessage(const Endpoint::Ptr& endpoint, const Stream::Ptr& stream, const Dictionary::Ptr& security,
+	    const shared_ptr<const String>& data, int& count, bool wait);
+	void CatchUpEndpoint(const Endpoint::Ptr& endpoint, const Stream::Ptr& stream);
 
-	Stream::Ptr m_LogFile;
-	size_t m_LogMessageCount;
+	ClusterLogWriter m_LogWriter;
 
 	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const String& authority);
 	void NextCheckChangedHandler(const Checkable::Ptr& checkable, double nextCheck, const String& authority);
@@ -129,7 +159,7 @@ private:
 
 	void SetSecurityInfo(const Dictionary::Ptr& message, const DynamicObject::Ptr& object, int privs);
 
-	void PersistMessage(const Endpoint::Ptr& source, const Dictionary::Ptr& message);
+	void PersistMessage(const Endpoint::Ptr& source, const Dictionary::Ptr& message, const String& json);
 
 	static void MessageExceptionHandler(boost::exception_ptr exp);
 };
@@ -0,0 +1,302 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "cluster/clusterlog.h"
+#include "remote/jsonrpc.h"
+#include "base/stdiostream.h"
+#include "base/zlibstream.h"
+#include "base/serializer.h"
+#include "base/logger_fwd.h"
+#include "base/convert.h"
+#include "base/array.h"
+#include "base/debug.h"
+#include <boost/foreach.hpp>
+#include <cctype>
+
+using namespace icinga;
+
+#define CLUSTERLOGINDEXMAGIC "I2CI"
+#define CLUSTERLOGINDEXVERSION 1
+#define CLUSTERLOGINDEXHEADERSIZE 8
+#define CLUSTERLOGINDEXINTERVAL 1000
+
+ClusterLogWriter::ClusterLogWriter(void)
+	: m_Offset(0), m_MessageCount(0), m_Timestamp(0)
+{ }
+
+/**
+ * Opens a log segment for appending. Log segments aren't compressed so
+ * replaying can seek to the offsets from the index.
+ *
+ * @returns false if the segment couldn't be opened.
+ */
+bool ClusterLogWriter::Open(const String& path)
+{
+	ASSERT(!m_File);
+
+	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::out | std::fstream::app | std::fstream::binary);
+
+	if (!fp->good()) {
+		delete fp;
+		return false;
+	}
+
+	fp->seekp(0, std::fstream::end);
+	m_Offset = fp->tellp();
+
+	m_File = make_shared<StdioStream>(fp, true);
+	m_MessageCount = 0;
+	m_Timestamp = 0;
+
+	m_IndexFile.open((path + ".idx").CStr(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+	m_IndexFile.seekp(0, std::ofstream::end);
+
+	if (m_IndexFile.tellp() == std::streampos(0)) {
+		char header[CLUSTERLOGINDEXHEADERSIZE];
+		boost::uint32_t version = CLUSTERLOGINDEXVERSION;
+
+		memcpy(header, CLUSTERLOGINDEXMAGIC, 4);
+		memcpy(header + 4, &version, sizeof(version));
+
+		m_IndexFile.write(header, sizeof(header));
+	}
+
+	return true;
+}
+
+void ClusterLogWriter::Close(void)
+{
+	if (!m_File)
+		return;
+
+	/* The last entry marks the end of the segment. */
+	if (m_MessageCount > 0)
+		WriteIndexEntry(m_Timestamp);
+
+	m_IndexFile.close();
+
+	m_File->Close();
+	m_File.reset();
+}
+
+bool ClusterLogWriter::IsOpen(void) const
+{
+	return m_File;
+}
+
+/**
+ * Appends a message to the segment. Each record is a netstring containing
+ * a netstring-encoded JSON header with the message's timestamp, source and
+ * security info, followed by the encoded message, so the message can be
+ * replayed without deserializing it. The header is a netstring of its own
+ * because the JSON may contain newlines when running in debug mode.
+ */
+void ClusterLogWriter::Write(double ts, const String& source, const Value& security, const String& json)
+{
+	ASSERT(m_File);
+
+	Array::Ptr header = make_shared<Array>();
+	header->Add(ts);
+	header->Add(source);
+	header->Add(security);
+
+	String record = NetString::Encode(NetString::Encode(JsonSerialize(header)) + JsonRpc::EncodeMessage(json));
+
+	if (m_MessageCount % CLUSTERLOGINDEXINTERVAL == 0)
+		WriteIndexEntry(ts);
+
+	m_File->Write(record.CStr(), record.GetLength());
+	m_Offset += record.GetLength();
+	m_MessageCount++;
+	m_Timestamp = ts;
+}
+
+size_t ClusterLogWriter::GetMessageCount(void) const
+{
+	return m_MessageCount;
+}
+
+/**
+ * Adds an entry for the next record to the segment's index.
+ */
+void ClusterLogWriter::WriteIndexEntry(double ts)
+{
+	ClusterLogIndexEntry entry;
+	entry.Timestamp = ts;
+	entry.Offset = m_Offset;
+
+	m_IndexFile.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+	m_IndexFile.flush();
+}
+
+/**
+ * Opens a log segment. The index is used to skip the records which are
+ * older than the peer's log position. Segments without a (valid) index
+ * are read from the start.
+ */
+ClusterLogReader::ClusterLogReader(const String& path, double peer_ts)
+	: m_Path(path)
+{
+	std::vector<ClusterLogIndexEntry> index;
+	boost::uint64_t offset = 0;
+
+	if (LoadIndex(path, index)) {
+		BOOST_FOREACH(const ClusterLogIndexEntry& entry, index) {
+			if (entry.Timestamp >= peer_ts)
+				break;
+
+			offset = entry.Offset;
+		}
+	}
+
+	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::in | std::fstream::binary);
+	fp->seekg(offset);
+
+	StdioStream::Ptr logStream = make_shared<StdioStream>(fp, true);
+	m_Stream = logStream;
+
+#ifdef HAVE_BIOZLIB
+	/* Segments which were written by older versions are compressed. Those
+	 * don't start with a netstring's length. */
+	int ch = fp->peek();
+
+	if (offset == 0 && ch != EOF && !isdigit(ch))
+		m_Stream = make_shared<ZlibStream>(logStream);
+#endif /* HAVE_BIOZLIB */
+}
+
+ClusterLogReader::~ClusterLogReader(void)
+{
+	m_Stream->Close();
+}
+
+/**
+ * Reads the next record. Records which are older than the peer's log
+ * position may still be returned, the index only makes sure that reading
+ * starts close to that position.
+ *
+ * @returns false at the end of the segment or if the rest of the segment
+ *	    is corrupted.
+ */
+bool ClusterLogReader::ReadRecord(ClusterLogRecord& record)
+{
+	try {
+		String data;
+
+		if (!NetString::ReadStringFromStream(m_Stream, &data, m_Context))
+			return false;
+
+		/* Records from older versions are JSON dictionaries. */
+		if (data.GetLength() > 0 && data[0] == '{')
+			ParseLegacyRecord(data, record);
+		else
+			ParseRecord(data, record);
+	} catch (const std::exception&) {
+		Log(LogWarning, "cluster", "Unexpected end-of-file for cluster log: " + m_Path);
+
+		/* Log files may be incomplete or corrupted. This is perfectly OK. */
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Parses a record. Only the record's header is deserialized, the message
+ * itself is sent as it is.
+ */
+void ClusterLogReader::ParseRecord(const String& data, ClusterLogRecord& record)
+{
+	size_t colon = data.FindFirstOf(':');
+
+	if (colon == String::NPos)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid cluster log record."));
+
+	long len = Convert::ToLong(data.SubStr(0, colon));
+
+	if (len < 0 || static_cast<size_t>(len) >= data.GetLength() - colon - 1)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid cluster log record."));
+
+	size_t eoh = colon + 1 + len;
+
+	if (data[eoh] != ',')
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid cluster log record."));
+
+	Array::Ptr header = JsonDeserialize(data.SubStr(colon + 1, len));
+
+	if (!header || header->GetLength() < 3)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid cluster log record."));
+
+	record.Timestamp = header->Get(0);
+	record.Source = header->Get(1);
+	record.Security = header->Get(2);
+	record.Message = make_shared<String>(data.SubStr(eoh + 1));
+}
+
+/**
+ * Parses a record which was written by an older version, i.e. before
+ * segments were indexed.
+ */
+void ClusterLogReader::ParseLegacyRecord(const String& data, ClusterLogRecord& record)
+{
+	Dictionary::Ptr pmessage = JsonDeserialize(data);
+
+	if (!pmessage)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid cluster log record."));
+
+	String json = pmessage->Get("message");
+
+	record.Timestamp = pmessage->Get("timestamp");
+	record.Source = pmessage->Get("source");
+	record.Security = pmessage->Get("security");
+	record.Message = make_shared<String>(JsonRpc::EncodeMessage(json));
+}
+
+/**
+ * Reads the index for a log segment.
+ *
+ * @returns false if the segment doesn't have an index, i.e. if it was
+ *	    written by an older version, or if the index is damaged.
+ */
+bool ClusterLogReader::LoadIndex(const String& path, std::vector<ClusterLogIndexEntry>& index)
+{
+	std::ifstream fp;
+	fp.open((path + ".idx").CStr(), std::ifstream::in | std::ifstream::binary);
+
+	char header[CLUSTERLOGINDEXHEADERSIZE];
+	fp.read(header, sizeof(header));
+
+	if (!fp.good())
+		return false;
+
+	boost::uint32_t version;
+	memcpy(&version, header + 4, sizeof(version));
+
+	if (memcmp(header, CLUSTERLOGINDEXMAGIC, 4) != 0 || version != CLUSTERLOGINDEXVERSION)
+		return false;
+
+	/* Incomplete entries are ignored, they're left over when Icinga
+	 * was killed while writing the index. */
+	ClusterLogIndexEntry entry;
+	while (fp.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+		index.push_back(entry);
+
+	return true;
+}
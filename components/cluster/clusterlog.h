@@ -0,0 +1,117 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef CLUSTERLOG_H
+#define CLUSTERLOG_H
+
+#include "base/stream.h"
+#include "base/netstring.h"
+#include "base/dictionary.h"
+#include <boost/cstdint.hpp>
+#include <fstream>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * An entry in the index of a cluster log segment: the record at the
+ * specified offset and all following records don't have a timestamp
+ * before the entry's timestamp.
+ *
+ * @ingroup cluster
+ */
+struct ClusterLogIndexEntry
+{
+	double Timestamp;
+	boost::uint64_t Offset;
+};
+
+/**
+ * A message from a cluster log segment.
+ *
+ * @ingroup cluster
+ */
+struct ClusterLogRecord
+{
+	double Timestamp;
+	String Source;
+	Dictionary::Ptr Security;
+	shared_ptr<const String> Message; /**< The encoded JSON-RPC message. */
+};
+
+/**
+ * Appends messages to a cluster log segment and maintains the segment's
+ * index.
+ *
+ * @ingroup cluster
+ */
+class ClusterLogWriter
+{
+public:
+	ClusterLogWriter(void);
+
+	bool Open(const String& path);
+	void Close(void);
+	bool IsOpen(void) const;
+
+	void Write(double ts, const String& source, const Value& security, const String& json);
+
+	size_t GetMessageCount(void) const;
+
+private:
+	Stream::Ptr m_File;
+	std::ofstream m_IndexFile;
+	boost::uint64_t m_Offset;
+	size_t m_MessageCount;
+	double m_Timestamp;
+
+	void WriteIndexEntry(double ts);
+};
+
+/**
+ * Reads the messages from a cluster log segment, starting close to a
+ * peer's log position if the segment has an index. Also reads segments
+ * which were written by older versions.
+ *
+ * @ingroup cluster
+ */
+class ClusterLogReader
+{
+public:
+	ClusterLogReader(const String& path, double peer_ts);
+	~ClusterLogReader(void);
+
+	bool ReadRecord(ClusterLogRecord& record);
+
+	static bool LoadIndex(const String& path, std::vector<ClusterLogIndexEntry>& index);
+
+private:
+	String m_Path;
+	Stream::Ptr m_Stream;
+	NetStringContext m_Context;
+
+	static void ParseRecord(const String& data, ClusterLogRecord& record);
+	static void ParseLegacyRecord(const String& data, ClusterLogRecord& record);
+};
+
+}
+
+#endif /* CLUSTERLOG_H */
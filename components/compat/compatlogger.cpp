@@ -437,6 +437,10 @@ void CompatLogger::ReopenFile(bool rotate)
 
 			Log(LogInformation, "compat", "Rotating compat log file '" + tempFile + "' -> '" + archiveFile + "'");
 			(void) rename(tempFile.CStr(), archiveFile.CStr());
+
+			/* livestatus keeps an index next to the log file, move it along
+			 * so it doesn't have to be rebuilt for the archived file */
+			(void) rename((tempFile + ".idx").CStr(), (archiveFile + ".idx").CStr());
 		}
 	}
 
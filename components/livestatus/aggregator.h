@@ -36,13 +36,18 @@ public:
 
 	virtual void Apply(const Table::Ptr& table, const Value& row) = 0;
 	virtual double GetResult(void) const = 0;
+
+	/* Clone() returns an empty aggregator with the same settings; Merge()
+	 * adds the state of such a clone to this aggregator. */
+	virtual Aggregator::Ptr Clone(void) const = 0;
+	virtual void Merge(const Aggregator::Ptr& other) = 0;
+
 	void SetFilter(const Filter::Ptr& filter);
+	Filter::Ptr GetFilter(void) const;
 
 protected:
 	Aggregator(void);
-	
-	Filter::Ptr GetFilter(void) const;
-	
+
 private:
 	Filter::Ptr m_Filter;
 };
@@ -34,3 +34,19 @@ bool AndFilter::Apply(const Table::Ptr& table, const Value& row)
 
 	return true;
 }
+
+double AndFilter::GetSelectivity(void) const
+{
+	double selectivity = 1;
+
+	BOOST_FOREACH(const Filter::Ptr& filter, m_Filters) {
+		selectivity *= filter->GetSelectivity();
+	}
+
+	return selectivity;
+}
+
+void AndFilter::Optimize(void)
+{
+	OptimizeSubFilters(true);
+}
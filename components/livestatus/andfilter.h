@@ -38,6 +38,9 @@ public:
 	AndFilter(void);
 
 	virtual bool Apply(const Table::Ptr& table, const Value& row);
+
+	virtual double GetSelectivity(void) const;
+	virtual void Optimize(void);
 };
 
 }
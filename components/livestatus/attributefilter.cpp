@@ -23,24 +23,72 @@
 #include "base/objectlock.h"
 #include "base/logger_fwd.h"
 #include <boost/foreach.hpp>
-#include <boost/regex.hpp>
 
 using namespace icinga;
 
+/**
+ * Constructor for the AttributeFilter class. Everything that only depends
+ * on the operator and the operand (i.e. regular expressions and numeric
+ * operands) is prepared here rather than once per row.
+ */
 AttributeFilter::AttributeFilter(const String& column, const String& op, const String& operand)
-	: m_Column(column), m_Operator(op), m_Operand(operand)
-{ }
+	: m_Column(column), m_Operator(op), m_Operand(operand), m_HasNumericOperand(false),
+	  m_NumericOperand(0), m_BoundTable(NULL), m_ColumnIndex(-1)
+{
+	if (op == "=")
+		m_Op = OperatorEqual;
+	else if (op == "~")
+		m_Op = OperatorRegex;
+	else if (op == "~~")
+		m_Op = OperatorIRegex;
+	else if (op == "=~")
+		m_Op = OperatorILess;
+	else if (op == "<")
+		m_Op = OperatorLess;
+	else if (op == ">")
+		m_Op = OperatorGreater;
+	else if (op == "<=")
+		m_Op = OperatorLessOrEqual;
+	else if (op == ">=")
+		m_Op = OperatorGreaterOrEqual;
+	else
+		m_Op = OperatorInvalid;
+
+	if (m_Op == OperatorRegex || m_Op == OperatorIRegex) {
+		/* Errors are reported when the filter is applied, just like
+		 * they were before the expression was compiled up front. */
+		try {
+			m_Regex.assign(operand.GetData(), (m_Op == OperatorIRegex) ? boost::regex::icase : boost::regex::normal);
+		} catch (const std::exception& ex) {
+			m_RegexError = ex.what();
+		}
+	} else {
+		try {
+			m_NumericOperand = Convert::ToDouble(operand);
+			m_HasNumericOperand = true;
+		} catch (const std::exception&) {
+			/* Not a number; only used for string comparisons. */
+		}
+	}
+}
+
+void AttributeFilter::Bind(const Table::Ptr& table)
+{
+	m_ColumnIndex = table->GetColumnIndex(m_Column);
+	m_BoundTable = table.get();
+}
 
 bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_Column);
+	if (m_BoundTable != table.get())
+		Bind(table);
 
-	Value value = column.ExtractValue(row);
+	Value value = table->GetColumnByIndex(m_ColumnIndex).ExtractValue(row);
 
 	if (value.IsObjectType<Array>()) {
 		Array::Ptr array = value;
 
-		if (m_Operator == ">=") {
+		if (m_Op == OperatorGreaterOrEqual) {
 			ObjectLock olock(array);
 			BOOST_FOREACH(const String& item, array) {
 				if (item == m_Operand)
@@ -48,63 +96,108 @@ bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 			}
 
 			return false; /* Item not found in list. */
-		} else if (m_Operator == "=") {
+		} else if (m_Op == OperatorEqual) {
 			return (array->GetLength() == 0);
 		} else {
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid operator for column '" + m_Column + "': " + m_Operator + " (expected '>=' or '=')."));
 		}
-	} else {
-		if (m_Operator == "=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) == Convert::ToDouble(m_Operand));
-			else
-				return (static_cast<String>(value) == m_Operand);
-		} else if (m_Operator == "~") {
-			boost::regex expr(m_Operand.GetData());
-			String operand = value;
-			boost::smatch what;
-			bool ret = boost::regex_search(operand.GetData(), what, expr);
+	}
 
-			//Log(LogDebug, "livestatus", "Attribute filter '" + m_Operand + " " + m_Operator + " " +
-			//    static_cast<String>(value) + "' " + (ret ? "matches" : "doesn't match") + "." );
+	bool numeric = (value.GetType() == ValueNumber);
 
-			return ret;
-		} else if (m_Operator == "=~") {
+	switch (m_Op) {
+		case OperatorEqual:
+			if (numeric)
+				return (static_cast<double>(value) == GetNumericOperand());
+			else
+				return (static_cast<String>(value) == m_Operand);
+		case OperatorRegex:
+		case OperatorIRegex:
+			return MatchRegex(value);
+		case OperatorILess:
 			return string_iless()(value, m_Operand);
-		} else if (m_Operator == "~~") {
-			boost::regex expr(m_Operand.GetData(), boost::regex::icase);
-			String operand = value;
-			boost::smatch what;
-			bool ret = boost::regex_search(operand.GetData(), what, expr);
-
-			//Log(LogDebug, "livestatus", "Attribute filter '" + m_Operand + " " + m_Operator + " " +
-			//    static_cast<String>(value) + "' " + (ret ? "matches" : "doesn't match") + "." );
-
-			return ret;
-		} else if (m_Operator == "<") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) < Convert::ToDouble(m_Operand));
+		case OperatorLess:
+			if (numeric)
+				return (static_cast<double>(value) < GetNumericOperand());
 			else
 				return (static_cast<String>(value) < m_Operand);
-		} else if (m_Operator == ">") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) > Convert::ToDouble(m_Operand));
+		case OperatorGreater:
+			if (numeric)
+				return (static_cast<double>(value) > GetNumericOperand());
 			else
 				return (static_cast<String>(value) > m_Operand);
-		} else if (m_Operator == "<=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) <= Convert::ToDouble(m_Operand));
+		case OperatorLessOrEqual:
+			if (numeric)
+				return (static_cast<double>(value) <= GetNumericOperand());
 			else
 				return (static_cast<String>(value) <= m_Operand);
-		} else if (m_Operator == ">=") {
-			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) >= Convert::ToDouble(m_Operand));
+		case OperatorGreaterOrEqual:
+			if (numeric)
+				return (static_cast<double>(value) >= GetNumericOperand());
 			else
 				return (static_cast<String>(value) >= m_Operand);
-		} else {
+		default:
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Unknown operator for column '" + m_Column + "': " + m_Operator));
-		}
 	}
 
 	return false;
 }
+
+double AttributeFilter::GetCost(void) const
+{
+	switch (m_Op) {
+		case OperatorRegex:
+		case OperatorIRegex:
+			return 10;
+		case OperatorILess:
+			return 3;
+		default:
+			return m_HasNumericOperand ? 1 : 2;
+	}
+}
+
+double AttributeFilter::GetSelectivity(void) const
+{
+	switch (m_Op) {
+		case OperatorEqual:
+			return 0.1;
+		case OperatorRegex:
+		case OperatorIRegex:
+			return 0.3;
+		default:
+			return 0.5;
+	}
+}
+
+double AttributeFilter::GetNumericOperand(void) const
+{
+	if (!m_HasNumericOperand)
+		return Convert::ToDouble(m_Operand); /* throws */
+
+	return m_NumericOperand;
+}
+
+bool AttributeFilter::MatchRegex(const Value& value) const
+{
+	if (!m_RegexError.IsEmpty())
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid regular expression for column '" + m_Column + "': " + m_RegexError));
+
+	String operand = value;
+	boost::smatch what;
+	return boost::regex_search(operand.GetData(), what, m_Regex);
+}
+
+String AttributeFilter::GetColumn(void) const
+{
+	return m_Column;
+}
+
+String AttributeFilter::GetOperator(void) const
+{
+	return m_Operator;
+}
+
+String AttributeFilter::GetOperand(void) const
+{
+	return m_Operand;
+}
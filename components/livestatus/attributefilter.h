@@ -21,6 +21,7 @@
 #define ATTRIBUTEFILTER_H
 
 #include "livestatus/filter.h"
+#include <boost/regex.hpp>
 
 using namespace icinga;
 
@@ -39,10 +40,46 @@ public:
 
 	virtual bool Apply(const Table::Ptr& table, const Value& row);
 
+	virtual double GetCost(void) const;
+	virtual double GetSelectivity(void) const;
+	virtual void Bind(const Table::Ptr& table);
+
+	String GetColumn(void) const;
+	String GetOperator(void) const;
+	String GetOperand(void) const;
+
 protected:
 	String m_Column;
 	String m_Operator;
 	String m_Operand;
+
+private:
+	enum AttributeOperator
+	{
+		OperatorEqual,
+		OperatorRegex,
+		OperatorIRegex,
+		OperatorILess,
+		OperatorLess,
+		OperatorGreater,
+		OperatorLessOrEqual,
+		OperatorGreaterOrEqual,
+		OperatorInvalid
+	};
+
+	AttributeOperator m_Op;
+
+	bool m_HasNumericOperand;
+	double m_NumericOperand;
+
+	boost::regex m_Regex;
+	String m_RegexError;
+
+	const Table *m_BoundTable;
+	int m_ColumnIndex;
+
+	double GetNumericOperand(void) const;
+	bool MatchRegex(const Value& value) const;
 };
 
 }
@@ -29,7 +29,7 @@ AvgAggregator::AvgAggregator(const String& attr)
 
 void AvgAggregator::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_AvgAttr);
+	const Column& column = table->GetColumn(m_AvgAttr);
 
 	Value value = column.ExtractValue(row);
 
@@ -41,3 +41,18 @@ double AvgAggregator::GetResult(void) const
 {
 	return (m_Avg / m_AvgCount);
 }
+
+Aggregator::Ptr AvgAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<AvgAggregator>(m_AvgAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void AvgAggregator::Merge(const Aggregator::Ptr& other)
+{
+	AvgAggregator::Ptr aggregator = static_pointer_cast<AvgAggregator>(other);
+
+	m_Avg += aggregator->m_Avg;
+	m_AvgCount += aggregator->m_AvgCount;
+}
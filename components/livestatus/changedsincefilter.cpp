@@ -0,0 +1,45 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "livestatus/changedsincefilter.h"
+#include "livestatus/changetracker.h"
+#include "icinga/checkable.h"
+
+using namespace icinga;
+
+ChangedSinceFilter::ChangedSinceFilter(unsigned long sequence)
+	: m_Sequence(sequence)
+{ }
+
+bool ChangedSinceFilter::Apply(const Table::Ptr&, const Value& row)
+{
+	if (!row.IsObjectType<Checkable>())
+		return true;
+
+	return ChangeTracker::GetObjectSequence(static_cast<Object::Ptr>(row)) > m_Sequence;
+}
+
+/**
+ * Usually only a few objects change between two queries.
+ */
+double ChangedSinceFilter::GetSelectivity(void) const
+{
+	return 0.1;
+}
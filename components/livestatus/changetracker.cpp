@@ -0,0 +1,203 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "livestatus/changetracker.h"
+#include "icinga/checkable.h"
+#include "icinga/externalcommandprocessor.h"
+#include "base/initialize.h"
+#include "base/utility.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <vector>
+
+using namespace icinga;
+
+#define CHANGETRIGGERCOUNT 7
+
+static boost::mutex l_ChangeMutex;
+static boost::condition_variable l_ChangeCV;
+static unsigned long l_ChangeSequence = 0;
+static unsigned long l_TriggerSequences[CHANGETRIGGERCOUNT];
+static boost::unordered_map<const Object *, unsigned long> l_ObjectSequences;
+
+/* Must be called with l_ChangeMutex held. */
+static unsigned long SumTriggerSequences(int triggers)
+{
+	unsigned long sequence = 0;
+
+	for (int i = 0; i < CHANGETRIGGERCOUNT; i++) {
+		if (triggers & (1 << i))
+			sequence += l_TriggerSequences[i];
+	}
+
+	return sequence;
+}
+
+boost::signals2::signal<void (int)> ChangeTracker::OnTriggered;
+
+INITIALIZE_ONCE(&ChangeTracker::StaticInitialize);
+
+void ChangeTracker::StaticInitialize(void)
+{
+	Checkable::OnNewCheckResult.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerCheck));
+	Checkable::OnStateChange.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerState | ChangeTriggerLog));
+	Checkable::OnFlappingChanged.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerState | ChangeTriggerLog));
+	Checkable::OnAcknowledgementSet.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerState));
+	Checkable::OnAcknowledgementCleared.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerState));
+
+	Checkable::OnNotificationSentToAllUsers.connect(boost::bind(&ChangeTracker::NotifyChange, _2, ChangeTriggerLog));
+
+	Checkable::OnDowntimeAdded.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerDowntime));
+	Checkable::OnDowntimeRemoved.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerDowntime | ChangeTriggerLog));
+	Checkable::OnDowntimeTriggered.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerDowntime | ChangeTriggerLog));
+
+	Checkable::OnCommentAdded.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerComment));
+	Checkable::OnCommentRemoved.connect(boost::bind(&ChangeTracker::NotifyChange, _1, ChangeTriggerComment));
+
+	/* These only change the object's attributes, there's no trigger for them. */
+	Checkable::OnNextCheckChanged.connect(boost::bind(&ChangeTracker::NotifyChange, _1, 0));
+	Checkable::OnForceNextCheckChanged.connect(boost::bind(&ChangeTracker::NotifyChange, _1, 0));
+	Checkable::OnForceNextNotificationChanged.connect(boost::bind(&ChangeTracker::NotifyChange, _1, 0));
+	Checkable::OnEnableActiveChecksChanged.connect(boost::bind(&ChangeTracker::NotifyChange, _1, 0));
+	Checkable::OnEnablePassiveChecksChanged.connect(boost::bind(&ChangeTracker::NotifyChange, _1, 0));
+	Checkable::OnEnableNotificationsChanged.connect(boost::bind(&ChangeTracker::NotifyChange, _1, 0));
+	Checkable::OnEnableFlappingChanged.connect(boost::bind(&ChangeTracker::NotifyChange, _1, 0));
+
+	/* Program-wide settings can only be changed using external commands. */
+	ExternalCommandProcessor::OnNewExternalCommand.connect(boost::bind(&ChangeTracker::NotifyChange,
+	    Object::Ptr(), ChangeTriggerCommand | ChangeTriggerProgram | ChangeTriggerLog));
+}
+
+/**
+ * Parses a WaitTrigger value.
+ *
+ * @returns the trigger or 0 if the name is unknown.
+ */
+int ChangeTracker::ParseTrigger(const String& trigger)
+{
+	if (trigger == "check")
+		return ChangeTriggerCheck;
+	else if (trigger == "state")
+		return ChangeTriggerState;
+	else if (trigger == "log")
+		return ChangeTriggerLog;
+	else if (trigger == "downtime")
+		return ChangeTriggerDowntime;
+	else if (trigger == "comment")
+		return ChangeTriggerComment;
+	else if (trigger == "command")
+		return ChangeTriggerCommand;
+	else if (trigger == "program")
+		return ChangeTriggerProgram;
+	else if (trigger == "all")
+		return ChangeTriggerAll;
+	else
+		return 0;
+}
+
+void ChangeTracker::NotifyChange(const Object::Ptr& object, int triggers)
+{
+	{
+		boost::mutex::scoped_lock lock(l_ChangeMutex);
+
+		l_ChangeSequence++;
+
+		if (object)
+			l_ObjectSequences[object.get()] = l_ChangeSequence;
+
+		if (triggers == 0)
+			return;
+
+		for (int i = 0; i < CHANGETRIGGERCOUNT; i++) {
+			if (triggers & (1 << i))
+				l_TriggerSequences[i]++;
+		}
+
+		l_ChangeCV.notify_all();
+	}
+
+	/* The trigger sequences have already been updated, so handlers can
+	 * use GetTriggerSequence() to find out whether they're affected. */
+	OnTriggered(triggers);
+}
+
+/**
+ * Returns the sequence number of the most recent change.
+ */
+unsigned long ChangeTracker::GetSequence(void)
+{
+	boost::mutex::scoped_lock lock(l_ChangeMutex);
+
+	return l_ChangeSequence;
+}
+
+/**
+ * Returns the sequence number of the most recent change to the specified
+ * object or 0 if the object hasn't changed since Icinga was started.
+ */
+unsigned long ChangeTracker::GetObjectSequence(const Object::Ptr& object)
+{
+	boost::mutex::scoped_lock lock(l_ChangeMutex);
+
+	boost::unordered_map<const Object *, unsigned long>::const_iterator it = l_ObjectSequences.find(object.get());
+
+	if (it == l_ObjectSequences.end())
+		return 0;
+
+	return it->second;
+}
+
+/**
+ * Returns a counter which is incremented whenever one of the specified
+ * triggers fires.
+ */
+unsigned long ChangeTracker::GetTriggerSequence(int triggers)
+{
+	boost::mutex::scoped_lock lock(l_ChangeMutex);
+
+	return SumTriggerSequences(triggers);
+}
+
+/**
+ * Waits until one of the specified triggers fires after the trigger
+ * sequence was obtained using GetTriggerSequence().
+ *
+ * @param deadline The time until which to wait.
+ * @returns false if the deadline has passed.
+ */
+bool ChangeTracker::WaitForTrigger(int triggers, unsigned long sequence, double deadline)
+{
+	boost::mutex::scoped_lock lock(l_ChangeMutex);
+
+	for (;;) {
+		if (SumTriggerSequences(triggers) != sequence)
+			return true;
+
+		double timeout = deadline - Utility::GetTime();
+
+		if (timeout <= 0)
+			return false;
+
+		l_ChangeCV.timed_wait(lock, boost::posix_time::milliseconds(static_cast<long>(timeout * 1000) + 1));
+	}
+}
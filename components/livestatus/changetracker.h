@@ -0,0 +1,83 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#ifndef CHANGETRACKER_H
+#define CHANGETRACKER_H
+
+#include "base/object.h"
+#include "base/qstring.h"
+#include <boost/signals2.hpp>
+
+using namespace icinga;
+
+namespace icinga
+{
+
+/**
+ * The events livestatus clients can wait for (WaitTrigger header).
+ *
+ * @ingroup livestatus
+ */
+enum ChangeTrigger
+{
+	ChangeTriggerCheck = 1,
+	ChangeTriggerState = 2,
+	ChangeTriggerLog = 4,
+	ChangeTriggerDowntime = 8,
+	ChangeTriggerComment = 16,
+	ChangeTriggerCommand = 32,
+	ChangeTriggerProgram = 64,
+	ChangeTriggerAll = 127
+};
+
+/**
+ * Keeps track of changes to hosts and services so livestatus queries can
+ * wait for them instead of polling.
+ *
+ * Every change increments a global sequence number. The sequence number of
+ * the last change is remembered for each checkable object so queries can
+ * ask for the rows which have changed since a previous query.
+ *
+ * @ingroup livestatus
+ */
+class ChangeTracker
+{
+public:
+	static void StaticInitialize(void);
+
+	static int ParseTrigger(const String& trigger);
+
+	static unsigned long GetSequence(void);
+	static unsigned long GetObjectSequence(const Object::Ptr& object);
+
+	static unsigned long GetTriggerSequence(int triggers);
+	static bool WaitForTrigger(int triggers, unsigned long sequence, double deadline);
+
+	static boost::signals2::signal<void (int)> OnTriggered;
+
+private:
+	ChangeTracker(void);
+
+	static void NotifyChange(const Object::Ptr& object, int triggers);
+};
+
+}
+
+#endif /* CHANGETRACKER_H */
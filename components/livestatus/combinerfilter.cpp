@@ -18,9 +18,19 @@
  ******************************************************************************/
 
 #include "livestatus/combinerfilter.h"
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <typeinfo>
 
 using namespace icinga;
 
+typedef std::pair<double, Filter::Ptr> RankedFilter;
+
+static bool CompareFilterRank(const RankedFilter& a, const RankedFilter& b)
+{
+	return a.first < b.first;
+}
+
 CombinerFilter::CombinerFilter(void)
 { }
 
@@ -28,3 +38,71 @@ void CombinerFilter::AddSubFilter(const Filter::Ptr& filter)
 {
 	m_Filters.push_back(filter);
 }
+
+double CombinerFilter::GetCost(void) const
+{
+	double cost = 0;
+
+	BOOST_FOREACH(const Filter::Ptr& filter, m_Filters) {
+		cost += filter->GetCost();
+	}
+
+	return cost;
+}
+
+void CombinerFilter::Bind(const Table::Ptr& table)
+{
+	BOOST_FOREACH(const Filter::Ptr& filter, m_Filters) {
+		if (filter)
+			filter->Bind(table);
+	}
+}
+
+/**
+ * Optimizes the sub-filters, merges nested filters of the same kind
+ * (e.g. an And filter inside of another And filter) and sorts them so
+ * that cheap filters which are likely to short-circuit the evaluation
+ * are evaluated first.
+ *
+ * @param conjunction Whether this is an And filter (i.e. evaluation stops
+ *		      at the first sub-filter which doesn't match).
+ */
+void CombinerFilter::OptimizeSubFilters(bool conjunction)
+{
+	std::vector<Filter::Ptr> filters;
+
+	BOOST_FOREACH(const Filter::Ptr& filter, m_Filters) {
+		/* Stats aggregators without a filter leave empty entries behind. */
+		if (!filter)
+			return;
+	}
+
+	BOOST_FOREACH(const Filter::Ptr& filter, m_Filters) {
+		filter->Optimize();
+
+		CombinerFilter::Ptr combiner = dynamic_pointer_cast<CombinerFilter>(filter);
+
+		/* Empty Or filters match everything and therefore can't be merged. */
+		if (combiner && typeid(*combiner) == typeid(*this) && !combiner->m_Filters.empty())
+			filters.insert(filters.end(), combiner->m_Filters.begin(), combiner->m_Filters.end());
+		else
+			filters.push_back(filter);
+	}
+
+	std::vector<RankedFilter> ranked;
+
+	BOOST_FOREACH(const Filter::Ptr& filter, filters) {
+		double selectivity = filter->GetSelectivity();
+		double shortCircuit = conjunction ? (1 - selectivity) : selectivity;
+
+		ranked.push_back(std::make_pair(filter->GetCost() / std::max(shortCircuit, 0.01), filter));
+	}
+
+	std::stable_sort(ranked.begin(), ranked.end(), CompareFilterRank);
+
+	m_Filters.clear();
+
+	BOOST_FOREACH(const RankedFilter& rf, ranked) {
+		m_Filters.push_back(rf.second);
+	}
+}
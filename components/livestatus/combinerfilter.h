@@ -39,8 +39,13 @@ public:
 
 	void AddSubFilter(const Filter::Ptr& filter);
 
+	virtual double GetCost(void) const;
+	virtual void Bind(const Table::Ptr& table);
+
 protected:
 	std::vector<Filter::Ptr> m_Filters;
+
+	void OptimizeSubFilters(bool conjunction);
 };
 
 }
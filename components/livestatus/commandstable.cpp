@@ -32,9 +32,7 @@
 using namespace icinga;
 
 CommandsTable::CommandsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void CommandsTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
@@ -28,9 +28,7 @@
 using namespace icinga;
 
 CommentsTable::CommentsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void CommentsTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
@@ -0,0 +1,336 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "livestatus/connection.h"
+#include "base/utility.h"
+#include "base/logger_fwd.h"
+#include "base/exception.h"
+#include <boost/algorithm/string/trim.hpp>
+
+using namespace icinga;
+
+#define RECVBUFSIZE 16384
+#define SENDBUFSIZE 65536
+#define SENDBUFHIGHWATER (1024 * 1024)
+
+LivestatusConnection::LivestatusConnection(const Socket::Ptr& socket, size_t maxRequestSize,
+    const NotifyCallback& notify)
+	: m_Socket(socket), m_MaxRequestSize(maxRequestSize), m_Notify(notify),
+	  m_RequestSize(0), m_SendOffset(0), m_Busy(false), m_Closing(false),
+	  m_Eof(false), m_Closed(false), m_LastActivity(Utility::GetTime())
+{ }
+
+Socket::Ptr LivestatusConnection::GetSocket(void) const
+{
+	return m_Socket;
+}
+
+/**
+ * Checks whether a failed socket operation merely would have blocked.
+ */
+static bool IsWouldBlock(const socket_error& ex)
+{
+#ifndef _WIN32
+	const int *error = boost::get_error_info<boost::errinfo_errno>(ex);
+
+	return (error && (*error == EAGAIN || *error == EWOULDBLOCK || *error == EINTR));
+#else /* _WIN32 */
+	const int *error = boost::get_error_info<errinfo_win32_error>(ex);
+
+	return (error && *error == WSAEWOULDBLOCK);
+#endif /* _WIN32 */
+}
+
+/**
+ * Reads whatever data is available on the socket and splits it into
+ * requests. Must only be called by the event loop when the socket is
+ * readable.
+ *
+ * @returns false if the connection should be dropped right away.
+ */
+bool LivestatusConnection::ProcessInput(void)
+{
+	char buffer[RECVBUFSIZE];
+	size_t rc;
+
+	try {
+		rc = m_Socket->Read(buffer, sizeof(buffer));
+	} catch (const socket_error& ex) {
+		if (IsWouldBlock(ex))
+			return true;
+
+		Log(LogDebug, "livestatus", "Error while reading from client: " + DiagnosticInformation(ex));
+		return false;
+	}
+
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	m_LastActivity = Utility::GetTime();
+
+	if (rc == 0) {
+		/* The client won't send anything else, treat whatever we've got
+		 * as the last request, just like Stream::ReadLine does. */
+		String line = m_RecvBuffer;
+		boost::algorithm::trim_right(line);
+		m_RecvBuffer.clear();
+
+		if (!line.IsEmpty())
+			m_Lines.push_back(line);
+
+		if (!m_Closing && !m_Lines.empty())
+			m_Requests.push_back(m_Lines);
+
+		m_Lines.clear();
+		m_Closing = true;
+		m_Eof = true;
+
+		return true;
+	}
+
+	if (m_Closing)
+		return true;
+
+	m_RecvBuffer.append(buffer, rc);
+
+	size_t start = 0, pos;
+
+	while (!m_Closing && (pos = m_RecvBuffer.find('\n', start)) != std::string::npos) {
+		String line = m_RecvBuffer.substr(start, pos - start);
+		boost::algorithm::trim_right(line);
+		start = pos + 1;
+
+		AddLine(line);
+	}
+
+	m_RecvBuffer.erase(0, start);
+
+	if (m_RequestSize + m_RecvBuffer.size() > m_MaxRequestSize) {
+		Log(LogWarning, "livestatus", "Client request exceeds the maximum request size. Closing connection.");
+		return false;
+	}
+
+	return true;
+}
+
+void LivestatusConnection::AddLine(const String& line)
+{
+	if (!line.IsEmpty()) {
+		m_Lines.push_back(line);
+		m_RequestSize += line.GetLength() + 1;
+		return;
+	}
+
+	/* An empty line without a request in front of it ends the session. */
+	if (m_Lines.empty()) {
+		m_Closing = true;
+		return;
+	}
+
+	m_Requests.push_back(m_Lines);
+	m_Lines.clear();
+	m_RequestSize = 0;
+}
+
+/**
+ * Sends as much of the buffered output as the socket accepts. Must only
+ * be called by the event loop when the socket is writable.
+ *
+ * @returns false if the connection should be dropped right away.
+ */
+bool LivestatusConnection::ProcessOutput(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	while (m_SendOffset < m_SendBuffer.size()) {
+		size_t count = std::min(m_SendBuffer.size() - m_SendOffset, static_cast<size_t>(SENDBUFSIZE));
+		size_t rc;
+
+		try {
+			rc = m_Socket->Write(m_SendBuffer.c_str() + m_SendOffset, count);
+		} catch (const socket_error& ex) {
+			if (IsWouldBlock(ex))
+				break;
+
+			Log(LogDebug, "livestatus", "Error while writing to client: " + DiagnosticInformation(ex));
+			return false;
+		}
+
+		m_LastActivity = Utility::GetTime();
+		m_SendOffset += rc;
+
+		if (rc < count)
+			break;
+	}
+
+	if (m_SendOffset == m_SendBuffer.size()) {
+		m_SendBuffer.clear();
+		m_SendOffset = 0;
+	} else if (m_SendOffset >= SENDBUFSIZE) {
+		m_SendBuffer.erase(0, m_SendOffset);
+		m_SendOffset = 0;
+	}
+
+	if (m_SendBuffer.size() - m_SendOffset < SENDBUFHIGHWATER)
+		m_CV.notify_all();
+
+	return true;
+}
+
+/**
+ * Takes the next pending request off the connection unless another
+ * request is still being executed.
+ *
+ * @returns true if a request was returned.
+ */
+bool LivestatusConnection::BeginRequest(std::vector<String>& lines)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (m_Busy || m_Closed || m_Requests.empty())
+		return false;
+
+	lines.swap(m_Requests.front());
+	m_Requests.pop_front();
+	m_Busy = true;
+
+	return true;
+}
+
+/**
+ * Called by the query executor once a request has been processed.
+ */
+void LivestatusConnection::EndRequest(bool keepAlive)
+{
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		m_Busy = false;
+
+		if (!keepAlive) {
+			m_Closing = true;
+			m_Requests.clear();
+		}
+	}
+
+	m_Notify(GetSelf());
+}
+
+bool LivestatusConnection::WantsRead(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	/* Requests are executed one at a time; stop reading while one is
+	 * queued so pipelining clients can't make us buffer unbounded input. */
+	return !m_Closing && m_Requests.empty();
+}
+
+bool LivestatusConnection::WantsWrite(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	return m_SendOffset < m_SendBuffer.size();
+}
+
+/**
+ * Checks whether the connection has done all its work and can be closed.
+ */
+bool LivestatusConnection::IsFinished(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	return m_Closing && !m_Busy && m_Requests.empty() && m_SendOffset == m_SendBuffer.size();
+}
+
+/**
+ * Checks whether the client hasn't sent or received anything for longer
+ * than the specified timeout. Connections which are waiting for a query
+ * to produce output are not considered to be idle unless the client has
+ * already closed its end of the connection.
+ */
+bool LivestatusConnection::IsIdle(double now, double timeout) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (m_Busy && !m_Eof && m_SendOffset == m_SendBuffer.size())
+		return false;
+
+	return (now - m_LastActivity > timeout);
+}
+
+/**
+ * Closes the socket. Queries which are still writing to this connection
+ * will fail.
+ */
+void LivestatusConnection::Shutdown(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (m_Closed)
+		return;
+
+	m_Closed = true;
+	m_CV.notify_all();
+
+	m_Socket->Close();
+}
+
+size_t LivestatusConnection::Read(void *, size_t)
+{
+	BOOST_THROW_EXCEPTION(std::runtime_error("Livestatus connections cannot be read from directly."));
+}
+
+/**
+ * Queues output for the client. Blocks while the client is lagging behind
+ * too far.
+ */
+void LivestatusConnection::Write(const void *buffer, size_t count)
+{
+	bool notify;
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		while (!m_Closed && m_SendBuffer.size() - m_SendOffset >= SENDBUFHIGHWATER)
+			m_CV.wait(lock);
+
+		if (m_Closed)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Livestatus connection was closed."));
+
+		notify = (m_SendOffset == m_SendBuffer.size());
+
+		m_SendBuffer.append(static_cast<const char *>(buffer), count);
+	}
+
+	if (notify)
+		m_Notify(GetSelf());
+}
+
+void LivestatusConnection::Close(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	m_Closing = true;
+}
+
+bool LivestatusConnection::IsEof(void) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	return m_Closed;
+}
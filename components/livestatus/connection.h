@@ -0,0 +1,103 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef LIVESTATUSCONNECTION_H
+#define LIVESTATUSCONNECTION_H
+
+#include "base/stream.h"
+#include "base/socket.h"
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+#include <vector>
+
+using namespace icinga;
+
+namespace icinga
+{
+
+/**
+ * A non-blocking livestatus client connection.
+ *
+ * The listener's event loop feeds received data into the connection,
+ * which splits it into requests, and drains its send buffer whenever the
+ * socket is writable. Queries are executed on a different thread and use
+ * the connection as their output stream.
+ *
+ * @ingroup livestatus
+ */
+class LivestatusConnection : public Stream
+{
+public:
+	DECLARE_PTR_TYPEDEFS(LivestatusConnection);
+
+	typedef boost::function<void (const LivestatusConnection::Ptr&)> NotifyCallback;
+
+	LivestatusConnection(const Socket::Ptr& socket, size_t maxRequestSize,
+	    const NotifyCallback& notify);
+
+	Socket::Ptr GetSocket(void) const;
+
+	virtual size_t Read(void *buffer, size_t count);
+	virtual void Write(const void *buffer, size_t count);
+	virtual void Close(void);
+	virtual bool IsEof(void) const;
+
+	bool ProcessInput(void);
+	bool ProcessOutput(void);
+
+	bool BeginRequest(std::vector<String>& lines);
+	void EndRequest(bool keepAlive);
+
+	bool WantsRead(void) const;
+	bool WantsWrite(void) const;
+	bool IsFinished(void) const;
+	bool IsIdle(double now, double timeout) const;
+
+	void Shutdown(void);
+
+private:
+	Socket::Ptr m_Socket;
+	size_t m_MaxRequestSize;
+	NotifyCallback m_Notify;
+
+	mutable boost::mutex m_Mutex;
+	boost::condition_variable m_CV;
+
+	std::string m_RecvBuffer;
+	std::vector<String> m_Lines;
+	size_t m_RequestSize;
+	std::deque<std::vector<String> > m_Requests;
+
+	std::string m_SendBuffer;
+	size_t m_SendOffset;
+
+	bool m_Busy;
+	bool m_Closing;
+	bool m_Eof;
+	bool m_Closed;
+	double m_LastActivity;
+
+	void AddLine(const String& line);
+};
+
+}
+
+#endif /* LIVESTATUSCONNECTION_H */
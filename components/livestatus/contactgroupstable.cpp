@@ -25,9 +25,7 @@
 using namespace icinga;
 
 ContactGroupsTable::ContactGroupsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void ContactGroupsTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
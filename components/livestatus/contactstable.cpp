@@ -30,9 +30,7 @@
 using namespace icinga;
 
 ContactsTable::ContactsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void ContactsTable::AddColumns(Table *table, const String& prefix,
 	const Column::ObjectAccessor& objectAccessor)
@@ -28,9 +28,7 @@
 using namespace icinga;
 
 DowntimesTable::DowntimesTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void DowntimesTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
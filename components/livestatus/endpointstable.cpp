@@ -35,9 +35,7 @@
 using namespace icinga;
 
 EndpointsTable::EndpointsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void EndpointsTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
@@ -23,3 +23,29 @@ using namespace icinga;
 
 Filter::Filter(void)
 { }
+
+/**
+ * Returns the estimated relative cost of evaluating the filter for a row.
+ */
+double Filter::GetCost(void) const
+{
+	return 1;
+}
+
+/**
+ * Returns the estimated probability that the filter matches a row.
+ */
+double Filter::GetSelectivity(void) const
+{
+	return 0.5;
+}
+
+void Filter::Optimize(void)
+{ }
+
+/**
+ * Prepares the filter for being applied to rows of the specified table.
+ * Bound filters can be applied from multiple threads at once.
+ */
+void Filter::Bind(const Table::Ptr& table)
+{ }
@@ -35,6 +35,11 @@ public:
 
 	virtual bool Apply(const Table::Ptr& table, const Value& row) = 0;
 
+	virtual double GetCost(void) const;
+	virtual double GetSelectivity(void) const;
+	virtual void Optimize(void);
+	virtual void Bind(const Table::Ptr& table);
+
 protected:
 	Filter(void);
 };
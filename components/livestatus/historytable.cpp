@@ -25,3 +25,16 @@ void HistoryTable::UpdateLogEntries(const Dictionary::Ptr&, int, int, const AddR
 {
 	/* does nothing by default */
 }
+
+/**
+ * Restricts the log lines which are read from the compat logs to lines
+ * with the specified host name, service description and type. Empty
+ * values match any line. The query's filter still has to be applied
+ * to the rows.
+ */
+void HistoryTable::SetIndexFilter(const String& hostName, const String& serviceDescription, const String& type)
+{
+	m_IndexHostName = hostName;
+	m_IndexServiceDescription = serviceDescription;
+	m_IndexType = type;
+}
@@ -33,7 +33,16 @@ namespace icinga
 class HistoryTable : public Table
 {
 public:
+	DECLARE_PTR_TYPEDEFS(HistoryTable);
+
         virtual void UpdateLogEntries(const Dictionary::Ptr& bag, int line_count, int lineno, const AddRowFunction& addRowFn);
+
+	void SetIndexFilter(const String& hostName, const String& serviceDescription, const String& type);
+
+protected:
+	String m_IndexHostName;
+	String m_IndexServiceDescription;
+	String m_IndexType;
 };
 
 }
@@ -27,9 +27,7 @@
 using namespace icinga;
 
 HostGroupsTable::HostGroupsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void HostGroupsTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
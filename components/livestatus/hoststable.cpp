@@ -39,9 +39,7 @@
 using namespace icinga;
 
 HostsTable::HostsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void HostsTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
@@ -29,7 +29,7 @@ InvAvgAggregator::InvAvgAggregator(const String& attr)
 
 void InvAvgAggregator::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_InvAvgAttr);
+	const Column& column = table->GetColumn(m_InvAvgAttr);
 
 	Value value = column.ExtractValue(row);
 
@@ -41,3 +41,18 @@ double InvAvgAggregator::GetResult(void) const
 {
 	return (m_InvAvg / m_InvAvgCount);
 }
+
+Aggregator::Ptr InvAvgAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<InvAvgAggregator>(m_InvAvgAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void InvAvgAggregator::Merge(const Aggregator::Ptr& other)
+{
+	InvAvgAggregator::Ptr aggregator = static_pointer_cast<InvAvgAggregator>(other);
+
+	m_InvAvg += aggregator->m_InvAvg;
+	m_InvAvgCount += aggregator->m_InvAvgCount;
+}
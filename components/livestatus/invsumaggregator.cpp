@@ -29,7 +29,7 @@ InvSumAggregator::InvSumAggregator(const String& attr)
 
 void InvSumAggregator::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_InvSumAttr);
+	const Column& column = table->GetColumn(m_InvSumAttr);
 
 	Value value = column.ExtractValue(row);
 
@@ -40,3 +40,17 @@ double InvSumAggregator::GetResult(void) const
 {
 	return m_InvSum;
 }
+
+Aggregator::Ptr InvSumAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<InvSumAggregator>(m_InvSumAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void InvSumAggregator::Merge(const Aggregator::Ptr& other)
+{
+	InvSumAggregator::Ptr aggregator = static_pointer_cast<InvSumAggregator>(other);
+
+	m_InvSum += aggregator->m_InvSum;
+}
@@ -39,6 +39,9 @@ public:
 	virtual void Apply(const Table::Ptr& table, const Value& row);
 	virtual double GetResult(void) const;
 
+	virtual Aggregator::Ptr Clone(void) const;
+	virtual void Merge(const Aggregator::Ptr& other);
+
 private:
 	double m_InvSum;
 	String m_InvSumAttr;
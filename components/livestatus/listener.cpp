@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "livestatus/listener.h"
+#include "livestatus/changetracker.h"
 #include "config/configcompilercontext.h"
 #include "base/utility.h"
 #include "base/objectlock.h"
@@ -31,14 +32,24 @@
 #include "base/scriptfunction.h"
 #include "base/statsfunction.h"
 #include "base/convert.h"
+#include <boost/foreach.hpp>
+#ifndef _WIN32
+#	include <poll.h>
+#	ifdef HAVE_EPOLL
+#		include <sys/epoll.h>
+#	endif /* HAVE_EPOLL */
+#endif /* _WIN32 */
 
 using namespace icinga;
 
+#define MAXREQUESTSIZE (1024 * 1024)
+
 REGISTER_TYPE(LivestatusListener);
 REGISTER_SCRIPTFUNCTION(ValidateSocketType, &LivestatusListener::ValidateSocketType);
 
 static int l_ClientsConnected = 0;
 static int l_Connections = 0;
+static int l_SlowQueries = 0;
 static boost::mutex l_ComponentMutex;
 
 REGISTER_STATSFUNCTION(LivestatusListenerStats, &LivestatusListener::StatsFunc);
@@ -50,10 +61,27 @@ Value LivestatusListener::StatsFunc(Dictionary::Ptr& status, Dictionary::Ptr& pe
 	BOOST_FOREACH(const LivestatusListener::Ptr& livestatuslistener, DynamicType::GetObjects<LivestatusListener>()) {
 		Dictionary::Ptr stats = make_shared<Dictionary>();
 		stats->Set("connections", l_Connections);
+		stats->Set("queries", Query::GetQueries());
+		stats->Set("slow_queries", GetSlowQueries());
+		stats->Set("query_histogram", Query::GetQueryHistogram());
+
+		QueryProfile totals = Query::GetQueryTotals();
+		stats->Set("parse_time", totals.ParseTime);
+		stats->Set("filter_time", totals.FilterTime);
+		stats->Set("serialize_time", totals.SerializeTime);
+		stats->Set("rows_scanned", static_cast<double>(totals.RowsScanned));
+		stats->Set("rows_matched", static_cast<double>(totals.RowsMatched));
+		stats->Set("bytes_sent", static_cast<double>(totals.BytesSent));
 
 		nodes->Set(livestatuslistener->GetName(), stats);
 
-		perfdata->Set("livestatuslistener_" + livestatuslistener->GetName() + "_connections", Convert::ToDouble(l_Connections));
+		String prefix = "livestatuslistener_" + livestatuslistener->GetName() + "_";
+
+		perfdata->Set(prefix + "connections", Convert::ToDouble(l_Connections));
+		perfdata->Set(prefix + "queries", Convert::ToDouble(Query::GetQueries()));
+		perfdata->Set(prefix + "slow_queries", Convert::ToDouble(GetSlowQueries()));
+		perfdata->Set(prefix + "rows_scanned", static_cast<double>(totals.RowsScanned));
+		perfdata->Set(prefix + "bytes_sent", static_cast<double>(totals.BytesSent));
 	}
 
 	status->Set("livestatuslistener", nodes);
@@ -68,11 +96,26 @@ void LivestatusListener::Start(void)
 {
 	DynamicObject::Start();
 
+#ifndef _WIN32
+	InitializeEvents();
+
+	ChangeTracker::OnTriggered.connect(boost::bind(&LivestatusListener::ResumeWaitingQueries, this));
+
+	for (int i = 0; i < GetQueryThreads(); i++) {
+		boost::thread thread(boost::bind(&LivestatusListener::QueryThreadProc, this));
+		thread.detach();
+	}
+#endif /* _WIN32 */
+
 	if (GetSocketType() == "tcp") {
 		TcpSocket::Ptr socket = make_shared<TcpSocket>();
 		socket->Bind(GetBindHost(), GetBindPort(), AF_INET);
 
+#ifndef _WIN32
+		boost::thread thread(boost::bind(&LivestatusListener::EventThreadProc, this, socket));
+#else /* _WIN32 */
 		boost::thread thread(boost::bind(&LivestatusListener::ServerThreadProc, this, socket));
+#endif /* _WIN32 */
 		thread.detach();
 		Log(LogInformation, "livestatus", "Created tcp socket listening on host '" + GetBindHost() + "' port '" + GetBindPort() + "'.");
 	}
@@ -91,7 +134,7 @@ void LivestatusListener::Start(void)
 			    << boost::errinfo_file_name(GetSocketPath()));
 		}
 
-		boost::thread thread(boost::bind(&LivestatusListener::ServerThreadProc, this, socket));
+		boost::thread thread(boost::bind(&LivestatusListener::EventThreadProc, this, socket));
 		thread.detach();
 		Log(LogInformation, "livestatus", "Created unix socket in '" + GetSocketPath() + "'.");
 #else
@@ -116,6 +159,527 @@ int LivestatusListener::GetConnections(void)
 	return l_Connections;
 }
 
+int LivestatusListener::GetSlowQueries(void)
+{
+	boost::mutex::scoped_lock lock(l_ComponentMutex);
+
+	return l_SlowQueries;
+}
+
+/**
+ * Logs queries which took longer than the slow_query_threshold.
+ */
+void LivestatusListener::ProfileQuery(const Query::Ptr& query)
+{
+	const QueryProfile& profile = query->GetProfile();
+
+	/* Queries which waited for changes aren't slow because of that, the
+	 * wait isn't part of the execution time. */
+	double duration = profile.ParseTime + profile.ExecutionTime;
+
+	if (GetSlowQueryThreshold() <= 0 || duration < GetSlowQueryThreshold())
+		return;
+
+	{
+		boost::mutex::scoped_lock lock(l_ComponentMutex);
+		l_SlowQueries++;
+	}
+
+	std::ostringstream msgbuf;
+	msgbuf << "Slow query: " << duration << "s (parse: " << profile.ParseTime
+	       << "s, filter: " << profile.FilterTime << "s, serialize: " << profile.SerializeTime
+	       << "s), rows scanned: " << profile.RowsScanned << ", rows matched: " << profile.RowsMatched
+	       << ", bytes sent: " << profile.BytesSent << std::endl << profile.Request;
+	Log(LogWarning, "livestatus", msgbuf.str());
+}
+
+#ifndef _WIN32
+void LivestatusListener::InitializeEvents(void)
+{
+	if (pipe(m_EventFDs) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("pipe")
+		    << boost::errinfo_errno(errno));
+	}
+
+	Utility::SetCloExec(m_EventFDs[0]);
+	Utility::SetCloExec(m_EventFDs[1]);
+	Utility::SetNonBlocking(m_EventFDs[0]);
+	Utility::SetNonBlocking(m_EventFDs[1]);
+
+#	ifdef HAVE_EPOLL
+	m_EpollFD = epoll_create1(EPOLL_CLOEXEC);
+
+	if (m_EpollFD < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("epoll_create1")
+		    << boost::errinfo_errno(errno));
+	}
+
+	SetEvents(m_EventFDs[0], 0, POLLIN);
+#	endif /* HAVE_EPOLL */
+}
+
+/**
+ * Updates the events the event loop is waiting for on a file descriptor.
+ * The events are specified as POLLIN/POLLOUT flags, 0 meaning that the
+ * file descriptor isn't registered.
+ */
+void LivestatusListener::SetEvents(int fd, int oldEvents, int newEvents)
+{
+#	ifdef HAVE_EPOLL
+	if (oldEvents == newEvents)
+		return;
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.fd = fd;
+
+	if (newEvents & POLLIN)
+		event.events |= EPOLLIN;
+
+	if (newEvents & POLLOUT)
+		event.events |= EPOLLOUT;
+
+	int op;
+
+	if (oldEvents == 0 && newEvents != 0)
+		op = EPOLL_CTL_ADD;
+	else if (oldEvents != 0 && newEvents == 0)
+		op = EPOLL_CTL_DEL;
+	else
+		op = EPOLL_CTL_MOD;
+
+	if (epoll_ctl(m_EpollFD, op, fd, &event) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("epoll_ctl")
+		    << boost::errinfo_errno(errno));
+	}
+#	endif /* HAVE_EPOLL */
+}
+
+/**
+ * Runs the event loop for the listener: accepts clients, reads their
+ * requests and writes the responses. Queries are executed by the query
+ * threads.
+ */
+void LivestatusListener::EventThreadProc(const Socket::Ptr& server)
+{
+	Utility::SetThreadName("Livestatus");
+
+	server->Listen();
+	server->MakeNonBlocking();
+
+	int serverFD = server->GetFD();
+
+#	ifdef HAVE_EPOLL
+	SetEvents(serverFD, 0, POLLIN);
+
+	epoll_event events[128];
+#	else /* HAVE_EPOLL */
+	std::vector<pollfd> pfds;
+#	endif /* HAVE_EPOLL */
+	std::vector<std::pair<int, int> > ready;
+	double lastSweep = Utility::GetTime();
+	double waitDeadline = 0;
+
+	for (;;) {
+		/* Wake up once per second to look for idle and disconnected clients
+		 * or earlier if a waiting query times out before that. */
+		int timeout = 1000;
+
+		if (waitDeadline != 0) {
+			double delta = waitDeadline - Utility::GetTime();
+
+			if (delta <= 0)
+				timeout = 0;
+			else if (delta < 1)
+				timeout = static_cast<int>(delta * 1000) + 1;
+		}
+
+		ready.clear();
+
+#	ifdef HAVE_EPOLL
+		int rc = epoll_wait(m_EpollFD, events, sizeof(events) / sizeof(events[0]), timeout);
+
+		for (int i = 0; i < rc; i++) {
+			int revents = 0;
+
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				revents |= POLLIN;
+
+			if (events[i].events & EPOLLOUT)
+				revents |= POLLOUT;
+
+			ready.push_back(std::make_pair(events[i].data.fd, revents));
+		}
+#	else /* HAVE_EPOLL */
+		pfds.resize(2 + m_Clients.size());
+
+		pfds[0].fd = m_EventFDs[0];
+		pfds[0].events = POLLIN;
+		pfds[1].fd = serverFD;
+		pfds[1].events = POLLIN;
+
+		int i = 2;
+		typedef std::pair<int, ClientInfo> kv_pair;
+		BOOST_FOREACH(const kv_pair& kv, m_Clients) {
+			if (kv.second.Events == 0)
+				continue;
+
+			pfds[i].fd = kv.first;
+			pfds[i].events = kv.second.Events;
+			i++;
+		}
+
+		pfds.resize(i);
+
+		int rc = poll(&pfds[0], pfds.size(), timeout);
+
+		if (rc > 0) {
+			BOOST_FOREACH(const pollfd& pfd, pfds) {
+				int revents = 0;
+
+				if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+					revents |= POLLIN;
+
+				if (pfd.revents & POLLOUT)
+					revents |= POLLOUT;
+
+				if (revents != 0)
+					ready.push_back(std::make_pair(pfd.fd, revents));
+			}
+		}
+#	endif /* HAVE_EPOLL */
+
+		typedef std::pair<int, int> fd_pair;
+		BOOST_FOREACH(const fd_pair& fp, ready) {
+			int fd = fp.first;
+
+			if (fd == m_EventFDs[0]) {
+				char buffer[512];
+				while (read(fd, buffer, sizeof(buffer)) > 0)
+					; /* Empty loop body. */
+
+				continue;
+			}
+
+			if (fd == serverFD) {
+				AcceptClient(server);
+				continue;
+			}
+
+			std::map<int, ClientInfo>::iterator it = m_Clients.find(fd);
+
+			if (it == m_Clients.end())
+				continue;
+
+			LivestatusConnection::Ptr connection = it->second.Connection;
+
+			if ((fp.second & POLLOUT) && !connection->ProcessOutput()) {
+				CloseClient(fd);
+				continue;
+			}
+
+			if ((fp.second & POLLIN) && !connection->ProcessInput()) {
+				CloseClient(fd);
+				continue;
+			}
+
+			UpdateClient(fd);
+		}
+
+		std::vector<LivestatusConnection::Ptr> notified;
+
+		{
+			boost::mutex::scoped_lock lock(m_NotifyMutex);
+			notified.swap(m_Notified);
+		}
+
+		BOOST_FOREACH(const LivestatusConnection::Ptr& connection, notified) {
+			int fd = connection->GetSocket()->GetFD();
+			std::map<int, ClientInfo>::iterator it = m_Clients.find(fd);
+
+			/* The connection might have been closed in the meantime. */
+			if (it == m_Clients.end() || it->second.Connection != connection)
+				continue;
+
+			UpdateClient(fd);
+		}
+
+		double now = Utility::GetTime();
+
+		if (now - lastSweep >= 1) {
+			std::vector<int> idle, hungup;
+
+			typedef std::pair<int, ClientInfo> kv_pair;
+			BOOST_FOREACH(const kv_pair& kv, m_Clients) {
+				if (kv.second.Events == 0 && IsHungUp(kv.first))
+					hungup.push_back(kv.first);
+				else if (GetIdleTimeout() > 0 && kv.second.Connection->IsIdle(now, GetIdleTimeout()))
+					idle.push_back(kv.first);
+			}
+
+			BOOST_FOREACH(int fd, hungup) {
+				Log(LogDebug, "livestatus", "Client disconnected while its query was running.");
+				CloseClient(fd);
+			}
+
+			BOOST_FOREACH(int fd, idle) {
+				Log(LogInformation, "livestatus", "Closing idle client connection.");
+				CloseClient(fd);
+			}
+
+			lastSweep = now;
+		}
+
+		waitDeadline = ResumeWaitingQueries();
+	}
+}
+
+void LivestatusListener::AcceptClient(const Socket::Ptr& server)
+{
+	Socket::Ptr client;
+
+	try {
+		client = server->Accept();
+	} catch (const socket_error& ex) {
+		const int *error = boost::get_error_info<boost::errinfo_errno>(ex);
+
+		if (!error || (*error != EAGAIN && *error != EWOULDBLOCK && *error != EINTR))
+			Log(LogWarning, "livestatus", "Could not accept client: " + DiagnosticInformation(ex));
+
+		return;
+	}
+
+	if (m_Clients.size() >= static_cast<size_t>(GetMaxConnections())) {
+		Log(LogWarning, "livestatus", "Rejecting client: the maximum number of connections (" +
+		    Convert::ToString(GetMaxConnections()) + ") has been reached.");
+		client->Close();
+		return;
+	}
+
+	Log(LogInformation, "livestatus", "Client connected");
+
+	client->MakeNonBlocking();
+
+	ClientInfo info;
+	info.Connection = make_shared<LivestatusConnection>(client, MAXREQUESTSIZE,
+	    boost::bind(&LivestatusListener::NotifyConnection, this, _1));
+	info.Events = POLLIN;
+
+	int fd = client->GetFD();
+	m_Clients[fd] = info;
+	SetEvents(fd, 0, POLLIN);
+
+	{
+		boost::mutex::scoped_lock lock(l_ComponentMutex);
+		l_ClientsConnected++;
+		l_Connections++;
+	}
+}
+
+/**
+ * Hands the client's next request to the query threads and figures out
+ * which events the client is waiting for.
+ */
+void LivestatusListener::UpdateClient(int fd)
+{
+	ClientInfo& info = m_Clients[fd];
+	std::vector<String> lines;
+
+	if (info.Connection->BeginRequest(lines)) {
+		boost::mutex::scoped_lock lock(m_QueryMutex);
+		m_Queries.push_back(QueryInfo());
+		m_Queries.back().Connection = info.Connection;
+		m_Queries.back().Lines.swap(lines);
+		m_QueryCV.notify_one();
+	}
+
+	if (info.Connection->IsFinished()) {
+		CloseClient(fd);
+		return;
+	}
+
+	int events = 0;
+
+	if (info.Connection->WantsRead())
+		events |= POLLIN;
+
+	if (info.Connection->WantsWrite())
+		events |= POLLOUT;
+
+	/* Connections which have read all their input and are waiting for a
+	 * query are taken out of the event set altogether: a hung-up FD would
+	 * otherwise keep reporting (level-triggered) hang-ups. The event loop
+	 * checks these connections for hang-ups once per second instead. */
+	if (events != info.Events) {
+		SetEvents(fd, info.Events, events);
+		info.Events = events;
+	}
+}
+
+/**
+ * Checks whether the client has hung up. Only used for connections which
+ * aren't part of the event set.
+ */
+bool LivestatusListener::IsHungUp(int fd)
+{
+	pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = 0;
+	pfd.revents = 0;
+
+	if (poll(&pfd, 1, 0) <= 0)
+		return false;
+
+	return ((pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) != 0);
+}
+
+void LivestatusListener::CloseClient(int fd)
+{
+	std::map<int, ClientInfo>::iterator it = m_Clients.find(fd);
+
+	SetEvents(fd, it->second.Events, 0);
+	it->second.Connection->Shutdown();
+	m_Clients.erase(it);
+
+	{
+		boost::mutex::scoped_lock lock(l_ComponentMutex);
+		l_ClientsConnected--;
+	}
+}
+
+/**
+ * Wakes up the event loop so it can take another look at the connection.
+ * Called by the query threads.
+ */
+void LivestatusListener::NotifyConnection(const LivestatusConnection::Ptr& connection)
+{
+	{
+		boost::mutex::scoped_lock lock(m_NotifyMutex);
+		m_Notified.push_back(connection);
+	}
+
+	(void)write(m_EventFDs[1], "T", 1);
+}
+
+/**
+ * Parks a query which has to wait for a change until one of its triggers
+ * fires, it times out or its client goes away. Waiting queries don't
+ * occupy a query thread.
+ */
+void LivestatusListener::AddWaitingQuery(const LivestatusConnection::Ptr& connection, const Query::Ptr& query)
+{
+	QueryInfo info;
+	info.Connection = connection;
+	info.WaitingQuery = query;
+
+	boost::mutex::scoped_lock lock(m_QueryMutex);
+
+	/* A trigger might have fired after the query checked its condition. */
+	if (query->IsWaitOver(Utility::GetTime())) {
+		m_Queries.push_back(info);
+		m_QueryCV.notify_one();
+		return;
+	}
+
+	m_WaitingQueries.push_back(info);
+
+	/* Let the event loop know about the query's deadline. */
+	(void)write(m_EventFDs[1], "T", 1);
+}
+
+/**
+ * Hands waiting queries whose wait is over back to the query threads.
+ * Called whenever a trigger fires and by the event loop.
+ *
+ * @returns the earliest deadline of the queries which are still waiting
+ *          or 0 if none of them has a deadline.
+ */
+double LivestatusListener::ResumeWaitingQueries(void)
+{
+	double now = Utility::GetTime();
+	double deadline = 0;
+
+	boost::mutex::scoped_lock lock(m_QueryMutex);
+
+	if (m_WaitingQueries.empty())
+		return 0;
+
+	std::vector<QueryInfo> waiting;
+
+	BOOST_FOREACH(const QueryInfo& info, m_WaitingQueries) {
+		if (info.Connection->IsEof() || info.WaitingQuery->IsWaitOver(now)) {
+			m_Queries.push_back(info);
+			m_QueryCV.notify_one();
+			continue;
+		}
+
+		double queryDeadline = info.WaitingQuery->GetWaitDeadline();
+
+		if (queryDeadline != 0 && (deadline == 0 || queryDeadline < deadline))
+			deadline = queryDeadline;
+
+		waiting.push_back(info);
+	}
+
+	m_WaitingQueries.swap(waiting);
+
+	return deadline;
+}
+
+/**
+ * Executes queries. Each connection only ever has one request in the
+ * queue or waiting for a change, so the length of the queues is bounded
+ * by max_connections.
+ */
+void LivestatusListener::QueryThreadProc(void)
+{
+	Utility::SetThreadName("LivestatusQuery");
+
+	for (;;) {
+		LivestatusConnection::Ptr connection;
+		std::vector<String> lines;
+		Query::Ptr query;
+
+		{
+			boost::mutex::scoped_lock lock(m_QueryMutex);
+
+			while (m_Queries.empty())
+				m_QueryCV.wait(lock);
+
+			connection = m_Queries.front().Connection;
+			lines.swap(m_Queries.front().Lines);
+			query = m_Queries.front().WaitingQuery;
+			m_Queries.pop_front();
+		}
+
+		bool keepAlive = false;
+
+		try {
+			if (!query)
+				query = make_shared<Query>(lines, GetCompatLogPath());
+
+			/* Nobody is going to read the result if the client has
+			 * gone away while the query was waiting. */
+			if (!connection->IsEof()) {
+				if (query->NeedsWait()) {
+					AddWaitingQuery(connection, query);
+					continue;
+				}
+
+				keepAlive = query->Execute(connection);
+				ProfileQuery(query);
+			}
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "livestatus", "Error while processing livestatus query: " + DiagnosticInformation(ex));
+		}
+
+		connection->EndRequest(keepAlive);
+	}
+}
+#else /* _WIN32 */
 void LivestatusListener::ServerThreadProc(const Socket::Ptr& server)
 {
 	server->Listen();
@@ -156,7 +720,14 @@ void LivestatusListener::ClientHandler(const Socket::Ptr& client)
 			break;
 
 		Query::Ptr query = make_shared<Query>(lines, GetCompatLogPath());
-		if (!query->Execute(stream))
+
+		if (!query->WaitForChange(stream))
+			break;
+
+		bool keepAlive = query->Execute(stream);
+		ProfileQuery(query);
+
+		if (!keepAlive)
 			break;
 	}
 
@@ -165,7 +736,7 @@ void LivestatusListener::ClientHandler(const Socket::Ptr& client)
 		l_ClientsConnected--;
 	}
 }
-
+#endif /* _WIN32 */
 
 void LivestatusListener::ValidateSocketType(const String& location, const Dictionary::Ptr& attrs)
 {
@@ -22,8 +22,13 @@
 
 #include "livestatus/listener.th"
 #include "livestatus/query.h"
+#include "livestatus/connection.h"
 #include "base/socket.h"
 #include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+#include <map>
 
 using namespace icinga;
 
@@ -43,6 +48,7 @@ public:
 
 	static int GetClientsConnected(void);
 	static int GetConnections(void);
+	static int GetSlowQueries(void);
 
 	static void ValidateSocketType(const String& location, const Dictionary::Ptr& attrs);
 
@@ -50,8 +56,52 @@ protected:
 	virtual void Start(void);
 
 private:
+#ifndef _WIN32
+	struct ClientInfo
+	{
+		LivestatusConnection::Ptr Connection;
+		int Events;
+	};
+
+	int m_EventFDs[2];
+#	ifdef HAVE_EPOLL
+	int m_EpollFD;
+#	endif /* HAVE_EPOLL */
+	std::map<int, ClientInfo> m_Clients;
+
+	boost::mutex m_NotifyMutex;
+	std::vector<LivestatusConnection::Ptr> m_Notified;
+
+	struct QueryInfo
+	{
+		LivestatusConnection::Ptr Connection;
+		std::vector<String> Lines;
+		Query::Ptr WaitingQuery;
+	};
+
+	boost::mutex m_QueryMutex;
+	boost::condition_variable m_QueryCV;
+	std::deque<QueryInfo> m_Queries;
+	std::vector<QueryInfo> m_WaitingQueries;
+
+	void EventThreadProc(const Socket::Ptr& server);
+	void QueryThreadProc(void);
+
+	void InitializeEvents(void);
+	void SetEvents(int fd, int oldEvents, int newEvents);
+	void AcceptClient(const Socket::Ptr& server);
+	void UpdateClient(int fd);
+	bool IsHungUp(int fd);
+	void CloseClient(int fd);
+	void NotifyConnection(const LivestatusConnection::Ptr& connection);
+	void AddWaitingQuery(const LivestatusConnection::Ptr& connection, const Query::Ptr& query);
+	double ResumeWaitingQueries(void);
+#else /* _WIN32 */
 	void ServerThreadProc(const Socket::Ptr& server);
 	void ClientHandler(const Socket::Ptr& client);
+#endif /* _WIN32 */
+
+	void ProfileQuery(const Query::Ptr& query);
 };
 
 }
@@ -0,0 +1,353 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "livestatus/logindex.h"
+#include "livestatus/logutility.h"
+#include "livestatus/mappedfile.h"
+#include "base/logger_fwd.h"
+#include "base/convert.h"
+#include "base/exception.h"
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <iterator>
+#include <fstream>
+
+using namespace icinga;
+
+#define LOGINDEXMAGIC "I2LI"
+#define LOGINDEXVERSION 2
+#define LOGINDEXSIGNATURESIZE 32
+#define LOGINDEXHEADERSIZE (4 + 4 + 4 + LOGINDEXSIGNATURESIZE)
+#define LOGINDEXBUCKETSIZE 3600
+#define LOGINDEXCACHESIZE 32
+
+static boost::mutex l_LogIndexMutex;
+static std::map<String, std::pair<LogIndex::Ptr, unsigned long> > l_LogIndexes;
+static unsigned long l_LogIndexUseCount = 0;
+
+LogIndex::LogIndex(const String& path)
+	: m_Path(path), m_IndexedSize(0), m_Persistent(true)
+{ }
+
+/**
+ * Returns an up-to-date index for the specified log file. Indexes are
+ * cached for the most recently used log files.
+ */
+LogIndex::Ptr LogIndex::GetByPath(const String& path)
+{
+	LogIndex::Ptr index;
+
+	{
+		boost::mutex::scoped_lock lock(l_LogIndexMutex);
+
+		std::map<String, std::pair<LogIndex::Ptr, unsigned long> >::iterator it = l_LogIndexes.find(path);
+
+		if (it != l_LogIndexes.end()) {
+			index = it->second.first;
+			it->second.second = ++l_LogIndexUseCount;
+		} else {
+			if (l_LogIndexes.size() >= LOGINDEXCACHESIZE) {
+				std::map<String, std::pair<LogIndex::Ptr, unsigned long> >::iterator lru = l_LogIndexes.begin();
+
+				for (it = l_LogIndexes.begin(); it != l_LogIndexes.end(); it++) {
+					if (it->second.second < lru->second.second)
+						lru = it;
+				}
+
+				l_LogIndexes.erase(lru);
+			}
+
+			index = make_shared<LogIndex>(path);
+			l_LogIndexes[path] = std::make_pair(index, ++l_LogIndexUseCount);
+		}
+	}
+
+	index->Update();
+
+	return index;
+}
+
+String LogIndex::GetIndexPath(const String& path)
+{
+	return path + ".idx";
+}
+
+/**
+ * Indexes the lines which were appended to the log file since the
+ * last update.
+ */
+void LogIndex::Update(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	MappedFile file(m_Path);
+
+	const char *data = file.GetData();
+	boost::uint64_t fileSize = file.GetSize();
+
+	std::string signature;
+
+	if (fileSize > 0)
+		signature.assign(data, std::min(fileSize, static_cast<boost::uint64_t>(LOGINDEXSIGNATURESIZE)));
+
+	/* The signature changes when the log file is replaced, e.g. when
+	 * the CompatLogger starts a new icinga.log after rotating the old one. */
+	if (m_Signature.empty() && m_Records.empty()) {
+		if (!Load(signature, fileSize))
+			Reset(signature);
+	} else if (signature != m_Signature || m_IndexedSize > fileSize)
+		Reset(signature);
+
+	if (m_IndexedSize >= fileSize)
+		return;
+
+	std::vector<Record> records;
+	boost::uint64_t offset = m_IndexedSize;
+
+	for (;;) {
+		const char *line = data + offset;
+
+		/* memchr() is vectorized by the C library. Partial lines aren't
+		 * indexed, the rest of the line is picked up by the next update. */
+		const char *eol = static_cast<const char *>(memchr(line, '\n', fileSize - offset));
+
+		if (!eol)
+			break;
+
+		size_t length = eol - line;
+		boost::uint64_t lineOffset = offset;
+		offset += length + 1;
+
+		LogLineInfo info;
+
+		/* Ignore empty and invalid lines */
+		if (length == 0 || !LogUtility::ParseLine(line, length, info))
+			continue;
+
+		Record record;
+		record.Offset = lineOffset;
+		record.Length = length;
+		record.Time = info.Time;
+		record.HostHash = Hash(info.HostName, info.HostNameLength);
+		record.ServiceHash = Hash(info.ServiceDescription, info.ServiceDescriptionLength);
+		record.TypeHash = Hash(info.Type, info.TypeLength);
+
+		AddRecord(record);
+		records.push_back(record);
+	}
+
+	m_IndexedSize = offset;
+
+	if (!m_Persistent || records.empty())
+		return;
+
+	std::ofstream ofp;
+	ofp.open(GetIndexPath(m_Path).CStr(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+	ofp.write(reinterpret_cast<const char *>(&records[0]), records.size() * sizeof(Record));
+
+	if (!ofp.good()) {
+		Log(LogWarning, "livestatus", "Could not write log index '" + GetIndexPath(m_Path) + "'. Keeping it in memory only.");
+		m_Persistent = false;
+	}
+}
+
+/**
+ * Loads the index file for the log file.
+ *
+ * @returns false if there's no usable index file.
+ */
+bool LogIndex::Load(const std::string& signature, boost::uint64_t fileSize)
+{
+	String indexPath = GetIndexPath(m_Path);
+
+	std::ifstream fp;
+	fp.open(indexPath.CStr(), std::ifstream::in | std::ifstream::binary);
+
+	if (!fp)
+		return false;
+
+	fp.seekg(0, std::ifstream::end);
+	boost::uint64_t indexSize = fp.tellg();
+	fp.seekg(0, std::ifstream::beg);
+
+	if (indexSize < LOGINDEXHEADERSIZE || (indexSize - LOGINDEXHEADERSIZE) % sizeof(Record) != 0)
+		return false;
+
+	char header[LOGINDEXHEADERSIZE];
+	fp.read(header, sizeof(header));
+
+	boost::uint32_t version, signatureLength;
+	memcpy(&version, header + 4, sizeof(version));
+	memcpy(&signatureLength, header + 8, sizeof(signatureLength));
+
+	if (memcmp(header, LOGINDEXMAGIC, 4) != 0 || version != LOGINDEXVERSION ||
+	    std::string(header + 12, std::min(signatureLength, static_cast<boost::uint32_t>(LOGINDEXSIGNATURESIZE))) != signature)
+		return false;
+
+	std::vector<Record> records((indexSize - LOGINDEXHEADERSIZE) / sizeof(Record));
+
+	if (!records.empty())
+		fp.read(reinterpret_cast<char *>(&records[0]), records.size() * sizeof(Record));
+
+	if (!fp.good())
+		return false;
+
+	if (!records.empty() && records.back().Offset + records.back().Length >= fileSize)
+		return false;
+
+	m_Signature = signature;
+
+	BOOST_FOREACH(const Record& record, records) {
+		AddRecord(record);
+	}
+
+	if (!records.empty())
+		m_IndexedSize = records.back().Offset + records.back().Length + 1;
+
+	Log(LogDebug, "livestatus", "Loaded log index '" + indexPath + "' with " +
+	    Convert::ToString(static_cast<long>(records.size())) + " entries.");
+
+	return true;
+}
+
+/**
+ * Discards the index and starts a new index file.
+ */
+void LogIndex::Reset(const std::string& signature)
+{
+	m_Records.clear();
+	m_TimeBuckets.clear();
+	m_HostPostings.clear();
+	m_ServicePostings.clear();
+	m_TypePostings.clear();
+	m_IndexedSize = 0;
+	m_Signature = signature;
+
+	char header[LOGINDEXHEADERSIZE];
+	memset(header, 0, sizeof(header));
+
+	boost::uint32_t version = LOGINDEXVERSION;
+	boost::uint32_t signatureLength = signature.size();
+
+	memcpy(header, LOGINDEXMAGIC, 4);
+	memcpy(header + 4, &version, sizeof(version));
+	memcpy(header + 8, &signatureLength, sizeof(signatureLength));
+	memcpy(header + 12, signature.c_str(), signature.size());
+
+	std::ofstream fp;
+	fp.open(GetIndexPath(m_Path).CStr(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+	fp.write(header, sizeof(header));
+
+	m_Persistent = fp.good();
+
+	if (!m_Persistent)
+		Log(LogWarning, "livestatus", "Could not write log index '" + GetIndexPath(m_Path) + "'. Keeping it in memory only.");
+}
+
+void LogIndex::AddRecord(const Record& record)
+{
+	boost::uint32_t id = m_Records.size();
+
+	m_Records.push_back(record);
+	m_TimeBuckets[record.Time / LOGINDEXBUCKETSIZE].push_back(id);
+	m_HostPostings[record.HostHash].push_back(id);
+	m_ServicePostings[record.ServiceHash].push_back(id);
+	m_TypePostings[record.TypeHash].push_back(id);
+}
+
+/**
+ * Finds the log lines within the specified time range. Empty host names,
+ * service descriptions and types match any line. Hash collisions can
+ * produce false positives, so callers still have to apply their filters.
+ */
+void LogIndex::Search(time_t from, time_t until, const String& hostName,
+    const String& serviceDescription, const String& type,
+    std::vector<LogIndexEntry>& entries) const
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	std::vector<boost::uint32_t> candidates;
+
+	std::map<boost::int64_t, std::vector<boost::uint32_t> >::const_iterator it;
+	for (it = m_TimeBuckets.lower_bound(from / LOGINDEXBUCKETSIZE);
+	    it != m_TimeBuckets.end() && it->first <= until / LOGINDEXBUCKETSIZE; it++)
+		candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+
+	/* Buckets are only out of order when the clock was turned back. */
+	std::sort(candidates.begin(), candidates.end());
+
+	if (!hostName.IsEmpty())
+		Intersect(candidates, m_HostPostings, hostName);
+
+	if (!serviceDescription.IsEmpty())
+		Intersect(candidates, m_ServicePostings, serviceDescription);
+
+	if (!type.IsEmpty())
+		Intersect(candidates, m_TypePostings, type);
+
+	BOOST_FOREACH(boost::uint32_t id, candidates) {
+		const Record& record = m_Records[id];
+
+		if (record.Time < from || record.Time > until)
+			continue;
+
+		LogIndexEntry entry;
+		entry.LineNumber = id;
+		entry.Offset = record.Offset;
+		entry.Length = record.Length;
+		entries.push_back(entry);
+	}
+}
+
+void LogIndex::Intersect(std::vector<boost::uint32_t>& candidates, const PostingMap& postings, const String& key)
+{
+	PostingMap::const_iterator it = postings.find(Hash(key));
+
+	if (it == postings.end()) {
+		candidates.clear();
+		return;
+	}
+
+	std::vector<boost::uint32_t> result;
+	std::set_intersection(candidates.begin(), candidates.end(),
+	    it->second.begin(), it->second.end(), std::back_inserter(result));
+
+	candidates.swap(result);
+}
+
+/**
+ * FNV-1a, the hashes are persisted and therefore must not depend on
+ * the platform or the Boost version.
+ */
+boost::uint32_t LogIndex::Hash(const char *value, size_t length)
+{
+	boost::uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= static_cast<unsigned char>(value[i]);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+boost::uint32_t LogIndex::Hash(const String& value)
+{
+	return Hash(value.CStr(), value.GetLength());
+}
@@ -0,0 +1,112 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include "base/object.h"
+#include "base/qstring.h"
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <vector>
+
+using namespace icinga;
+
+namespace icinga
+{
+
+/**
+ * A log line which was found in a log index.
+ *
+ * @ingroup livestatus
+ */
+struct LogIndexEntry
+{
+	int LineNumber;
+	boost::uint64_t Offset;
+	boost::uint32_t Length;
+};
+
+/**
+ * An index for a compat log file.
+ *
+ * The index is stored in a binary file next to the log file ("<log>.idx")
+ * which contains one fixed-size record per log line. New lines are only
+ * ever appended to the index, so keeping it up to date for the log file
+ * the CompatLogger is currently writing to just means indexing the lines
+ * which were added since the last query. The time buckets and the
+ * host/service/type postings are built from the records when the index
+ * is loaded.
+ *
+ * @ingroup livestatus
+ */
+class LogIndex : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(LogIndex);
+
+	static LogIndex::Ptr GetByPath(const String& path);
+	static String GetIndexPath(const String& path);
+
+	void Search(time_t from, time_t until, const String& hostName,
+	    const String& serviceDescription, const String& type,
+	    std::vector<LogIndexEntry>& entries) const;
+
+	explicit LogIndex(const String& path);
+
+private:
+	struct Record
+	{
+		boost::uint64_t Offset;
+		boost::uint32_t Length;
+		boost::uint32_t HostHash;
+		boost::int64_t Time;
+		boost::uint32_t ServiceHash;
+		boost::uint32_t TypeHash;
+	};
+
+	typedef boost::unordered_map<boost::uint32_t, std::vector<boost::uint32_t> > PostingMap;
+
+	String m_Path;
+
+	mutable boost::mutex m_Mutex;
+	std::vector<Record> m_Records;
+	std::map<boost::int64_t, std::vector<boost::uint32_t> > m_TimeBuckets;
+	PostingMap m_HostPostings;
+	PostingMap m_ServicePostings;
+	PostingMap m_TypePostings;
+	boost::uint64_t m_IndexedSize;
+	std::string m_Signature;
+	bool m_Persistent;
+
+	void Update(void);
+	bool Load(const std::string& signature, boost::uint64_t fileSize);
+	void Reset(const std::string& signature);
+	void AddRecord(const Record& record);
+
+	static boost::uint32_t Hash(const char *value, size_t length);
+	static boost::uint32_t Hash(const String& value);
+	static void Intersect(std::vector<boost::uint32_t>& candidates, const PostingMap& postings, const String& key);
+};
+
+}
+
+#endif /* LOGINDEX_H */
@@ -53,8 +53,6 @@ LogTable::LogTable(const String& compat_log_path, time_t from, time_t until)
 	m_TimeFrom = from;
 	m_TimeUntil = until;
 	m_CompatLogPath = compat_log_path;
-
-	AddColumns(this);
 }
 
 
@@ -97,7 +95,8 @@ void LogTable::FetchRows(const AddRowFunction& addRowFn)
 	LogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
 
 	/* generate log cache */
-	LogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
+	LogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil,
+	    m_IndexHostName, m_IndexServiceDescription, m_IndexType, addRowFn);
 }
 
 /* gets called in LogUtility::CreateLogCache */
@@ -18,6 +18,8 @@
  ******************************************************************************/
 
 #include "livestatus/logutility.h"
+#include "livestatus/logindex.h"
+#include "livestatus/mappedfile.h"
 #include "icinga/service.h"
 #include "icinga/host.h"
 #include "icinga/user.h"
@@ -35,6 +37,7 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <fstream>
+#include <algorithm>
 
 using namespace icinga;
 
@@ -73,32 +76,43 @@ void LogUtility::CreateLogIndexFileHandler(const String& path, std::map<time_t,
 	index[ts_start] = path;
 }
 
-void LogUtility::CreateLogCache(std::map<time_t, String> index, HistoryTable *table,
-    time_t from, time_t until, const AddRowFunction& addRowFn)
+void LogUtility::CreateLogCache(const std::map<time_t, String>& index, HistoryTable *table,
+    time_t from, time_t until, const String& hostName, const String& serviceDescription,
+    const String& type, const AddRowFunction& addRowFn)
 {
 	ASSERT(table);
 
-	/* m_LogFileIndex map tells which log files are involved ordered by their start timestamp */
-	unsigned int ts;
+	/* the index map tells which log files are involved ordered by their start timestamp */
 	unsigned long line_count = 0;
-	BOOST_FOREACH(boost::tie(ts, boost::tuples::ignore), index) {
-		/* skip log files not in range (performance optimization) */
-		if (ts < from || ts > until)
+
+	for (std::map<time_t, String>::const_iterator it = index.begin(); it != index.end(); it++) {
+		std::map<time_t, String>::const_iterator next = it;
+		next++;
+
+		/* skip log files not in range (performance optimization), a log
+		 * file ends where the next one starts */
+		if (it->first > until || (next != index.end() && next->first < from))
 			continue;
 
-		String log_file = index[ts];
-		int lineno = 0;
+		const String& log_file = it->second;
+
+		LogIndex::Ptr log_index = LogIndex::GetByPath(log_file);
+
+		std::vector<LogIndexEntry> entries;
+		log_index->Search(from, until, hostName, serviceDescription, type, entries);
+
+		if (entries.empty())
+			continue;
 
-		std::ifstream fp;
-		fp.exceptions(std::ifstream::badbit);
-		fp.open(log_file.CStr(), std::ifstream::in);
+		/* only the lines the index returned are copied out of the file */
+		MappedFile file(log_file);
 
-		while (fp.good()) {
-			std::string line;
-			std::getline(fp, line);
+		BOOST_FOREACH(const LogIndexEntry& entry, entries) {
+			if (entry.Offset + entry.Length > file.GetSize())
+				break;
 
-			if (line.empty())
-				continue; /* Ignore empty lines */
+			const char *data = file.GetData() + entry.Offset;
+			String line(data, data + entry.Length);
 
 			Dictionary::Ptr log_entry_attrs = LogUtility::GetAttributes(line);
 
@@ -108,13 +122,10 @@ void LogUtility::CreateLogCache(std::map<time_t, String> index, HistoryTable *ta
 				continue;
 			}
 
-			table->UpdateLogEntries(log_entry_attrs, line_count, lineno, addRowFn);
+			table->UpdateLogEntries(log_entry_attrs, line_count, entry.LineNumber, addRowFn);
 
 			line_count++;
-			lineno++;
 		}
-
-		fp.close();
 	}
 }
 
@@ -341,3 +352,156 @@ Dictionary::Ptr LogUtility::GetAttributes(const String& text)
 
         return bag;
 }
+
+static bool SpanContains(const char *text, size_t length, const char *needle)
+{
+	return std::search(text, text + length, needle, needle + strlen(needle)) != text + length;
+}
+
+static void TrimSpan(const char *& text, size_t& length)
+{
+	while (length > 0 && isspace(static_cast<unsigned char>(text[0]))) {
+		text++;
+		length--;
+	}
+
+	while (length > 0 && isspace(static_cast<unsigned char>(text[length - 1])))
+		length--;
+}
+
+/**
+ * Extracts the time, type, host name and service description from a log
+ * line without copying anything. The results have to match the attributes
+ * GetAttributes returns for the same line.
+ *
+ * @returns false if the line is not a valid log line.
+ */
+bool LogUtility::ParseLine(const char *text, size_t length, LogLineInfo& info)
+{
+	/* [1379025342] SERVICE NOTIFICATION: contactname;hostname;servicedesc;WARNING;true;foo output */
+	if (length < 13)
+		return false;
+
+	/* same as atoi() on the 11 characters following the '[' */
+	const char *ts = text + 1;
+	const char *ts_end = text + std::min(length, static_cast<size_t>(12));
+	bool negative = false;
+	int time = 0;
+
+	while (ts < ts_end && isspace(static_cast<unsigned char>(*ts)))
+		ts++;
+
+	if (ts < ts_end && (*ts == '-' || *ts == '+')) {
+		negative = (*ts == '-');
+		ts++;
+	}
+
+	while (ts < ts_end && *ts >= '0' && *ts <= '9') {
+		time = time * 10 + (*ts - '0');
+		ts++;
+	}
+
+	info.Time = static_cast<unsigned long>(negative ? -time : time);
+
+	const char *colon = static_cast<const char *>(memchr(text, ':', length));
+
+	info.Type = text + 13;
+
+	if (colon && colon - text >= 13)
+		info.TypeLength = colon - info.Type;
+	else
+		info.TypeLength = length - 13;
+
+	const char *options = colon ? colon + 1 : text;
+	size_t options_length = text + length - options;
+
+	TrimSpan(info.Type, info.TypeLength);
+	TrimSpan(options, options_length);
+
+	/* split the options, we need the first three tokens and the token count */
+	const char *tokens[3];
+	size_t token_lengths[3];
+	size_t token_count = 0;
+	const char *token = options;
+	const char *options_end = options + options_length;
+
+	for (;;) {
+		const char *sep = static_cast<const char *>(memchr(token, ';', options_end - token));
+		const char *token_end = sep ? sep : options_end;
+
+		if (token_count < 3) {
+			tokens[token_count] = token;
+			token_lengths[token_count] = token_end - token;
+		}
+
+		token_count++;
+
+		if (!sep || token_count >= 7)
+			break;
+
+		token = sep + 1;
+	}
+
+	info.HostName = NULL;
+	info.HostNameLength = 0;
+	info.ServiceDescription = NULL;
+	info.ServiceDescriptionLength = 0;
+
+	int host_token = -1, service_token = -1;
+	size_t min_tokens = 0;
+
+	const char *type = info.Type;
+	size_t type_length = info.TypeLength;
+
+	if (SpanContains(type, type_length, "INITIAL HOST STATE") ||
+	    SpanContains(type, type_length, "CURRENT HOST STATE") ||
+	    SpanContains(type, type_length, "HOST ALERT")) {
+		host_token = 0;
+		min_tokens = 5;
+	} else if (SpanContains(type, type_length, "HOST DOWNTIME ALERT") ||
+	    SpanContains(type, type_length, "HOST FLAPPING ALERT")) {
+		host_token = 0;
+		min_tokens = 3;
+	} else if (SpanContains(type, type_length, "INITIAL SERVICE STATE") ||
+	    SpanContains(type, type_length, "CURRENT SERVICE STATE") ||
+	    SpanContains(type, type_length, "SERVICE ALERT")) {
+		host_token = 0;
+		service_token = 1;
+		min_tokens = 6;
+	} else if (SpanContains(type, type_length, "SERVICE DOWNTIME ALERT") ||
+	    SpanContains(type, type_length, "SERVICE FLAPPING ALERT") ||
+	    SpanContains(type, type_length, "TIMEPERIOD TRANSITION")) {
+		host_token = 0;
+		service_token = 1;
+		min_tokens = 4;
+	} else if (SpanContains(type, type_length, "HOST NOTIFICATION")) {
+		host_token = 1;
+		min_tokens = 6;
+	} else if (SpanContains(type, type_length, "SERVICE NOTIFICATION")) {
+		host_token = 1;
+		service_token = 2;
+		min_tokens = 7;
+	} else if (SpanContains(type, type_length, "PASSIVE HOST CHECK")) {
+		host_token = 0;
+		min_tokens = 3;
+	} else if (SpanContains(type, type_length, "PASSIVE SERVICE CHECK")) {
+		host_token = 0;
+		service_token = 1;
+		min_tokens = 4;
+	}
+
+	if (token_count < min_tokens)
+		return true;
+
+	if (host_token != -1) {
+		info.HostName = tokens[host_token];
+		info.HostNameLength = token_lengths[host_token];
+	}
+
+	if (service_token != -1) {
+		info.ServiceDescription = tokens[service_token];
+		info.ServiceDescriptionLength = token_lengths[service_token];
+	}
+
+	return true;
+}
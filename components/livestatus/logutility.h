@@ -57,6 +57,23 @@ enum LogEntryClass {
     LogEntryClassText = 7
 };
 
+/**
+ * The fields of a log line which are needed for indexing. The pointers
+ * refer to the log line itself.
+ *
+ * @ingroup livestatus
+ */
+struct LogLineInfo
+{
+	time_t Time;
+	const char *Type;
+	size_t TypeLength;
+	const char *HostName;
+	size_t HostNameLength;
+	const char *ServiceDescription;
+	size_t ServiceDescriptionLength;
+};
+
 /**
  * @ingroup livestatus
  */
@@ -66,8 +83,10 @@ class LogUtility
 public:
 	static void CreateLogIndex(const String& path, std::map<time_t, String>& index);
 	static void CreateLogIndexFileHandler(const String& path, std::map<time_t, String>& index);
-	static void CreateLogCache(std::map<time_t, String> index, HistoryTable *table, time_t from, time_t until, const AddRowFunction& addRowFn);
+	static void CreateLogCache(const std::map<time_t, String>& index, HistoryTable *table, time_t from, time_t until,
+	    const String& hostName, const String& serviceDescription, const String& type, const AddRowFunction& addRowFn);
 	static Dictionary::Ptr GetAttributes(const String& text);
+	static bool ParseLine(const char *text, size_t length, LogLineInfo& info);
 
 private:
 	LogUtility(void);
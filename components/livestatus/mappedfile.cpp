@@ -0,0 +1,120 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "livestatus/mappedfile.h"
+#include "base/exception.h"
+#include <fstream>
+#ifndef _WIN32
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+MappedFile::MappedFile(const String& path)
+	: m_Data(NULL), m_Size(0)
+{
+#ifndef _WIN32
+	m_Mapping = MAP_FAILED;
+
+	int fd = open(path.CStr(), O_RDONLY);
+
+	if (fd < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("open")
+		    << boost::errinfo_errno(errno)
+		    << boost::errinfo_file_name(path));
+	}
+
+	struct stat statbuf;
+
+	if (fstat(fd, &statbuf) < 0) {
+		int error = errno;
+		(void)close(fd);
+
+		BOOST_THROW_EXCEPTION(posix_error()
+		    << boost::errinfo_api_function("fstat")
+		    << boost::errinfo_errno(error)
+		    << boost::errinfo_file_name(path));
+	}
+
+	m_Size = statbuf.st_size;
+
+	/* mmap() doesn't support empty mappings */
+	if (m_Size > 0) {
+		m_Mapping = mmap(NULL, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (m_Mapping == MAP_FAILED) {
+			int error = errno;
+			(void)close(fd);
+
+			BOOST_THROW_EXCEPTION(posix_error()
+			    << boost::errinfo_api_function("mmap")
+			    << boost::errinfo_errno(error)
+			    << boost::errinfo_file_name(path));
+		}
+
+		/* log files are read front to back */
+		(void)madvise(m_Mapping, m_Size, MADV_SEQUENTIAL);
+
+		m_Data = static_cast<const char *>(m_Mapping);
+	}
+
+	(void)close(fd);
+#else /* _WIN32 */
+	std::ifstream fp;
+	fp.open(path.CStr(), std::ifstream::in | std::ifstream::binary);
+
+	if (!fp)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open file: " + path));
+
+	fp.seekg(0, std::ifstream::end);
+	m_Buffer.resize(fp.tellg());
+	fp.seekg(0, std::ifstream::beg);
+
+	if (!m_Buffer.empty()) {
+		fp.read(&m_Buffer[0], m_Buffer.size());
+		m_Buffer.resize(fp.gcount());
+	}
+
+	m_Size = m_Buffer.size();
+
+	if (m_Size > 0)
+		m_Data = &m_Buffer[0];
+#endif /* _WIN32 */
+}
+
+MappedFile::~MappedFile(void)
+{
+#ifndef _WIN32
+	if (m_Mapping != MAP_FAILED)
+		(void)munmap(m_Mapping, m_Size);
+#endif /* _WIN32 */
+}
+
+const char *MappedFile::GetData(void) const
+{
+	return m_Data;
+}
+
+size_t MappedFile::GetSize(void) const
+{
+	return m_Size;
+}
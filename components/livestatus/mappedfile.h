@@ -0,0 +1,60 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "base/qstring.h"
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+using namespace icinga;
+
+namespace icinga
+{
+
+/**
+ * Read-only view of a file's contents. The file is mapped into memory
+ * where that's supported and read into a buffer otherwise. Data which is
+ * appended to the file later on is not visible.
+ *
+ * @ingroup livestatus
+ */
+class MappedFile : private boost::noncopyable
+{
+public:
+	explicit MappedFile(const String& path);
+	~MappedFile(void);
+
+	const char *GetData(void) const;
+	size_t GetSize(void) const;
+
+private:
+	const char *m_Data;
+	size_t m_Size;
+#ifndef _WIN32
+	void *m_Mapping;
+#else /* _WIN32 */
+	std::vector<char> m_Buffer;
+#endif /* _WIN32 */
+};
+
+}
+
+#endif /* MAPPEDFILE_H */
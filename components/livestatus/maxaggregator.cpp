@@ -29,7 +29,7 @@ MaxAggregator::MaxAggregator(const String& attr)
 
 void MaxAggregator::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_MaxAttr);
+	const Column& column = table->GetColumn(m_MaxAttr);
 
 	Value value = column.ExtractValue(row);
 
@@ -41,3 +41,18 @@ double MaxAggregator::GetResult(void) const
 {
 	return m_Max;
 }
+
+Aggregator::Ptr MaxAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<MaxAggregator>(m_MaxAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void MaxAggregator::Merge(const Aggregator::Ptr& other)
+{
+	MaxAggregator::Ptr aggregator = static_pointer_cast<MaxAggregator>(other);
+
+	if (aggregator->m_Max > m_Max)
+		m_Max = aggregator->m_Max;
+}
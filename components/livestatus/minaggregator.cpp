@@ -29,7 +29,7 @@ MinAggregator::MinAggregator(const String& attr)
 
 void MinAggregator::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_MinAttr);
+	const Column& column = table->GetColumn(m_MinAttr);
 
 	Value value = column.ExtractValue(row);
 
@@ -41,3 +41,18 @@ double MinAggregator::GetResult(void) const
 {
 	return m_Min;
 }
+
+Aggregator::Ptr MinAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<MinAggregator>(m_MinAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void MinAggregator::Merge(const Aggregator::Ptr& other)
+{
+	MinAggregator::Ptr aggregator = static_pointer_cast<MinAggregator>(other);
+
+	if (aggregator->m_Min < m_Min)
+		m_Min = aggregator->m_Min;
+}
@@ -29,3 +29,23 @@ bool NegateFilter::Apply(const Table::Ptr& table, const Value& row)
 {
 	return !m_Inner->Apply(table, row);
 }
+
+double NegateFilter::GetCost(void) const
+{
+	return m_Inner->GetCost();
+}
+
+double NegateFilter::GetSelectivity(void) const
+{
+	return 1 - m_Inner->GetSelectivity();
+}
+
+void NegateFilter::Optimize(void)
+{
+	m_Inner->Optimize();
+}
+
+void NegateFilter::Bind(const Table::Ptr& table)
+{
+	m_Inner->Bind(table);
+}
@@ -39,6 +39,11 @@ public:
 
 	virtual bool Apply(const Table::Ptr& table, const Value& row);
 
+	virtual double GetCost(void) const;
+	virtual double GetSelectivity(void) const;
+	virtual void Optimize(void);
+	virtual void Bind(const Table::Ptr& table);
+
 private:
 	Filter::Ptr m_Inner;
 };
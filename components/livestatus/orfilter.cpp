@@ -37,3 +37,22 @@ bool OrFilter::Apply(const Table::Ptr& table, const Value& row)
 
 	return false;
 }
+
+double OrFilter::GetSelectivity(void) const
+{
+	if (m_Filters.empty())
+		return 1;
+
+	double mismatch = 1;
+
+	BOOST_FOREACH(const Filter::Ptr& filter, m_Filters) {
+		mismatch *= 1 - filter->GetSelectivity();
+	}
+
+	return 1 - mismatch;
+}
+
+void OrFilter::Optimize(void)
+{
+	OptimizeSubFilters(false);
+}
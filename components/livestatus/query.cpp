@@ -30,7 +30,14 @@
 #include "livestatus/negatefilter.h"
 #include "livestatus/orfilter.h"
 #include "livestatus/andfilter.h"
+#include "livestatus/changedsincefilter.h"
+#include "livestatus/changetracker.h"
+#include "livestatus/historytable.h"
 #include "icinga/externalcommandprocessor.h"
+#include "icinga/service.h"
+#include "icinga/hostgroup.h"
+#include "icinga/servicegroup.h"
+#include "icinga/user.h"
 #include "base/debug.h"
 #include "base/convert.h"
 #include "base/objectlock.h"
@@ -41,15 +48,158 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/bind.hpp>
+#include <boost/unordered_map.hpp>
 
 using namespace icinga;
 
+#define OUTPUTCHUNKSIZE 65536
+#define SCANPARTITIONSIZE 1024
+#define QUERYHISTOGRAMSIZE 6
+#define WAITSLICE 1
+
 static int l_ExternalCommands = 0;
 static boost::mutex l_QueryMutex;
 
+/* Upper bounds (in seconds) for the execution time histogram buckets,
+ * the last bucket holds all queries which took longer than 10 seconds. */
+static const double l_QueryHistogramBounds[QUERYHISTOGRAMSIZE - 1] = { 0.001, 0.01, 0.1, 1, 10 };
+static int l_QueryHistogram[QUERYHISTOGRAMSIZE];
+static int l_Queries = 0;
+static QueryProfile l_QueryTotals;
+
+/**
+ * The column values and aggregators for one group of a stats query
+ * with columns (i.e. GROUP BY).
+ */
+struct ScanGroup
+{
+	std::vector<Value> Columns;
+	std::vector<Aggregator::Ptr> Aggregators;
+};
+
+/**
+ * A range of rows which is filtered and aggregated by a single thread.
+ */
+struct ScanPartition
+{
+	size_t Begin;
+	size_t End;
+	size_t Matched;
+	std::vector<Value> Matches;
+	std::vector<Aggregator::Ptr> Aggregators;
+	boost::unordered_map<String, ScanGroup> Groups;
+	std::vector<String> GroupOrder;
+	boost::exception_ptr Exception;
+};
+
+struct ScanBarrier
+{
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	int Pending;
+};
+
+static void ScanGroupRow(const Table::Ptr& table, const Value& row, const std::vector<int>& groupColumns,
+    ScanPartition& partition)
+{
+	std::vector<Value> values;
+	String key;
+
+	BOOST_FOREACH(int index, groupColumns) {
+		Value value = table->GetColumnByIndex(index).ExtractValue(row);
+
+		if (value.IsObjectType<Array>())
+			key += JsonSerialize(value);
+		else
+			key += static_cast<String>(value);
+
+		key += "\x1f";
+
+		values.push_back(value);
+	}
+
+	boost::unordered_map<String, ScanGroup>::iterator it = partition.Groups.find(key);
+
+	if (it == partition.Groups.end()) {
+		ScanGroup group;
+		group.Columns = values;
+
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, partition.Aggregators) {
+			group.Aggregators.push_back(aggregator->Clone());
+		}
+
+		it = partition.Groups.insert(std::make_pair(key, group)).first;
+		partition.GroupOrder.push_back(key);
+	}
+
+	BOOST_FOREACH(const Aggregator::Ptr& aggregator, it->second.Aggregators) {
+		aggregator->Apply(table, row);
+	}
+}
+
+static void ScanPartitionRows(const Table::Ptr& table, const std::vector<Value>& rows,
+    const Filter::Ptr& filter, const std::vector<int>& groupColumns, ScanPartition& partition)
+{
+	try {
+		for (size_t i = partition.Begin; i < partition.End; i++) {
+			const Value& row = rows[i];
+
+			if (!filter->Apply(table, row))
+				continue;
+
+			partition.Matched++;
+
+			if (partition.Aggregators.empty()) {
+				partition.Matches.push_back(row);
+				continue;
+			}
+
+			if (!groupColumns.empty()) {
+				ScanGroupRow(table, row, groupColumns, partition);
+				continue;
+			}
+
+			BOOST_FOREACH(const Aggregator::Ptr& aggregator, partition.Aggregators) {
+				aggregator->Apply(table, row);
+			}
+		}
+	} catch (const std::exception&) {
+		partition.Exception = boost::current_exception();
+	}
+}
+
+static void AsyncScanPartitionRows(const Table::Ptr& table, const std::vector<Value>& rows,
+    const Filter::Ptr& filter, const std::vector<int>& groupColumns, ScanPartition& partition,
+    ScanBarrier *barrier)
+{
+	ScanPartitionRows(table, rows, filter, groupColumns, partition);
+
+	boost::mutex::scoped_lock lock(barrier->Mutex);
+	barrier->Pending--;
+	barrier->CV.notify_all();
+}
+
+QueryProfile::QueryProfile(void)
+	: ParseTime(0), WaitTime(0), FilterTime(0), SerializeTime(0), ExecutionTime(0),
+	  RowsScanned(0), RowsMatched(0), BytesSent(0)
+{ }
+
 Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 	: m_KeepAlive(false), m_OutputFormat("csv"), m_ColumnHeaders(true),
-	  m_LogTimeFrom(0), m_LogTimeUntil(static_cast<long>(Utility::GetTime()))
+	  m_WaitTrigger(0), m_WaitTimeout(0), m_WaitTriggers(0), m_WaitSequence(0),
+	  m_WaitStart(0), m_WaitDeadline(0), m_LogTimeFrom(0), m_LogTimeUntil(static_cast<long>(Utility::GetTime()))
+{
+	double start = Utility::GetTime();
+
+	Parse(lines, compat_log_path);
+
+	m_Profile.ParseTime = Utility::GetTime() - start;
+}
+
+void Query::Parse(const std::vector<String>& lines, const String& compat_log_path)
 {
 	if (lines.size() == 0) {
 		m_Verb = "ERROR";
@@ -64,6 +214,8 @@ Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 	}
 	Log(LogDebug, "livestatus", msg);
 
+	m_Profile.Request = msg;
+
 	m_CompatLogPath = compat_log_path;
 
 	/* default separators */
@@ -96,8 +248,10 @@ Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 		return;
 	}
 
-	std::deque<Filter::Ptr> filters, stats;
+	std::deque<Filter::Ptr> filters, stats, waits;
 	std::deque<Aggregator::Ptr> aggregators;
+	bool changedSince = false;
+	unsigned long changedSinceSequence = 0;
 
 	for (unsigned int i = 1; i < lines.size(); i++) {
 		line = lines[i];
@@ -133,7 +287,7 @@ Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 				m_Separators[3] = String(1, static_cast<char>(Convert::ToLong(separators[3])));
 		} else if (header == "ColumnHeaders")
 			m_ColumnHeaders = (params == "on");
-		else if (header == "Filter") {
+		else if (header == "Filter" || header == "WaitCondition") {
 			Filter::Ptr filter = ParseFilter(params, m_LogTimeFrom, m_LogTimeUntil);
 
 			if (!filter) {
@@ -143,7 +297,26 @@ Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 				return;
 			}
 
-			filters.push_back(filter);
+			if (header == "Filter")
+				filters.push_back(filter);
+			else
+				waits.push_back(filter);
+		} else if (header == "WaitObject")
+			m_WaitObject = params;
+		else if (header == "WaitTrigger") {
+			m_WaitTrigger = ChangeTracker::ParseTrigger(params);
+
+			if (m_WaitTrigger == 0) {
+				m_Verb = "ERROR";
+				m_ErrorCode = LivestatusErrorQuery;
+				m_ErrorMessage = "Invalid wait trigger: " + params;
+				return;
+			}
+		} else if (header == "WaitTimeout")
+			m_WaitTimeout = Convert::ToLong(params);
+		else if (header == "ChangedSince") {
+			changedSince = true;
+			changedSinceSequence = Convert::ToLong(params);
 		} else if (header == "Stats") {
 			m_ColumnHeaders = false; // Might be explicitly re-enabled later on
 
@@ -194,13 +367,15 @@ Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 			aggregators.push_back(aggregator);
 
 			stats.push_back(filter);
-		} else if (header == "Or" || header == "And" || header == "StatsOr" || header == "StatsAnd") {
-			std::deque<Filter::Ptr>& deq = (header == "Or" || header == "And") ? filters : stats;
+		} else if (header == "Or" || header == "And" || header == "StatsOr" || header == "StatsAnd" ||
+		    header == "WaitConditionOr" || header == "WaitConditionAnd") {
+			std::deque<Filter::Ptr>& deq = (header == "Or" || header == "And") ? filters :
+			    (header == "StatsOr" || header == "StatsAnd") ? stats : waits;
 
 			unsigned int num = Convert::ToLong(params);
 			CombinerFilter::Ptr filter;
 
-			if (header == "Or" || header == "StatsOr") {
+			if (header == "Or" || header == "StatsOr" || header == "WaitConditionOr") {
 				filter = make_shared<OrFilter>();
 				Log(LogDebug, "livestatus", "Add OR filter for " + params + " column(s). " + Convert::ToString(deq.size()) + " filters available.");
 			} else {
@@ -229,8 +404,9 @@ Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 				aggregator->SetFilter(filter);
 				aggregators.push_back(aggregator);
 			}
-		} else if (header == "Negate" || header == "StatsNegate") {
-			std::deque<Filter::Ptr>& deq = (header == "Negate") ? filters : stats;
+		} else if (header == "Negate" || header == "StatsNegate" || header == "WaitConditionNegate") {
+			std::deque<Filter::Ptr>& deq = (header == "Negate") ? filters :
+			    (header == "StatsNegate") ? stats : waits;
 
 			if (deq.empty()) {
 				m_Verb = "ERROR";
@@ -251,7 +427,7 @@ Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 
 			deq.push_back(make_shared<NegateFilter>(filter));
 
-			if (deq == stats) {
+			if (&deq == &stats) {
 				Aggregator::Ptr aggregator = aggregators.back();
 				aggregator->SetFilter(filter);
 			}
@@ -263,6 +439,42 @@ Query::Query(const std::vector<String>& lines, const String& compat_log_path)
 
 	BOOST_FOREACH(const Filter::Ptr& filter, filters) {
 		top_filter->AddSubFilter(filter);
+
+		/* Equality filters on the top level narrow down the log lines
+		 * which the history tables have to read. */
+		AttributeFilter::Ptr afilter = dynamic_pointer_cast<AttributeFilter>(filter);
+
+		if (!afilter || afilter->GetOperator() != "=" || afilter->GetOperand().IsEmpty())
+			continue;
+
+		if (afilter->GetColumn() == "host_name")
+			m_LogHostName = afilter->GetOperand();
+		else if (afilter->GetColumn() == "service_description")
+			m_LogServiceDescription = afilter->GetOperand();
+		else if (afilter->GetColumn() == "type")
+			m_LogType = afilter->GetOperand();
+	}
+
+	if (changedSince)
+		top_filter->AddSubFilter(make_shared<ChangedSinceFilter>(changedSinceSequence));
+
+	top_filter->Optimize();
+
+	if (!waits.empty()) {
+		AndFilter::Ptr wait_filter = make_shared<AndFilter>();
+
+		BOOST_FOREACH(const Filter::Ptr& filter, waits) {
+			wait_filter->AddSubFilter(filter);
+		}
+
+		wait_filter->Optimize();
+
+		m_WaitCondition = wait_filter;
+	}
+
+	BOOST_FOREACH(const Filter::Ptr& filter, stats) {
+		if (filter)
+			filter->Optimize();
 	}
 
 	m_Filter = top_filter;
@@ -276,6 +488,69 @@ int Query::GetExternalCommands(void)
 	return l_ExternalCommands;
 }
 
+const QueryProfile& Query::GetProfile(void) const
+{
+	return m_Profile;
+}
+
+void Query::AddProfile(const QueryProfile& profile)
+{
+	/* Time spent waiting for changes isn't part of the execution time. */
+	double duration = profile.ParseTime + profile.ExecutionTime;
+
+	int bucket = 0;
+
+	while (bucket < QUERYHISTOGRAMSIZE - 1 && duration > l_QueryHistogramBounds[bucket])
+		bucket++;
+
+	boost::mutex::scoped_lock lock(l_QueryMutex);
+
+	l_Queries++;
+	l_QueryHistogram[bucket]++;
+
+	l_QueryTotals.ParseTime += profile.ParseTime;
+	l_QueryTotals.WaitTime += profile.WaitTime;
+	l_QueryTotals.FilterTime += profile.FilterTime;
+	l_QueryTotals.SerializeTime += profile.SerializeTime;
+	l_QueryTotals.ExecutionTime += profile.ExecutionTime;
+	l_QueryTotals.RowsScanned += profile.RowsScanned;
+	l_QueryTotals.RowsMatched += profile.RowsMatched;
+	l_QueryTotals.BytesSent += profile.BytesSent;
+}
+
+int Query::GetQueries(void)
+{
+	boost::mutex::scoped_lock lock(l_QueryMutex);
+
+	return l_Queries;
+}
+
+/**
+ * Returns the number of queries per execution time bucket
+ * (<= 1ms, <= 10ms, <= 100ms, <= 1s, <= 10s, > 10s).
+ */
+Array::Ptr Query::GetQueryHistogram(void)
+{
+	Array::Ptr histogram = make_shared<Array>();
+
+	boost::mutex::scoped_lock lock(l_QueryMutex);
+
+	for (int i = 0; i < QUERYHISTOGRAMSIZE; i++)
+		histogram->Add(l_QueryHistogram[i]);
+
+	return histogram;
+}
+
+/**
+ * Returns the totals for all queries which have been executed so far.
+ */
+QueryProfile Query::GetQueryTotals(void)
+{
+	boost::mutex::scoped_lock lock(l_QueryMutex);
+
+	return l_QueryTotals;
+}
+
 Filter::Ptr Query::ParseFilter(const String& params, unsigned long& from, unsigned long& until)
 {
 	/*
@@ -345,34 +620,45 @@ Filter::Ptr Query::ParseFilter(const String& params, unsigned long& from, unsign
 	return filter;
 }
 
-void Query::PrintResultSet(std::ostream& fp, const Array::Ptr& rs)
+void Query::BeginResultSet(std::ostream& fp)
 {
-	if (m_OutputFormat == "csv") {
-		ObjectLock olock(rs);
-
-		BOOST_FOREACH(const Array::Ptr& row, rs) {
-			bool first = true;
-
-			ObjectLock rlock(row);
-			BOOST_FOREACH(const Value& value, row) {
-				if (first)
-					first = false;
-				else
-					fp << m_Separators[1];
-
-				if (value.IsObjectType<Array>())
-					PrintCsvArray(fp, value, 0);
-				else
-					fp << value;
-			}
+	if (m_OutputFormat == "json")
+		fp << "[";
+}
 
-			fp << m_Separators[0];
+void Query::PrintResultRow(std::ostream& fp, const Array::Ptr& row, bool first)
+{
+	if (m_OutputFormat == "csv") {
+		bool firstColumn = true;
+
+		ObjectLock rlock(row);
+		BOOST_FOREACH(const Value& value, row) {
+			if (firstColumn)
+				firstColumn = false;
+			else
+				fp << m_Separators[1];
+
+			if (value.IsObjectType<Array>())
+				PrintCsvArray(fp, value, 0);
+			else
+				fp << value;
 		}
+
+		fp << m_Separators[0];
 	} else if (m_OutputFormat == "json") {
-		fp << JsonSerialize(rs);
+		if (!first)
+			fp << ",";
+
+		fp << JsonSerialize(row);
 	}
 }
 
+void Query::EndResultSet(std::ostream& fp)
+{
+	if (m_OutputFormat == "json")
+		fp << "]";
+}
+
 void Query::PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level)
 {
 	bool first = true;
@@ -391,19 +677,215 @@ void Query::PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level)
 	}
 }
 
-void Query::ExecuteGetHelper(const Stream::Ptr& stream)
+/**
+ * Writes the buffered part of the result set to the stream once it has
+ * grown beyond OUTPUTCHUNKSIZE (or unconditionally if force is true).
+ * This is only used when the response doesn't need a length header.
+ */
+void Query::FlushResultSet(const Stream::Ptr& stream, std::ostringstream& fp, bool force)
+{
+	if (!force && static_cast<size_t>(fp.tellp()) < OUTPUTCHUNKSIZE)
+		return;
+
+	String data = fp.str();
+	fp.str("");
+
+	try {
+		stream->Write(data.CStr(), data.GetLength());
+		m_Profile.BytesSent += data.GetLength();
+	} catch (const std::exception& ex) {
+		std::ostringstream info;
+		info << "Exception thrown while writing to the livestatus socket: " << std::endl
+		     << DiagnosticInformation(ex);
+		Log(LogCritical, "livestatus", info.str());
+
+		/* Stop producing rows for a client that went away. */
+		throw;
+	}
+}
+
+/**
+ * Moves the buffered part of the result set to a list of chunks once it
+ * has grown beyond OUTPUTCHUNKSIZE (or unconditionally if force is true).
+ * This is used for fixed16 responses which can only be sent once the
+ * length of the whole response is known.
+ */
+void Query::SpillResultSet(std::ostringstream& fp, std::vector<String>& chunks, size_t& length, bool force)
 {
-	Log(LogInformation, "livestatus", "Table: " + m_Table);
+	if (!force && static_cast<size_t>(fp.tellp()) < OUTPUTCHUNKSIZE)
+		return;
+
+	chunks.push_back(fp.str());
+	fp.str("");
+
+	length += chunks.back().GetLength();
+}
+
+/**
+ * Filters the table's rows and feeds the matching rows to all aggregators
+ * in a single pass. Large tables are split into partitions which are
+ * scanned on the thread pool using their own copies of the aggregators;
+ * these are merged afterwards.
+ *
+ * When a stats query also has columns the rows are grouped by the values
+ * of these columns and each group gets its own set of aggregators.
+ *
+ * @param table The table.
+ * @param matches Receives the matching rows (for queries without stats).
+ * @param groups Receives one row (column values followed by the stats)
+ *		 per group (for stats queries with columns).
+ */
+void Query::ScanRows(const Table::Ptr& table, std::vector<Value>& matches, std::vector<Array::Ptr>& groups)
+{
+	std::vector<Value> rows = table->FilterRows(Filter::Ptr());
+
+	m_Profile.RowsScanned = rows.size();
+
+	m_Filter->Bind(table);
+
+	BOOST_FOREACH(const Aggregator::Ptr& aggregator, m_Aggregators) {
+		Filter::Ptr filter = aggregator->GetFilter();
+
+		if (filter)
+			filter->Bind(table);
+	}
 
+	std::vector<int> groupColumns;
+
+	if (!m_Aggregators.empty()) {
+		BOOST_FOREACH(const String& columnName, m_Columns) {
+			groupColumns.push_back(table->GetColumnIndex(columnName));
+		}
+	}
+
+	size_t count = boost::thread::hardware_concurrency();
+	size_t maxCount = (rows.size() + SCANPARTITIONSIZE - 1) / SCANPARTITIONSIZE;
+
+	if (count > maxCount)
+		count = maxCount;
+
+	if (count < 1)
+		count = 1;
+
+	std::vector<ScanPartition> partitions(count);
+
+	for (size_t i = 0; i < count; i++) {
+		ScanPartition& partition = partitions[i];
+
+		partition.Begin = rows.size() * i / count;
+		partition.End = rows.size() * (i + 1) / count;
+		partition.Matched = 0;
+
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, m_Aggregators) {
+			partition.Aggregators.push_back(aggregator->Clone());
+		}
+	}
+
+	ScanBarrier barrier;
+	barrier.Pending = count - 1;
+
+	for (size_t i = 1; i < count; i++)
+		Utility::QueueAsyncCallback(boost::bind(&AsyncScanPartitionRows, table, boost::cref(rows),
+		    m_Filter, boost::cref(groupColumns), boost::ref(partitions[i]), &barrier));
+
+	ScanPartitionRows(table, rows, m_Filter, groupColumns, partitions[0]);
+
+	{
+		boost::mutex::scoped_lock lock(barrier.Mutex);
+
+		while (barrier.Pending > 0)
+			barrier.CV.wait(lock);
+	}
+
+	boost::unordered_map<String, ScanGroup> mergedGroups;
+	std::vector<String> groupOrder;
+
+	BOOST_FOREACH(ScanPartition& partition, partitions) {
+		if (partition.Exception)
+			boost::rethrow_exception(partition.Exception);
+
+		m_Profile.RowsMatched += partition.Matched;
+
+		matches.insert(matches.end(), partition.Matches.begin(), partition.Matches.end());
+
+		for (size_t i = 0; i < m_Aggregators.size(); i++)
+			m_Aggregators[i]->Merge(partition.Aggregators[i]);
+
+		BOOST_FOREACH(const String& key, partition.GroupOrder) {
+			const ScanGroup& group = partition.Groups[key];
+
+			boost::unordered_map<String, ScanGroup>::iterator it = mergedGroups.find(key);
+
+			if (it == mergedGroups.end()) {
+				mergedGroups.insert(std::make_pair(key, group));
+				groupOrder.push_back(key);
+			} else {
+				for (size_t i = 0; i < group.Aggregators.size(); i++)
+					it->second.Aggregators[i]->Merge(group.Aggregators[i]);
+			}
+		}
+	}
+
+	/* Groups are returned in the order they were first seen in. */
+	BOOST_FOREACH(const String& key, groupOrder) {
+		const ScanGroup& group = mergedGroups[key];
+		Array::Ptr row = make_shared<Array>();
+
+		BOOST_FOREACH(const Value& value, group.Columns) {
+			row->Add(value);
+		}
+
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, group.Aggregators) {
+			row->Add(aggregator->GetResult());
+		}
+
+		groups.push_back(row);
+	}
+}
+
+/**
+ * Creates the table the query is about.
+ *
+ * @returns the table or an empty pointer if the table doesn't exist.
+ */
+Table::Ptr Query::CreateTable(void) const
+{
 	Table::Ptr table = Table::GetByName(m_Table, m_CompatLogPath, m_LogTimeFrom, m_LogTimeUntil);
 
+	HistoryTable::Ptr historyTable = dynamic_pointer_cast<HistoryTable>(table);
+
+	if (historyTable)
+		historyTable->SetIndexFilter(m_LogHostName, m_LogServiceDescription, m_LogType);
+
+	return table;
+}
+
+void Query::ExecuteGetHelper(const Stream::Ptr& stream)
+{
+	Log(LogDebug, "livestatus", "Table: " + m_Table);
+
+	/* Queries which have waited for a change reuse the table. */
+	Table::Ptr table = m_WaitTable;
+
+	if (!table)
+		table = CreateTable();
+
 	if (!table) {
 		SendResponse(stream, LivestatusErrorNotFound, "Table '" + m_Table + "' does not exist.");
 
 		return;
 	}
 
-	std::vector<Value> objects = table->FilterRows(m_Filter);
+	double start = Utility::GetTime();
+
+	std::vector<Value> objects;
+	std::vector<Array::Ptr> groups;
+	ScanRows(table, objects, groups);
+
+	double now = Utility::GetTime();
+	m_Profile.FilterTime = now - start;
+	start = now;
+
 	std::vector<String> columns;
 
 	if (m_Columns.size() > 0)
@@ -411,44 +893,54 @@ void Query::ExecuteGetHelper(const Stream::Ptr& stream)
 	else
 		columns = table->GetColumnNames();
 
-	Array::Ptr rs = make_shared<Array>();
+	/* fixed16 response headers contain the length of the response, so
+	 * the result set has to be buffered completely. It is kept as a list
+	 * of chunks rather than one big string. Otherwise rows are written to
+	 * the stream in chunks while they're being generated. */
+	bool spill = (m_ResponseHeader == "fixed16");
+
+	std::ostringstream result;
+	std::vector<String> chunks;
+	size_t length = 0;
+	bool first = true;
+
+	BeginResultSet(result);
 
 	if (m_Aggregators.empty()) {
-		Array::Ptr header = make_shared<Array>();
+		std::vector<int> columnIndices;
 
-		BOOST_FOREACH(const Value& object, objects) {
-			Array::Ptr row = make_shared<Array>();
+		BOOST_FOREACH(const String& columnName, columns) {
+			columnIndices.push_back(table->GetColumnIndex(columnName));
+		}
 
-			BOOST_FOREACH(const String& columnName, columns) {
-				Column column = table->GetColumn(columnName);
+		BOOST_FOREACH(const Value& object, objects) {
+			if (m_ColumnHeaders) {
+				Array::Ptr header = make_shared<Array>();
 
-				if (m_ColumnHeaders)
+				BOOST_FOREACH(const String& columnName, columns) {
 					header->Add(columnName);
+				}
 
-				row->Add(column.ExtractValue(object));
-			}
-
-			if (m_ColumnHeaders) {
-				rs->Add(header);
+				PrintResultRow(result, header, first);
+				first = false;
 				m_ColumnHeaders = false;
 			}
 
-			rs->Add(row);
-		}
-	} else {
-		std::vector<double> stats(m_Aggregators.size(), 0);
-		int index = 0;
+			Array::Ptr row = make_shared<Array>();
 
-		/* add aggregated stats */
-		BOOST_FOREACH(const Aggregator::Ptr aggregator, m_Aggregators) {
-			BOOST_FOREACH(const Value& object, objects) {
-				aggregator->Apply(table, object);
+			BOOST_FOREACH(int index, columnIndices) {
+				row->Add(table->GetColumnByIndex(index).ExtractValue(object));
 			}
 
-			stats[index] = aggregator->GetResult();
-			index++;
-		}
+			PrintResultRow(result, row, first);
+			first = false;
 
+			if (spill)
+				SpillResultSet(result, chunks, length, false);
+			else
+				FlushResultSet(stream, result, false);
+		}
+	} else {
 		/* add column headers both for raw and aggregated data */
 		if (m_ColumnHeaders) {
 			Array::Ptr header = make_shared<Array>();
@@ -461,33 +953,170 @@ void Query::ExecuteGetHelper(const Stream::Ptr& stream)
 				header->Add("stats_" + Convert::ToString(i));
 			}
 
-			rs->Add(header);
+			PrintResultRow(result, header, first);
+			first = false;
 		}
 
-		Array::Ptr row = make_shared<Array>();
+		if (m_Columns.empty()) {
+			/* the rows have already been fed to the aggregators by ScanRows */
+			Array::Ptr row = make_shared<Array>();
 
-		/*
-		 * add selected columns next to stats
-		 * may not be accurate for grouping!
-		 */
-		if (objects.size() > 0 && m_Columns.size() > 0) {
-			BOOST_FOREACH(const String& columnName, m_Columns) {
-				Column column = table->GetColumn(columnName);
+			BOOST_FOREACH(const Aggregator::Ptr& aggregator, m_Aggregators) {
+				row->Add(aggregator->GetResult());
+			}
+
+			PrintResultRow(result, row, first);
+		} else {
+			/* one row per group */
+			BOOST_FOREACH(const Array::Ptr& row, groups) {
+				PrintResultRow(result, row, first);
+				first = false;
 
-				row->Add(column.ExtractValue(objects[0])); // first object wins
+				if (spill)
+					SpillResultSet(result, chunks, length, false);
+				else
+					FlushResultSet(stream, result, false);
 			}
 		}
+	}
 
-		for (size_t i = 0; i < m_Aggregators.size(); i++)
-			row->Add(stats[i]);
+	EndResultSet(result);
+
+	if (spill) {
+		SpillResultSet(result, chunks, length, true);
+		SendResponse(stream, LivestatusErrorOK, chunks, length);
+	} else
+		FlushResultSet(stream, result, true);
 
-		rs->Add(row);
+	m_Profile.SerializeTime = Utility::GetTime() - start;
+}
+
+/**
+ * Checks whether the query has to wait for a change before it can be
+ * executed, i.e. whether its wait condition isn't met yet or, if it doesn't
+ * have one, whether the trigger hasn't fired yet. The first call starts
+ * the wait. Once IsWaitOver() returns true the caller has to call
+ * NeedsWait() again.
+ */
+bool Query::NeedsWait(void)
+{
+	if (m_Verb != "GET" || (!m_WaitCondition && m_WaitTrigger == 0))
+		return false;
+
+	double now = Utility::GetTime();
+
+	if (m_WaitStart == 0) {
+		m_WaitTable = CreateTable();
+
+		/* ExecuteGetHelper() complains about the table. */
+		if (!m_WaitTable)
+			return false;
+
+		m_WaitTriggers = (m_WaitTrigger != 0) ? m_WaitTrigger : static_cast<int>(ChangeTriggerAll);
+		m_WaitDeadline = (m_WaitTimeout > 0) ? now + m_WaitTimeout / 1000.0 : 0;
+		m_WaitStart = now;
+	} else if (!m_WaitCondition || (m_WaitDeadline != 0 && now >= m_WaitDeadline)) {
+		m_Profile.WaitTime = now - m_WaitStart;
+		return false;
 	}
 
-	std::ostringstream result;
-	PrintResultSet(result, rs);
+	/* Get the trigger sequence before checking the condition so we
+	 * don't miss changes which happen while the condition is checked. */
+	m_WaitSequence = ChangeTracker::GetTriggerSequence(m_WaitTriggers);
+
+	/* Without a wait condition the query waits for the next trigger. */
+	if (!m_WaitCondition || !IsWaitConditionMet(m_WaitTable))
+		return true;
+
+	m_Profile.WaitTime = Utility::GetTime() - m_WaitStart;
+	return false;
+}
+
+/**
+ * Checks whether one of the triggers a waiting query is interested in has
+ * fired or its wait timeout has expired since NeedsWait() was called.
+ */
+bool Query::IsWaitOver(double now) const
+{
+	if (m_WaitDeadline != 0 && now >= m_WaitDeadline)
+		return true;
+
+	return (ChangeTracker::GetTriggerSequence(m_WaitTriggers) != m_WaitSequence);
+}
 
-	SendResponse(stream, LivestatusErrorOK, result.str());
+/**
+ * Returns the time when the wait times out or 0 if the query waits
+ * forever.
+ */
+double Query::GetWaitDeadline(void) const
+{
+	return m_WaitDeadline;
+}
+
+/**
+ * Blocks the calling thread until the query doesn't need to wait anymore.
+ * The wait is split into slices of WAITSLICE seconds so disconnected
+ * clients are noticed even if the query doesn't have a wait timeout.
+ *
+ * @returns false if the client has disconnected.
+ */
+bool Query::WaitForChange(const Stream::Ptr& stream)
+{
+	while (NeedsWait()) {
+		for (;;) {
+			if (stream->IsEof())
+				return false;
+
+			double now = Utility::GetTime();
+
+			if (m_WaitDeadline != 0 && now >= m_WaitDeadline)
+				break;
+
+			double slice = now + WAITSLICE;
+
+			if (m_WaitDeadline != 0 && m_WaitDeadline < slice)
+				slice = m_WaitDeadline;
+
+			if (ChangeTracker::WaitForTrigger(m_WaitTriggers, m_WaitSequence, slice))
+				break;
+		}
+	}
+
+	return true;
+}
+
+bool Query::IsWaitConditionMet(const Table::Ptr& table)
+{
+	if (m_WaitObject.IsEmpty())
+		return !table->FilterRows(m_WaitCondition).empty();
+
+	Object::Ptr object;
+
+	if (m_Table == "hosts")
+		object = Host::GetByName(m_WaitObject);
+	else if (m_Table == "services") {
+		/* Service objects are specified as "host;service" or "host service". */
+		size_t pos = m_WaitObject.FindFirstOf(";");
+
+		if (pos == String::NPos)
+			pos = m_WaitObject.FindFirstOf(" ");
+
+		if (pos != String::NPos)
+			object = Service::GetByNamePair(m_WaitObject.SubStr(0, pos), m_WaitObject.SubStr(pos + 1));
+	} else if (m_Table == "hostgroups")
+		object = HostGroup::GetByName(m_WaitObject);
+	else if (m_Table == "servicegroups")
+		object = ServiceGroup::GetByName(m_WaitObject);
+	else if (m_Table == "contacts")
+		object = User::GetByName(m_WaitObject);
+	else
+		return !table->FilterRows(m_WaitCondition).empty();
+
+	/* Don't wait for objects which don't exist. */
+	if (!object)
+		return true;
+
+	return m_WaitCondition->Apply(table, object);
 }
 
 void Query::ExecuteCommandHelper(const Stream::Ptr& stream)
@@ -512,11 +1141,12 @@ void Query::ExecuteErrorHelper(const Stream::Ptr& stream)
 void Query::SendResponse(const Stream::Ptr& stream, int code, const String& data)
 {
 	if (m_ResponseHeader == "fixed16")
-		PrintFixed16(stream, code, data);
+		PrintFixed16(stream, code, data.GetLength());
 
 	if (m_ResponseHeader == "fixed16" || code == LivestatusErrorOK) {
 		try {
 			stream->Write(data.CStr(), data.GetLength());
+			m_Profile.BytesSent += data.GetLength();
 		} catch (const std::exception& ex) {
 			std::ostringstream info;
 			info << "Exception thrown while writing to the livestatus socket: " << std::endl
@@ -526,17 +1156,38 @@ void Query::SendResponse(const Stream::Ptr& stream, int code, const String& data
 	}
 }
 
-void Query::PrintFixed16(const Stream::Ptr& stream, int code, const String& data)
+/**
+ * Sends a response which has been spilled into chunks by SpillResultSet().
+ */
+void Query::SendResponse(const Stream::Ptr& stream, int code, const std::vector<String>& chunks, size_t length)
+{
+	PrintFixed16(stream, code, length);
+
+	try {
+		BOOST_FOREACH(const String& chunk, chunks) {
+			stream->Write(chunk.CStr(), chunk.GetLength());
+			m_Profile.BytesSent += chunk.GetLength();
+		}
+	} catch (const std::exception& ex) {
+		std::ostringstream info;
+		info << "Exception thrown while writing to the livestatus socket: " << std::endl
+		     << DiagnosticInformation(ex);
+		Log(LogCritical, "livestatus", info.str());
+	}
+}
+
+void Query::PrintFixed16(const Stream::Ptr& stream, int code, size_t length)
 {
 	ASSERT(code >= 100 && code <= 999);
 
 	String sCode = Convert::ToString(code);
-	String sLength = Convert::ToString(static_cast<long>(data.GetLength()));
+	String sLength = Convert::ToString(static_cast<long>(length));
 
 	String header = sCode + String(16 - 3 - sLength.GetLength() - 1, ' ') + sLength + m_Separators[0];
 
 	try {
 		stream->Write(header.CStr(), header.GetLength());
+		m_Profile.BytesSent += header.GetLength();
 	} catch (const std::exception& ex) {
 		std::ostringstream info;
 		info << "Exception thrown while writing to the livestatus socket: " << std::endl
@@ -547,8 +1198,10 @@ void Query::PrintFixed16(const Stream::Ptr& stream, int code, const String& data
 
 bool Query::Execute(const Stream::Ptr& stream)
 {
+	double start = Utility::GetTime();
+
 	try {
-		Log(LogInformation, "livestatus", "Executing livestatus query: " + m_Verb);
+		Log(LogDebug, "livestatus", "Executing livestatus query: " + m_Verb);
 
 		if (m_Verb == "GET")
 			ExecuteGetHelper(stream);
@@ -562,6 +1215,10 @@ bool Query::Execute(const Stream::Ptr& stream)
 		SendResponse(stream, LivestatusErrorQuery, DiagnosticInformation(ex));
 	}
 
+	m_Profile.ExecutionTime = Utility::GetTime() - start;
+
+	AddProfile(m_Profile);
+
 	if (!m_KeepAlive) {
 		stream->Close();
 		return false;
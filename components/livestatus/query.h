@@ -39,6 +39,26 @@ enum LivestatusError
 	LivestatusErrorQuery = 452
 };
 
+/**
+ * Statistics for a single livestatus query. Times are in seconds.
+ *
+ * @ingroup livestatus
+ */
+struct QueryProfile
+{
+	String Request;
+	double ParseTime;
+	double WaitTime;
+	double FilterTime;
+	double SerializeTime;
+	double ExecutionTime;
+	size_t RowsScanned;
+	size_t RowsMatched;
+	size_t BytesSent;
+
+	QueryProfile(void);
+};
+
 /**
  * @ingroup livestatus
  */
@@ -49,9 +69,19 @@ public:
 
 	Query(const std::vector<String>& lines, const String& compat_log_path);
 
+	bool NeedsWait(void);
+	bool IsWaitOver(double now) const;
+	double GetWaitDeadline(void) const;
+	bool WaitForChange(const Stream::Ptr& stream);
+
 	bool Execute(const Stream::Ptr& stream);
 
+	const QueryProfile& GetProfile(void) const;
+
 	static int GetExternalCommands(void);
+	static int GetQueries(void);
+	static Array::Ptr GetQueryHistogram(void);
+	static QueryProfile GetQueryTotals(void);
 
 private:
 	String m_Verb;
@@ -71,6 +101,19 @@ private:
 
 	String m_ResponseHeader;
 
+	/* Parameters for queries which wait for changes. */
+	String m_WaitObject;
+	Filter::Ptr m_WaitCondition;
+	int m_WaitTrigger;
+	long m_WaitTimeout;
+
+	/* State of the wait, see NeedsWait(). */
+	Table::Ptr m_WaitTable;
+	int m_WaitTriggers;
+	unsigned long m_WaitSequence;
+	double m_WaitStart;
+	double m_WaitDeadline;
+
 	/* Parameters for COMMAND queries. */
 	String m_Command;
 
@@ -80,18 +123,36 @@ private:
 	
 	unsigned long m_LogTimeFrom;
 	unsigned long m_LogTimeUntil;
+	String m_LogHostName;
+	String m_LogServiceDescription;
+	String m_LogType;
 	String m_CompatLogPath;
 
-	void PrintResultSet(std::ostream& fp, const Array::Ptr& rs);
+	QueryProfile m_Profile;
+
+	void Parse(const std::vector<String>& lines, const String& compat_log_path);
+
+	void BeginResultSet(std::ostream& fp);
+	void PrintResultRow(std::ostream& fp, const Array::Ptr& row, bool first);
+	void EndResultSet(std::ostream& fp);
 	void PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level);
+	void FlushResultSet(const Stream::Ptr& stream, std::ostringstream& fp, bool force);
+	void SpillResultSet(std::ostringstream& fp, std::vector<String>& chunks, size_t& length, bool force);
+
+	void ScanRows(const Table::Ptr& table, std::vector<Value>& matches, std::vector<Array::Ptr>& groups);
+
+	Table::Ptr CreateTable(void) const;
+	bool IsWaitConditionMet(const Table::Ptr& table);
 
 	void ExecuteGetHelper(const Stream::Ptr& stream);
 	void ExecuteCommandHelper(const Stream::Ptr& stream);
 	void ExecuteErrorHelper(const Stream::Ptr& stream);
 
 	void SendResponse(const Stream::Ptr& stream, int code, const String& data);
-	void PrintFixed16(const Stream::Ptr& stream, int code, const String& data);
+	void SendResponse(const Stream::Ptr& stream, int code, const std::vector<String>& chunks, size_t length);
+	void PrintFixed16(const Stream::Ptr& stream, int code, size_t length);
 	
+	static void AddProfile(const QueryProfile& profile);
 	static Filter::Ptr ParseFilter(const String& params, unsigned long& from, unsigned long& until);
 };
 
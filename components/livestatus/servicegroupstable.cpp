@@ -25,9 +25,7 @@
 using namespace icinga;
 
 ServiceGroupsTable::ServiceGroupsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void ServiceGroupsTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
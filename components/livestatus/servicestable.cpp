@@ -38,9 +38,7 @@
 using namespace icinga;
 
 ServicesTable::ServicesTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void ServicesTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
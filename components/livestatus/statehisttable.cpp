@@ -54,8 +54,6 @@ StateHistTable::StateHistTable(const String& compat_log_path, time_t from, time_
 	m_TimeFrom = from;
 	m_TimeUntil = until;
 	m_CompatLogPath = compat_log_path;
-
-	AddColumns(this);
 }
 
 void StateHistTable::UpdateLogEntries(const Dictionary::Ptr& log_entry_attrs, int line_count, int lineno, const AddRowFunction& addRowFn)
@@ -257,8 +255,9 @@ void StateHistTable::FetchRows(const AddRowFunction& addRowFn)
 	/* create log file index */
 	LogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
 
-	/* generate log cache */
-	LogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
+	/* generate log cache; state changes are tracked across all line types */
+	LogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil,
+	    m_IndexHostName, m_IndexServiceDescription, "", addRowFn);
 
 	Checkable::Ptr checkable;
 
@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "livestatus/statustable.h"
+#include "livestatus/changetracker.h"
 #include "livestatus/listener.h"
 #include "icinga/icingaapplication.h"
 #include "icinga/cib.h"
@@ -30,9 +31,7 @@
 using namespace icinga;
 
 StatusTable::StatusTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void StatusTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
@@ -40,8 +39,8 @@ void StatusTable::AddColumns(Table *table, const String& prefix,
 	table->AddColumn(prefix + "neb_callbacks", Column(&Table::ZeroAccessor, objectAccessor));
 	table->AddColumn(prefix + "neb_callbacks_rate", Column(&Table::ZeroAccessor, objectAccessor));
 
-	table->AddColumn(prefix + "requests", Column(&Table::ZeroAccessor, objectAccessor));
-	table->AddColumn(prefix + "requests_rate", Column(&Table::ZeroAccessor, objectAccessor));
+	table->AddColumn(prefix + "requests", Column(&StatusTable::RequestsAccessor, objectAccessor));
+	table->AddColumn(prefix + "requests_rate", Column(&StatusTable::RequestsRateAccessor, objectAccessor));
 
 	table->AddColumn(prefix + "connections", Column(&StatusTable::ConnectionsAccessor, objectAccessor));
 	table->AddColumn(prefix + "connections_rate", Column(&StatusTable::ConnectionsRateAccessor, objectAccessor));
@@ -97,6 +96,10 @@ void StatusTable::AddColumns(Table *table, const String& prefix,
 	table->AddColumn(prefix + "livestatus_queued_connections", Column(&Table::ZeroAccessor, objectAccessor));
 	table->AddColumn(prefix + "livestatus_threads", Column(&Table::ZeroAccessor, objectAccessor));
 
+	table->AddColumn(prefix + "change_sequence", Column(&StatusTable::ChangeSequenceAccessor, objectAccessor));
+	table->AddColumn(prefix + "livestatus_slow_queries", Column(&StatusTable::LivestatusSlowQueriesAccessor, objectAccessor));
+	table->AddColumn(prefix + "livestatus_query_histogram", Column(&StatusTable::LivestatusQueryHistogramAccessor, objectAccessor));
+
 	table->AddColumn(prefix + "custom_variable_names", Column(&StatusTable::CustomVariableNamesAccessor, objectAccessor));
 	table->AddColumn(prefix + "custom_variable_values", Column(&StatusTable::CustomVariableValuesAccessor, objectAccessor));
 	table->AddColumn(prefix + "custom_variables", Column(&StatusTable::CustomVariablesAccessor, objectAccessor));
@@ -115,6 +118,16 @@ void StatusTable::FetchRows(const AddRowFunction& addRowFn)
 	addRowFn(obj);
 }
 
+Value StatusTable::RequestsAccessor(const Value&)
+{
+	return Query::GetQueries();
+}
+
+Value StatusTable::RequestsRateAccessor(const Value&)
+{
+	return (Query::GetQueries() / (Utility::GetTime() - Application::GetStartTime()));
+}
+
 Value StatusTable::ConnectionsAccessor(const Value&)
 {
 	return LivestatusListener::GetConnections();
@@ -187,6 +200,21 @@ Value StatusTable::ProgramStartAccessor(const Value&)
 	return static_cast<long>(Application::GetStartTime());
 }
 
+Value StatusTable::LivestatusSlowQueriesAccessor(const Value&)
+{
+	return LivestatusListener::GetSlowQueries();
+}
+
+Value StatusTable::LivestatusQueryHistogramAccessor(const Value&)
+{
+	return Query::GetQueryHistogram();
+}
+
+Value StatusTable::ChangeSequenceAccessor(const Value&)
+{
+	return static_cast<double>(ChangeTracker::GetSequence());
+}
+
 Value StatusTable::NumHostsAccessor(const Value&)
 {
 	return std::distance(DynamicType::GetObjects<Host>().first, DynamicType::GetObjects<Host>().second);
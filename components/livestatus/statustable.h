@@ -45,6 +45,8 @@ public:
 protected:
 	virtual void FetchRows(const AddRowFunction& addRowFn);
 
+	static Value RequestsAccessor(const Value& row);
+	static Value RequestsRateAccessor(const Value& row);
 	static Value ConnectionsAccessor(const Value& row);
 	static Value ConnectionsRateAccessor(const Value& row);
         static Value ServiceChecksAccessor(const Value& row);
@@ -64,6 +66,9 @@ protected:
 	static Value ProgramVersionAccessor(const Value& row);
 	static Value LivestatusVersionAccessor(const Value& row);
 	static Value LivestatusActiveConnectionsAccessor(const Value& row);
+	static Value LivestatusSlowQueriesAccessor(const Value& row);
+	static Value LivestatusQueryHistogramAccessor(const Value& row);
+	static Value ChangeSequenceAccessor(const Value& row);
 	static Value CustomVariableNamesAccessor(const Value& row);
 	static Value CustomVariableValuesAccessor(const Value& row);
 	static Value CustomVariablesAccessor(const Value& row);
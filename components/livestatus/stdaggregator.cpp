@@ -30,7 +30,7 @@ StdAggregator::StdAggregator(const String& attr)
 
 void StdAggregator::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_StdAttr);
+	const Column& column = table->GetColumn(m_StdAttr);
 
 	Value value = column.ExtractValue(row);
 
@@ -43,3 +43,19 @@ double StdAggregator::GetResult(void) const
 {
 	return sqrt((m_StdQSum - (1 / m_StdCount) * pow(m_StdSum, 2)) / (m_StdCount - 1));
 }
+
+Aggregator::Ptr StdAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<StdAggregator>(m_StdAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void StdAggregator::Merge(const Aggregator::Ptr& other)
+{
+	StdAggregator::Ptr aggregator = static_pointer_cast<StdAggregator>(other);
+
+	m_StdSum += aggregator->m_StdSum;
+	m_StdQSum += aggregator->m_StdQSum;
+	m_StdCount += aggregator->m_StdCount;
+}
@@ -29,7 +29,7 @@ SumAggregator::SumAggregator(const String& attr)
 
 void SumAggregator::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_SumAttr);
+	const Column& column = table->GetColumn(m_SumAttr);
 
 	Value value = column.ExtractValue(row);
 
@@ -40,3 +40,17 @@ double SumAggregator::GetResult(void) const
 {
 	return m_Sum;
 }
+
+Aggregator::Ptr SumAggregator::Clone(void) const
+{
+	Aggregator::Ptr aggregator = make_shared<SumAggregator>(m_SumAttr);
+	aggregator->SetFilter(GetFilter());
+	return aggregator;
+}
+
+void SumAggregator::Merge(const Aggregator::Ptr& other)
+{
+	SumAggregator::Ptr aggregator = static_pointer_cast<SumAggregator>(other);
+
+	m_Sum += aggregator->m_Sum;
+}
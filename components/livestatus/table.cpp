@@ -38,76 +38,140 @@
 #include <boost/tuple/tuple.hpp>
 #include <boost/foreach.hpp>
 #include <boost/bind.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
+boost::mutex Table::m_SchemaMutex;
+std::map<String, shared_ptr<TableSchema> > Table::m_Schemas;
+
 Table::Table(void)
 { }
 
 Table::Ptr Table::GetByName(const String& name, const String& compat_log_path, const unsigned long& from, const unsigned long& until)
 {
-	if (name == "status")
-		return make_shared<StatusTable>();
-	else if (name == "contactgroups")
-		return make_shared<ContactGroupsTable>();
-	else if (name == "contacts")
-		return make_shared<ContactsTable>();
-	else if (name == "hostgroups")
-		return make_shared<HostGroupsTable>();
-	else if (name == "hosts")
-		return make_shared<HostsTable>();
-	else if (name == "servicegroups")
-		return make_shared<ServiceGroupsTable>();
-	else if (name == "services")
-		return make_shared<ServicesTable>();
-	else if (name == "commands")
-		return make_shared<CommandsTable>();
-	else if (name == "comments")
-		return make_shared<CommentsTable>();
-	else if (name == "downtimes")
-		return make_shared<DowntimesTable>();
-	else if (name == "timeperiods")
-		return make_shared<TimePeriodsTable>();
-	else if (name == "log")
-		return make_shared<LogTable>(compat_log_path, from, until);
-	else if (name == "statehist")
-		return make_shared<StateHistTable>(compat_log_path, from, until);
-	else if (name == "endpoints")
-		return make_shared<EndpointsTable>();
-
-	return Table::Ptr();
+	Table::Ptr table;
+	AddColumnsFunction addColumns;
+
+	if (name == "status") {
+		table = make_shared<StatusTable>();
+		addColumns = &StatusTable::AddColumns;
+	} else if (name == "contactgroups") {
+		table = make_shared<ContactGroupsTable>();
+		addColumns = &ContactGroupsTable::AddColumns;
+	} else if (name == "contacts") {
+		table = make_shared<ContactsTable>();
+		addColumns = &ContactsTable::AddColumns;
+	} else if (name == "hostgroups") {
+		table = make_shared<HostGroupsTable>();
+		addColumns = &HostGroupsTable::AddColumns;
+	} else if (name == "hosts") {
+		table = make_shared<HostsTable>();
+		addColumns = &HostsTable::AddColumns;
+	} else if (name == "servicegroups") {
+		table = make_shared<ServiceGroupsTable>();
+		addColumns = &ServiceGroupsTable::AddColumns;
+	} else if (name == "services") {
+		table = make_shared<ServicesTable>();
+		addColumns = &ServicesTable::AddColumns;
+	} else if (name == "commands") {
+		table = make_shared<CommandsTable>();
+		addColumns = &CommandsTable::AddColumns;
+	} else if (name == "comments") {
+		table = make_shared<CommentsTable>();
+		addColumns = &CommentsTable::AddColumns;
+	} else if (name == "downtimes") {
+		table = make_shared<DowntimesTable>();
+		addColumns = &DowntimesTable::AddColumns;
+	} else if (name == "timeperiods") {
+		table = make_shared<TimePeriodsTable>();
+		addColumns = &TimePeriodsTable::AddColumns;
+	} else if (name == "log") {
+		table = make_shared<LogTable>(compat_log_path, from, until);
+		addColumns = &LogTable::AddColumns;
+	} else if (name == "statehist") {
+		table = make_shared<StateHistTable>(compat_log_path, from, until);
+		addColumns = &StateHistTable::AddColumns;
+	} else if (name == "endpoints") {
+		table = make_shared<EndpointsTable>();
+		addColumns = &EndpointsTable::AddColumns;
+	} else
+		return Table::Ptr();
+
+	table->LoadSchema(addColumns);
+
+	return table;
+}
+
+/**
+ * Attaches the table type's schema to this table, building it first if
+ * this is the first table of its type.
+ */
+void Table::LoadSchema(AddColumnsFunction addColumns)
+{
+	String name = GetName();
+
+	boost::mutex::scoped_lock lock(m_SchemaMutex);
+
+	std::map<String, shared_ptr<TableSchema> >::const_iterator it = m_Schemas.find(name);
+
+	if (it != m_Schemas.end()) {
+		m_Schema = it->second;
+		return;
+	}
+
+	m_Schema = make_shared<TableSchema>();
+
+	addColumns(this, String(), Column::ObjectAccessor());
+
+	String columnName;
+	BOOST_FOREACH(boost::tie(columnName, boost::tuples::ignore), m_Schema->Index) {
+		m_Schema->SortedNames.push_back(columnName);
+	}
+
+	std::sort(m_Schema->SortedNames.begin(), m_Schema->SortedNames.end());
+
+	m_Schemas[name] = m_Schema;
 }
 
+/**
+ * Adds a column to the table's schema. This must only be called while the
+ * schema is being built (i.e. from the AddColumns functions).
+ */
 void Table::AddColumn(const String& name, const Column& column)
 {
-	std::pair<String, Column> item = std::make_pair(name, column);
+	std::pair<boost::unordered_map<String, int>::iterator, bool> ret =
+	    m_Schema->Index.insert(std::make_pair(name, static_cast<int>(m_Schema->Columns.size())));
 
-	std::pair<std::map<String, Column>::iterator, bool> ret = m_Columns.insert(item);
+	if (ret.second)
+		m_Schema->Columns.push_back(column);
+	else
+		m_Schema->Columns[ret.first->second] = column;
+}
 
-	if (!ret.second)
-		ret.first->second = column;
+const Column& Table::GetColumn(const String& name) const
+{
+	return GetColumnByIndex(GetColumnIndex(name));
 }
 
-Column Table::GetColumn(const String& name) const
+int Table::GetColumnIndex(const String& name) const
 {
-	std::map<String, Column>::const_iterator it = m_Columns.find(name);
+	boost::unordered_map<String, int>::const_iterator it = m_Schema->Index.find(name);
 
-	if (it == m_Columns.end())
+	if (it == m_Schema->Index.end())
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Column '" + name + "' does not exist in table '" + GetName() + "'."));
 
 	return it->second;
 }
 
-std::vector<String> Table::GetColumnNames(void) const
+const Column& Table::GetColumnByIndex(int index) const
 {
-	std::vector<String> names;
-
-	String name;
-	BOOST_FOREACH(boost::tie(name, boost::tuples::ignore), m_Columns) {
-		names.push_back(name);
-	}
+	return m_Schema->Columns[index];
+}
 
-	return names;
+std::vector<String> Table::GetColumnNames(void) const
+{
+	return m_Schema->SortedNames;
 }
 
 std::vector<Value> Table::FilterRows(const Filter::Ptr& filter)
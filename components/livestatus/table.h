@@ -23,6 +23,8 @@
 #include "livestatus/column.h"
 #include "base/object.h"
 #include "base/dictionary.h"
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
 #include <vector>
 
 namespace icinga
@@ -32,6 +34,20 @@ typedef boost::function<void (const Value&)> AddRowFunction;
 
 class Filter;
 
+/**
+ * The columns of a table type. Schemas are built once per table type and
+ * are shared by all tables (and thus queries) of that type. They must not
+ * be modified once they've been published.
+ *
+ * @ingroup livestatus
+ */
+struct TableSchema
+{
+	std::vector<Column> Columns;
+	boost::unordered_map<String, int> Index;
+	std::vector<String> SortedNames;
+};
+
 /**
  * @ingroup livestatus
  */
@@ -47,7 +63,9 @@ public:
 	std::vector<Value> FilterRows(const shared_ptr<Filter>& filter);
 
 	void AddColumn(const String& name, const Column& column);
-	Column GetColumn(const String& name) const;
+	const Column& GetColumn(const String& name) const;
+	int GetColumnIndex(const String& name) const;
+	const Column& GetColumnByIndex(int index) const;
 	std::vector<String> GetColumnNames(void) const;
 
 protected:
@@ -62,7 +80,14 @@ protected:
 	static Value EmptyDictionaryAccessor(const Value&);
 
 private:
-	std::map<String, Column> m_Columns;
+	typedef void (*AddColumnsFunction)(Table *table, const String& prefix, const Column::ObjectAccessor& objectAccessor);
+
+	shared_ptr<TableSchema> m_Schema;
+
+	static boost::mutex m_SchemaMutex;
+	static std::map<String, shared_ptr<TableSchema> > m_Schemas;
+
+	void LoadSchema(AddColumnsFunction addColumns);
 
 	void FilteredAddRow(std::vector<Value>& rs, const shared_ptr<Filter>& filter, const Value& row);
 };
@@ -30,9 +30,7 @@
 using namespace icinga;
 
 TimePeriodsTable::TimePeriodsTable(void)
-{
-	AddColumns(this);
-}
+{ }
 
 void TimePeriodsTable::AddColumns(Table *table, const String& prefix,
     const Column::ObjectAccessor& objectAccessor)
@@ -133,27 +133,14 @@ void GraphiteWriter::CheckResultHandler(const Checkable::Ptr& checkable, const C
 
 void GraphiteWriter::SendPerfdata(const String& prefix, const CheckResult::Ptr& cr)
 {
-	Value pdv = cr->GetPerformanceData();
+	shared_ptr<const PerfdataRecordList> records = cr->GetPerfdataRecords();
 
-	if (!pdv.IsObjectType<Dictionary>())
-		return;
-
-	Dictionary::Ptr perfdata = pdv;
-
-	ObjectLock olock(perfdata);
-	BOOST_FOREACH(const Dictionary::Pair& kv, perfdata) {
-		double valueNum;
-
-		if (!kv.second.IsObjectType<PerfdataValue>())
-			valueNum = kv.second;
-		else
-			valueNum = static_cast<PerfdataValue::Ptr>(kv.second)->GetValue();
-
-		String escaped_key = kv.first;
+	BOOST_FOREACH(const PerfdataRecord& record, *records) {
+		String escaped_key = record.Label;
 		SanitizeMetric(escaped_key);
 		boost::algorithm::replace_all(escaped_key, "::", ".");
 
-		SendMetric(prefix, escaped_key, valueNum);
+		SendMetric(prefix, escaped_key, record.Value);
 	}
 }
 
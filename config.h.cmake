@@ -4,6 +4,8 @@
 #cmakedefine HAVE_BIOZLIB
 #cmakedefine HAVE_BACKTRACE_SYMBOLS
 #cmakedefine HAVE_PIPE2
+#cmakedefine HAVE_EPOLL
+#cmakedefine HAVE_POSIX_SPAWN
 #cmakedefine HAVE_VFORK
 #cmakedefine HAVE_DLADDR
 #cmakedefine HAVE_LIBEXECINFO
@@ -28,6 +28,7 @@
 #include "base/convert.h"
 #include "base/scriptvariable.h"
 #include "base/context.h"
+#include "base/process.h"
 #include "config.h"
 #include <boost/program_options.hpp>
 #include <boost/tuple/tuple.hpp>
@@ -406,6 +407,11 @@ int Main(void)
 	}
 
 	ScriptVariable::Set("UseVfork", true, false, true);
+	ScriptVariable::Set("SpawnMode", "fork", false, true);
+
+	/* Start the spawn helper before we load the config and become large. It
+	 * can only be enabled on the command line (-D SpawnMode=helper). */
+	Process::InitializeSpawnHelper();
 
 	Application::MakeVariablesConstant();
 
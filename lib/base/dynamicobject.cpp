@@ -315,7 +315,8 @@ void DynamicObject::RestoreObjects(const String& filename, int attributeTypes)
 	unsigned long restored = 0;
 
 	String message;
-	while (NetString::ReadStringFromStream(sfp, &message)) {
+	NetStringContext context;
+	while (NetString::ReadStringFromStream(sfp, &message, context)) {
 		Dictionary::Ptr persistentObject = JsonDeserialize(message);
 
 		String type = persistentObject->Get("type");
@@ -20,9 +20,13 @@
 #include "base/netstring.h"
 #include "base/debug.h"
 #include <sstream>
+#include <algorithm>
+#include <cstring>
 
 using namespace icinga;
 
+#define NETSTRINGREADSIZE 65536
+
 /**
  * Reads data from a stream in netstring format.
  *
@@ -114,6 +118,94 @@ bool NetString::ReadStringFromStream(const Stream::Ptr& stream, String *str)
 	return true;
 }
 
+/**
+ * Reads data from a stream in netstring format. Unlike the other overload
+ * this reads as much data as the stream has available and keeps whatever
+ * belongs to the following messages in the context, so reading a batch of
+ * small messages usually takes a single read.
+ *
+ * @param stream The stream to read from.
+ * @param[out] str The String that has been read from the stream.
+ * @param context The read buffer for the stream.
+ * @returns true if a complete String was read from the stream, false on EOF.
+ * @exception invalid_argument The input stream is invalid.
+ */
+bool NetString::ReadStringFromStream(const Stream::Ptr& stream, String *str, NetStringContext& context)
+{
+	for (;;) {
+		size_t available = context.Size - context.Offset;
+		size_t needed = 0;
+
+		if (available > 0) {
+			const char *header = &context.Buffer[context.Offset];
+
+			/* 16 bytes are enough for the header */
+			const char *colon = static_cast<const char *>(memchr(header, ':', std::min(available, static_cast<size_t>(16))));
+
+			if (colon == NULL) {
+				if (available >= 16)
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing :)"));
+			} else {
+				size_t header_length = colon - header + 1;
+
+				/* no leading zeros allowed */
+				if (header[0] == '0' && isdigit(header[1]))
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (leading zero)"));
+
+				size_t len = 0;
+				for (size_t i = 0; i < header_length && isdigit(header[i]); i++) {
+					/* length specifier must have at most 9 characters */
+					if (i >= 9)
+						BOOST_THROW_EXCEPTION(std::invalid_argument("Length specifier must not exceed 9 characters"));
+
+					len = len * 10 + (header[i] - '0');
+				}
+
+				needed = header_length + len + 1;
+
+				if (available >= needed) {
+					if (header[needed - 1] != ',')
+						BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing ,)"));
+
+					*str = String(header + header_length, header + header_length + len);
+					context.Offset += needed;
+
+					return true;
+				}
+			}
+		}
+
+		/* Move the partial message to the front of the buffer and make
+		 * sure there's room for the rest of it. */
+		if (context.Offset > 0) {
+			if (available > 0)
+				memmove(&context.Buffer[0], &context.Buffer[context.Offset], available);
+
+			context.Offset = 0;
+			context.Size = available;
+		}
+
+		if (context.Buffer.size() < std::max(needed, context.Size + NETSTRINGREADSIZE))
+			context.Buffer.resize(std::max(needed, context.Size + NETSTRINGREADSIZE));
+
+		size_t rc = stream->ReadAvailable(&context.Buffer[context.Size], context.Buffer.size() - context.Size);
+
+		if (rc == 0) {
+			if (available == 0)
+				return false;
+
+			BOOST_THROW_EXCEPTION(std::runtime_error("Read() failed."));
+		}
+
+		/* Some streams pass on errors from the underlying library, e.g.
+		 * BIO_read()'s -1, as a huge byte count. */
+		if (rc > context.Buffer.size() - context.Size)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Read() returned more data than requested."));
+
+		context.Size += rc;
+	}
+}
+
 /**
  * Writes data into a stream using the netstring format.
  *
@@ -121,10 +213,21 @@ bool NetString::ReadStringFromStream(const Stream::Ptr& stream, String *str)
  * @param str The String that is to be written.
  */
 void NetString::WriteStringToStream(const Stream::Ptr& stream, const String& str)
+{
+	String msg = Encode(str);
+	stream->Write(msg.CStr(), msg.GetLength());
+}
+
+/**
+ * Encodes a String using the netstring format.
+ *
+ * @param str The String that is to be encoded.
+ * @returns The encoded String.
+ */
+String NetString::Encode(const String& str)
 {
 	std::ostringstream msgbuf;
 	msgbuf << str.GetLength() << ":" << str << ",";
 
-	String msg = msgbuf.str();
-	stream->Write(msg.CStr(), msg.GetLength());
+	return msgbuf.str();
 }
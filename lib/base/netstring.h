@@ -22,10 +22,27 @@
 
 #include "base/i2-base.h"
 #include "base/stream.h"
+#include <vector>
 
 namespace icinga
 {
 
+/**
+ * Read buffer for NetString::ReadStringFromStream(). A context must only
+ * be used for a single stream.
+ *
+ * @ingroup base
+ */
+struct I2_BASE_API NetStringContext
+{
+	NetStringContext(void) : Offset(0), Size(0)
+	{ }
+
+	std::vector<char> Buffer;
+	size_t Offset;
+	size_t Size;
+};
+
 /**
  * Helper functions for reading/writing messages in the netstring format.
  *
@@ -37,7 +54,9 @@ class I2_BASE_API NetString
 {
 public:
 	static bool ReadStringFromStream(const Stream::Ptr& stream, String *message);
+	static bool ReadStringFromStream(const Stream::Ptr& stream, String *message, NetStringContext& context);
 	static void WriteStringToStream(const Stream::Ptr& stream, const String& message);
+	static String Encode(const String& message);
 
 private:
 	NetString(void);
@@ -28,15 +28,26 @@
 #include "base/logger_fwd.h"
 #include "base/utility.h"
 #include "base/scriptvariable.h"
+#include "base/serializer.h"
 #include <boost/foreach.hpp>
 #include <boost/bind.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/algorithm/string/join.hpp>
+#include <set>
 
 #ifndef _WIN32
 #	include <execvpe.h>
 #	include <poll.h>
+#	include <sys/syscall.h>
+#	include <sys/socket.h>
+#	include <sys/resource.h>
+#	ifdef HAVE_POSIX_SPAWN
+#		include <spawn.h>
+#	endif /* HAVE_POSIX_SPAWN */
+#	ifdef HAVE_EPOLL
+#		include <sys/epoll.h>
+#	endif /* HAVE_EPOLL */
 
 #	ifndef __APPLE__
 extern char **environ;
@@ -49,14 +60,34 @@ extern char **environ;
 using namespace icinga;
 
 #define IOTHREADS 2
+#define IOBUFSIZE 65536
+#define REAPINTERVAL 0.1
 
 static boost::mutex l_ProcessMutex[IOTHREADS];
 static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[IOTHREADS];
+static char l_IOBuffers[IOTHREADS][IOBUFSIZE];
 #ifdef _WIN32
 static HANDLE l_Events[IOTHREADS];
 #else /* _WIN32 */
 static int l_EventFDs[IOTHREADS][2];
 static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[IOTHREADS];
+static std::set<std::pair<double, Process::ProcessHandle> > l_Timeouts[IOTHREADS];
+#	ifdef HAVE_EPOLL
+static int l_EpollFDs[IOTHREADS];
+#	else /* HAVE_EPOLL */
+static bool l_FDsChanged[IOTHREADS];
+#	endif /* HAVE_EPOLL */
+
+#	ifndef MSG_NOSIGNAL
+#		define MSG_NOSIGNAL 0
+#	endif /* MSG_NOSIGNAL */
+
+static boost::mutex l_SpawnHelperMutex;
+static int l_SpawnHelperFD = -1;
+static int l_SpawnHelperStatusFD = -1;
+static boost::mutex l_SpawnHelperStatusMutex;
+static std::map<Process::ProcessHandle, int> l_SpawnHelperStatus;
+static int l_SpawnHelperSignalFDs[2];
 #endif /* _WIN32 */
 static boost::once_flag l_OnceFlag = BOOST_ONCE_INIT;
 
@@ -64,7 +95,16 @@ INITIALIZE_ONCE(&Process::StaticInitialize);
 
 Process::Process(const Process::Arguments& arguments, const Dictionary::Ptr& extraEnvironment)
 	: m_Arguments(arguments), m_ExtraEnvironment(extraEnvironment), m_Timeout(600)
-{ }
+{
+#ifndef _WIN32
+	m_PidFD = -1;
+	m_Status = 0;
+	m_Reaped = false;
+	m_TimedOut = false;
+	m_SpawnHelper = false;
+	m_NextTimeout = 0;
+#endif /* _WIN32 */
+}
 
 void Process::StaticInitialize(void)
 {
@@ -91,6 +131,29 @@ void Process::StaticInitialize(void)
 
 		Utility::SetNonBlocking(l_EventFDs[tid][0]);
 		Utility::SetNonBlocking(l_EventFDs[tid][1]);
+
+#	ifdef HAVE_EPOLL
+		l_EpollFDs[tid] = epoll_create1(EPOLL_CLOEXEC);
+
+		if (l_EpollFDs[tid] < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("epoll_create1")
+				<< boost::errinfo_errno(errno));
+		}
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.data.fd = l_EventFDs[tid][0];
+		event.events = EPOLLIN;
+
+		if (epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, l_EventFDs[tid][0], &event) < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("epoll_ctl")
+				<< boost::errinfo_errno(errno));
+		}
+#	else /* HAVE_EPOLL */
+		l_FDsChanged[tid] = true;
+#	endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
 	}
 }
@@ -102,6 +165,416 @@ void Process::ThreadInitialize(void)
 		boost::thread t(boost::bind(&Process::IOThreadProc, tid));
 		t.detach();
 	}
+
+#ifndef _WIN32
+	if (l_SpawnHelperStatusFD != -1) {
+		boost::thread t(&Process::SpawnHelperThreadProc);
+		t.detach();
+	}
+#endif /* _WIN32 */
+}
+
+#ifndef _WIN32
+static String GetSpawnMode(void)
+{
+	ScriptVariable::Ptr mode = ScriptVariable::GetByName("SpawnMode");
+
+	if (!mode)
+		return "fork";
+
+	return mode->GetData();
+}
+
+static void CreatePipe(int fds[2])
+{
+#ifdef HAVE_PIPE2
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("pipe2")
+			<< boost::errinfo_errno(errno));
+	}
+#else /* HAVE_PIPE2 */
+	if (pipe(fds) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("pipe")
+			<< boost::errinfo_errno(errno));
+	}
+
+	Utility::SetCloExec(fds[0]);
+	Utility::SetCloExec(fds[1]);
+#endif /* HAVE_PIPE2 */
+}
+
+static char **BuildArguments(const std::vector<String>& arguments)
+{
+	char **argv = new char *[arguments.size() + 1];
+
+	for (unsigned int i = 0; i < arguments.size(); i++)
+		argv[i] = strdup(arguments[i].CStr());
+
+	argv[arguments.size()] = NULL;
+
+	return argv;
+}
+
+static char **BuildEnvironment(const Dictionary::Ptr& extraEnvironment)
+{
+	int envc = 0;
+
+	/* count existing environment variables */
+	while (environ[envc] != NULL)
+		envc++;
+
+	char **envp = new char *[envc + (extraEnvironment ? extraEnvironment->GetLength() : 0) + 1];
+
+	for (int i = 0; i < envc; i++)
+		envp[i] = strdup(environ[i]);
+
+	if (extraEnvironment) {
+		ObjectLock olock(extraEnvironment);
+
+		int index = envc;
+		BOOST_FOREACH(const Dictionary::Pair& kv, extraEnvironment) {
+			String skv = kv.first + "=" + Convert::ToString(kv.second);
+			envp[index] = strdup(skv.CStr());
+			index++;
+		}
+	}
+
+	envp[envc + (extraEnvironment ? extraEnvironment->GetLength() : 0)] = NULL;
+
+	return envp;
+}
+
+static void FreeStrings(char **strings)
+{
+	for (int i = 0; strings[i] != NULL; i++)
+		free(strings[i]);
+
+	delete[] strings;
+}
+
+/**
+ * Runs in the child process after fork(): Redirects stdout/stderr
+ * to the output pipe and executes the command.
+ */
+static void ExecChild(int fd, char **argv, char **envp)
+{
+	if (dup2(fd, STDOUT_FILENO) < 0 || dup2(fd, STDERR_FILENO) < 0) {
+		perror("dup2() failed.");
+		_exit(128);
+	}
+
+	(void)close(fd);
+
+	(void)nice(5);
+
+	if (icinga2_execvpe(argv[0], argv, envp) < 0) {
+		perror("execvpe() failed.");
+		_exit(128);
+	}
+
+	_exit(128);
+}
+
+static bool SpawnHelperSend(int fd, const String& message, int passfd)
+{
+	iovec iov;
+	iov.iov_base = const_cast<char *>(message.CStr());
+	iov.iov_len = message.GetLength();
+
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	union {
+		cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	if (passfd != -1) {
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+
+		cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &passfd, sizeof(int));
+	}
+
+	ssize_t rc;
+
+	do {
+		rc = sendmsg(fd, &msg, MSG_NOSIGNAL);
+	} while (rc < 0 && errno == EINTR);
+
+	return (rc >= 0);
+}
+
+static bool SpawnHelperRecv(int fd, String& message, int *passfd)
+{
+	ssize_t length;
+
+	/* Find out how large the next message is. */
+	do {
+		length = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+	} while (length < 0 && errno == EINTR);
+
+	if (length <= 0)
+		return false;
+
+	std::vector<char> buffer(length);
+
+	iovec iov;
+	iov.iov_base = &buffer[0];
+	iov.iov_len = buffer.size();
+
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	union {
+		cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	int flags = 0;
+#ifdef MSG_CMSG_CLOEXEC
+	flags |= MSG_CMSG_CLOEXEC;
+#endif /* MSG_CMSG_CLOEXEC */
+
+	ssize_t rc;
+
+	do {
+		rc = recvmsg(fd, &msg, flags);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc <= 0)
+		return false;
+
+	if (passfd) {
+		*passfd = -1;
+
+		for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+				memcpy(passfd, CMSG_DATA(cmsg), sizeof(int));
+#ifndef MSG_CMSG_CLOEXEC
+				Utility::SetCloExec(*passfd);
+#endif /* MSG_CMSG_CLOEXEC */
+			}
+		}
+	}
+
+	message = String(buffer.begin(), buffer.begin() + rc);
+
+	return true;
+}
+
+static void SpawnHelperSigChldHandler(int)
+{
+	int saved_errno = errno;
+	(void)write(l_SpawnHelperSignalFDs[1], "C", 1);
+	errno = saved_errno;
+}
+
+static void SpawnHelperHandleRequest(int fd, const String& message)
+{
+	Dictionary::Ptr response = make_shared<Dictionary>();
+	int fds[2] = { -1, -1 };
+
+	try {
+		Dictionary::Ptr request = JsonDeserialize(message);
+		Array::Ptr arguments = request->Get("arguments");
+
+		std::vector<String> args;
+
+		{
+			ObjectLock olock(arguments);
+			BOOST_FOREACH(const Value& argument, arguments) {
+				args.push_back(argument);
+			}
+		}
+
+		CreatePipe(fds);
+
+		char **argv = BuildArguments(args);
+		char **envp = BuildEnvironment(request->Get("extra_environment"));
+
+#ifdef HAVE_VFORK
+		pid_t pid = vfork();
+#else /* HAVE_VFORK */
+		pid_t pid = fork();
+#endif /* HAVE_VFORK */
+
+		if (pid == 0)
+			ExecChild(fds[1], argv, envp);
+
+		int error = errno;
+
+		FreeStrings(argv);
+		FreeStrings(envp);
+
+		(void)close(fds[1]);
+
+		if (pid < 0) {
+			(void)close(fds[0]);
+			fds[0] = -1;
+			response->Set("errno", error);
+		} else
+			response->Set("pid", pid);
+	} catch (const posix_error& ex) {
+		const int *error = boost::get_error_info<boost::errinfo_errno>(ex);
+		response->Set("errno", error ? *error : EINVAL);
+	} catch (const std::exception&) {
+		response->Set("errno", EINVAL);
+	}
+
+	(void)SpawnHelperSend(fd, JsonSerialize(response), fds[0]);
+
+	if (fds[0] != -1)
+		(void)close(fds[0]);
+}
+
+/**
+ * Main loop for the spawn helper process. It starts processes on behalf
+ * of the daemon and reports their exit status, so that the daemon
+ * itself doesn't have to fork.
+ */
+static void SpawnHelperProc(int fd, int statusFD)
+{
+	/* Don't get killed by signals sent to the daemon's process group. */
+	(void)setsid();
+
+	int fdnull = open("/dev/null", O_RDWR);
+	if (fdnull >= 0) {
+		(void)dup2(fdnull, STDIN_FILENO);
+		(void)dup2(fdnull, STDOUT_FILENO);
+
+		if (fdnull > STDERR_FILENO)
+			(void)close(fdnull);
+	}
+
+	CreatePipe(l_SpawnHelperSignalFDs);
+	Utility::SetNonBlocking(l_SpawnHelperSignalFDs[0]);
+	Utility::SetNonBlocking(l_SpawnHelperSignalFDs[1]);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &SpawnHelperSigChldHandler;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+
+	for (;;) {
+		pollfd pfds[2];
+		pfds[0].fd = fd;
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+		pfds[1].fd = l_SpawnHelperSignalFDs[0];
+		pfds[1].events = POLLIN;
+		pfds[1].revents = 0;
+
+		int rc = poll(pfds, 2, -1);
+
+		if (rc < 0 && errno != EINTR)
+			_exit(EXIT_FAILURE);
+
+		if (pfds[1].revents & POLLIN) {
+			char buffer[512];
+			while (read(l_SpawnHelperSignalFDs[0], buffer, sizeof(buffer)) > 0)
+				; /* Empty loop body. */
+		}
+
+		pid_t pid;
+		int status;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			Dictionary::Ptr message = make_shared<Dictionary>();
+			message->Set("pid", pid);
+			message->Set("status", status);
+
+			if (!SpawnHelperSend(statusFD, JsonSerialize(message), -1))
+				_exit(EXIT_SUCCESS);
+		}
+
+		if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+			String request;
+
+			/* The daemon has terminated. */
+			if (!SpawnHelperRecv(fd, request, NULL))
+				_exit(EXIT_SUCCESS);
+
+			SpawnHelperHandleRequest(fd, request);
+		}
+	}
+}
+#endif /* _WIN32 */
+
+/**
+ * Starts the spawn helper process. This should be called as early as
+ * possible while the daemon is still small and has no other threads.
+ */
+void Process::InitializeSpawnHelper(void)
+{
+#ifndef _WIN32
+	if (GetSpawnMode() != "helper")
+		return;
+
+	int fds[2], statusFDs[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0) {
+		Log(LogWarning, "base", "Could not create socket pair for the spawn helper, falling back to fork(): " + String(strerror(errno)));
+		return;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, statusFDs) < 0) {
+		Log(LogWarning, "base", "Could not create socket pair for the spawn helper, falling back to fork(): " + String(strerror(errno)));
+		(void)close(fds[0]);
+		(void)close(fds[1]);
+		return;
+	}
+
+	Utility::SetCloExec(fds[0]);
+	Utility::SetCloExec(fds[1]);
+	Utility::SetCloExec(statusFDs[0]);
+	Utility::SetCloExec(statusFDs[1]);
+
+	pid_t pid = fork();
+
+	if (pid < 0) {
+		Log(LogWarning, "base", "Could not start the spawn helper, falling back to fork(): " + String(strerror(errno)));
+		(void)close(fds[0]);
+		(void)close(fds[1]);
+		(void)close(statusFDs[0]);
+		(void)close(statusFDs[1]);
+		return;
+	}
+
+	if (pid == 0) {
+		(void)close(fds[0]);
+		(void)close(statusFDs[0]);
+
+		try {
+			SpawnHelperProc(fds[1], statusFDs[1]);
+		} catch (...) {
+			/* Nothing to do here. */
+		}
+
+		_exit(EXIT_FAILURE);
+	}
+
+	(void)close(fds[1]);
+	(void)close(statusFDs[1]);
+
+	l_SpawnHelperFD = fds[0];
+	l_SpawnHelperStatusFD = statusFDs[0];
+
+	Log(LogInformation, "base", "Started spawn helper: PID " + Convert::ToString(pid));
+#endif /* _WIN32 */
 }
 
 Process::Arguments Process::PrepareCommand(const Value& command)
@@ -152,15 +625,12 @@ double Process::GetTimeout(void) const
 
 void Process::IOThreadProc(int tid)
 {
+	Utility::SetThreadName("ProcessIO");
+
 #ifdef _WIN32
 	HANDLE *handles = NULL;
-#else /* _WIN32 */
-	pollfd *pfds = NULL;
-#endif /* _WIN32 */
 	int count = 0;
 
-	Utility::SetThreadName("ProcessIO");
-
 	for (;;) {
 		double now, timeout = -1;
 
@@ -170,29 +640,14 @@ void Process::IOThreadProc(int tid)
 			boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
 
 			count = 1 + l_Processes[tid].size();
-#ifdef _WIN32
 			handles = reinterpret_cast<HANDLE *>(realloc(handles, sizeof(HANDLE) * count));
 
 			handles[0] = l_Events[tid];
 
-#else /* _WIN32 */
-			pfds = reinterpret_cast<pollfd *>(realloc(pfds, sizeof(pollfd) * count));
-
-			pfds[0].fd = l_EventFDs[tid][0];
-			pfds[0].events = POLLIN;
-			pfds[0].revents = 0;
-#endif /* _WIN32 */
-
 			int i = 1;
 			std::pair<ProcessHandle, Process::Ptr> kv;
 			BOOST_FOREACH(kv, l_Processes[tid]) {
-#ifdef _WIN32
 				handles[i] = kv.first;
-#else /* _WIN32 */
-				pfds[i].fd = kv.second->m_FD;
-				pfds[i].events = POLLIN;
-				pfds[i].revents = 0;
-#endif /* _WIN32 */
 
 				if (kv.second->m_Timeout != 0) {
 					double delta = kv.second->m_Timeout - (now - kv.second->m_Result.ExecutionStart);
@@ -208,64 +663,143 @@ void Process::IOThreadProc(int tid)
 		if (timeout != -1)
 			timeout *= 1000;
 
-#ifdef _WIN32
 		DWORD rc = WaitForMultipleObjects(count, handles, FALSE, timeout == -1 ? INFINITE : static_cast<DWORD>(timeout));
-#else /* _WIN32 */
-		int rc = poll(pfds, count, timeout);
-
-		if (rc < 0)
-			continue;
-#endif /* _WIN32 */
 
 		{
 			boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
 
-#ifdef _WIN32
 			if (rc == WAIT_OBJECT_0)
 				ResetEvent(l_Events[tid]);
-#else /* _WIN32 */
-			if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
-				char buffer[512];
-				(void)read(l_EventFDs[tid][0], buffer, sizeof(buffer));
-			}
-#endif /* _WIN32 */
 
 			for (int i = 1; i < count; i++) {
-#ifdef _WIN32
 				if (rc == WAIT_OBJECT_0 + i) {
-#else /* _WIN32 */
-				if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
-					std::map<ConsoleHandle, ProcessHandle>::iterator it2;
-					it2 = l_FDs[tid].find(pfds[i].fd);
-
-					if (it2 == l_FDs[tid].end())
-						continue; /* This should never happen. */
-
-#endif /* _WIN32 */
 					std::map<ProcessHandle, Process::Ptr>::iterator it;
-#ifdef _WIN32
 					it = l_Processes[tid].find(handles[i]);
-#else /* _WIN32 */
-					it = l_Processes[tid].find(it2->second);
-#endif /* _WIN32 */
 
 					if (it == l_Processes[tid].end())
 						continue; /* This should never happen. */
 
-					if (!it->second->DoEvents()) {
-#ifdef _WIN32
-						CloseHandle(it->first);
-						CloseHandle(it->second->m_FD);
-#else /* _WIN32 */
-						l_FDs[tid].erase(it->second->m_FD);
-						(void)close(it->second->m_FD);
-#endif /* _WIN32 */
-						l_Processes[tid].erase(it);
-					}
+					if (!it->second->DoEvents()) {
+						CloseHandle(it->first);
+						CloseHandle(it->second->m_FD);
+						l_Processes[tid].erase(it);
+					}
+				}
+			}
+		}
+	}
+#else /* _WIN32 */
+#	ifdef HAVE_EPOLL
+	epoll_event events[128];
+#	else /* HAVE_EPOLL */
+	std::vector<pollfd> pfds;
+#	endif /* HAVE_EPOLL */
+	std::vector<int> ready;
+
+	for (;;) {
+		int timeout = -1;
+
+		{
+			boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+			if (!l_Timeouts[tid].empty()) {
+				double delta = l_Timeouts[tid].begin()->first - Utility::GetTime();
+
+				if (delta < 0)
+					delta = 0;
+
+				/* Round up so that we don't wake up just before the deadline. */
+				timeout = static_cast<int>(delta * 1000) + 1;
+			}
+
+#	ifndef HAVE_EPOLL
+			if (l_FDsChanged[tid]) {
+				pfds.resize(1 + l_FDs[tid].size());
+
+				pfds[0].fd = l_EventFDs[tid][0];
+				pfds[0].events = POLLIN;
+
+				int i = 1;
+				typedef std::pair<ConsoleHandle, ProcessHandle> kv_pair;
+				BOOST_FOREACH(const kv_pair& kv, l_FDs[tid]) {
+					pfds[i].fd = kv.first;
+					pfds[i].events = POLLIN;
+					i++;
+				}
+
+				l_FDsChanged[tid] = false;
+			}
+#	endif /* HAVE_EPOLL */
+		}
+
+		ready.clear();
+
+#	ifdef HAVE_EPOLL
+		int rc = epoll_wait(l_EpollFDs[tid], events, sizeof(events) / sizeof(events[0]), timeout);
+
+		for (int i = 0; i < rc; i++)
+			ready.push_back(events[i].data.fd);
+#	else /* HAVE_EPOLL */
+		int rc = poll(&pfds[0], pfds.size(), timeout);
+
+		if (rc > 0) {
+			BOOST_FOREACH(const pollfd& pfd, pfds) {
+				if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+					ready.push_back(pfd.fd);
+			}
+		}
+#	endif /* HAVE_EPOLL */
+
+		{
+			boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+			BOOST_FOREACH(int fd, ready) {
+				if (fd == l_EventFDs[tid][0]) {
+					char buffer[512];
+					while (read(fd, buffer, sizeof(buffer)) > 0)
+						; /* Empty loop body. */
+
+					continue;
+				}
+
+				std::map<ConsoleHandle, ProcessHandle>::iterator it2;
+				it2 = l_FDs[tid].find(fd);
+
+				if (it2 == l_FDs[tid].end())
+					continue; /* The process has already finished. */
+
+				std::map<ProcessHandle, Process::Ptr>::iterator it;
+				it = l_Processes[tid].find(it2->second);
+
+				if (it == l_Processes[tid].end())
+					continue; /* This should never happen. */
+
+				/* Keep a reference, Finish() removes the process from l_Processes. */
+				Process::Ptr process = it->second;
+
+				if (fd == process->m_PidFD)
+					process->HandleExit(tid);
+				else
+					process->HandleOutput(tid);
+			}
+
+			double now = Utility::GetTime();
+
+			while (!l_Timeouts[tid].empty() && l_Timeouts[tid].begin()->first <= now) {
+				std::map<ProcessHandle, Process::Ptr>::iterator it;
+				it = l_Processes[tid].find(l_Timeouts[tid].begin()->second);
+
+				if (it == l_Processes[tid].end()) {
+					l_Timeouts[tid].erase(l_Timeouts[tid].begin()); /* This should never happen. */
+					continue;
 				}
+
+				Process::Ptr process = it->second;
+				process->HandleTimeout(tid, now);
 			}
 		}
 	}
+#endif /* _WIN32 */
 }
 
 void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
@@ -382,136 +916,137 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 		"': PID " + Convert::ToString(pi.dwProcessId));
 
 #else /* _WIN32 */
-	int fds[2];
-
-#ifdef HAVE_PIPE2
-	if (pipe2(fds, O_CLOEXEC) < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-			<< boost::errinfo_api_function("pipe2")
-			<< boost::errinfo_errno(errno));
-	}
-#else /* HAVE_PIPE2 */
-	if (pipe(fds) < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-			<< boost::errinfo_api_function("pipe")
-			<< boost::errinfo_errno(errno));
-	}
+	String mode = GetSpawnMode();
 
-	Utility::SetCloExec(fds[0]);
-	Utility::SetCloExec(fds[1]);
-#endif /* HAVE_PIPE2 */
-
-	// build argv
-	char **argv = new char *[m_Arguments.size() + 1];
-
-	for (unsigned int i = 0; i < m_Arguments.size(); i++)
-		argv[i] = strdup(m_Arguments[i].CStr());
-
-	argv[m_Arguments.size()] = NULL;
-
-	// build envp
-	int envc = 0;
+	if (mode != "helper" || !SpawnWithHelper()) {
+		int fds[2];
+		CreatePipe(fds);
 
-	/* count existing environment variables */
-	while (environ[envc] != NULL)
-		envc++;
+		char **argv = BuildArguments(m_Arguments);
+		char **envp = BuildEnvironment(m_ExtraEnvironment);
 
-	char **envp = new char *[envc + (m_ExtraEnvironment ? m_ExtraEnvironment->GetLength() : 0) + 1];
+#ifdef HAVE_POSIX_SPAWN
+		if (mode == "posix_spawn") {
+			posix_spawn_file_actions_t actions;
+			posix_spawn_file_actions_init(&actions);
+			posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+			posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
 
-	for (int i = 0; i < envc; i++)
-		envp[i] = strdup(environ[i]);
+			int rc = posix_spawnp(&m_Process, argv[0], &actions, NULL, argv, envp);
 
-	if (m_ExtraEnvironment) {
-		ObjectLock olock(m_ExtraEnvironment);
+			posix_spawn_file_actions_destroy(&actions);
 
-		int index = envc;
-		BOOST_FOREACH(const Dictionary::Pair& kv, m_ExtraEnvironment) {
-			String skv = kv.first + "=" + Convert::ToString(kv.second);
-			envp[index] = strdup(skv.CStr());
-			index++;
-		}
-	}
+			if (rc != 0) {
+				FreeStrings(argv);
+				FreeStrings(envp);
+				(void)close(fds[0]);
+				(void)close(fds[1]);
 
-	envp[envc + (m_ExtraEnvironment ? m_ExtraEnvironment->GetLength() : 0)] = NULL;
+				BOOST_THROW_EXCEPTION(posix_error()
+					<< boost::errinfo_api_function("posix_spawnp")
+					<< boost::errinfo_errno(rc));
+			}
 
-	m_ExtraEnvironment.reset();
+			/* posix_spawn() can't change the child's nice value, do it
+			 * here instead just like ExecChild() does for fork(). */
+			errno = 0;
+			int prio = getpriority(PRIO_PROCESS, 0);
 
+			if (errno == 0)
+				(void)setpriority(PRIO_PROCESS, m_Process, prio + 5);
+		} else {
+#endif /* HAVE_POSIX_SPAWN */
 #ifdef HAVE_VFORK
-	Value use_vfork = ScriptVariable::Get("UseVfork");
+			Value use_vfork = ScriptVariable::Get("UseVfork");
 
-	if (use_vfork.IsEmpty() || static_cast<bool>(use_vfork))
-		m_Process = vfork();
-	else
-		m_Process = fork();
+			if (use_vfork.IsEmpty() || static_cast<bool>(use_vfork))
+				m_Process = vfork();
+			else
+				m_Process = fork();
 #else /* HAVE_VFORK */
-	m_Process = fork();
+			m_Process = fork();
 #endif /* HAVE_VFORK */
 
-	if (m_Process < 0) {
-		BOOST_THROW_EXCEPTION(posix_error()
-			<< boost::errinfo_api_function("fork")
-			<< boost::errinfo_errno(errno));
-	}
-
-	if (m_Process == 0) {
-		// child process
+			if (m_Process < 0) {
+				BOOST_THROW_EXCEPTION(posix_error()
+					<< boost::errinfo_api_function("fork")
+					<< boost::errinfo_errno(errno));
+			}
 
-		if (dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[1], STDERR_FILENO) < 0) {
-			perror("dup2() failed.");
-			_exit(128);
+			if (m_Process == 0)
+				ExecChild(fds[1], argv, envp);
+#ifdef HAVE_POSIX_SPAWN
 		}
+#endif /* HAVE_POSIX_SPAWN */
 
-		(void)close(fds[0]);
-		(void)close(fds[1]);
+		FreeStrings(argv);
+		FreeStrings(envp);
 
-		(void)nice(5);
+		(void)close(fds[1]);
 
-		if (icinga2_execvpe(argv[0], argv, envp) < 0) {
-			perror("execvpe() failed.");
-			_exit(128);
-		}
+		m_FD = fds[0];
 
-		_exit(128);
+#ifdef SYS_pidfd_open
+		/* The pidfd becomes readable once the child has exited which saves
+		 * us from having to poll waitpid(). Older kernels return ENOSYS. */
+		m_PidFD = syscall(SYS_pidfd_open, m_Process, 0);
+#endif /* SYS_pidfd_open */
 	}
 
-	// parent process
-
 	Log(LogInformation, "base", "Running command '" + boost::algorithm::join(m_Arguments, " ") +
 		"': PID " + Convert::ToString(m_Process));
 
 	m_Arguments.clear();
+	m_ExtraEnvironment.reset();
 
-	// free arguments
-	for (int i = 0; argv[i] != NULL; i++)
-		free(argv[i]);
-
-	delete[] argv;
-
-	// free environment
-	for (int i = 0; envp[i] != NULL; i++)
-		free(envp[i]);
-
-	delete[] envp;
-
-	(void)close(fds[1]);
-
-	Utility::SetNonBlocking(fds[0]);
-
-	m_FD = fds[0];
+	Utility::SetNonBlocking(m_FD);
 #endif /* _WIN32 */
 
 	m_Callback = callback;
 
 	int tid = GetTID();
+	bool wakeup = true;
 
 	{
+#ifndef _WIN32
+		/* The spawn helper might have reported the exit status already. */
+		boost::mutex::scoped_lock slock(l_SpawnHelperStatusMutex, boost::defer_lock);
+
+		if (m_SpawnHelper)
+			slock.lock();
+#endif /* _WIN32 */
+
 		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
 		l_Processes[tid][m_Process] = GetSelf();
 #ifndef _WIN32
-		l_FDs[tid][m_FD] = m_Process;
+		if (m_SpawnHelper) {
+			std::map<ProcessHandle, int>::iterator it = l_SpawnHelperStatus.find(m_Process);
+
+			if (it != l_SpawnHelperStatus.end()) {
+				m_Status = it->second;
+				m_Reaped = true;
+				l_SpawnHelperStatus.erase(it);
+			}
+		}
+
+		AddFD(tid, m_FD);
+
+		if (m_PidFD != -1)
+			AddFD(tid, m_PidFD);
+
+		UpdateTimeout(tid);
+
+#	ifdef HAVE_EPOLL
+		/* epoll picks up new FDs on its own, the I/O thread only needs
+		 * to be woken up if its next timeout has changed. */
+		wakeup = (m_NextTimeout != 0 && l_Timeouts[tid].begin()->second == m_Process);
+#	endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
 	}
 
+	if (!wakeup)
+		return;
+
 #ifdef _WIN32
 	SetEvent(l_Events[tid]);
 #else /* _WIN32 */
@@ -519,84 +1054,395 @@ void Process::Run(const boost::function<void(const ProcessResult&)>& callback)
 #endif /* _WIN32 */
 }
 
+/**
+ * Reads the available output from the child process.
+ *
+ * @returns true if there might be more output, false if the
+ *          output pipe has been closed.
+ */
 bool Process::DoEvents(void)
 {
+	char *buffer = l_IOBuffers[GetTID()];
+
+#ifdef _WIN32
 	if (m_Timeout != 0) {
 		double timeout = m_Timeout - (Utility::GetTime() - m_Result.ExecutionStart);
 
 		if (timeout < 0) {
 			m_OutputStream << "<Timeout exceeded.>";
-#ifdef _WIN32
 			TerminateProcess(m_Process, 1);
-#else /* _WIN32 */
-			kill(m_Process, SIGKILL);
-#endif /* _WIN32 */
 		}
 	}
 
-	char buffer[512];
-	for (;;) {
-#ifdef _WIN32
-		DWORD rc;
-		if (!ReadFile(m_FD, buffer, sizeof(buffer), &rc, NULL) || rc == 0)
-			break;
-#else /* _WIN32 */
-		int rc = read(m_FD, buffer, sizeof(buffer));
+	DWORD rc;
+	if (ReadFile(m_FD, buffer, IOBUFSIZE, &rc, NULL) && rc > 0) {
+		m_OutputStream.write(buffer, rc);
+		return true;
+	}
 
-		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
-			return true;
+	WaitForSingleObject(m_Process, INFINITE);
+
+	DWORD exitcode;
+	GetExitCodeProcess(m_Process, &exitcode);
+
+	m_Result.ExecutionEnd = Utility::GetTime();
+	m_Result.ExitStatus = exitcode;
+	m_Result.Output = m_OutputStream.str();
+
+	if (m_Callback)
+		Utility::QueueAsyncCallback(boost::bind(m_Callback, m_Result));
+
+	return false;
+#else /* _WIN32 */
+	/* The FD is edge-triggered so we need to read until we hit EAGAIN. */
+	for (;;) {
+		ssize_t rc = read(m_FD, buffer, IOBUFSIZE);
 
 		if (rc > 0) {
-#endif /* _WIN32 */
 			m_OutputStream.write(buffer, rc);
-#ifdef _WIN32
-			return true;
-#else /* _WIN32 */
 			continue;
 		}
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+
+		return false;
+	}
 #endif /* _WIN32 */
+}
+
+#ifndef _WIN32
+void Process::AddFD(int tid, int fd)
+{
+	l_FDs[tid][fd] = m_Process;
 
-		break;
+#	ifdef HAVE_EPOLL
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.data.fd = fd;
+	event.events = EPOLLIN | EPOLLET;
+
+	if (epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, fd, &event) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_ctl")
+			<< boost::errinfo_errno(errno));
 	}
+#	else /* HAVE_EPOLL */
+	l_FDsChanged[tid] = true;
+#	endif /* HAVE_EPOLL */
+}
 
-	String output = m_OutputStream.str();
+void Process::RemoveFD(int tid, int fd)
+{
+#	ifdef HAVE_EPOLL
+	/* Closing the FD isn't enough if a concurrently forked child
+	 * still holds a copy of it. */
+	(void)epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_DEL, fd, NULL);
+#	else /* HAVE_EPOLL */
+	l_FDsChanged[tid] = true;
+#	endif /* HAVE_EPOLL */
+
+	l_FDs[tid].erase(fd);
+	(void)close(fd);
+}
 
-#ifdef _WIN32
-	WaitForSingleObject(m_Process, INFINITE);
+/**
+ * Updates this process' entry in the I/O thread's timeout set. The entry
+ * is due either when the process' timeout expires or - if the child
+ * can't be reaped using a pidfd - when we should try to reap it again.
+ */
+void Process::UpdateTimeout(int tid)
+{
+	double next = 0;
 
-	DWORD exitcode;
-	GetExitCodeProcess(m_Process, &exitcode);
-#else /* _WIN32 */
-	int status, exitcode;
-	if (waitpid(m_Process, &status, 0) != m_Process) {
+	if (m_Timeout != 0 && !m_TimedOut)
+		next = m_Result.ExecutionStart + m_Timeout;
+
+	if (m_FD == -1 && m_PidFD == -1 && !m_Reaped && !m_SpawnHelper) {
+		double retry = Utility::GetTime() + REAPINTERVAL;
+
+		if (next == 0 || retry < next)
+			next = retry;
+	}
+
+	if (next == m_NextTimeout)
+		return;
+
+	if (m_NextTimeout != 0)
+		l_Timeouts[tid].erase(std::make_pair(m_NextTimeout, m_Process));
+
+	m_NextTimeout = next;
+
+	if (m_NextTimeout != 0)
+		l_Timeouts[tid].insert(std::make_pair(m_NextTimeout, m_Process));
+}
+
+void Process::HandleTimeout(int tid, double now)
+{
+	l_Timeouts[tid].erase(std::make_pair(m_NextTimeout, m_Process));
+	m_NextTimeout = 0;
+
+	if (m_Timeout != 0 && !m_TimedOut && now >= m_Result.ExecutionStart + m_Timeout) {
+		m_OutputStream << "<Timeout exceeded.>";
+		kill(m_Process, SIGKILL);
+		m_TimedOut = true;
+	}
+
+	if (m_FD == -1 && m_PidFD == -1 && Reap()) {
+		Finish(tid);
+		return;
+	}
+
+	UpdateTimeout(tid);
+}
+
+void Process::HandleOutput(int tid)
+{
+	if (DoEvents())
+		return;
+
+	RemoveFD(tid, m_FD);
+	m_FD = -1;
+
+	/* Without a pidfd we have to check whether the child has exited. In most
+	 * cases it already has, otherwise UpdateTimeout() schedules a retry. */
+	if (m_PidFD == -1 && !m_Reaped)
+		Reap();
+
+	if (m_Reaped)
+		Finish(tid);
+	else
+		UpdateTimeout(tid);
+}
+
+void Process::HandleExit(int tid)
+{
+	Reap();
+
+	RemoveFD(tid, m_PidFD);
+	m_PidFD = -1;
+
+	/* Wait for the output pipe to be closed before finishing the process. */
+	if (m_Reaped && m_FD == -1)
+		Finish(tid);
+	else
+		UpdateTimeout(tid);
+}
+
+/**
+ * Reaps the child process without blocking.
+ *
+ * @returns true if the child has been reaped, false otherwise.
+ */
+bool Process::Reap(void)
+{
+	/* The spawn helper reaps its children and sends us their exit status. */
+	if (m_SpawnHelper)
+		return m_Reaped;
+
+	int rc = waitpid(m_Process, &m_Status, WNOHANG);
+
+	if (rc == 0 || (rc < 0 && errno == EINTR))
+		return false;
+
+	if (rc < 0) {
 		BOOST_THROW_EXCEPTION(posix_error()
 			<< boost::errinfo_api_function("waitpid")
 			<< boost::errinfo_errno(errno));
 	}
 
-	if (WIFEXITED(status)) {
-		exitcode = WEXITSTATUS(status);
-	}
-	else if (WIFSIGNALED(status)) {
+	m_Reaped = true;
+
+	return true;
+}
+
+void Process::Finish(int tid)
+{
+	String output = m_OutputStream.str();
+	int exitcode;
+
+	if (WIFEXITED(m_Status)) {
+		exitcode = WEXITSTATUS(m_Status);
+	} else if (WIFSIGNALED(m_Status)) {
 		std::ostringstream outputbuf;
-		outputbuf << "<Terminated by signal " << WTERMSIG(status) << ".>";
+		outputbuf << "<Terminated by signal " << WTERMSIG(m_Status) << ".>";
 		output = output + outputbuf.str();
 		exitcode = 128;
-	}
-	else {
+	} else {
 		exitcode = 128;
 	}
-#endif /* _WIN32 */
 
 	m_Result.ExecutionEnd = Utility::GetTime();
 	m_Result.ExitStatus = exitcode;
 	m_Result.Output = output;
 
+	if (m_NextTimeout != 0) {
+		l_Timeouts[tid].erase(std::make_pair(m_NextTimeout, m_Process));
+		m_NextTimeout = 0;
+	}
+
 	if (m_Callback)
 		Utility::QueueAsyncCallback(boost::bind(m_Callback, m_Result));
 
+	l_Processes[tid].erase(m_Process);
+}
+
+/**
+ * Starts the process using the spawn helper.
+ *
+ * @returns true if the process was started, false if the spawn helper
+ *          isn't available.
+ */
+bool Process::SpawnWithHelper(void)
+{
+	Array::Ptr arguments = make_shared<Array>();
+
+	BOOST_FOREACH(const String& argument, m_Arguments) {
+		arguments->Add(argument);
+	}
+
+	Dictionary::Ptr extraEnvironment;
+
+	if (m_ExtraEnvironment) {
+		extraEnvironment = make_shared<Dictionary>();
+
+		ObjectLock olock(m_ExtraEnvironment);
+		BOOST_FOREACH(const Dictionary::Pair& kv, m_ExtraEnvironment) {
+			extraEnvironment->Set(kv.first, Convert::ToString(kv.second));
+		}
+	}
+
+	Dictionary::Ptr request = make_shared<Dictionary>();
+	request->Set("arguments", arguments);
+	request->Set("extra_environment", extraEnvironment);
+
+	String message = JsonSerialize(request);
+	int fd;
+
+	{
+		boost::mutex::scoped_lock lock(l_SpawnHelperMutex);
+
+		if (l_SpawnHelperFD == -1)
+			return false;
+
+		if (!SpawnHelperSend(l_SpawnHelperFD, message, -1) || !SpawnHelperRecv(l_SpawnHelperFD, message, &fd)) {
+			Log(LogCritical, "base", "Lost connection to the spawn helper, falling back to fork().");
+
+			(void)close(l_SpawnHelperFD);
+			l_SpawnHelperFD = -1;
+
+			return false;
+		}
+	}
+
+	Dictionary::Ptr response = JsonDeserialize(message);
+
+	if (response->Contains("errno") || fd == -1) {
+		if (fd != -1)
+			(void)close(fd);
+
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("fork")
+			<< boost::errinfo_errno(static_cast<int>(response->Get("errno"))));
+	}
+
+	m_Process = static_cast<long>(response->Get("pid"));
+	m_FD = fd;
+	m_SpawnHelper = true;
+
+	return true;
+}
+
+void Process::SpawnHelperThreadProc(void)
+{
+	Utility::SetThreadName("SpawnHelper");
+
+	for (;;) {
+		String message;
+
+		if (!SpawnHelperRecv(l_SpawnHelperStatusFD, message, NULL))
+			break;
+
+		Dictionary::Ptr status = JsonDeserialize(message);
+		ProcessHandle pid = static_cast<long>(status->Get("pid"));
+
+		boost::mutex::scoped_lock lock(l_SpawnHelperStatusMutex);
+
+		if (!SetSpawnHelperStatus(pid, status->Get("status")))
+			l_SpawnHelperStatus[pid] = status->Get("status");
+	}
+
+	Log(LogCritical, "base", "The spawn helper has terminated, falling back to fork().");
+
+	{
+		boost::mutex::scoped_lock lock(l_SpawnHelperMutex);
+
+		if (l_SpawnHelperFD != -1) {
+			(void)close(l_SpawnHelperFD);
+			l_SpawnHelperFD = -1;
+		}
+	}
+
+	/* We won't get an exit status for the remaining processes. */
+	boost::mutex::scoped_lock slock(l_SpawnHelperStatusMutex);
+
+	for (int tid = 0; tid < IOTHREADS; tid++) {
+		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+		std::vector<Process::Ptr> processes;
+
+		std::pair<ProcessHandle, Process::Ptr> kv;
+		BOOST_FOREACH(kv, l_Processes[tid]) {
+			if (kv.second->m_SpawnHelper && !kv.second->m_Reaped)
+				processes.push_back(kv.second);
+		}
+
+		BOOST_FOREACH(const Process::Ptr& process, processes) {
+			process->m_Status = W_EXITCODE(128, 0);
+			process->m_Reaped = true;
+
+			if (process->m_FD == -1)
+				process->Finish(tid);
+		}
+	}
+}
+
+/**
+ * Stores the exit status the spawn helper has reported for a process.
+ *
+ * @returns false if the process isn't registered (yet).
+ */
+bool Process::SetSpawnHelperStatus(ProcessHandle pid, int status)
+{
+	for (int tid = 0; tid < IOTHREADS; tid++) {
+		boost::mutex::scoped_lock lock(l_ProcessMutex[tid]);
+
+		std::map<ProcessHandle, Process::Ptr>::iterator it = l_Processes[tid].find(pid);
+
+		if (it == l_Processes[tid].end())
+			continue;
+
+		Process::Ptr process = it->second;
+
+		if (!process->m_SpawnHelper)
+			continue;
+
+		process->m_Status = status;
+		process->m_Reaped = true;
+
+		/* Otherwise HandleOutput() finishes the process once the pipe is closed. */
+		if (process->m_FD == -1)
+			process->Finish(tid);
+
+		return true;
+	}
+
 	return false;
 }
+#endif /* _WIN32 */
 
 int Process::GetTID(void) const
 {
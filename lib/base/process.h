@@ -79,6 +79,7 @@ public:
 
 	static void StaticInitialize(void);
 	static void ThreadInitialize(void);
+	static void InitializeSpawnHelper(void);
 
 private:
 	Arguments m_Arguments;
@@ -89,6 +90,15 @@ private:
 	ProcessHandle m_Process;
 	ConsoleHandle m_FD;
 
+#ifndef _WIN32
+	int m_PidFD; /**< pidfd for the child, or -1 if not supported. */
+	int m_Status; /**< The child's wait status, once reaped. */
+	bool m_Reaped; /**< Whether the child has been reaped. */
+	bool m_TimedOut; /**< Whether the child has been killed due to the timeout. */
+	bool m_SpawnHelper; /**< Whether the child was started by the spawn helper. */
+	double m_NextTimeout; /**< Key in the I/O thread's timeout set, or 0. */
+#endif /* _WIN32 */
+
 	std::ostringstream m_OutputStream;
 	boost::function<void (const ProcessResult&)> m_Callback;
 	ProcessResult m_Result;
@@ -96,6 +106,21 @@ private:
 	static void IOThreadProc(int tid);
 	bool DoEvents(void);
 	int GetTID(void) const;
+
+#ifndef _WIN32
+	void AddFD(int tid, int fd);
+	void RemoveFD(int tid, int fd);
+	void UpdateTimeout(int tid);
+	void HandleTimeout(int tid, double now);
+	void HandleOutput(int tid);
+	void HandleExit(int tid);
+	bool Reap(void);
+	void Finish(int tid);
+
+	bool SpawnWithHelper(void);
+	static void SpawnHelperThreadProc(void);
+	static bool SetSpawnHelperStatus(ProcessHandle pid, int status);
+#endif /* _WIN32 */
 };
 
 }
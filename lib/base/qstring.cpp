@@ -24,6 +24,7 @@
 #include <boost/algorithm/string/compare.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/functional/hash.hpp>
 
 using namespace icinga;
 
@@ -354,3 +355,8 @@ String::ConstIterator icinga::range_end(const String& x)
 {
 	return x.End();
 }
+
+size_t icinga::hash_value(const String& s)
+{
+	return boost::hash_value(s.GetData());
+}
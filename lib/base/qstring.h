@@ -149,6 +149,8 @@ I2_BASE_API String::ConstIterator range_begin(const String& x);
 I2_BASE_API String::Iterator range_end(String& x);
 I2_BASE_API String::ConstIterator range_end(const String& x);
 
+I2_BASE_API size_t hash_value(const String& s);
+
 struct string_iless : std::binary_function<String, String, bool>
 {
 	bool operator()(const String& s1, const String& s2) const
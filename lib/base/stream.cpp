@@ -24,6 +24,23 @@
 
 using namespace icinga;
 
+/**
+ * Reads up to the specified number of bytes from the stream. Unlike Read()
+ * this only blocks until some data is available rather than until the
+ * buffer has been filled.
+ *
+ * The default implementation just calls Read() which is fine for streams
+ * that return partial reads anyway.
+ *
+ * @param buffer The buffer where data should be stored.
+ * @param count The maximum number of bytes to read.
+ * @returns The number of bytes actually read, 0 on EOF.
+ */
+size_t Stream::ReadAvailable(void *buffer, size_t count)
+{
+	return Read(buffer, count);
+}
+
 bool Stream::ReadLine(String *line, ReadLineContext& context)
 {
 	if (context.Eof)
@@ -60,6 +60,8 @@ public:
 	 */
 	virtual size_t Read(void *buffer, size_t count) = 0;
 
+	virtual size_t ReadAvailable(void *buffer, size_t count);
+
 	/**
 	 * Writes data to the stream.
 	 *
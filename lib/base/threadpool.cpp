@@ -26,6 +26,7 @@
 #include "base/exception.h"
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 
@@ -33,11 +34,23 @@ using namespace icinga;
 
 int ThreadPool::m_NextID = 1;
 
+boost::thread_specific_ptr<ThreadPool::WorkerThread> ThreadPool::m_CurrentWorker;
+
+/* Maximum number of items a worker moves from the injection queue into its
+ * own queue in one go. */
+static const size_t l_InjectionBatchSize = 16;
+
+/* Number of worker threads we start with and never go below. */
+static const int l_MinThreads = 4;
+
 ThreadPool::ThreadPool(int max_threads)
-	: m_ID(m_NextID++), m_MaxThreads(max_threads), m_Stopped(false)
+	: m_ID(m_NextID++), m_MaxThreads(max_threads), m_LocalPosts(0), m_Stopped(false), m_MgmtStopped(false)
 {
-	if (m_MaxThreads != -1 && m_MaxThreads < sizeof(m_Queues) / sizeof(m_Queues[0]))
-		m_MaxThreads = sizeof(m_Queues) / sizeof(m_Queues[0]);
+	if (m_MaxThreads != -1 && m_MaxThreads < l_MinThreads)
+		m_MaxThreads = l_MinThreads;
+
+	for (size_t i = 0; i < sizeof(m_Threads) / sizeof(m_Threads[0]); i++)
+		m_Threads[i].Pool = this;
 
 	Start();
 }
@@ -50,22 +63,34 @@ ThreadPool::~ThreadPool(void)
 
 void ThreadPool::Start(void)
 {
-	for (int i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++)
-		m_Queues[i].SpawnWorker(m_ThreadGroup);
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		for (int i = 0; i < l_MinThreads; i++)
+			SpawnWorker();
+	}
 
 	m_ThreadGroup.create_thread(boost::bind(&ThreadPool::ManagerThreadProc, this));
 }
 
 void ThreadPool::Stop(void)
 {
-	for (int i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
-		boost::mutex::scoped_lock lock(m_Queues[i].Mutex);
-		m_Queues[i].Stopped = true;
-		m_Queues[i].CV.notify_all();
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_Stopped = true;
+
+		/* Post() only holds the worker's lock when it is called from
+		 * one of our worker threads. */
+		for (size_t i = 0; i < sizeof(m_Threads) / sizeof(m_Threads[0]); i++) {
+			boost::mutex::scoped_lock wlock(m_Threads[i].Mutex);
+			m_Threads[i].Stopped = true;
+		}
+
+		m_CV.notify_all();
 	}
 
 	boost::mutex::scoped_lock lock(m_MgmtMutex);
-	m_Stopped = true;
+	m_MgmtStopped = true;
 	m_MgmtCV.notify_all();
 }
 
@@ -79,50 +104,204 @@ void ThreadPool::Join(bool wait_for_stop)
 		return;
 	}
 
-	for (int i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
-		boost::mutex::scoped_lock lock(m_Queues[i].Mutex);
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	while (HasPendingItems())
+		m_CVStarved.timed_wait(lock, boost::posix_time::milliseconds(100));
+}
 
-		while (!m_Queues[i].Items.empty())
-			m_Queues[i].CVStarved.wait(lock);
+/**
+ * Checks whether there are any items left in the injection queue or
+ * in one of the workers' queues.
+ *
+ * Note: Caller must hold m_Mutex.
+ */
+bool ThreadPool::HasPendingItems(void)
+{
+	if (!m_Items.empty())
+		return true;
+
+	for (size_t i = 0; i < sizeof(m_Threads) / sizeof(m_Threads[0]); i++) {
+		boost::mutex::scoped_lock wlock(m_Threads[i].Mutex);
+
+		if (!m_Threads[i].Items.empty())
+			return true;
 	}
+
+	return false;
 }
 
 /**
- * Waits for work items and processes them.
+ * Takes a work item from the injection queue. Additional items are moved
+ * into the worker's own queue so other idle workers can steal them from there
+ * without having to contend for the injection queue.
+ *
+ * @param worker The worker thread.
+ * @param wi The work item.
+ * @returns true if an item was dequeued, false otherwise.
  */
-void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
+bool ThreadPool::DequeueInjected(WorkerThread& worker, WorkItem& wi)
 {
-	std::ostringstream idbuf;
-	idbuf << "Q #" << &queue << " W #" << this;
-	Utility::SetThreadName(idbuf.str());
+	boost::mutex::scoped_lock lock(m_Mutex);
 
-	for (;;) {
-		WorkItem wi;
+	if (m_Items.empty())
+		return false;
+
+	wi = m_Items.front();
+	m_Items.pop_front();
+
+	size_t count = std::min(m_Items.size() / 2, l_InjectionBatchSize);
+
+	if (count > 0) {
+		boost::mutex::scoped_lock wlock(worker.Mutex);
+
+		for (size_t i = 0; i < count; i++) {
+			worker.Items.push_back(m_Items.front());
+			m_Items.pop_front();
+		}
+
+		m_LocalPosts++;
+	}
+
+	/* Let another worker have a look at the remaining items. */
+	if (!m_Items.empty() || count > 0)
+		m_CV.notify_one();
+
+	return true;
+}
+
+/**
+ * Steals work items from another worker thread's queue. Half of the victim's
+ * items are taken, the oldest one is returned and the rest is appended to the
+ * thief's own queue.
+ *
+ * @param thief The worker thread which is looking for work.
+ * @param wi The work item.
+ * @returns true if an item was stolen, false otherwise.
+ */
+bool ThreadPool::Steal(WorkerThread& thief, WorkItem& wi)
+{
+	const size_t count = sizeof(m_Threads) / sizeof(m_Threads[0]);
+	size_t offset = Utility::Random() % count;
+
+	for (size_t i = 0; i < count; i++) {
+		WorkerThread& victim = m_Threads[(offset + i) % count];
+
+		if (&victim == &thief)
+			continue;
+
+		std::deque<WorkItem> items;
 
 		{
-			boost::mutex::scoped_lock lock(queue.Mutex);
+			boost::mutex::scoped_lock vlock(victim.Mutex);
 
-			UpdateUtilization(ThreadIdle);
+			if (victim.Items.empty())
+				continue;
 
-			while (queue.Items.empty() && !queue.Stopped && !Zombie) {
-				if (queue.Items.empty())
-					queue.CVStarved.notify_all();
+			size_t num = (victim.Items.size() + 1) / 2;
 
-				queue.CV.wait(lock);
+			for (size_t k = 0; k < num; k++) {
+				items.push_back(victim.Items.front());
+				victim.Items.pop_front();
 			}
+		}
+
+		wi = items.front();
+		items.pop_front();
+
+		boost::mutex::scoped_lock tlock(thief.Mutex);
+
+		thief.Items.insert(thief.Items.end(), items.begin(), items.end());
+		thief.StealCount++;
+
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Retrieves the next work item for this worker thread. Blocks until an item
+ * is available.
+ *
+ * @param wi The work item.
+ * @returns true if an item was retrieved, false if the thread should exit.
+ */
+bool ThreadPool::WorkerThread::GetWorkItem(WorkItem& wi)
+{
+	for (;;) {
+		{
+			boost::mutex::scoped_lock lock(Mutex);
 
 			if (Zombie)
-				break;
+				return false;
 
-			if (queue.Items.empty() && queue.Stopped)
-				break;
+			if (!Items.empty()) {
+				wi = Items.front();
+				Items.pop_front();
 
-			wi = queue.Items.front();
-			queue.Items.pop_front();
+				UpdateUtilization(ThreadBusy);
 
+				return true;
+			}
+
+			UpdateUtilization(ThreadIdle);
+		}
+
+		unsigned long localPosts;
+
+		{
+			boost::mutex::scoped_lock lock(Pool->m_Mutex);
+			localPosts = Pool->m_LocalPosts;
+		}
+
+		if (Pool->DequeueInjected(*this, wi) || Pool->Steal(*this, wi)) {
+			boost::mutex::scoped_lock lock(Mutex);
 			UpdateUtilization(ThreadBusy);
+
+			return true;
 		}
 
+		boost::mutex::scoped_lock lock(Pool->m_Mutex);
+
+		/* Items might have been added to another worker's queue after
+		 * we've looked for something to steal. */
+		if (!Pool->m_Items.empty() || Pool->m_LocalPosts != localPosts)
+			continue;
+
+		if (Pool->m_Stopped)
+			return false;
+
+		{
+			boost::mutex::scoped_lock wlock(Mutex);
+
+			if (Zombie)
+				return false;
+		}
+
+		Pool->m_CVStarved.notify_all();
+
+		Pool->m_CV.wait(lock);
+	}
+}
+
+/**
+ * Waits for work items and processes them.
+ */
+void ThreadPool::WorkerThread::ThreadProc(void)
+{
+	std::ostringstream idbuf;
+	idbuf << "TP #" << Pool->m_ID << " W #" << (this - Pool->m_Threads);
+	Utility::SetThreadName(idbuf.str());
+
+	m_CurrentWorker.reset(this);
+
+	for (;;) {
+		WorkItem wi;
+
+		if (!GetWorkItem(wi))
+			break;
+
 		double st = Utility::GetTime();;
 
 #ifdef _DEBUG
@@ -149,11 +328,11 @@ void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
 		double latency = st - wi.Timestamp;
 
 		{
-			boost::mutex::scoped_lock lock(queue.Mutex);
+			boost::mutex::scoped_lock lock(Mutex);
 
-			queue.WaitTime += latency;
-			queue.ServiceTime += et - st;
-			queue.TaskCount++;
+			WaitTime += latency;
+			ServiceTime += et - st;
+			TaskCount++;
 		}
 
 #ifdef _DEBUG
@@ -187,13 +366,28 @@ void ThreadPool::WorkerThread::ThreadProc(Queue& queue)
 #endif /* _DEBUG */
 	}
 
-	boost::mutex::scoped_lock lock(queue.Mutex);
+	/* The worker object is owned by the pool. */
+	m_CurrentWorker.release();
+
+	/* Hand any items we didn't get to back to the other workers. */
+	boost::mutex::scoped_lock plock(Pool->m_Mutex);
+	boost::mutex::scoped_lock lock(Mutex);
+
+	if (!Items.empty()) {
+		Pool->m_Items.insert(Pool->m_Items.end(), Items.begin(), Items.end());
+		Items.clear();
+
+		Pool->m_CV.notify_all();
+	}
+
 	UpdateUtilization(ThreadDead);
 	Zombie = false;
 }
 
 /**
- * Appends a work item to the work queue. Work items will be processed in FIFO order.
+ * Appends a work item to the work queue. Items which are posted from one of
+ * the pool's worker threads go into that thread's own queue, all other items
+ * are added to the injection queue.
  *
  * @param callback The callback function for the work item.
  * @returns true if the item was queued, false otherwise.
@@ -204,18 +398,39 @@ bool ThreadPool::Post(const ThreadPool::WorkFunction& callback)
 	wi.Callback = callback;
 	wi.Timestamp = Utility::GetTime();
 
-	Queue& queue = m_Queues[Utility::Random() % (sizeof(m_Queues) / sizeof(m_Queues[0]))];
+	WorkerThread *worker = m_CurrentWorker.get();
 
-	{
-		boost::mutex::scoped_lock lock(queue.Mutex);
+	if (worker && worker->Pool == this) {
+		{
+			boost::mutex::scoped_lock lock(worker->Mutex);
 
-		if (queue.Stopped)
-			return false;
+			if (worker->Stopped)
+				return false;
+
+			if (!worker->Zombie) {
+				worker->Items.push_back(wi);
+
+				lock.unlock();
 
-		queue.Items.push_back(wi);
-		queue.CV.notify_one();
+				/* Wake up an idle worker so it can steal the item. Workers
+				 * which are about to go to sleep notice the changed counter. */
+				boost::mutex::scoped_lock plock(m_Mutex);
+				m_LocalPosts++;
+				m_CV.notify_one();
+
+				return true;
+			}
+		}
 	}
 
+	boost::mutex::scoped_lock lock(m_Mutex);
+
+	if (m_Stopped)
+		return false;
+
+	m_Items.push_back(wi);
+	m_CV.notify_one();
+
 	return true;
 }
 
@@ -228,117 +443,128 @@ void ThreadPool::ManagerThreadProc(void)
 	double lastStats = 0;
 
 	for (;;) {
-		size_t total_pending = 0, total_alive = 0;
-		double total_avg_latency = 0;
-		double total_utilization = 0;
+		size_t pending, alive = 0;
+		double avg_latency;
+		double utilization = 0;
+		double wait_time = 0;
+		int task_count = 0, steal_count = 0;
 
 		{
 			boost::mutex::scoped_lock lock(m_MgmtMutex);
 
-			if (!m_Stopped)
+			if (!m_MgmtStopped)
 				m_MgmtCV.timed_wait(lock, boost::posix_time::seconds(5));
 
-			if (m_Stopped)
+			if (m_MgmtStopped)
 				break;
 		}
 
-		for (int i = 0; i < sizeof(m_Queues) / sizeof(m_Queues[0]); i++) {
-			size_t pending, alive = 0;
-			double avg_latency;
-			double utilization = 0;
+		boost::mutex::scoped_lock lock(m_Mutex);
 
-			Queue& queue = m_Queues[i];
+		pending = m_Items.size();
 
-			boost::mutex::scoped_lock lock(queue.Mutex);
+		for (size_t i = 0; i < sizeof(m_Threads) / sizeof(m_Threads[0]); i++) {
+			WorkerThread& thread = m_Threads[i];
 
-			for (size_t i = 0; i < sizeof(queue.Threads) / sizeof(queue.Threads[0]); i++)
-				queue.Threads[i].UpdateUtilization();
+			boost::mutex::scoped_lock wlock(thread.Mutex);
 
-			pending = queue.Items.size();
+			thread.UpdateUtilization();
 
-			for (size_t i = 0; i < sizeof(queue.Threads) / sizeof(queue.Threads[0]); i++) {
-				if (queue.Threads[i].State != ThreadDead && !queue.Threads[i].Zombie) {
-					alive++;
-					utilization += queue.Threads[i].Utilization * 100;
-				}
+			pending += thread.Items.size();
+
+			if (thread.State != ThreadDead && !thread.Zombie) {
+				alive++;
+				utilization += thread.Utilization * 100;
 			}
 
-			utilization /= alive;
+			wait_time += thread.WaitTime;
+			task_count += thread.TaskCount;
+			steal_count += thread.StealCount;
 
-			if (queue.TaskCount > 0)
-				avg_latency = queue.WaitTime / (queue.TaskCount * 1.0);
-			else
-				avg_latency = 0;
+			thread.WaitTime = 0;
+			thread.ServiceTime = 0;
+			thread.TaskCount = 0;
+			thread.StealCount = 0;
+		}
 
-			if (utilization < 60 || utilization > 80 || alive < 8) {
-				double wthreads = ceil((utilization * alive) / 80.0);
+		if (alive > 0)
+			utilization /= alive;
 
-				int tthreads = wthreads - alive;
+		if (task_count > 0)
+			avg_latency = wait_time / (task_count * 1.0);
+		else
+			avg_latency = 0;
 
-				/* Don't ever kill the last thread. */
-				if (alive + tthreads < 1)
-					tthreads = 1 - alive;
+		if (utilization < 60 || utilization > 80 || alive < 8) {
+			double wthreads = ceil((utilization * alive) / 80.0);
 
-				/* Don't kill more than 8 threads at once. */
-				if (tthreads < -8)
-					tthreads = -8;
+			int tthreads = wthreads - alive;
 
-				/* Spawn more workers if there are outstanding work items. */
-				if (tthreads > 0 && pending > 0)
-					tthreads = 8;
+			/* Don't go below the minimum number of threads. */
+			if (alive + tthreads < l_MinThreads)
+				tthreads = l_MinThreads - alive;
 
-				if (m_MaxThreads != -1 && (alive + tthreads) * (sizeof(m_Queues) / sizeof(m_Queues[0])) > m_MaxThreads)
-					tthreads = m_MaxThreads / (sizeof(m_Queues) / sizeof(m_Queues[0])) - alive;
+			/* Don't kill more than 8 threads at once. */
+			if (tthreads < -8)
+				tthreads = -8;
 
-				if (tthreads != 0) {
-					std::ostringstream msgbuf;
-					msgbuf << "Thread pool; current: " << alive << "; adjustment: " << tthreads;
-					Log(LogDebug, "base", msgbuf.str());
-				}
+			/* Spawn more workers if there are outstanding work items. */
+			if (tthreads > 0 && pending > 0)
+				tthreads = 8;
 
-				for (int i = 0; i < -tthreads; i++)
-					queue.KillWorker(m_ThreadGroup);
+			if (m_MaxThreads != -1 && static_cast<int>(alive) + tthreads > m_MaxThreads)
+				tthreads = m_MaxThreads - alive;
 
-				for (int i = 0; i < tthreads; i++)
-					queue.SpawnWorker(m_ThreadGroup);
+			if (tthreads != 0) {
+				std::ostringstream msgbuf;
+				msgbuf << "Thread pool; current: " << alive << "; adjustment: " << tthreads;
+				Log(LogDebug, "base", msgbuf.str());
 			}
 
-			queue.WaitTime = 0;
-			queue.ServiceTime = 0;
-			queue.TaskCount = 0;
+			for (int i = 0; i < -tthreads; i++)
+				KillWorker();
 
-			total_pending += pending;
-			total_alive += alive;
-			total_avg_latency += avg_latency;
-			total_utilization += utilization;
+			for (int i = 0; i < tthreads; i++)
+				SpawnWorker();
 		}
 
+		lock.unlock();
+
 		double now = Utility::GetTime();
 
 		if (lastStats < now - 15) {
 			lastStats = now;
 
 			std::ostringstream msgbuf;
-			msgbuf << "Pool #" << m_ID << ": Pending tasks: " << total_pending << "; Average latency: "
-				<< (long)(total_avg_latency * 1000 / (sizeof(m_Queues) / sizeof(m_Queues[0]))) << "ms"
-				<< "; Threads: " << total_alive
-				<< "; Pool utilization: " << (total_utilization / (sizeof(m_Queues) / sizeof(m_Queues[0]))) << "%";
+			msgbuf << "Pool #" << m_ID << ": Pending tasks: " << pending << "; Average latency: "
+				<< (long)(avg_latency * 1000) << "ms"
+				<< "; Threads: " << alive
+				<< "; Pool utilization: " << utilization << "%"
+				<< "; Steals: " << steal_count;
 			Log(LogDebug, "base", msgbuf.str());
 		}
 	}
 }
 
 /**
- * Note: Caller must hold m_Mutex
+ * Note: Caller must hold m_Mutex.
  */
-void ThreadPool::Queue::SpawnWorker(boost::thread_group& group)
+void ThreadPool::SpawnWorker(void)
 {
-	for (size_t i = 0; i < sizeof(Threads) / sizeof(Threads[0]); i++) {
-		if (Threads[i].State == ThreadDead) {
+	for (size_t i = 0; i < sizeof(m_Threads) / sizeof(m_Threads[0]); i++) {
+		WorkerThread& thread = m_Threads[i];
+
+		boost::mutex::scoped_lock wlock(thread.Mutex);
+
+		if (thread.State == ThreadDead) {
 			Log(LogDebug, "base", "Spawning worker thread.");
 
-			Threads[i] = WorkerThread(ThreadIdle);
-			Threads[i].Thread = group.create_thread(boost::bind(&ThreadPool::WorkerThread::ThreadProc, boost::ref(Threads[i]), boost::ref(*this)));
+			thread.State = ThreadIdle;
+			thread.Zombie = false;
+			thread.Stopped = m_Stopped;
+			thread.Utilization = 0;
+			thread.LastUpdate = 0;
+			thread.Thread = m_ThreadGroup.create_thread(boost::bind(&ThreadPool::WorkerThread::ThreadProc, boost::ref(thread)));
 
 			break;
 		}
@@ -346,20 +572,24 @@ void ThreadPool::Queue::SpawnWorker(boost::thread_group& group)
 }
 
 /**
- * Note: Caller must hold Mutex.
+ * Note: Caller must hold m_Mutex.
  */
-void ThreadPool::Queue::KillWorker(boost::thread_group& group)
+void ThreadPool::KillWorker(void)
 {
-	for (size_t i = 0; i < sizeof(Threads) / sizeof(Threads[0]); i++) {
-		if (Threads[i].State == ThreadIdle && !Threads[i].Zombie) {
+	for (size_t i = 0; i < sizeof(m_Threads) / sizeof(m_Threads[0]); i++) {
+		WorkerThread& thread = m_Threads[i];
+
+		boost::mutex::scoped_lock wlock(thread.Mutex);
+
+		if (thread.State == ThreadIdle && !thread.Zombie) {
 			Log(LogDebug, "base", "Killing worker thread.");
 
-			group.remove_thread(Threads[i].Thread);
-			Threads[i].Thread->detach();
-			delete Threads[i].Thread;
+			m_ThreadGroup.remove_thread(thread.Thread);
+			thread.Thread->detach();
+			delete thread.Thread;
 
-			Threads[i].Zombie = true;
-			CV.notify_all();
+			thread.Zombie = true;
+			m_CV.notify_all();
 
 			break;
 		}
@@ -367,7 +597,7 @@ void ThreadPool::Queue::KillWorker(boost::thread_group& group)
 }
 
 /**
- * Note: Caller must hold queue Mutex.
+ * Note: Caller must hold the worker's Mutex.
  */
 void ThreadPool::WorkerThread::UpdateUtilization(ThreadState state)
 {
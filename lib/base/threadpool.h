@@ -21,17 +21,21 @@
 #define THREADPOOL_H
 
 #include "base/i2-base.h"
-#include <stack>
+#include <deque>
 #include <boost/function.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
 
 namespace icinga
 {
 
 /**
- * A thread pool.
+ * A work-stealing thread pool. Each worker thread owns a work queue; items
+ * which are posted from outside of the pool go into a shared injection queue
+ * from which idle workers pick them up in batches. Idle workers steal work
+ * from their busy siblings.
  *
  * @ingroup base
  */
@@ -64,47 +68,36 @@ private:
 		double Timestamp;
 	};
 
-	struct Queue;
-
 	struct WorkerThread
 	{
+		ThreadPool *Pool;
+
+		boost::mutex Mutex; /**< Protects all of the following fields. */
+
 		ThreadState State;
 		bool Zombie;
+		bool Stopped; /**< Copy of ThreadPool::m_Stopped for Post(). */
 		double Utilization;
 		double LastUpdate;
 		boost::thread *Thread;
 
-		WorkerThread(ThreadState state = ThreadDead)
-			: State(state), Zombie(false), Utilization(0), LastUpdate(0), Thread(NULL)
-		{ }
-
-		void UpdateUtilization(ThreadState state = ThreadUnspecified);
-
-		void ThreadProc(Queue& queue);
-	};
-
-	struct Queue
-	{
-		boost::mutex Mutex;
-		boost::condition_variable CV;
-		boost::condition_variable CVStarved;
-
 		std::deque<WorkItem> Items;
 
 		double WaitTime;
 		double ServiceTime;
 		int TaskCount;
+		int StealCount;
 
-		bool Stopped;
+		WorkerThread(void)
+			: Pool(NULL), State(ThreadDead), Zombie(false), Stopped(false), Utilization(0), LastUpdate(0),
+			  Thread(NULL), WaitTime(0), ServiceTime(0), TaskCount(0), StealCount(0)
+		{ }
 
-		WorkerThread Threads[16];
+		void UpdateUtilization(ThreadState state = ThreadUnspecified);
 
-		Queue(void)
-			: WaitTime(0), ServiceTime(0), TaskCount(0), Stopped(false)
-		{ }
+		void ThreadProc(void);
 
-		void SpawnWorker(boost::thread_group& group);
-		void KillWorker(boost::thread_group& group);
+		bool GetWorkItem(WorkItem& wi);
 	};
 
 	int m_ID;
@@ -114,11 +107,27 @@ private:
 
 	boost::thread_group m_ThreadGroup;
 
+	boost::mutex m_Mutex; /**< Protects the injection queue and the thread slots. */
+	boost::condition_variable m_CV;
+	boost::condition_variable m_CVStarved;
+	std::deque<WorkItem> m_Items;
+	unsigned long m_LocalPosts; /**< Incremented whenever items are added to a worker's queue. */
+	bool m_Stopped;
+
 	boost::mutex m_MgmtMutex;
 	boost::condition_variable m_MgmtCV;
-	bool m_Stopped;
+	bool m_MgmtStopped;
+
+	WorkerThread m_Threads[64];
+
+	static boost::thread_specific_ptr<WorkerThread> m_CurrentWorker;
+
+	bool DequeueInjected(WorkerThread& worker, WorkItem& wi);
+	bool Steal(WorkerThread& thief, WorkItem& wi);
+	bool HasPendingItems(void);
 
-	Queue m_Queues[4];
+	void SpawnWorker(void);
+	void KillWorker(void);
 
 	void ManagerThreadProc(void);
 };
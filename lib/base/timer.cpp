@@ -24,60 +24,219 @@
 #include "base/logger_fwd.h"
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
+#include <cmath>
 
 using namespace icinga;
 
 /**
+ * A hierarchical timing wheel. Level 0 has one slot per tick, each slot on
+ * the higher levels covers a full revolution of the level below it. Timers
+ * are moved down one level whenever the lower level wraps around ("cascade").
+ * Inserting and removing timers is O(1).
+ *
+ * Note: All members must only be used while holding l_Mutex.
+ *
  * @ingroup base
  */
-struct icinga::TimerNextExtractor
+struct icinga::TimerWheel
 {
-	typedef double result_type;
+	static const int Levels = 4;
+	static const int SlotBits = 8;
+	static const int Slots = 1 << SlotBits;
+	static const int SlotMask = Slots - 1;
+
+	/* The length of a tick in seconds. */
+	static const double TickInterval;
+
+	Timer::TimerList Wheel[Levels][Slots];
+	boost::uint64_t CurrentTick; /**< The next tick which is going to be processed. */
+	size_t Count;
+
+	TimerWheel(void)
+		: CurrentTick(0), Count(0)
+	{ }
+
+	static boost::uint64_t TimeToTick(double ts)
+	{
+		if (ts < 0)
+			return 0;
+
+		return static_cast<boost::uint64_t>(ts / TickInterval);
+	}
+
+	static double TickToTime(boost::uint64_t tick)
+	{
+		return tick * TickInterval;
+	}
 
 	/**
-	 * Extracts the next timestamp from a Timer.
+	 * Adds a timer to the wheel.
 	 *
-	 * Note: Caller must hold l_Mutex.
+	 * @param timer The timer.
+	 */
+	void Insert(const Timer::Ptr& timer)
+	{
+		ASSERT(!timer->m_Slot);
+
+		boost::uint64_t tick = TimeToTick(timer->m_Next);
+
+		/* Timers which are already due go into the slot that is processed next. */
+		if (tick < CurrentTick)
+			tick = CurrentTick;
+
+		boost::uint64_t delta = tick - CurrentTick;
+
+		int level;
+
+		for (level = 0; level < Levels - 1; level++) {
+			if (delta < (static_cast<boost::uint64_t>(1) << (SlotBits * (level + 1))))
+				break;
+		}
+
+		/* Timers which are too far in the future are put into the last
+		 * slot of the top level and re-inserted when it is cascaded. */
+		boost::uint64_t max_delta = (static_cast<boost::uint64_t>(1) << (SlotBits * Levels)) - 1;
+
+		if (delta > max_delta)
+			tick = CurrentTick + max_delta;
+
+		Timer::TimerList& slot = Wheel[level][(tick >> (SlotBits * level)) & SlotMask];
+		timer->m_Slot = &slot;
+		timer->m_SlotIterator = slot.insert(slot.end(), timer);
+		Count++;
+	}
+
+	/**
+	 * Removes a timer from the wheel. Does nothing if the timer is not
+	 * scheduled.
 	 *
-	 * @param wtimer Weak pointer to the timer.
-	 * @returns The next timestamp
+	 * @param timer The timer.
 	 */
-	double operator()(const weak_ptr<Timer>& wtimer)
+	void Remove(Timer *timer)
 	{
-		Timer::Ptr timer = wtimer.lock();
+		if (!timer->m_Slot)
+			return;
 
-		if (!timer)
-			return 0;
+		timer->m_Slot->erase(timer->m_SlotIterator);
+		timer->m_Slot = NULL;
+		Count--;
+	}
+
+	/**
+	 * Removes all timers from a slot.
+	 *
+	 * @param slot The slot.
+	 * @param timers Receives the live timers which were in the slot.
+	 */
+	void Drain(Timer::TimerList& slot, std::vector<Timer::Ptr>& timers)
+	{
+		BOOST_FOREACH(const Timer::WeakPtr& wtimer, slot) {
+			Timer::Ptr timer = wtimer.lock();
+
+			Count--;
+
+			if (!timer)
+				continue;
+
+			timer->m_Slot = NULL;
+			timers.push_back(timer);
+		}
+
+		slot.clear();
+	}
+
+	/**
+	 * Removes all timers from the wheel.
+	 *
+	 * @param timers Receives the live timers.
+	 */
+	void DrainAll(std::vector<Timer::Ptr>& timers)
+	{
+		for (int level = 0; level < Levels; level++) {
+			for (int i = 0; i < Slots; i++)
+				Drain(Wheel[level][i], timers);
+		}
+	}
+
+	/**
+	 * Processes the current tick and advances the wheel by one tick.
+	 *
+	 * @param expired Receives the timers which have expired.
+	 * @param cascaded Receives the timers which were moved to a lower level.
+	 */
+	void Tick(std::vector<Timer::Ptr>& expired, std::vector<Timer::Ptr>& cascaded)
+	{
+		for (int level = 1; level < Levels; level++) {
+			/* Only cascade when the lower level wraps around. */
+			if ((CurrentTick & ((static_cast<boost::uint64_t>(1) << (SlotBits * level)) - 1)) != 0)
+				break;
+
+			size_t offset = cascaded.size();
+			Drain(Wheel[level][(CurrentTick >> (SlotBits * level)) & SlotMask], cascaded);
+
+			for (size_t i = offset; i < cascaded.size(); i++)
+				Insert(cascaded[i]);
+		}
+
+		Drain(Wheel[0][CurrentTick & SlotMask], expired);
+
+		CurrentTick++;
+	}
+
+	/**
+	 * Re-inserts all timers, e.g. after their timestamps were modified.
+	 *
+	 * @param tick The new current tick.
+	 * @param timers Receives the timers which were re-inserted.
+	 */
+	void Rebuild(boost::uint64_t tick, std::vector<Timer::Ptr>& timers)
+	{
+		DrainAll(timers);
+
+		CurrentTick = tick;
 
-		return timer->m_Next;
+		BOOST_FOREACH(const Timer::Ptr& timer, timers)
+			Insert(timer);
+	}
+
+	/**
+	 * Determines the next tick the timer thread needs to wake up for:
+	 * either the next non-empty level 0 slot or the next cascade.
+	 *
+	 * @returns The tick.
+	 */
+	boost::uint64_t GetNextEventTick(void) const
+	{
+		boost::uint64_t tick = CurrentTick;
+
+		do {
+			if (!Wheel[0][tick & SlotMask].empty())
+				return tick;
+
+			tick++;
+		} while ((tick & SlotMask) != 0);
+
+		return tick;
 	}
 };
 
-typedef boost::multi_index_container<
-	Timer::WeakPtr,
-	boost::multi_index::indexed_by<
-		boost::multi_index::ordered_unique<boost::multi_index::identity<Timer::WeakPtr> >,
-		boost::multi_index::ordered_non_unique<TimerNextExtractor>
-	>
-> TimerSet;
+const double TimerWheel::TickInterval = 0.01;
 
 static boost::mutex l_Mutex;
 static boost::condition_variable l_CV;
 static boost::thread l_Thread;
 static bool l_StopThread;
-static TimerSet l_Timers;
+static TimerWheel l_Timers;
 
 /**
  * Constructor for the Timer class.
  */
 Timer::Timer(void)
-	: m_Interval(0), m_Next(0)
+	: m_Interval(0), m_Next(0), m_Started(false), m_Slot(NULL)
 { }
 
 /**
@@ -85,8 +244,15 @@ Timer::Timer(void)
  */
 void Timer::Initialize(void)
 {
+	std::vector<Timer::Ptr> timers;
+
 	boost::mutex::scoped_lock lock(l_Mutex);
 	l_StopThread = false;
+
+	/* Timers might have been started before the wheel's current tick
+	 * was initialized. */
+	l_Timers.Rebuild(TimerWheel::TimeToTick(Utility::GetTime()), timers);
+
 	l_Thread = boost::thread(boost::bind(&Timer::TimerThreadProc));
 }
 
@@ -175,10 +341,10 @@ void Timer::Stop(void)
 	boost::mutex::scoped_lock lock(l_Mutex);
 
 	m_Started = false;
-	l_Timers.erase(GetSelf());
+	l_Timers.Remove(this);
 
-	/* Notify the worker thread that we've disabled a timer. */
-	l_CV.notify_all();
+	/* The timer thread doesn't need to be notified here: at worst it wakes
+	 * up for a slot which is now empty. */
 }
 
 /**
@@ -204,12 +370,15 @@ void Timer::Reschedule(double next)
 	m_Next = next;
 
 	if (m_Started) {
-		/* Remove and re-add the timer to update the index. */
-		l_Timers.erase(GetSelf());
-		l_Timers.insert(GetSelf());
-
-		/* Notify the worker that we've rescheduled a timer. */
-		l_CV.notify_all();
+		/* Remove and re-add the timer to move it to the right slot. */
+		l_Timers.Remove(this);
+		l_Timers.Insert(GetSelf());
+
+		/* Notify the worker that we've rescheduled a timer. This is only
+		 * necessary if the timer thread might be sleeping past the
+		 * new timestamp. */
+		if (l_Timers.Count == 1 || TimerWheel::TimeToTick(m_Next) < l_Timers.CurrentTick + TimerWheel::Slots)
+			l_CV.notify_all();
 	}
 }
 
@@ -234,35 +403,45 @@ double Timer::GetNext(void) const
  */
 void Timer::AdjustTimers(double adjustment)
 {
-	boost::mutex::scoped_lock lock(l_Mutex);
+	std::vector<Timer::Ptr> timers;
 
-	double now = Utility::GetTime();
+	{
+		boost::mutex::scoped_lock lock(l_Mutex);
 
-	typedef boost::multi_index::nth_index<TimerSet, 1>::type TimerView;
-	TimerView& idx = boost::get<1>(l_Timers);
+		double now = Utility::GetTime();
 
-	std::vector<Timer::Ptr> timers;
+		l_Timers.DrainAll(timers);
 
-	BOOST_FOREACH(const Timer::WeakPtr& wtimer, idx) {
-		Timer::Ptr timer = wtimer.lock();
+		l_Timers.CurrentTick = TimerWheel::TimeToTick(now);
 
-		if (!timer)
-			continue;
+		BOOST_FOREACH(const Timer::Ptr& timer, timers) {
+			if (std::fabs(now - (timer->m_Next + adjustment)) <
+			    std::fabs(now - timer->m_Next))
+				timer->m_Next += adjustment;
 
-		if (abs(now - (timer->m_Next + adjustment)) <
-		    abs(now - timer->m_Next)) {
-			timer->m_Next += adjustment;
-			timers.push_back(timer);
+			l_Timers.Insert(timer);
 		}
-	}
 
-	BOOST_FOREACH(const Timer::Ptr& timer, timers) {
-		l_Timers.erase(timer);
-		l_Timers.insert(timer);
+		/* Notify the worker that we've rescheduled some timers. */
+		l_CV.notify_all();
 	}
 
-	/* Notify the worker that we've rescheduled some timers. */
-	l_CV.notify_all();
+	/* The timers vector is destroyed after we've released l_Mutex, which
+	 * is necessary because it might hold the last reference to some timers. */
+}
+
+/**
+ * Calls the specified timers. This is used as a thread pool work item so
+ * that the timer thread only has to post a single item for each batch of
+ * expired timers; the individual timers are then posted from within the
+ * pool where idle workers can pick them up.
+ *
+ * @param timers The timers.
+ */
+void Timer::DispatchTimers(const std::vector<Timer::Ptr>& timers)
+{
+	BOOST_FOREACH(const Timer::Ptr& timer, timers)
+		Utility::QueueAsyncCallback(boost::bind(&Timer::Call, timer));
 }
 
 /**
@@ -273,46 +452,51 @@ void Timer::TimerThreadProc(void)
 	Utility::SetThreadName("Timer Thread");
 
 	for (;;) {
-		boost::mutex::scoped_lock lock(l_Mutex);
+		/* These must be destroyed after the lock is released because
+		 * they might hold the last reference to some timers. */
+		std::vector<Timer::Ptr> expired, cascaded;
 
-		typedef boost::multi_index::nth_index<TimerSet, 1>::type NextTimerView;
-		NextTimerView& idx = boost::get<1>(l_Timers);
+		boost::mutex::scoped_lock lock(l_Mutex);
 
 		/* Wait until there is at least one timer. */
-		while (idx.empty() && !l_StopThread)
+		while (l_Timers.Count == 0 && !l_StopThread)
 			l_CV.wait(lock);
 
 		if (l_StopThread)
 			break;
 
-		NextTimerView::iterator it = idx.begin();
-		Timer::Ptr timer = it->lock();
+		boost::uint64_t now = TimerWheel::TimeToTick(Utility::GetTime());
 
-		if (!timer) {
-			/* Remove the timer from the list if it's not alive anymore. */
-			idx.erase(it);
-			continue;
+		if (now > l_Timers.CurrentTick + TimerWheel::Slots * TimerWheel::Slots) {
+			/* We've fallen behind quite a bit (e.g. because the process was
+			 * suspended). Rebuilding the wheel is cheaper than processing each
+			 * individual tick. */
+			l_Timers.Rebuild(now, cascaded);
 		}
 
-		double wait = timer->m_Next - Utility::GetTime();
+		/* Remove the expired timers from the wheel so they don't get called
+		 * again until the current call is completed. A tick is only
+		 * processed once it is completely in the past. */
+		while (l_Timers.CurrentTick < now)
+			l_Timers.Tick(expired, cascaded);
 
-		if (wait > 0) {
-			/* Make sure the timer we just examined can be destroyed while we're waiting. */
-			timer.reset();
+		if (expired.empty()) {
+			boost::uint64_t next = l_Timers.GetNextEventTick();
+			double wait = TimerWheel::TickToTime(next + 1) - Utility::GetTime();
 
 			/* Wait for the next timer. */
-			l_CV.timed_wait(lock, boost::posix_time::milliseconds(wait * 1000));
+			if (wait > 0)
+				l_CV.timed_wait(lock, boost::posix_time::milliseconds(static_cast<long>(wait * 1000) + 1));
 
 			continue;
 		}
 
-		/* Remove the timer from the list so it doesn't get called again
-		 * until the current call is completed. */
-		l_Timers.erase(timer);
-
 		lock.unlock();
 
-		/* Asynchronously call the timer. */
-		Utility::QueueAsyncCallback(boost::bind(&Timer::Call, timer));
+		/* Asynchronously call the timers. */
+		if (expired.size() == 1)
+			Utility::QueueAsyncCallback(boost::bind(&Timer::Call, expired[0]));
+		else
+			Utility::QueueAsyncCallback(boost::bind(&Timer::DispatchTimers, expired));
 	}
 }
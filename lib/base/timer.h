@@ -22,11 +22,13 @@
 
 #include "base/i2-base.h"
 #include "base/object.h"
+#include <list>
+#include <vector>
 #include <boost/signals2.hpp>
 
 namespace icinga {
 
-struct TimerNextExtractor;
+struct TimerWheel;
 
 /**
  * A timer that periodically triggers an event.
@@ -57,15 +59,20 @@ public:
 	static void Uninitialize(void);
 
 private:
+	typedef std::list<Timer::WeakPtr> TimerList;
+
 	double m_Interval; /**< The interval of the timer. */
 	double m_Next; /**< When the next event should happen. */
 	bool m_Started; /**< Whether the timer is enabled. */
+	TimerList *m_Slot; /**< The timer wheel slot this timer is in. */
+	TimerList::iterator m_SlotIterator; /**< The timer's position in the slot. */
 
 	void Call();
 
 	static void TimerThreadProc(void);
+	static void DispatchTimers(const std::vector<Timer::Ptr>& timers);
 
-	friend struct TimerNextExtractor;
+	friend struct TimerWheel;
 };
 
 }
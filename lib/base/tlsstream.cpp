@@ -166,6 +166,44 @@ size_t TlsStream::Read(void *buffer, size_t count)
 	return count;
 }
 
+/**
+ * Reads whatever is left of the current TLS record, waiting for the
+ * next record if there's nothing to read right now.
+ */
+size_t TlsStream::ReadAvailable(void *buffer, size_t count)
+{
+	ASSERT(!OwnsLock());
+
+	for (;;) {
+		int rc;
+
+		{
+			ObjectLock olock(this);
+			rc = SSL_read(m_SSL.get(), buffer, count);
+		}
+
+		if (rc > 0)
+			return rc;
+
+		int err = SSL_get_error(m_SSL.get(), rc);
+		switch (err) {
+			case SSL_ERROR_WANT_READ:
+				m_Socket->Poll(true, false);
+				continue;
+			case SSL_ERROR_WANT_WRITE:
+				m_Socket->Poll(false, true);
+				continue;
+			case SSL_ERROR_ZERO_RETURN:
+				Close();
+				return 0;
+			default:
+				BOOST_THROW_EXCEPTION(openssl_error()
+				    << boost::errinfo_api_function("SSL_read")
+				    << errinfo_openssl_error(ERR_get_error()));
+		}
+	}
+}
+
 void TlsStream::Write(const void *buffer, size_t count)
 {
 	ASSERT(!OwnsLock());
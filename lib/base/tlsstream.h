@@ -54,6 +54,7 @@ public:
 	virtual void Close(void);
 
 	virtual size_t Read(void *buffer, size_t count);
+	virtual size_t ReadAvailable(void *buffer, size_t count);
 	virtual void Write(const void *buffer, size_t count);
 
 	virtual bool IsEof(void) const;
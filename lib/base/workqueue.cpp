@@ -180,7 +180,10 @@ ParallelWorkQueue::ParallelWorkQueue(void)
 	: m_QueueCount(boost::thread::hardware_concurrency()),
 	  m_Queues(new WorkQueue[m_QueueCount]),
 	  m_Index(0)
-{ }
+{
+	for (unsigned int i = 0; i < m_QueueCount; i++)
+		m_Queues[i].SetExceptionCallback(boost::bind(&ParallelWorkQueue::ExceptionHandler, this, _1));
+}
 
 ParallelWorkQueue::~ParallelWorkQueue(void)
 {
@@ -197,4 +200,27 @@ void ParallelWorkQueue::Join(void)
 {
 	for (unsigned int i = 0; i < m_QueueCount; i++)
 		m_Queues[i].Join();
+
+	boost::exception_ptr exp;
+
+	{
+		boost::mutex::scoped_lock lock(m_ExceptionMutex);
+		exp = m_Exception;
+		m_Exception = boost::exception_ptr();
+	}
+
+	if (exp)
+		boost::rethrow_exception(exp);
+}
+
+/**
+ * Remembers the first exception thrown by a work item so that Join()
+ * can rethrow it in the caller's thread.
+ */
+void ParallelWorkQueue::ExceptionHandler(boost::exception_ptr exp)
+{
+	boost::mutex::scoped_lock lock(m_ExceptionMutex);
+
+	if (!m_Exception)
+		m_Exception = exp;
 }
@@ -97,6 +97,11 @@ private:
 	unsigned int m_QueueCount;
 	WorkQueue *m_Queues;
 	unsigned int m_Index;
+
+	boost::mutex m_ExceptionMutex;
+	boost::exception_ptr m_Exception;
+
+	void ExceptionHandler(boost::exception_ptr exp);
 };
 
 }
@@ -65,6 +65,9 @@ void ZlibStream::Close(void)
 	ObjectLock olock(this);
 
 	if (m_BIO) {
+		/* The zlib BIO doesn't write its pending output when it's freed. */
+		(void) BIO_flush(m_BIO);
+
 		BIO_free_all(m_BIO);
 		m_BIO = NULL;
 
@@ -72,6 +72,21 @@ void AExpression::MakeInline(void)
 		m_Operand2 = true;
 }
 
+AExpression::OpCallback AExpression::GetOperator(void) const
+{
+	return m_Operator;
+}
+
+Value AExpression::GetOperand1(void) const
+{
+	return m_Operand1;
+}
+
+Value AExpression::GetOperand2(void) const
+{
+	return m_Operand2;
+}
+
 void AExpression::DumpOperand(std::ostream& stream, const Value& operand, int indent) {
 	if (operand.IsObjectType<Array>()) {
 		Array::Ptr arr = operand;
@@ -44,6 +44,10 @@ public:
 	Value Evaluate(const Dictionary::Ptr& locals) const;
 
 	void MakeInline(void);
+
+	OpCallback GetOperator(void) const;
+	Value GetOperand1(void) const;
+	Value GetOperand2(void) const;
 	
 	void Dump(std::ostream& stream, int indent = 0) const;
 
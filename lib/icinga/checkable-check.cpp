@@ -393,6 +393,10 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const String& aut
 
 	olock.Unlock();
 
+	/* The children's reachability depends on our state and state type. */
+	if (!old_cr || stateChange || GetStateType() != old_stateType)
+		InvalidateReachability();
+
 //	Log(LogDebug, "icinga", "Flapping: Checkable " + GetName() +
 //			" was: " + Convert::ToString(was_flapping) +
 //			" is: " + Convert::ToString(is_flapping) +
@@ -32,14 +32,22 @@ using namespace icinga;
 
 void Checkable::AddDependency(const Dependency::Ptr& dep)
 {
-	boost::mutex::scoped_lock lock(m_DependencyMutex);
-	m_Dependencies.insert(dep);
+	{
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+		m_Dependencies.insert(dep);
+	}
+
+	InvalidateReachability();
 }
 
 void Checkable::RemoveDependency(const Dependency::Ptr& dep)
 {
-	boost::mutex::scoped_lock lock(m_DependencyMutex);
-	m_Dependencies.erase(dep);
+	{
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+		m_Dependencies.erase(dep);
+	}
+
+	InvalidateReachability();
 }
 
 std::set<Dependency::Ptr> Checkable::GetDependencies(void) const
@@ -68,15 +76,86 @@ std::set<Dependency::Ptr> Checkable::GetReverseDependencies(void) const
 
 bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency, int rstack) const
 {
+	bool cacheable;
+	return InternalIsReachable(dt, failedDependency, rstack, &cacheable);
+}
+
+bool Checkable::InternalIsReachable(DependencyType dt, Dependency::Ptr *failedDependency, int rstack, bool *cacheable) const
+{
+	int generation;
+
+	{
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+
+		if (m_ReachabilityValid & (1 << dt)) {
+			m_ReachabilityCacheHits++;
+
+			if (failedDependency)
+				*failedDependency = m_ReachabilityFailedDependency[dt];
+
+			*cacheable = true;
+			return m_Reachable[dt];
+		}
+
+		m_ReachabilityCacheMisses++;
+		generation = m_ReachabilityGeneration;
+	}
+
+	Dependency::Ptr failed;
+	bool reachable = CalculateReachability(dt, &failed, rstack, cacheable);
+
+	if (*cacheable) {
+		boost::mutex::scoped_lock lock(m_DependencyMutex);
+
+		/* Don't store the result if a parent has changed in the meantime. */
+		if (generation == m_ReachabilityGeneration) {
+			m_Reachable[dt] = reachable;
+			m_ReachabilityFailedDependency[dt] = failed;
+			m_ReachabilityValid |= (1 << dt);
+		}
+	}
+
+	if (failedDependency)
+		*failedDependency = failed;
+
+	return reachable;
+}
+
+/**
+ * Evaluates the dependencies for this checkable.
+ *
+ * @param cacheable Set to false if the result depends on something other
+ *                  than the state of this checkable's parents, e.g. on a
+ *                  dependency's time period.
+ */
+bool Checkable::CalculateReachability(DependencyType dt, Dependency::Ptr *failedDependency, int rstack, bool *cacheable) const
+{
+	*cacheable = true;
+
 	if (rstack > 20) {
 		Log(LogWarning, "icinga", "Too many nested dependencies for service '" + GetName() + "': Dependency failed.");
 
+		*cacheable = false;
 		return false;
 	}
 
-	BOOST_FOREACH(const Checkable::Ptr& service, GetParents()) {
-		if (!service->IsReachable(dt, failedDependency, rstack + 1))
+	std::set<Dependency::Ptr> dependencies = GetDependencies();
+
+	BOOST_FOREACH(const Dependency::Ptr& dep, dependencies) {
+		Checkable::Ptr parent = dep->GetParent();
+
+		if (!parent)
+			continue;
+
+		bool parentCacheable;
+
+		if (!parent->InternalIsReachable(dt, failedDependency, rstack + 1, &parentCacheable)) {
+			*cacheable = parentCacheable;
 			return false;
+		}
+
+		if (!parentCacheable)
+			*cacheable = false;
 	}
 
 	/* implicit dependency on host if this is a service */
@@ -85,28 +164,76 @@ bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency
 		Host::Ptr host = service->GetHost();
 
 		if (host && host->GetState() != HostUp && host->GetStateType() == StateTypeHard) {
-			if (failedDependency)
-				*failedDependency = Dependency::Ptr();
-
+			*failedDependency = Dependency::Ptr();
 			return false;
 		}
 	}
 
-	BOOST_FOREACH(const Dependency::Ptr& dep, GetDependencies()) {
-		if (!dep->IsAvailable(dt)) {
-			if (failedDependency)
-				*failedDependency = dep;
+	BOOST_FOREACH(const Dependency::Ptr& dep, dependencies) {
+		if (!dep->GetPeriodRaw().IsEmpty())
+			*cacheable = false;
 
+		if (!dep->IsAvailable(dt)) {
+			*failedDependency = dep;
 			return false;
 		}
 	}
 
-	if (failedDependency)
-		*failedDependency = Dependency::Ptr();
+	*failedDependency = Dependency::Ptr();
 
 	return true;
 }
 
+/**
+ * Invalidates the cached reachability of this checkable and of all
+ * checkables which directly or indirectly depend on it.
+ */
+void Checkable::InvalidateReachability(void)
+{
+	std::set<Checkable::Ptr> visited;
+	std::vector<Checkable::Ptr> pending;
+
+	pending.push_back(GetSelf());
+
+	while (!pending.empty()) {
+		Checkable::Ptr checkable = pending.back();
+		pending.pop_back();
+
+		if (!visited.insert(checkable).second)
+			continue;
+
+		{
+			boost::mutex::scoped_lock lock(checkable->m_DependencyMutex);
+
+			checkable->m_ReachabilityValid = 0;
+			checkable->m_ReachabilityGeneration++;
+
+			for (int dt = 0; dt <= DependencyNotification; dt++)
+				checkable->m_ReachabilityFailedDependency[dt].reset();
+		}
+
+		BOOST_FOREACH(const Checkable::Ptr& child, checkable->GetChildren()) {
+			pending.push_back(child);
+		}
+
+		/* services implicitly depend on their host */
+		Host::Ptr host = dynamic_pointer_cast<Host>(checkable);
+
+		if (host) {
+			BOOST_FOREACH(const Service::Ptr& service, host->GetServices()) {
+				pending.push_back(service);
+			}
+		}
+	}
+}
+
+void Checkable::GetReachabilityCacheStatistics(double *hits, double *misses) const
+{
+	boost::mutex::scoped_lock lock(m_DependencyMutex);
+	*hits = m_ReachabilityCacheHits;
+	*misses = m_ReachabilityCacheMisses;
+}
+
 std::set<Checkable::Ptr> Checkable::GetParents(void) const
 {
 	std::set<Checkable::Ptr> parents;
@@ -87,16 +87,22 @@ void Checkable::SendNotifications(NotificationType type, const CheckResult::Ptr&
 
 std::set<Notification::Ptr> Checkable::GetNotifications(void) const
 {
+	boost::mutex::scoped_lock lock(m_NotificationMutex);
+
 	return m_Notifications;
 }
 
 void Checkable::AddNotification(const Notification::Ptr& notification)
 {
+	boost::mutex::scoped_lock lock(m_NotificationMutex);
+
 	m_Notifications.insert(notification);
 }
 
 void Checkable::RemoveNotification(const Notification::Ptr& notification)
 {
+	boost::mutex::scoped_lock lock(m_NotificationMutex);
+
 	m_Notifications.erase(notification);
 }
 
@@ -43,7 +43,8 @@ boost::signals2::signal<void (const Checkable::Ptr&, const String&, const String
 boost::signals2::signal<void (const Checkable::Ptr&, const String&)> Checkable::OnAcknowledgementCleared;
 
 Checkable::Checkable(void)
-	: m_CheckRunning(false)
+	: m_CheckRunning(false), m_ReachabilityValid(0), m_ReachabilityGeneration(0),
+	  m_ReachabilityCacheHits(0), m_ReachabilityCacheMisses(0)
 { }
 
 void Checkable::Start(void)
@@ -92,6 +92,8 @@ public:
 	//bool IsHostCheck(void) const;
 
 	bool IsReachable(DependencyType dt = DependencyState, shared_ptr<Dependency> *failedDependency = NULL, int rstack = 0) const;
+	void InvalidateReachability(void);
+	void GetReachabilityCacheStatistics(double *hits, double *misses) const;
 
 	AcknowledgementType GetAcknowledgement(void);
 
@@ -284,12 +286,24 @@ private:
 	void AddCommentsToCache(void);
 
 	/* Notifications */
+	mutable boost::mutex m_NotificationMutex;
 	std::set<Notification::Ptr> m_Notifications;
 
 	/* Dependencies */
 	mutable boost::mutex m_DependencyMutex;
 	std::set<shared_ptr<Dependency> > m_Dependencies;
 	std::set<shared_ptr<Dependency> > m_ReverseDependencies;
+
+	/* Reachability cache, protected by m_DependencyMutex */
+	mutable int m_ReachabilityValid; /**< Bit mask of cached DependencyTypes. */
+	mutable bool m_Reachable[DependencyNotification + 1];
+	mutable shared_ptr<Dependency> m_ReachabilityFailedDependency[DependencyNotification + 1];
+	mutable int m_ReachabilityGeneration;
+	mutable double m_ReachabilityCacheHits;
+	mutable double m_ReachabilityCacheMisses;
+
+	bool CalculateReachability(DependencyType dt, shared_ptr<Dependency> *failedDependency, int rstack, bool *cacheable) const;
+	bool InternalIsReachable(DependencyType dt, shared_ptr<Dependency> *failedDependency, int rstack, bool *cacheable) const;
 };
 
 }
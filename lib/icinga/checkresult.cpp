@@ -18,6 +18,7 @@
  ******************************************************************************/
 
 #include "icinga/checkresult.h"
+#include "icinga/pluginutility.h"
 #include "base/dynamictype.h"
 #include "base/initialize.h"
 #include "base/scriptvariable.h"
@@ -25,3 +26,25 @@
 using namespace icinga;
 
 REGISTER_TYPE(CheckResult);
+
+/**
+ * Returns the performance data as a list of records. The performance data
+ * is parsed when this is first called and whenever it has been changed.
+ * Invalid performance data results in an empty list.
+ */
+shared_ptr<const PerfdataRecordList> CheckResult::GetPerfdataRecords(void) const
+{
+	Value perfdata = GetPerformanceData();
+
+	boost::mutex::scoped_lock lock(m_PerfdataMutex);
+
+	if (!m_PerfdataRecords || m_PerfdataSource != perfdata) {
+		m_PerfdataRecords = make_shared<PerfdataRecordList>();
+		m_PerfdataSource = perfdata;
+
+		if (!PluginUtility::ParsePerfdataRecords(perfdata, *m_PerfdataRecords))
+			m_PerfdataRecords->clear();
+	}
+
+	return m_PerfdataRecords;
+}
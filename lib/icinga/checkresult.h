@@ -22,6 +22,8 @@
 
 #include "icinga/i2-icinga.h"
 #include "icinga/checkresult.th"
+#include "icinga/perfdatavalue.h"
+#include <boost/thread/mutex.hpp>
 
 namespace icinga
 {
@@ -35,6 +37,13 @@ class I2_ICINGA_API CheckResult : public ObjectImpl<CheckResult>
 {
 public:
 	DECLARE_PTR_TYPEDEFS(CheckResult);
+
+	shared_ptr<const PerfdataRecordList> GetPerfdataRecords(void) const;
+
+private:
+	mutable boost::mutex m_PerfdataMutex;
+	mutable Value m_PerfdataSource;
+	mutable shared_ptr<PerfdataRecordList> m_PerfdataRecords;
 };
 
 }
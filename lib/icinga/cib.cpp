@@ -29,6 +29,8 @@ using namespace icinga;
 
 RingBuffer CIB::m_ActiveChecksStatistics(15 * 60);
 RingBuffer CIB::m_PassiveChecksStatistics(15 * 60);
+boost::mutex CIB::m_Mutex;
+CheckQueueStatistics CIB::m_CheckQueueStatistics = { 0, 0, 0 };
 
 void CIB::UpdateActiveChecksStatistics(long tv, int num)
 {
@@ -50,6 +52,23 @@ int CIB::GetPassiveChecksStatistics(long timespan)
 	return m_PassiveChecksStatistics.GetValues(timespan);
 }
 
+/**
+ * Updates the check queue statistics. This is used by the checker component.
+ *
+ * @param cqs The statistics.
+ */
+void CIB::UpdateCheckQueueStatistics(const CheckQueueStatistics& cqs)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	m_CheckQueueStatistics = cqs;
+}
+
+CheckQueueStatistics CIB::GetCheckQueueStatistics(void)
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	return m_CheckQueueStatistics;
+}
+
 ServiceCheckStatistics CIB::CalculateServiceCheckStats(void)
 {
 	double min_latency = -1, max_latency = 0, sum_latency = 0;
@@ -162,6 +181,26 @@ HostStatistics CIB::CalculateHostStats(void)
 	return hs;
 }
 
+ReachabilityCacheStatistics CIB::CalculateReachabilityCacheStats(void)
+{
+	ReachabilityCacheStatistics rcs = {0};
+	double hits, misses;
+
+	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjects<Host>()) {
+		host->GetReachabilityCacheStatistics(&hits, &misses);
+		rcs.hits += hits;
+		rcs.misses += misses;
+	}
+
+	BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjects<Service>()) {
+		service->GetReachabilityCacheStatistics(&hits, &misses);
+		rcs.hits += hits;
+		rcs.misses += misses;
+	}
+
+	return rcs;
+}
+
 /*
  * 'perfdata' must be a flat dictionary with double values
  * 'status' dictionary can contain multiple levels of dictionaries
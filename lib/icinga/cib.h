@@ -23,6 +23,7 @@
 #include "icinga/i2-icinga.h"
 #include "base/ringbuffer.h"
 #include "base/dictionary.h"
+#include <boost/thread/mutex.hpp>
 
 namespace icinga
 {
@@ -58,6 +59,17 @@ typedef struct {
     double hosts_acknowledged;
 } HostStatistics;
 
+typedef struct {
+    double running_checks;
+    double queue_length;
+    double avg_queue_wait_time;
+} CheckQueueStatistics;
+
+typedef struct {
+    double hits;
+    double misses;
+} ReachabilityCacheStatistics;
+
 /**
  * Common Information Base class. Holds some statistics (and will likely be
  * removed/refactored).
@@ -76,15 +88,20 @@ public:
         static ServiceCheckStatistics CalculateServiceCheckStats(void);
         static ServiceStatistics CalculateServiceStats(void);
         static HostStatistics CalculateHostStats(void);
+        static ReachabilityCacheStatistics CalculateReachabilityCacheStats(void);
 
         static std::pair<Dictionary::Ptr, Dictionary::Ptr> GetFeatureStats(void);
 
+	static void UpdateCheckQueueStatistics(const CheckQueueStatistics& cqs);
+	static CheckQueueStatistics GetCheckQueueStatistics(void);
+
 private:
 	CIB(void);
 
 	static boost::mutex m_Mutex;
 	static RingBuffer m_ActiveChecksStatistics;
 	static RingBuffer m_PassiveChecksStatistics;
+	static CheckQueueStatistics m_CheckQueueStatistics;
 };
 
 }
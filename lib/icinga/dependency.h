@@ -58,6 +58,7 @@ protected:
 
 private:
 	static bool EvaluateApplyRule(const Checkable::Ptr& checkable, const ApplyRule& rule);
+	static void EvaluateApplyRuleForObjects(const ApplyRule& rule, const std::vector<Checkable::Ptr>& checkables);
 	static void EvaluateApplyRules(const std::vector<ApplyRule>& rules);
 };
 
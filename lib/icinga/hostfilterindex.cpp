@@ -0,0 +1,235 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/hostfilterindex.h"
+#include "base/dynamictype.h"
+#include "base/objectlock.h"
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <iterator>
+
+using namespace icinga;
+
+HostFilterIndex::HostFilterIndex(void)
+{
+	BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjects<Host>()) {
+		m_Hosts.push_back(host);
+	}
+}
+
+const std::vector<Host::Ptr>& HostFilterIndex::GetHosts(void) const
+{
+	return m_Hosts;
+}
+
+/**
+ * Returns the hosts the specified filter might match. This isn't
+ * thread-safe; callers are expected to look up the candidates for all
+ * their rules before evaluating them in parallel.
+ */
+std::vector<Host::Ptr> HostFilterIndex::GetCandidates(const AExpression::Ptr& filter)
+{
+	std::vector<int> indices;
+
+	if (!FindCandidates(filter, indices))
+		return m_Hosts;
+
+	std::vector<Host::Ptr> hosts;
+	hosts.reserve(indices.size());
+
+	BOOST_FOREACH(int index, indices) {
+		hosts.push_back(m_Hosts[index]);
+	}
+
+	return hosts;
+}
+
+/**
+ * Stores the sorted indices of the hosts the expression might be true for
+ * in result. Returns false if the expression can't be narrowed down.
+ */
+bool HostFilterIndex::FindCandidates(const AExpression::Ptr& expr, std::vector<int>& result)
+{
+	AExpression::OpCallback op = expr->GetOperator();
+
+	if (op == &AExpression::OpLiteral) {
+		if (expr->GetOperand1().ToBool())
+			return false;
+
+		result.clear();
+		return true;
+	} else if (op == &AExpression::OpLogicalOr || op == &AExpression::OpLogicalAnd) {
+		std::vector<int> left, right;
+		bool hasLeft = FindCandidates(expr->GetOperand1(), left);
+		bool hasRight = FindCandidates(expr->GetOperand2(), right);
+
+		result.clear();
+
+		if (op == &AExpression::OpLogicalOr) {
+			if (!hasLeft || !hasRight)
+				return false;
+
+			std::set_union(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(result));
+		} else {
+			if (!hasLeft && !hasRight)
+				return false;
+			else if (!hasLeft)
+				result.swap(right);
+			else if (!hasRight)
+				result.swap(left);
+			else
+				std::set_intersection(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(result));
+		}
+
+		return true;
+	} else if (op == &AExpression::OpEqual) {
+		return FindValue(expr->GetOperand1(), expr->GetOperand2(), false, result) ||
+		    FindValue(expr->GetOperand2(), expr->GetOperand1(), false, result);
+	} else if (op == &AExpression::OpIn) {
+		return FindValue(expr->GetOperand2(), expr->GetOperand1(), true, result);
+	}
+
+	return false;
+}
+
+bool HostFilterIndex::FindValue(const Value& path, const Value& value, bool member, std::vector<int>& result)
+{
+	String key;
+
+	if (!GetPathKey(path, &key))
+		return false;
+
+	AExpression::Ptr valueExpr = value;
+
+	if (valueExpr->GetOperator() != &AExpression::OpLiteral)
+		return false;
+
+	Value literal = valueExpr->GetOperand1();
+
+	/* Only strings are indexed. Value::operator== never considers
+	 * a string to be equal to a number or an object. */
+	if (!literal.IsString())
+		return false;
+
+	const PathIndex& index = GetPathIndex(path, key, member);
+
+	result.clear();
+
+	ValueMap::const_iterator it = index.Values.find(literal);
+
+	if (it != index.Values.end())
+		std::set_union(it->second.begin(), it->second.end(), index.Errors.begin(), index.Errors.end(), std::back_inserter(result));
+	else
+		result = index.Errors;
+
+	return true;
+}
+
+/**
+ * Evaluates the path expression for all hosts and groups them by the
+ * resulting value (or by the array members when member is true). Hosts
+ * where the evaluation fails are always candidates so that the actual
+ * filter evaluation gets to report the error.
+ */
+const HostFilterIndex::PathIndex& HostFilterIndex::GetPathIndex(const AExpression::Ptr& path, const String& key, bool member)
+{
+	String indexKey = (member ? "in:" : "eq:") + key;
+
+	std::map<String, PathIndex>::iterator it = m_Paths.find(indexKey);
+
+	if (it != m_Paths.end())
+		return it->second;
+
+	PathIndex& index = m_Paths[indexKey];
+	int count = m_Hosts.size();
+
+	for (int i = 0; i < count; i++) {
+		Dictionary::Ptr locals = make_shared<Dictionary>();
+		locals->Set("host", m_Hosts[i]);
+
+		Value value;
+
+		try {
+			value = path->Evaluate(locals);
+		} catch (const std::exception&) {
+			index.Errors.push_back(i);
+			continue;
+		}
+
+		if (!member) {
+			if (value.IsString())
+				index.Values[value].push_back(i);
+
+			continue;
+		}
+
+		if (value.IsEmpty())
+			continue;
+
+		if (!value.IsObjectType<Array>()) {
+			index.Errors.push_back(i);
+			continue;
+		}
+
+		Array::Ptr arr = value;
+
+		ObjectLock olock(arr);
+		BOOST_FOREACH(const Value& item, arr) {
+			if (!item.IsString())
+				continue;
+
+			std::vector<int>& hosts = index.Values[item];
+
+			if (hosts.empty() || hosts.back() != i)
+				hosts.push_back(i);
+		}
+	}
+
+	return index;
+}
+
+/**
+ * Checks whether the expression is a chain of literal indexers applied
+ * to the 'host' variable (e.g. host.vars.os) and returns the path.
+ */
+bool HostFilterIndex::GetPathKey(const AExpression::Ptr& expr, String *key)
+{
+	AExpression::OpCallback op = expr->GetOperator();
+
+	if (op == &AExpression::OpVariable) {
+		if (expr->GetOperand1() != "host")
+			return false;
+
+		*key = "host";
+		return true;
+	} else if (op == &AExpression::OpIndexer) {
+		AExpression::Ptr index = expr->GetOperand2();
+
+		if (index->GetOperator() != &AExpression::OpLiteral || !index->GetOperand1().IsString())
+			return false;
+
+		if (!GetPathKey(expr->GetOperand1(), key))
+			return false;
+
+		*key += "." + static_cast<String>(index->GetOperand1());
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,70 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#ifndef HOSTFILTERINDEX_H
+#define HOSTFILTERINDEX_H
+
+#include "icinga/i2-icinga.h"
+#include "icinga/host.h"
+#include "config/aexpression.h"
+
+namespace icinga
+{
+
+/**
+ * Narrows down the hosts an 'apply' rule filter can match.
+ *
+ * Filter terms of the form `host.<path> == "value"` and
+ * `"value" in host.<path>` are answered with a hash lookup; the
+ * remaining terms are assumed to match every host. The resulting
+ * candidate list is a superset of the matching hosts, so callers
+ * still have to evaluate the full filter for each candidate.
+ *
+ * @ingroup icinga
+ */
+class I2_ICINGA_API HostFilterIndex
+{
+public:
+	HostFilterIndex(void);
+
+	const std::vector<Host::Ptr>& GetHosts(void) const;
+	std::vector<Host::Ptr> GetCandidates(const AExpression::Ptr& filter);
+
+private:
+	typedef std::map<String, std::vector<int> > ValueMap;
+
+	struct PathIndex
+	{
+		ValueMap Values;
+		std::vector<int> Errors;
+	};
+
+	std::vector<Host::Ptr> m_Hosts;
+	std::map<String, PathIndex> m_Paths;
+
+	bool FindCandidates(const AExpression::Ptr& expr, std::vector<int>& result);
+	bool FindValue(const Value& path, const Value& value, bool member, std::vector<int>& result);
+	const PathIndex& GetPathIndex(const AExpression::Ptr& path, const String& key, bool member);
+
+	static bool GetPathKey(const AExpression::Ptr& expr, String *key);
+};
+
+}
+
+#endif /* HOSTFILTERINDEX_H */
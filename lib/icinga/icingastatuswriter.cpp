@@ -115,6 +115,12 @@ Dictionary::Ptr IcingaStatusWriter::GetStatusData(void)
 	icinga_stats->Set("max_execution_time", scs.max_latency);
 	icinga_stats->Set("avg_execution_time", scs.avg_execution_time);
 
+	CheckQueueStatistics cqs = CIB::GetCheckQueueStatistics();
+
+	icinga_stats->Set("running_checks", cqs.running_checks);
+	icinga_stats->Set("check_queue_length", cqs.queue_length);
+	icinga_stats->Set("avg_check_queue_wait_time", cqs.avg_queue_wait_time);
+
 	ServiceStatistics ss = CIB::CalculateServiceStats();
 
 	icinga_stats->Set("num_services_ok", ss.services_ok);
@@ -136,6 +142,11 @@ Dictionary::Ptr IcingaStatusWriter::GetStatusData(void)
 	icinga_stats->Set("num_hosts_in_downtime", hs.hosts_in_downtime);
 	icinga_stats->Set("num_hosts_acknowledged", hs.hosts_acknowledged);
 
+	ReachabilityCacheStatistics rcs = CIB::CalculateReachabilityCacheStats();
+
+	icinga_stats->Set("reachability_cache_hits", rcs.hits);
+	icinga_stats->Set("reachability_cache_misses", rcs.misses);
+
 	bag->Set("icinga_status", icinga_stats);
 
 	return bag;
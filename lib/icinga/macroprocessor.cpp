@@ -25,6 +25,7 @@
 #include "base/logger_fwd.h"
 #include "base/context.h"
 #include "base/dynamicobject.h"
+#include "base/type.h"
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -32,6 +33,47 @@
 
 using namespace icinga;
 
+#define MACROCACHESIZE 4096
+
+/**
+ * A macro reference in a compiled format string, e.g. $host.vars.foo$.
+ */
+struct MacroProcessor::MacroReference
+{
+	String Name; /**< The macro's name. */
+	String ObjName; /**< The resolver's name, empty if the macro isn't qualified. */
+	std::vector<String> Tokens; /**< The path components after the resolver's name. */
+	String Path; /**< The path components, joined with '.'. */
+	bool Recursive; /**< Whether the macro's value may contain further macros. */
+};
+
+/**
+ * A compiled format string. Literals[i] precedes Macros[i], the last
+ * literal follows the last macro. Templates aren't modified once they
+ * have been compiled.
+ */
+struct MacroProcessor::MacroTemplate
+{
+	std::vector<String> Literals;
+	std::vector<MacroReference> Macros;
+};
+
+/**
+ * A resolver which has been cast to the interfaces ResolveMacro() checks
+ * for once per ResolveMacros() call rather than once per macro.
+ */
+struct MacroProcessor::ResolverSlot
+{
+	String Name;
+	Object::Ptr Obj;
+	DynamicObject::Ptr DObj;
+	MacroResolver::Ptr MResolver;
+};
+
+boost::mutex MacroProcessor::m_TemplateMutex;
+std::map<String, shared_ptr<MacroProcessor::MacroTemplate> > MacroProcessor::m_Templates;
+boost::thread_specific_ptr<MacroProcessor::FieldIdCache> MacroProcessor::m_FieldIds;
+
 Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolvers,
     const CheckResult::Ptr& cr, String *missingMacro,
     const MacroProcessor::EscapeCallback& escapeFn)
@@ -41,8 +83,19 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 	if (str.IsEmpty())
 		return Empty;
 
+	ResolverSlotList slots;
+
+	BOOST_FOREACH(const ResolverSpec& resolver, resolvers) {
+		ResolverSlot slot;
+		slot.Name = resolver.first;
+		slot.Obj = resolver.second;
+		slot.DObj = dynamic_pointer_cast<DynamicObject>(resolver.second);
+		slot.MResolver = dynamic_pointer_cast<MacroResolver>(resolver.second);
+		slots.push_back(slot);
+	}
+
 	if (str.IsScalar()) {
-		result = InternalResolveMacros(str, resolvers, cr, missingMacro, escapeFn);
+		result = InternalResolveMacros(str, slots, cr, missingMacro, escapeFn);
 	} else if (str.IsObjectType<Array>()) {
 		Array::Ptr resultArr = make_shared<Array>();
 		Array::Ptr arr = str;
@@ -51,7 +104,7 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 
 		BOOST_FOREACH(const Value& arg, arr) {
 			/* Note: don't escape macros here. */
-			resultArr->Add(InternalResolveMacros(arg, resolvers, cr, missingMacro, EscapeCallback()));
+			resultArr->Add(InternalResolveMacros(arg, slots, cr, missingMacro, EscapeCallback()));
 		}
 
 		result = resultArr;
@@ -62,87 +115,172 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 	return result;
 }
 
-bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resolvers,
-    const CheckResult::Ptr& cr, String *result, bool *recursive_macro)
+/**
+ * Returns the compiled form of a format string. Compiled templates only
+ * depend on the format string itself and are shared by all callers.
+ */
+shared_ptr<MacroProcessor::MacroTemplate> MacroProcessor::GetTemplate(const String& str)
 {
-	CONTEXT("Resolving macro '" + macro + "'");
+	{
+		boost::mutex::scoped_lock lock(m_TemplateMutex);
 
-	*recursive_macro = false;
+		std::map<String, shared_ptr<MacroTemplate> >::const_iterator it = m_Templates.find(str);
+
+		if (it != m_Templates.end())
+			return it->second;
+	}
+
+	shared_ptr<MacroTemplate> tmpl = CompileTemplate(str);
 
-	std::vector<String> tokens;
-	boost::algorithm::split(tokens, macro, boost::is_any_of("."));
+	boost::mutex::scoped_lock lock(m_TemplateMutex);
+
+	/* Custom attributes can be changed at runtime, so resolved values
+	 * don't necessarily come from a bounded set of strings. */
+	if (m_Templates.size() >= MACROCACHESIZE)
+		m_Templates.clear();
+
+	m_Templates[str] = tmpl;
+
+	return tmpl;
+}
 
-	String objName;
-	if (tokens.size() > 1) {
-		objName = tokens[0];
-		tokens.erase(tokens.begin());
+shared_ptr<MacroProcessor::MacroTemplate> MacroProcessor::CompileTemplate(const String& str)
+{
+	shared_ptr<MacroTemplate> tmpl = make_shared<MacroTemplate>();
+
+	size_t offset, pos_first, pos_second;
+	offset = 0;
+
+	while ((pos_first = str.FindFirstOf("$", offset)) != String::NPos) {
+		pos_second = str.FindFirstOf("$", pos_first + 1);
+
+		if (pos_second == String::NPos)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Closing $ not found in macro format string."));
+
+		tmpl->Literals.push_back(str.SubStr(offset, pos_first - offset));
+
+		MacroReference ref;
+		ref.Name = str.SubStr(pos_first + 1, pos_second - pos_first - 1);
+
+		boost::algorithm::split(ref.Tokens, ref.Name, boost::is_any_of("."));
+
+		if (ref.Tokens.size() > 1) {
+			ref.ObjName = ref.Tokens[0];
+			ref.Tokens.erase(ref.Tokens.begin());
+		}
+
+		ref.Path = boost::algorithm::join(ref.Tokens, ".");
+		ref.Recursive = (ref.Tokens[0] == "vars" ||
+		    ref.Tokens[0] == "action_url" ||
+		    ref.Tokens[0] == "notes_url" ||
+		    ref.Tokens[0] == "notes");
+
+		tmpl->Macros.push_back(ref);
+
+		offset = pos_second + 1;
 	}
 
-	BOOST_FOREACH(const ResolverSpec& resolver, resolvers) {
-		if (!objName.IsEmpty() && objName != resolver.first)
-			continue;
+	tmpl->Literals.push_back(str.SubStr(offset));
 
-		if (objName.IsEmpty()) {
-			DynamicObject::Ptr dobj = dynamic_pointer_cast<DynamicObject>(resolver.second);
+	return tmpl;
+}
 
-			if (dobj) {
-				Dictionary::Ptr vars = dobj->GetVars();
+/**
+ * Looks up the field ID for a macro's path component. IDs are cached per
+ * type and field name in a per-thread cache, so resolving the same macro
+ * for different resolver types doesn't evict cached IDs and doesn't
+ * require any locking.
+ */
+int MacroProcessor::GetFieldId(const Object::Ptr& object, const String& name)
+{
+	const Type *type = object->GetReflectionType();
 
-				if (vars && vars->Contains(macro)) {
-					*result = vars->Get(macro);
-					*recursive_macro = true;
-					return true;
-				}
+	if (!type)
+		return -1;
+
+	FieldIdCache *cache = m_FieldIds.get();
+
+	if (!cache) {
+		cache = new FieldIdCache();
+		m_FieldIds.reset(cache);
+	}
+
+	std::pair<const Type *, String> key = std::make_pair(type, name);
+	FieldIdCache::const_iterator it = cache->find(key);
+
+	if (it != cache->end())
+		return it->second;
+
+	/* Field names which don't exist come from the config, so the cache
+	 * is bounded just like the template cache. */
+	if (cache->size() >= MACROCACHESIZE)
+		cache->clear();
+
+	int field = type->GetFieldId(name);
+	(*cache)[key] = field;
+
+	return field;
+}
+
+bool MacroProcessor::ResolveMacro(const MacroReference& ref,
+    const ResolverSlotList& resolvers, const CheckResult::Ptr& cr,
+    String *result, bool *recursive_macro)
+{
+	CONTEXT("Resolving macro '" + ref.Name + "'");
+
+	*recursive_macro = false;
+
+	BOOST_FOREACH(const ResolverSlot& resolver, resolvers) {
+		if (!ref.ObjName.IsEmpty() && ref.ObjName != resolver.Name)
+			continue;
+
+		if (ref.ObjName.IsEmpty() && resolver.DObj) {
+			Dictionary::Ptr vars = resolver.DObj->GetVars();
+
+			if (vars && vars->Contains(ref.Name)) {
+				*result = vars->Get(ref.Name);
+				*recursive_macro = true;
+				return true;
 			}
 		}
 
-		MacroResolver::Ptr mresolver = dynamic_pointer_cast<MacroResolver>(resolver.second);
-
-		if (mresolver && mresolver->ResolveMacro(boost::algorithm::join(tokens, "."), cr, result))
+		if (resolver.MResolver && resolver.MResolver->ResolveMacro(ref.Path, cr, result))
 			return true;
 
-		Value ref = resolver.second;
+		Value value = resolver.Obj;
 		bool valid = true;
 
-		BOOST_FOREACH(const String& token, tokens) {
-			if (ref.IsObjectType<Dictionary>()) {
-				Dictionary::Ptr dict = ref;
+		for (size_t i = 0; i < ref.Tokens.size(); i++) {
+			const String& token = ref.Tokens[i];
+
+			if (value.IsObjectType<Dictionary>()) {
+				Dictionary::Ptr dict = value;
 				if (dict->Contains(token)) {
-					ref = dict->Get(token);
+					value = dict->Get(token);
 					continue;
 				} else {
 					valid = false;
 					break;
 				}
-			} else if (ref.IsObject()) {
-				Object::Ptr object = ref;
+			} else if (value.IsObject()) {
+				Object::Ptr object = value;
 
-				const Type *type = object->GetReflectionType();
-
-				if (!type) {
-					valid = false;
-					break;
-				}
-
-				int field = type->GetFieldId(token);
+				int field = GetFieldId(object, token);
 
 				if (field == -1) {
 					valid = false;
 					break;
 				}
 
-				ref = object->GetField(field);
+				value = object->GetField(field);
 			}
 		}
 
 		if (valid) {
-			if (tokens[0] == "vars" ||
-			    tokens[0] == "action_url" ||
-			    tokens[0] == "notes_url" ||
-			    tokens[0] == "notes")
+			if (ref.Recursive)
 				*recursive_macro = true;
 
-			*result = ref;
+			*result = value;
 			return true;
 		}
 	}
@@ -150,42 +288,41 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 	return false;
 }
 
-String MacroProcessor::InternalResolveMacros(const String& str, const ResolverList& resolvers,
+String MacroProcessor::InternalResolveMacros(const String& str, const ResolverSlotList& resolvers,
     const CheckResult::Ptr& cr, String *missingMacro,
     const MacroProcessor::EscapeCallback& escapeFn, int recursionLevel)
 {
+	/* Most custom attributes and many arguments don't contain macros. */
+	if (str.FindFirstOf("$") == String::NPos)
+		return str;
+
 	CONTEXT("Resolving macros for string '" + str + "'");
 
 	if (recursionLevel > 15)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Infinite recursion detected while resolving macros"));
 
-	size_t offset, pos_first, pos_second;
-	offset = 0;
-
-	String result = str;
-	while ((pos_first = result.FindFirstOf("$", offset)) != String::NPos) {
-		pos_second = result.FindFirstOf("$", pos_first + 1);
+	shared_ptr<MacroTemplate> tmpl = GetTemplate(str);
 
-		if (pos_second == String::NPos)
-			BOOST_THROW_EXCEPTION(std::runtime_error("Closing $ not found in macro format string."));
+	String result = tmpl->Literals[0];
 
-		String name = result.SubStr(pos_first + 1, pos_second - pos_first - 1);
+	for (size_t i = 0; i < tmpl->Macros.size(); i++) {
+		const MacroReference& ref = tmpl->Macros[i];
 
 		String resolved_macro;
 		bool recursive_macro;
-		bool found = ResolveMacro(name, resolvers, cr, &resolved_macro, &recursive_macro);
+		bool found = ResolveMacro(ref, resolvers, cr, &resolved_macro, &recursive_macro);
 
 		/* $$ is an escape sequence for $. */
-		if (name.IsEmpty()) {
+		if (ref.Name.IsEmpty()) {
 			resolved_macro = "$";
 			found = true;
 		}
 
 		if (!found) {
 			if (!missingMacro)
-				Log(LogWarning, "icinga", "Macro '" + name + "' is not defined.");
+				Log(LogWarning, "icinga", "Macro '" + ref.Name + "' is not defined.");
 			else
-				*missingMacro = name;
+				*missingMacro = ref.Name;
 		}
 
 		/* recursively resolve macros in the macro if it was a user macro */
@@ -196,8 +333,8 @@ String MacroProcessor::InternalResolveMacros(const String& str, const ResolverLi
 		if (escapeFn)
 			resolved_macro = escapeFn(resolved_macro);
 
-		result.Replace(pos_first, pos_second - pos_first + 1, resolved_macro);
-		offset = pos_first + resolved_macro.GetLength() + 1;
+		result += resolved_macro;
+		result += tmpl->Literals[i + 1];
 	}
 
 	return result;
@@ -25,6 +25,8 @@
 #include "base/dictionary.h"
 #include "base/array.h"
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 #include <map>
 
 namespace icinga
@@ -47,12 +49,28 @@ public:
 	    const EscapeCallback& escapeFn = EscapeCallback());
 
 private:
+	struct MacroReference;
+	struct MacroTemplate;
+	struct ResolverSlot;
+
+	typedef std::vector<ResolverSlot> ResolverSlotList;
+	typedef std::map<std::pair<const Type *, String>, int> FieldIdCache;
+
+	static boost::mutex m_TemplateMutex;
+	static std::map<String, shared_ptr<MacroTemplate> > m_Templates;
+	static boost::thread_specific_ptr<FieldIdCache> m_FieldIds;
+
 	MacroProcessor(void);
 
-	static bool ResolveMacro(const String& macro, const ResolverList& resolvers,
-		const CheckResult::Ptr& cr, String *result, bool *recursive_macro);
+	static shared_ptr<MacroTemplate> GetTemplate(const String& str);
+	static shared_ptr<MacroTemplate> CompileTemplate(const String& str);
+	static int GetFieldId(const Object::Ptr& object, const String& name);
+
+	static bool ResolveMacro(const MacroReference& ref,
+	    const ResolverSlotList& resolvers, const CheckResult::Ptr& cr,
+	    String *result, bool *recursive_macro);
 	static String InternalResolveMacros(const String& str,
-	    const ResolverList& resolvers, const CheckResult::Ptr& cr,
+	    const ResolverSlotList& resolvers, const CheckResult::Ptr& cr,
 	    String *missingMacro, const EscapeCallback& escapeFn,
 	    int recursionLevel = 0);
 };
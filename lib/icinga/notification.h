@@ -112,6 +112,7 @@ private:
 	void ExecuteNotificationHelper(NotificationType type, const User::Ptr& user, const CheckResult::Ptr& cr, bool force, const String& author = "", const String& text = "");
 
 	static bool EvaluateApplyRule(const shared_ptr<Checkable>& checkable, const ApplyRule& rule);
+	static void EvaluateApplyRuleForObjects(const ApplyRule& rule, const std::vector<shared_ptr<Checkable> >& checkables);
 	static void EvaluateApplyRules(const std::vector<ApplyRule>& rules);
 };
 
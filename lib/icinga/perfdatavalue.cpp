@@ -19,9 +19,6 @@
 
 #include "icinga/perfdatavalue.h"
 #include "base/convert.h"
-#include <boost/algorithm/string/case_conv.hpp>
-#include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string/classification.hpp>
 
 using namespace icinga;
 
@@ -42,86 +39,210 @@ PerfdataValue::PerfdataValue(double value, bool counter, const String& unit,
 	SetMax(max);
 }
 
-Value PerfdataValue::Parse(const String& perfdata)
+/**
+ * Parses a number which must span the entire range [begin, end).
+ */
+static bool ParseNumber(const char *begin, const char *end, double *result)
 {
-	size_t pos = perfdata.FindFirstNotOf("+-0123456789.e");
+	if (begin == end)
+		return false;
 
-	double value = Convert::ToDouble(perfdata.SubStr(0, pos));
+	for (const char *p = begin; p < end; p++) {
+		if (!strchr("+-0123456789.eE", *p))
+			return false;
+	}
 
-	if (pos == String::NPos)
-		return value;
+	char *last;
+	*result = strtod(begin, &last);
 
-	std::vector<String> tokens;
-	boost::algorithm::split(tokens, perfdata, boost::is_any_of(";"));
+	return (last == end);
+}
 
-	bool counter = false;
-	String unit;
-	Value warn, crit, min, max;
+/**
+ * Compares a unit with a lower-case string, ignoring the unit's case.
+ */
+static bool UnitEquals(const char *begin, const char *end, const char *unit)
+{
+	for (; begin < end; begin++, unit++) {
+		if (*unit == '\0' || tolower(static_cast<unsigned char>(*begin)) != *unit)
+			return false;
+	}
 
-	unit = perfdata.SubStr(pos, tokens[0].GetLength() - pos);
+	return (*unit == '\0');
+}
+
+/**
+ * Parses a single performance data value (i.e. the part after the '=')
+ * in one pass and without allocating memory.
+ *
+ * @param begin The beginning of the value.
+ * @param end The end of the value.
+ * @param record The record which receives the value. Its label is not modified.
+ * @returns true if the value is valid, false otherwise.
+ */
+bool PerfdataValue::ParseRecord(const char *begin, const char *end, PerfdataRecord& record)
+{
+	const char *pos = begin;
 
-	boost::algorithm::to_lower(unit);
+	while (pos < end && strchr("+-0123456789.e", *pos))
+		pos++;
+
+	if (!ParseNumber(begin, pos, &record.Value))
+		return false;
+
+	record.Counter = false;
+	record.Unit = "";
+	record.Warn = record.Crit = record.Min = record.Max = 0;
+	record.Flags = 0;
+
+	if (pos == end) {
+		record.Flags = PerfdataPlain;
+		return true;
+	}
+
+	const char *unit = pos;
+
+	while (pos < end && *pos != ';')
+		pos++;
 
 	double base = 1.0;
 
-	if (unit == "us") {
+	if (unit == pos) {
+		/* No unit. */
+	} else if (UnitEquals(unit, pos, "us")) {
 		base /= 1000.0 * 1000.0;
-		unit = "seconds";
-	} else if (unit == "ms") {
+		record.Unit = "seconds";
+	} else if (UnitEquals(unit, pos, "ms")) {
 		base /= 1000.0;
-		unit = "seconds";
-	} else if (unit == "s") {
-		unit = "seconds";
-	} else if (unit == "tb") {
+		record.Unit = "seconds";
+	} else if (UnitEquals(unit, pos, "s")) {
+		record.Unit = "seconds";
+	} else if (UnitEquals(unit, pos, "tb")) {
 		base *= 1024.0 * 1024.0 * 1024.0 * 1024.0;
-		unit = "bytes";
-	} else if (unit == "gb") {
+		record.Unit = "bytes";
+	} else if (UnitEquals(unit, pos, "gb")) {
 		base *= 1024.0 * 1024.0 * 1024.0;
-		unit = "bytes";
-	} else if (unit == "mb") {
+		record.Unit = "bytes";
+	} else if (UnitEquals(unit, pos, "mb")) {
 		base *= 1024.0 * 1024.0;
-		unit = "bytes";
-	} else if (unit == "kb") {
+		record.Unit = "bytes";
+	} else if (UnitEquals(unit, pos, "kb")) {
 		base *= 1024.0;
-		unit = "bytes";
-	} else if (unit == "b") {
-		unit = "bytes";
-	} else if (unit == "%") {
-		unit = "percent";
-	} else if (unit == "c") {
-		counter = true;
-		unit = "";
-	} else if (unit != "") {
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid performance data unit: " + unit));
+		record.Unit = "bytes";
+	} else if (UnitEquals(unit, pos, "b")) {
+		record.Unit = "bytes";
+	} else if (UnitEquals(unit, pos, "%")) {
+		record.Unit = "percent";
+	} else if (UnitEquals(unit, pos, "c")) {
+		record.Counter = true;
+	} else {
+		return false;
 	}
 
-	if (tokens.size() > 1 && tokens[1] != "U" && tokens[1] != "")
-		warn = Convert::ToDouble(tokens[1]);
+	record.Value *= base;
+
+	double *thresholds[] = { &record.Warn, &record.Crit, &record.Min, &record.Max };
 
-	if (tokens.size() > 2 && tokens[2] != "U" && tokens[2] != "")
-		crit = Convert::ToDouble(tokens[2]);
+	for (int i = 0; i < 4 && pos < end; i++) {
+		const char *field = ++pos;
 
-	if (tokens.size() > 3 && tokens[3] != "U" && tokens[3] != "")
-		min = Convert::ToDouble(tokens[3]);
+		while (pos < end && *pos != ';')
+			pos++;
 
-	if (tokens.size() > 4 && tokens[4] != "U" && tokens[4] != "")
-		max = Convert::ToDouble(tokens[4]);
+		if (field == pos || (pos - field == 1 && *field == 'U'))
+			continue;
 
-	value = value * base;
+		if (!ParseNumber(field, pos, thresholds[i]))
+			return false;
 
-	if (!warn.IsEmpty())
-		warn = warn * base;
+		*thresholds[i] *= base;
+		record.Flags |= (PerfdataHasWarn << i);
+	}
 
-	if (!crit.IsEmpty())
-		crit = crit * base;
+	return true;
+}
+
+/**
+ * Converts a record into the representation used by Parse(), i.e. either
+ * a number or a PerfdataValue object.
+ */
+Value PerfdataValue::FromRecord(const PerfdataRecord& record)
+{
+	if (record.Flags & PerfdataPlain)
+		return record.Value;
+
+	Value warn, crit, min, max;
 
-	if (!min.IsEmpty())
-		min = min * base;
+	if (record.Flags & PerfdataHasWarn)
+		warn = record.Warn;
+
+	if (record.Flags & PerfdataHasCrit)
+		crit = record.Crit;
+
+	if (record.Flags & PerfdataHasMin)
+		min = record.Min;
+
+	if (record.Flags & PerfdataHasMax)
+		max = record.Max;
+
+	return make_shared<PerfdataValue>(record.Value, record.Counter, record.Unit, warn, crit, min, max);
+}
+
+/**
+ * Converts a value as returned by Parse() into a record.
+ *
+ * @returns true if the value could be converted, false otherwise.
+ */
+bool PerfdataValue::ToRecord(const Value& perfdata, PerfdataRecord& record)
+{
+	record.Counter = false;
+	record.Unit = "";
+	record.Warn = record.Crit = record.Min = record.Max = 0;
+
+	if (!perfdata.IsObjectType<PerfdataValue>()) {
+		if (!perfdata.IsScalar())
+			return false;
+
+		record.Value = perfdata;
+		record.Flags = PerfdataPlain;
+		return true;
+	}
+
+	PerfdataValue::Ptr pdv = perfdata;
+
+	record.Value = pdv->GetValue();
+	record.Counter = pdv->GetCounter();
+	record.Flags = 0;
+
+	if (pdv->GetUnit() == "seconds")
+		record.Unit = "seconds";
+	else if (pdv->GetUnit() == "bytes")
+		record.Unit = "bytes";
+	else if (pdv->GetUnit() == "percent")
+		record.Unit = "percent";
+
+	Value thresholds[] = { pdv->GetWarn(), pdv->GetCrit(), pdv->GetMin(), pdv->GetMax() };
+	double *fields[] = { &record.Warn, &record.Crit, &record.Min, &record.Max };
+
+	for (int i = 0; i < 4; i++) {
+		if (thresholds[i].IsEmpty())
+			continue;
+
+		*fields[i] = thresholds[i];
+		record.Flags |= (PerfdataHasWarn << i);
+	}
+
+	return true;
+}
+
+Value PerfdataValue::Parse(const String& perfdata)
+{
+	PerfdataRecord record;
 
-	if (!max.IsEmpty())
-		max = max * base;
+	if (!ParseRecord(perfdata.CStr(), perfdata.CStr() + perfdata.GetLength(), record))
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid performance data value: " + perfdata));
 
-	return make_shared<PerfdataValue>(value, counter, unit, warn, crit, min, max);
+	return FromRecord(record);
 }
 
 String PerfdataValue::Format(const Value& perfdata)
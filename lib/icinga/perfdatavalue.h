@@ -22,10 +22,46 @@
 
 #include "icinga/i2-icinga.h"
 #include "icinga/perfdatavalue.th"
+#include <vector>
 
 namespace icinga
 {
 
+/**
+ * Flags for PerfdataRecord::Flags.
+ *
+ * @ingroup icinga
+ */
+enum PerfdataRecordFlag
+{
+	PerfdataHasWarn = 1,
+	PerfdataHasCrit = 2,
+	PerfdataHasMin = 4,
+	PerfdataHasMax = 8,
+	PerfdataPlain = 16 /**< The metric consists of a number only. */
+};
+
+/**
+ * A performance data metric in a compact form which - unlike a
+ * PerfdataValue object - doesn't require heap allocations.
+ *
+ * @ingroup icinga
+ */
+struct PerfdataRecord
+{
+	String Label;
+	double Value;
+	bool Counter;
+	const char *Unit; /**< "seconds", "bytes", "percent" or "". */
+	double Warn;
+	double Crit;
+	double Min;
+	double Max;
+	int Flags; /**< A combination of PerfdataRecordFlag values. */
+};
+
+typedef std::vector<PerfdataRecord> PerfdataRecordList;
+
 class I2_ICINGA_API PerfdataValue : public ObjectImpl<PerfdataValue>
 {
 public:
@@ -39,6 +75,10 @@ public:
 
 	static Value Parse(const String& perfdata);
 	static String Format(const Value& perfdata);
+
+	static bool ParseRecord(const char *begin, const char *end, PerfdataRecord& record);
+	static Value FromRecord(const PerfdataRecord& record);
+	static bool ToRecord(const Value& perfdata, PerfdataRecord& record);
 };
 
 }
@@ -219,65 +219,128 @@ std::pair<String, Value> PluginUtility::ParseCheckOutput(const String& output)
 
 	boost::algorithm::trim(perfdata);
 
+	/* Check results are serialized (state file, cluster messages) with the
+	 * performance data as a Dictionary, which is what older endpoints and
+	 * perfdata writers expect. CheckResult::GetPerfdataRecords() caches the
+	 * records for consumers which can use them directly. */
 	return std::make_pair(text, ParsePerfdata(perfdata));
 }
 
 Value PluginUtility::ParsePerfdata(const String& perfdata)
 {
-	try {
-		Dictionary::Ptr result = make_shared<Dictionary>();
-	
-		size_t begin = 0;
-		String multi_prefix;
-		
-		for (;;) {
-			size_t eqp = perfdata.FindFirstOf('=', begin);
+	PerfdataRecordList records;
 
-			if (eqp == String::NPos)
-				break;
+	if (!ParsePerfdataRecords(perfdata, records))
+		return perfdata;
+
+	Dictionary::Ptr result = make_shared<Dictionary>();
+
+	BOOST_FOREACH(const PerfdataRecord& record, records) {
+		result->Set(record.Label, PerfdataValue::FromRecord(record));
+	}
+
+	return result;
+}
 
-			String key = perfdata.SubStr(begin, eqp - begin);
+/**
+ * Parses performance data into a list of records. The performance data
+ * can either be a string or a dictionary as returned by ParsePerfdata().
+ *
+ * @returns true if the performance data is valid, false otherwise.
+ */
+bool PluginUtility::ParsePerfdataRecords(const Value& perfdata, PerfdataRecordList& records)
+{
+	records.clear();
+
+	if (perfdata.IsObjectType<Dictionary>()) {
+		Dictionary::Ptr dict = perfdata;
 
-			if (key.GetLength() > 2 && key[0] == '\'' && key[key.GetLength() - 1] == '\'')
-				key = key.SubStr(1, key.GetLength() - 2);
+		ObjectLock olock(dict);
+		BOOST_FOREACH(const Dictionary::Pair& kv, dict) {
+			records.push_back(PerfdataRecord());
+			PerfdataRecord& record = records.back();
 
-			size_t multi_index = key.RFind("::");
+			record.Label = kv.first;
 
-			if (multi_index != String::NPos)
-				multi_prefix = "";
+			if (!PerfdataValue::ToRecord(kv.second, record))
+				return false;
+		}
 
-			size_t spq = perfdata.FindFirstOf(' ', eqp);
+		return true;
+	}
 
-			if (spq == String::NPos)
-				spq = perfdata.GetLength();
+	if (perfdata.IsObject())
+		return false;
 
-			String value = perfdata.SubStr(eqp + 1, spq - eqp - 1);
+	String text = perfdata;
+	const char *data = text.CStr();
+	size_t begin = 0;
+	String multi_prefix;
 
-			if (!multi_prefix.IsEmpty())
-				key = multi_prefix + "::" + key;
+	for (;;) {
+		size_t eqp = text.FindFirstOf('=', begin);
 
-			result->Set(key, PerfdataValue::Parse(value));
+		if (eqp == String::NPos)
+			break;
 
-			if (multi_index != String::NPos)
-				multi_prefix = key.SubStr(0, multi_index);
+		size_t key_begin = begin, key_end = eqp;
 
-			begin = spq + 1;
+		if (key_end - key_begin > 2 && data[key_begin] == '\'' && data[key_end - 1] == '\'') {
+			key_begin++;
+			key_end--;
 		}
 
-		return result;
-	} catch (const std::exception&) {
-		return perfdata;
+		size_t multi_index = String::NPos;
+
+		for (size_t i = key_begin; i + 1 < key_end; i++) {
+			if (data[i] == ':' && data[i + 1] == ':')
+				multi_index = i - key_begin;
+		}
+
+		if (multi_index != String::NPos)
+			multi_prefix.Clear();
+
+		size_t spq = text.FindFirstOf(' ', eqp);
+
+		if (spq == String::NPos)
+			spq = text.GetLength();
+
+		records.push_back(PerfdataRecord());
+		PerfdataRecord& record = records.back();
+
+		if (!PerfdataValue::ParseRecord(data + eqp + 1, data + spq, record))
+			return false;
+
+		if (!multi_prefix.IsEmpty()) {
+			record.Label = multi_prefix;
+			record.Label += "::";
+			record.Label += String(data + key_begin, data + key_end);
+		} else
+			record.Label = String(data + key_begin, data + key_end);
+
+		if (multi_index != String::NPos)
+			multi_prefix = record.Label.SubStr(0, multi_index);
+
+		begin = spq + 1;
 	}
+
+	return true;
 }
 
 String PluginUtility::FormatPerfdata(const Value& perfdata)
 {
 	std::ostringstream result;
 
-	if (!perfdata.IsObjectType<Dictionary>())
+	Value pdv = perfdata;
+
+	/* Plugin check results store the unparsed performance data. */
+	if (pdv.IsString())
+		pdv = ParsePerfdata(pdv);
+
+	if (!pdv.IsObjectType<Dictionary>())
 		return perfdata;
 
-	Dictionary::Ptr dict = perfdata;
+	Dictionary::Ptr dict = pdv;
 
 	ObjectLock olock(dict);
 
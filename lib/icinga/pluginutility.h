@@ -24,6 +24,7 @@
 #include "icinga/service.h"
 #include "icinga/checkcommand.h"
 #include "icinga/macroprocessor.h"
+#include "icinga/perfdatavalue.h"
 #include "base/process.h"
 #include "base/dictionary.h"
 #include "base/dynamicobject.h"
@@ -48,6 +49,7 @@ public:
 	static std::pair<String, Value> ParseCheckOutput(const String& output);
 
 	static Value ParsePerfdata(const String& perfdata);
+	static bool ParsePerfdataRecords(const Value& perfdata, PerfdataRecordList& records);
 	static String FormatPerfdata(const Value& perfdata);
 
 private:
@@ -18,13 +18,16 @@
  ******************************************************************************/
 
 #include "icinga/scheduleddowntime.h"
+#include "icinga/hostfilterindex.h"
 #include "config/configitembuilder.h"
 #include "base/initialize.h"
 #include "base/dynamictype.h"
 #include "base/convert.h"
 #include "base/logger_fwd.h"
 #include "base/context.h"
+#include "base/workqueue.h"
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 
 using namespace icinga;
 
@@ -89,39 +92,47 @@ bool ScheduledDowntime::EvaluateApplyRule(const Checkable::Ptr& checkable, const
 	return true;
 }
 
-void ScheduledDowntime::EvaluateApplyRules(const std::vector<ApplyRule>& rules)
+void ScheduledDowntime::EvaluateApplyRuleForObjects(const ApplyRule& rule, const std::vector<Checkable::Ptr>& checkables)
 {
 	int apply_count = 0;
+	String type = (rule.GetTargetType() == "Host") ? "host" : "service";
 
-	BOOST_FOREACH(const ApplyRule& rule, rules) {
-		if (rule.GetTargetType() == "Host") {
-			apply_count = 0;
+	BOOST_FOREACH(const Checkable::Ptr& checkable, checkables) {
+		CONTEXT("Evaluating 'apply' rules for " + type + " '" + checkable->GetName() + "'");
 
-			BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjects<Host>()) {
-				CONTEXT("Evaluating 'apply' rules for host '" + host->GetName() + "'");
-
-				if (EvaluateApplyRule(host, rule))
-					apply_count++;
-			}
+		if (EvaluateApplyRule(checkable, rule))
+			apply_count++;
+	}
 
-			if (apply_count == 0)
-				Log(LogWarning, "icinga", "Apply rule '" + rule.GetName() + "' for host does not match anywhere!");
+	if (apply_count == 0)
+		Log(LogWarning, "icinga", "Apply rule '" + rule.GetName() + "' for " + type + " does not match anywhere!");
+}
 
-		} else if (rule.GetTargetType() == "Service") {
-			apply_count = 0;
+void ScheduledDowntime::EvaluateApplyRules(const std::vector<ApplyRule>& rules)
+{
+	HostFilterIndex index;
+	ParallelWorkQueue upq;
 
-			BOOST_FOREACH(const Service::Ptr& service, DynamicType::GetObjects<Service>()) {
-				CONTEXT("Evaluating 'apply' rules for Service '" + service->GetName() + "'");
+	BOOST_FOREACH(const ApplyRule& rule, rules) {
+		std::vector<Checkable::Ptr> checkables;
 
-				if(EvaluateApplyRule(service, rule))
-					apply_count++;
+		if (rule.GetTargetType() == "Host") {
+			BOOST_FOREACH(const Host::Ptr& host, index.GetCandidates(rule.GetFilter())) {
+				checkables.push_back(host);
+			}
+		} else if (rule.GetTargetType() == "Service") {
+			BOOST_FOREACH(const Host::Ptr& host, index.GetCandidates(rule.GetFilter())) {
+				BOOST_FOREACH(const Service::Ptr& service, host->GetServices()) {
+					checkables.push_back(service);
+				}
 			}
-
-			if (apply_count == 0)
-				Log(LogWarning, "icinga", "Apply rule '" + rule.GetName() + "' for service does not match anywhere!");
-
 		} else {
 			Log(LogWarning, "icinga", "Wrong target type for apply rule '" + rule.GetName() + "'!");
+			continue;
 		}
+
+		upq.Enqueue(boost::bind(&ScheduledDowntime::EvaluateApplyRuleForObjects, boost::cref(rule), checkables));
 	}
+
+	upq.Join();
 }
@@ -56,6 +56,7 @@ private:
 	void CreateNextDowntime(void);
 
 	static bool EvaluateApplyRule(const Checkable::Ptr& checkable, const ApplyRule& rule);
+	static void EvaluateApplyRuleForObjects(const ApplyRule& rule, const std::vector<Checkable::Ptr>& checkables);
 	static void EvaluateApplyRules(const std::vector<ApplyRule>& rules);
 };
 
@@ -18,13 +18,16 @@
  ******************************************************************************/
 
 #include "icinga/service.h"
+#include "icinga/hostfilterindex.h"
 #include "config/configitembuilder.h"
 #include "base/initialize.h"
 #include "base/dynamictype.h"
 #include "base/convert.h"
 #include "base/logger_fwd.h"
 #include "base/context.h"
+#include "base/workqueue.h"
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 
 using namespace icinga;
 
@@ -80,21 +83,29 @@ bool Service::EvaluateApplyRule(const Host::Ptr& host, const ApplyRule& rule)
 	return true;
 }
 
-void Service::EvaluateApplyRules(const std::vector<ApplyRule>& rules)
+void Service::EvaluateApplyRuleForHosts(const ApplyRule& rule, const std::vector<Host::Ptr>& hosts)
 {
 	int apply_count = 0;
 
-	BOOST_FOREACH(const ApplyRule& rule, rules) {
-		apply_count = 0;
+	BOOST_FOREACH(const Host::Ptr& host, hosts) {
+		CONTEXT("Evaluating 'apply' rules for host '" + host->GetName() + "'");
 
-		BOOST_FOREACH(const Host::Ptr& host, DynamicType::GetObjects<Host>()) {
-			CONTEXT("Evaluating 'apply' rules for host '" + host->GetName() + "'");
+		if (EvaluateApplyRule(host, rule))
+			apply_count++;
+	}
 
-			if (EvaluateApplyRule(host, rule))
-				apply_count++;
-		}
+	if (apply_count == 0)
+		Log(LogWarning, "icinga", "Apply rule '" + rule.GetName() + "' for host does not match anywhere!");
+}
 
-		if (apply_count == 0)
-			Log(LogWarning, "icinga", "Apply rule '" + rule.GetName() + "' for host does not match anywhere!");
+void Service::EvaluateApplyRules(const std::vector<ApplyRule>& rules)
+{
+	HostFilterIndex index;
+	ParallelWorkQueue upq;
+
+	BOOST_FOREACH(const ApplyRule& rule, rules) {
+		upq.Enqueue(boost::bind(&Service::EvaluateApplyRuleForHosts, boost::cref(rule), index.GetCandidates(rule.GetFilter())));
 	}
+
+	upq.Join();
 }
@@ -68,6 +68,7 @@ private:
 	Host::Ptr m_Host;
 
 	static bool EvaluateApplyRule(const Host::Ptr& host, const ApplyRule& rule);
+	static void EvaluateApplyRuleForHosts(const ApplyRule& rule, const std::vector<Host::Ptr>& hosts);
 	static void EvaluateApplyRules(const std::vector<ApplyRule>& rules);
 };
 
@@ -82,6 +82,11 @@ void IcingaCheckTask::ScriptFunc(const Checkable::Ptr& service, const CheckResul
 	perfdata->Set("num_hosts_in_downtime", hs.hosts_in_downtime);
 	perfdata->Set("num_hosts_acknowledged", hs.hosts_acknowledged);
 
+	ReachabilityCacheStatistics rcs = CIB::CalculateReachabilityCacheStats();
+
+	perfdata->Set("reachability_cache_hits", rcs.hits);
+	perfdata->Set("reachability_cache_misses", rcs.misses);
+
 	cr->SetOutput("Icinga 2 has been running for " + Utility::FormatDuration(uptime) +
 	    ". Version: " + Application::GetVersion());
 	cr->SetPerformanceData(perfdata);
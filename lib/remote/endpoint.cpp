@@ -35,6 +35,10 @@ boost::signals2::signal<void (const Endpoint::Ptr&)> Endpoint::OnConnected;
 boost::signals2::signal<void (const Endpoint::Ptr&)> Endpoint::OnDisconnected;
 boost::signals2::signal<void (const Endpoint::Ptr&, const Dictionary::Ptr&)> Endpoint::OnMessageReceived;
 
+Endpoint::Endpoint(void)
+	: m_SendQueueBytes(0)
+{ }
+
 /**
  * Checks whether this endpoint is connected.
  *
@@ -52,6 +56,8 @@ bool Endpoint::IsAvailable(void) const
 
 Stream::Ptr Endpoint::GetClient(void) const
 {
+	boost::mutex::scoped_lock lock(m_SendMutex);
+
 	return m_Client;
 }
 
@@ -59,15 +65,30 @@ void Endpoint::SetClient(const Stream::Ptr& client)
 {
 	SetBlockedUntil(Utility::GetTime() + 15);
 
-	if (m_Client)
-		m_Client->Close();
+	Stream::Ptr oldClient;
+
+	{
+		boost::mutex::scoped_lock lock(m_SendMutex);
 
-	m_Client = client;
+		oldClient = m_Client;
+		m_Client = client;
+
+		/* Messages which were queued for the old connection are lost. */
+		m_SendQueue.clear();
+		m_SendQueueBytes = 0;
+		m_SendCV.notify_all();
+	}
+
+	if (oldClient)
+		oldClient->Close();
 
 	if (client) {
 		boost::thread thread(boost::bind(&Endpoint::MessageThreadProc, this, client));
 		thread.detach();
 
+		boost::thread writer(boost::bind(&Endpoint::WriterThreadProc, this, client));
+		writer.detach();
+
 		OnConnected(GetSelf());
 		Log(LogInformation, "remote", "Endpoint connected: " + GetName());
 	} else {
@@ -78,41 +99,148 @@ void Endpoint::SetClient(const Stream::Ptr& client)
 
 void Endpoint::SendMessage(const Dictionary::Ptr& message)
 {
-	Stream::Ptr client = GetClient();
+	if (!GetClient())
+		return;
 
-	if (!client)
+	SendEncodedMessage(make_shared<String>(JsonRpc::EncodeMessage(message)));
+}
+
+/**
+ * Queues a message which was encoded using JsonRpc::EncodeMessage(). The
+ * message is written to the peer by the endpoint's writer thread, so the
+ * same buffer can be queued for any number of endpoints.
+ *
+ * The queue isn't bounded; callers are expected to check the queue's size
+ * using GetSendQueueBytes() before adding more messages.
+ *
+ * @param data The encoded message.
+ */
+void Endpoint::SendEncodedMessage(const shared_ptr<const String>& data)
+{
+	boost::mutex::scoped_lock lock(m_SendMutex);
+
+	if (!m_Client)
 		return;
 
-	try {
-		JsonRpc::SendMessage(client, message);
-	} catch (const std::exception& ex) {
-		std::ostringstream msgbuf;
-		msgbuf << "Error while sending JSON-RPC message for endpoint '" << GetName() << "': " << DiagnosticInformation(ex);
-		Log(LogWarning, "remote", msgbuf.str());
+	m_SendQueue.push_back(data);
+	m_SendQueueBytes += data->GetLength();
+	m_SendCV.notify_all();
+}
+
+size_t Endpoint::GetSendQueueLength(void) const
+{
+	boost::mutex::scoped_lock lock(m_SendMutex);
 
-		m_Client.reset();
+	return m_SendQueue.size();
+}
 
-		OnDisconnected(GetSelf());
-		Log(LogWarning, "remote", "Endpoint disconnected: " + GetName());
+/**
+ * Returns the number of bytes which have been queued but not yet written,
+ * including the message the writer thread is currently working on.
+ */
+size_t Endpoint::GetSendQueueBytes(void) const
+{
+	boost::mutex::scoped_lock lock(m_SendMutex);
+
+	return m_SendQueueBytes;
+}
+
+/**
+ * Waits until the send queue has shrunk to the specified number of bytes
+ * or the endpoint has been disconnected.
+ */
+void Endpoint::WaitForSendQueue(size_t bytes)
+{
+	boost::mutex::scoped_lock lock(m_SendMutex);
+
+	while (m_Client && m_SendQueueBytes > bytes)
+		m_SendCV.wait(lock);
+}
+
+void Endpoint::WriterThreadProc(const Stream::Ptr& stream)
+{
+	Utility::SetThreadName("EndpointWriter");
+
+	for (;;) {
+		shared_ptr<const String> data;
+
+		{
+			boost::mutex::scoped_lock lock(m_SendMutex);
+
+			while (m_Client == stream && m_SendQueue.empty())
+				m_SendCV.wait(lock);
+
+			if (m_Client != stream)
+				return;
+
+			data = m_SendQueue.front();
+			m_SendQueue.pop_front();
+		}
+
+		try {
+			JsonRpc::SendEncodedMessage(stream, *data);
+		} catch (const std::exception& ex) {
+			std::ostringstream msgbuf;
+			msgbuf << "Error while sending JSON-RPC message for endpoint '" << GetName() << "': " << DiagnosticInformation(ex);
+			Log(LogWarning, "remote", msgbuf.str());
+
+			DropClient(stream);
+
+			return;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(m_SendMutex);
+
+			if (m_Client != stream)
+				return;
+
+			m_SendQueueBytes -= data->GetLength();
+			m_SendCV.notify_all();
+		}
+	}
+}
+
+/**
+ * Disconnects the endpoint after reading from or writing to the
+ * specified client connection failed.
+ */
+void Endpoint::DropClient(const Stream::Ptr& stream)
+{
+	{
+		boost::mutex::scoped_lock lock(m_SendMutex);
+
+		/* The other thread might have noticed the error first. */
+		if (m_Client != stream)
+			return;
+
+		m_Client.reset();
+		m_SendQueue.clear();
+		m_SendQueueBytes = 0;
+		m_SendCV.notify_all();
 	}
+
+	stream->Close();
+
+	OnDisconnected(GetSelf());
+	Log(LogWarning, "remote", "Endpoint disconnected: " + GetName());
 }
 
 void Endpoint::MessageThreadProc(const Stream::Ptr& stream)
 {
 	Utility::SetThreadName("EndpointMsg");
 
+	NetStringContext context;
+
 	for (;;) {
 		Dictionary::Ptr message;
 
 		try {
-			message = JsonRpc::ReadMessage(stream);
+			message = JsonRpc::ReadMessage(stream, context);
 		} catch (const std::exception& ex) {
 			Log(LogWarning, "remote", "Error while reading JSON-RPC message for endpoint '" + GetName() + "': " + DiagnosticInformation(ex));
 
-			m_Client.reset();
-
-			OnDisconnected(GetSelf());
-			Log(LogWarning, "remote", "Endpoint disconnected: " + GetName());
+			DropClient(stream);
 
 			return;
 		}
@@ -25,6 +25,9 @@
 #include "base/array.h"
 #include "remote/i2-remote.h"
 #include <boost/signals2.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
 
 namespace icinga
 {
@@ -46,6 +49,8 @@ public:
         static boost::signals2::signal<void (const Endpoint::Ptr&)> OnDisconnected;
 	static boost::signals2::signal<void (const Endpoint::Ptr&, const Dictionary::Ptr&)> OnMessageReceived;
 
+	Endpoint(void);
+
 	Stream::Ptr GetClient(void) const;
 	void SetClient(const Stream::Ptr& client);
 
@@ -53,6 +58,11 @@ public:
 	bool IsAvailable(void) const;
 
 	void SendMessage(const Dictionary::Ptr& request);
+	void SendEncodedMessage(const shared_ptr<const String>& data);
+
+	size_t GetSendQueueLength(void) const;
+	size_t GetSendQueueBytes(void) const;
+	void WaitForSendQueue(size_t bytes);
 
 	bool HasFeature(const String& type) const;
 
@@ -61,7 +71,14 @@ private:
 	boost::thread m_Thread;
 	Array::Ptr m_ConnectedEndpoints;
 
+	mutable boost::mutex m_SendMutex;
+	boost::condition_variable m_SendCV;
+	std::deque<shared_ptr<const String> > m_SendQueue;
+	size_t m_SendQueueBytes;
+
 	void MessageThreadProc(const Stream::Ptr& stream);
+	void WriterThreadProc(const Stream::Ptr& stream);
+	void DropClient(const Stream::Ptr& stream);
 };
 
 }
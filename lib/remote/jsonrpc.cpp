@@ -22,7 +22,12 @@
 #include "base/objectlock.h"
 #include "base/logger_fwd.h"
 #include "base/serializer.h"
+#include "base/stdiostream.h"
+#include "base/zlibstream.h"
+#include <boost/foreach.hpp>
+#include <openssl/evp.h>
 #include <iostream>
+#include <sstream>
 
 using namespace icinga;
 
@@ -33,9 +38,42 @@ using namespace icinga;
  */
 void JsonRpc::SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message)
 {
-	String json = JsonSerialize(message);
-	//std::cerr << ">> " << json << std::endl;
-	NetString::WriteStringToStream(stream, json);
+	SendEncodedMessage(stream, EncodeMessage(message));
+}
+
+/**
+ * Sends a message which was encoded using EncodeMessage() to the
+ * connected peer. The same encoded message can be sent to any number
+ * of peers.
+ *
+ * @param data The encoded message.
+ */
+void JsonRpc::SendEncodedMessage(const Stream::Ptr& stream, const String& data)
+{
+	//std::cerr << ">> " << data << std::endl;
+	stream->Write(data.CStr(), data.GetLength());
+}
+
+/**
+ * Encodes a message for SendEncodedMessage().
+ *
+ * @param message The message.
+ * @returns The encoded message.
+ */
+String JsonRpc::EncodeMessage(const Dictionary::Ptr& message)
+{
+	return EncodeMessage(JsonSerialize(message));
+}
+
+/**
+ * Encodes a message which has already been serialized to JSON.
+ *
+ * @param json The JSON representation of the message.
+ * @returns The encoded message.
+ */
+String JsonRpc::EncodeMessage(const String& json)
+{
+	return NetString::Encode(json);
 }
 
 Dictionary::Ptr JsonRpc::ReadMessage(const Stream::Ptr& stream)
@@ -44,6 +82,28 @@ Dictionary::Ptr JsonRpc::ReadMessage(const Stream::Ptr& stream)
 	if (!NetString::ReadStringFromStream(stream, &jsonString))
 		BOOST_THROW_EXCEPTION(std::runtime_error("ReadStringFromStream signalled EOF."));
 
+	return DecodeMessage(jsonString);
+}
+
+/**
+ * Reads a message from the stream using a read buffer. All messages for
+ * the stream have to be read using the same context.
+ *
+ * @param stream The stream.
+ * @param context The read buffer for the stream.
+ * @returns The message.
+ */
+Dictionary::Ptr JsonRpc::ReadMessage(const Stream::Ptr& stream, NetStringContext& context)
+{
+	String jsonString;
+	if (!NetString::ReadStringFromStream(stream, &jsonString, context))
+		BOOST_THROW_EXCEPTION(std::runtime_error("ReadStringFromStream signalled EOF."));
+
+	return DecodeMessage(jsonString);
+}
+
+Dictionary::Ptr JsonRpc::DecodeMessage(const String& jsonString)
+{
 	//std::cerr << "<< " << jsonString << std::endl;
 	Value value = JsonDeserialize(jsonString);
 
@@ -54,3 +114,143 @@ Dictionary::Ptr JsonRpc::ReadMessage(const Stream::Ptr& stream)
 
 	return value;
 }
+
+#ifdef HAVE_BIOZLIB
+static String CompressString(const String& data)
+{
+	std::stringstream buffer;
+
+	ZlibStream::Ptr zstream = make_shared<ZlibStream>(make_shared<StdioStream>(&buffer, false));
+	zstream->Write(data.CStr(), data.GetLength());
+	zstream->Close();
+
+	return buffer.str();
+}
+
+static String DecompressString(const String& data)
+{
+	std::stringstream buffer(data.GetData());
+
+	ZlibStream::Ptr zstream = make_shared<ZlibStream>(make_shared<StdioStream>(&buffer, false));
+
+	String result;
+	char chunk[4096];
+
+	for (;;) {
+		size_t rc = zstream->Read(chunk, sizeof(chunk));
+
+		/* BIO_read() returns -1 for corrupted data. */
+		if (rc == 0 || rc > sizeof(chunk))
+			break;
+
+		result.GetData().append(chunk, rc);
+	}
+
+	return result;
+}
+#endif /* HAVE_BIOZLIB */
+
+static String Base64Encode(const String& data)
+{
+	std::vector<unsigned char> buffer(4 * ((data.GetLength() + 2) / 3) + 1);
+
+	int length = EVP_EncodeBlock(&buffer[0], reinterpret_cast<const unsigned char *>(data.CStr()), data.GetLength());
+
+	return String(reinterpret_cast<const char *>(&buffer[0]), reinterpret_cast<const char *>(&buffer[0]) + length);
+}
+
+static String Base64Decode(const String& data)
+{
+	size_t length = data.GetLength();
+
+	if (length % 4 != 0)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid base64 data."));
+
+	std::vector<unsigned char> buffer(length / 4 * 3 + 1);
+
+	int rc = EVP_DecodeBlock(&buffer[0], reinterpret_cast<const unsigned char *>(data.CStr()), length);
+
+	if (rc < 0)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid base64 data."));
+
+	/* EVP_DecodeBlock() includes the padding in the length. */
+	if (length > 0 && data[length - 1] == '=')
+		rc--;
+
+	if (length > 1 && data[length - 2] == '=')
+		rc--;
+
+	return String(reinterpret_cast<const char *>(&buffer[0]), reinterpret_cast<const char *>(&buffer[0]) + rc);
+}
+
+/**
+ * Combines messages which have already been serialized to JSON into a
+ * single message. The messages are wrapped as they are, so they don't
+ * have to be serialized again.
+ *
+ * @param method The method for the batch message.
+ * @param messages The JSON representations of the messages.
+ * @param compress Whether to compress the messages. Ignored if Icinga
+ *		   was built without zlib support.
+ * @returns The JSON representation of the batch message.
+ */
+String JsonRpc::EncodeBatch(const String& method, const std::vector<String>& messages, bool compress)
+{
+	size_t size = 2;
+
+	BOOST_FOREACH(const String& message, messages) {
+		size += message.GetLength() + 1;
+	}
+
+	String body;
+	body.GetData().reserve(size);
+	body += "[";
+
+	for (std::vector<String>::size_type i = 0; i < messages.size(); i++) {
+		if (i > 0)
+			body += ",";
+
+		body += messages[i];
+	}
+
+	body += "]";
+
+	String params;
+
+#ifdef HAVE_BIOZLIB
+	if (compress)
+		params = "{\"compression\":\"zlib\",\"messages\":\"" + Base64Encode(CompressString(body)) + "\"}";
+	else
+#endif /* HAVE_BIOZLIB */
+		params = "{\"messages\":" + body + "}";
+
+	return "{\"jsonrpc\":\"2.0\",\"method\":\"" + method + "\",\"params\":" + params + "}";
+}
+
+/**
+ * Extracts the messages from a batch message.
+ *
+ * @param params The batch message's parameters.
+ * @returns The messages.
+ */
+Array::Ptr JsonRpc::DecodeBatch(const Dictionary::Ptr& params)
+{
+	Value messages = params->Get("messages");
+	String compression = params->Get("compression");
+
+	if (!compression.IsEmpty()) {
+#ifdef HAVE_BIOZLIB
+		if (compression != "zlib")
+#endif /* HAVE_BIOZLIB */
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Unsupported batch compression: " + compression));
+
+#ifdef HAVE_BIOZLIB
+		messages = JsonDeserialize(DecompressString(Base64Decode(messages)));
+#endif /* HAVE_BIOZLIB */
+	}
+
+	if (!messages.IsObjectType<Array>())
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Batch message must contain an array of messages."));
+
+	return messages;
+}
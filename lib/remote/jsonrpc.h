@@ -21,8 +21,11 @@
 #define JSONRPC_H
 
 #include "base/stream.h"
+#include "base/netstring.h"
 #include "base/dictionary.h"
+#include "base/array.h"
 #include "remote/i2-remote.h"
+#include <vector>
 
 namespace icinga
 {
@@ -36,10 +39,19 @@ class I2_REMOTE_API JsonRpc
 {
 public:
 	static void SendMessage(const Stream::Ptr& stream, const Dictionary::Ptr& message);
+	static void SendEncodedMessage(const Stream::Ptr& stream, const String& data);
+	static String EncodeMessage(const Dictionary::Ptr& message);
+	static String EncodeMessage(const String& json);
 	static Dictionary::Ptr ReadMessage(const Stream::Ptr& stream);
+	static Dictionary::Ptr ReadMessage(const Stream::Ptr& stream, NetStringContext& context);
+
+	static String EncodeBatch(const String& method, const std::vector<String>& messages, bool compress);
+	static Array::Ptr DecodeBatch(const Dictionary::Ptr& params);
 
 private:
 	JsonRpc(void);
+
+	static Dictionary::Ptr DecodeMessage(const String& jsonString);
 };
 
 }
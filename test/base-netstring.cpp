@@ -19,6 +19,7 @@
 
 #include "base/netstring.h"
 #include "base/fifo.h"
+#include "base/utility.h"
 #include <boost/test/unit_test.hpp>
 
 using namespace icinga;
@@ -38,4 +39,130 @@ BOOST_AUTO_TEST_CASE(netstring)
 	fifo->Close();
 }
 
+BOOST_AUTO_TEST_CASE(encode)
+{
+	String data = NetString::Encode("hello");
+	BOOST_CHECK(data == "5:hello,");
+
+	/* An encoded string can be written to any number of streams. */
+	for (int i = 0; i < 2; i++) {
+		FIFO::Ptr fifo = make_shared<FIFO>();
+		fifo->Write(data.CStr(), data.GetLength());
+
+		String s;
+		BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s));
+		BOOST_CHECK(s == "hello");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(buffered)
+{
+	FIFO::Ptr fifo = make_shared<FIFO>();
+
+	String large(100000, 'x');
+
+	NetString::WriteStringToStream(fifo, "hello");
+	NetString::WriteStringToStream(fifo, "");
+	NetString::WriteStringToStream(fifo, large);
+	NetString::WriteStringToStream(fifo, "world");
+
+	NetStringContext context;
+	String s;
+
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, context));
+	BOOST_CHECK(s == "hello");
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, context));
+	BOOST_CHECK(s == "");
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, context));
+	BOOST_CHECK(s == large);
+	BOOST_CHECK(NetString::ReadStringFromStream(fifo, &s, context));
+	BOOST_CHECK(s == "world");
+	BOOST_CHECK(!NetString::ReadStringFromStream(fifo, &s, context));
+
+	/* truncated messages */
+	fifo->Write("5:hel", 5);
+	BOOST_CHECK_THROW(NetString::ReadStringFromStream(fifo, &s, context), std::runtime_error);
+
+	NetStringContext context2;
+	fifo->Write("5:hello;", 8);
+	BOOST_CHECK_THROW(NetString::ReadStringFromStream(fifo, &s, context2), std::invalid_argument);
+}
+
+/**
+ * A stream which fails the way ZlibStream does when BIO_read() returns -1.
+ */
+class BrokenStream : public Stream
+{
+public:
+	DECLARE_PTR_TYPEDEFS(BrokenStream);
+
+	virtual size_t Read(void *, size_t)
+	{
+		return static_cast<size_t>(-1);
+	}
+
+	virtual void Write(const void *, size_t)
+	{ }
+
+	virtual void Close(void)
+	{ }
+
+	virtual bool IsEof(void) const
+	{
+		return false;
+	}
+};
+
+BOOST_AUTO_TEST_CASE(read_error)
+{
+	BrokenStream::Ptr stream = make_shared<BrokenStream>();
+
+	NetStringContext context;
+	String s;
+	BOOST_CHECK_THROW(NetString::ReadStringFromStream(stream, &s, context), std::runtime_error);
+}
+
+/* Not part of the default test run (timings only):
+ * --run_test=base_netstring/benchmark */
+BOOST_AUTO_TEST_CASE(benchmark)
+{
+	const int count = 100000;
+
+	/* roughly the size of a check result message */
+	String message = "{\"jsonrpc\":\"2.0\",\"method\":\"cluster::CheckResult\",\"params\":{\"cr\":\"" +
+	    String(400, 'x') + "\"}}";
+
+	String data = NetString::Encode(message);
+	double size = static_cast<double>(data.GetLength()) * count;
+
+	FIFO::Ptr fifo = make_shared<FIFO>();
+
+	for (int i = 0; i < count; i++)
+		fifo->Write(data.CStr(), data.GetLength());
+
+	String s;
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < count; i++)
+		NetString::ReadStringFromStream(fifo, &s);
+
+	double unbuffered_duration = Utility::GetTime() - start;
+
+	for (int i = 0; i < count; i++)
+		fifo->Write(data.CStr(), data.GetLength());
+
+	NetStringContext context;
+	start = Utility::GetTime();
+
+	for (int i = 0; i < count; i++)
+		NetString::ReadStringFromStream(fifo, &s, context);
+
+	double buffered_duration = Utility::GetTime() - start;
+
+	BOOST_CHECK(s == message);
+
+	BOOST_TEST_MESSAGE("Unbuffered: " << size / 1024 / 1024 / unbuffered_duration << " MB/s");
+	BOOST_TEST_MESSAGE("Buffered: " << size / 1024 / 1024 / buffered_duration << " MB/s");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
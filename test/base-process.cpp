@@ -0,0 +1,194 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+#include "base/process.h"
+#include "base/scriptvariable.h"
+#include "base/utility.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <fstream>
+#include <vector>
+
+using namespace icinga;
+
+#ifndef _WIN32
+struct ProcessFixture
+{
+	ProcessFixture(void)
+	{
+		ScriptVariable::Set("UseVfork", true);
+		ScriptVariable::Set("SpawnMode", "helper");
+
+		static bool initialized = false;
+
+		if (!initialized) {
+			Process::InitializeSpawnHelper();
+			initialized = true;
+		}
+	}
+};
+
+struct ResultCollector
+{
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	std::vector<ProcessResult> Results;
+
+	void Add(const ProcessResult& pr)
+	{
+		boost::mutex::scoped_lock lock(Mutex);
+		Results.push_back(pr);
+		CV.notify_all();
+	}
+
+	bool WaitFor(size_t count)
+	{
+		boost::mutex::scoped_lock lock(Mutex);
+
+		while (Results.size() < count) {
+			if (!CV.timed_wait(lock, boost::posix_time::seconds(30)))
+				return false;
+		}
+
+		return true;
+	}
+};
+
+static ProcessResult RunCommand(const String& mode, const String& command, double timeout = 600)
+{
+	ScriptVariable::Set("SpawnMode", mode);
+
+	ResultCollector collector;
+
+	Dictionary::Ptr env = boost::make_shared<Dictionary>();
+	env->Set("ICINGA_TEST", "bar");
+
+	Process::Ptr process = boost::make_shared<Process>(Process::PrepareCommand(command), env);
+	process->SetTimeout(timeout);
+	process->Run(boost::bind(&ResultCollector::Add, &collector, _1));
+
+	BOOST_REQUIRE(collector.WaitFor(1));
+
+	return collector.Results[0];
+}
+
+static void CheckMode(const String& mode)
+{
+	ProcessResult pr = RunCommand(mode, "echo $ICINGA_TEST; exit 3");
+	BOOST_CHECK(pr.ExitStatus == 3);
+	BOOST_CHECK(pr.Output == "bar\n");
+
+	pr = RunCommand(mode, "kill -9 $$");
+	BOOST_CHECK(pr.ExitStatus == 128);
+	BOOST_CHECK(pr.Output == "<Terminated by signal 9.>");
+
+	pr = RunCommand(mode, "head -c 100000 /dev/zero");
+	BOOST_CHECK(pr.ExitStatus == 0);
+	BOOST_CHECK(pr.Output.GetLength() == 100000);
+
+	pr = RunCommand(mode, "echo foo; exec sleep 10", 0.5);
+	BOOST_CHECK(pr.ExitStatus == 128);
+	BOOST_CHECK(pr.Output.Find("<Timeout exceeded.>") != String::NPos);
+}
+
+static double GetResidentSetSize(void)
+{
+	std::ifstream fp("/proc/self/statm");
+	long pages = 0, rss = 0;
+	fp >> pages >> rss;
+	return static_cast<double>(rss) * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+/**
+ * Starts a batch of processes and returns how many processes per second
+ * Run() was able to start.
+ */
+static double MeasureSpawnRate(const String& mode, int count)
+{
+	ScriptVariable::Set("SpawnMode", mode);
+
+	ResultCollector collector;
+	Process::Arguments args;
+	args.push_back("true");
+
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < count; i++) {
+		Process::Ptr process = boost::make_shared<Process>(args);
+		process->Run(boost::bind(&ResultCollector::Add, &collector, _1));
+	}
+
+	double duration = Utility::GetTime() - start;
+
+	BOOST_CHECK(collector.WaitFor(count));
+
+	return count / duration;
+}
+
+BOOST_FIXTURE_TEST_SUITE(base_process, ProcessFixture)
+
+BOOST_AUTO_TEST_CASE(fork)
+{
+	CheckMode("fork");
+}
+
+BOOST_AUTO_TEST_CASE(posix_spawn)
+{
+	CheckMode("posix_spawn");
+}
+
+BOOST_AUTO_TEST_CASE(helper)
+{
+	CheckMode("helper");
+}
+
+/* Grows the process to 768MB, so it isn't part of the default test run.
+ * Run it with --run_test=base_process/spawn_rate. */
+BOOST_AUTO_TEST_CASE(spawn_rate)
+{
+	const int count = 200;
+	std::vector<char *> ballast;
+
+	/* vfork() hides the effect the parent's size has on fork(). */
+	ScriptVariable::Set("UseVfork", false);
+
+	for (int i = 0; i < 3; i++) {
+		BOOST_TEST_MESSAGE("Spawn rate with " << GetResidentSetSize() << "MB RSS: "
+		    << "fork: " << MeasureSpawnRate("fork", count) << "/s; "
+		    << "posix_spawn: " << MeasureSpawnRate("posix_spawn", count) << "/s; "
+		    << "helper: " << MeasureSpawnRate("helper", count) << "/s");
+
+		/* Grow the parent process by 256MB. */
+		for (int k = 0; k < 256; k++) {
+			char *block = new char[1024 * 1024];
+			memset(block, 1, 1024 * 1024);
+			ballast.push_back(block);
+		}
+	}
+
+	BOOST_FOREACH(char *block, ballast) {
+		delete [] block;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif /* _WIN32 */
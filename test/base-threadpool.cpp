@@ -0,0 +1,285 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/threadpool.h"
+#include "base/utility.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+using namespace icinga;
+
+/**
+ * The thread pool design we're comparing against: a fixed number of
+ * queues which are picked at random by Post(), each with its own set of
+ * worker threads.
+ */
+class BaselineThreadPool
+{
+public:
+	BaselineThreadPool(void)
+	{
+		for (int i = 0; i < QueueCount; i++) {
+			for (int k = 0; k < ThreadsPerQueue; k++)
+				m_Threads.create_thread(boost::bind(&BaselineThreadPool::ThreadProc, this, boost::ref(m_Queues[i])));
+		}
+	}
+
+	~BaselineThreadPool(void)
+	{
+		for (int i = 0; i < QueueCount; i++) {
+			boost::mutex::scoped_lock lock(m_Queues[i].Mutex);
+			m_Queues[i].Stopped = true;
+			m_Queues[i].CV.notify_all();
+		}
+
+		m_Threads.join_all();
+	}
+
+	bool Post(const ThreadPool::WorkFunction& callback)
+	{
+		Queue& queue = m_Queues[Utility::Random() % QueueCount];
+
+		boost::mutex::scoped_lock lock(queue.Mutex);
+		queue.Items.push_back(callback);
+		queue.CV.notify_one();
+
+		return true;
+	}
+
+private:
+	static const int QueueCount = 4;
+	static const int ThreadsPerQueue = 2;
+
+	struct Queue
+	{
+		boost::mutex Mutex;
+		boost::condition_variable CV;
+		std::deque<ThreadPool::WorkFunction> Items;
+		bool Stopped;
+
+		Queue(void)
+			: Stopped(false)
+		{ }
+	};
+
+	Queue m_Queues[QueueCount];
+	boost::thread_group m_Threads;
+
+	void ThreadProc(Queue& queue)
+	{
+		for (;;) {
+			ThreadPool::WorkFunction callback;
+
+			{
+				boost::mutex::scoped_lock lock(queue.Mutex);
+
+				while (queue.Items.empty() && !queue.Stopped)
+					queue.CV.wait(lock);
+
+				if (queue.Items.empty())
+					return;
+
+				callback = queue.Items.front();
+				queue.Items.pop_front();
+			}
+
+			callback();
+		}
+	}
+};
+
+struct TaskCounter
+{
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	int Count;
+	std::vector<double> Latencies;
+
+	TaskCounter(void)
+		: Count(0)
+	{ }
+
+	void Increment(double ts = 0)
+	{
+		boost::mutex::scoped_lock lock(Mutex);
+		Count++;
+
+		if (ts > 0)
+			Latencies.push_back(Utility::GetTime() - ts);
+
+		CV.notify_all();
+	}
+
+	bool WaitFor(int count)
+	{
+		boost::mutex::scoped_lock lock(Mutex);
+
+		while (Count < count) {
+			if (!CV.timed_wait(lock, boost::posix_time::seconds(30)))
+				return false;
+		}
+
+		return true;
+	}
+};
+
+template<typename TP>
+static void SpawnChildren(TP *tp, TaskCounter *counter, int depth)
+{
+	if (depth > 0) {
+		tp->Post(boost::bind(&SpawnChildren<TP>, tp, counter, depth - 1));
+		tp->Post(boost::bind(&SpawnChildren<TP>, tp, counter, depth - 1));
+	}
+
+	counter->Increment(Utility::GetTime());
+}
+
+struct StopState
+{
+	boost::mutex Mutex;
+	boost::condition_variable CV;
+	bool Stopped;
+	bool Done;
+	bool Posted;
+
+	StopState(void)
+		: Stopped(false), Done(false), Posted(true)
+	{ }
+};
+
+static void PostAfterStop(ThreadPool *tp, StopState *state)
+{
+	boost::mutex::scoped_lock lock(state->Mutex);
+
+	while (!state->Stopped)
+		state->CV.wait(lock);
+
+	state->Posted = tp->Post(boost::bind(&Utility::Sleep, 0));
+	state->Done = true;
+	state->CV.notify_all();
+}
+
+template<typename TP>
+static void MeasureThroughput(const String& name, int count)
+{
+	TaskCounter counter;
+
+	{
+		TP tp;
+
+		double start = Utility::GetTime();
+
+		for (int i = 0; i < count; i++)
+			tp.Post(boost::bind(&TaskCounter::Increment, &counter, Utility::GetTime()));
+
+		BOOST_CHECK(counter.WaitFor(count));
+
+		double duration = Utility::GetTime() - start;
+
+		std::sort(counter.Latencies.begin(), counter.Latencies.end());
+
+		BOOST_TEST_MESSAGE(name << ": " << count / duration << " items/s; "
+		    << "median latency: " << counter.Latencies[count / 2] * 1000 << "ms; "
+		    << "p99 latency: " << counter.Latencies[count * 99 / 100] * 1000 << "ms");
+	}
+
+	TaskCounter nestedCounter;
+
+	{
+		TP tp;
+		const int depth = 16;
+		const int nestedCount = (1 << (depth + 1)) - 1;
+
+		double start = Utility::GetTime();
+
+		tp.Post(boost::bind(&SpawnChildren<TP>, &tp, &nestedCounter, depth));
+
+		BOOST_CHECK(nestedCounter.WaitFor(nestedCount));
+
+		double duration = Utility::GetTime() - start;
+
+		std::sort(nestedCounter.Latencies.begin(), nestedCounter.Latencies.end());
+
+		BOOST_TEST_MESSAGE(name << " (nested): " << nestedCount / duration << " items/s; "
+		    << "p99 latency: " << nestedCounter.Latencies[nestedCount * 99 / 100] * 1000 << "ms");
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(base_threadpool)
+
+BOOST_AUTO_TEST_CASE(post)
+{
+	ThreadPool tp;
+	TaskCounter counter;
+
+	for (int i = 0; i < 1000; i++)
+		BOOST_CHECK(tp.Post(boost::bind(&TaskCounter::Increment, &counter, 0)));
+
+	BOOST_CHECK(counter.WaitFor(1000));
+}
+
+BOOST_AUTO_TEST_CASE(nested)
+{
+	ThreadPool tp;
+	TaskCounter counter;
+
+	/* Work items posted from within the pool go into the workers' own
+	 * queues and have to be stolen by the other workers. */
+	tp.Post(boost::bind(&SpawnChildren<ThreadPool>, &tp, &counter, 12));
+
+	BOOST_CHECK(counter.WaitFor((1 << 13) - 1));
+}
+
+BOOST_AUTO_TEST_CASE(stop)
+{
+	ThreadPool tp;
+	StopState state;
+
+	/* Items posted by the pool's own workers are rejected as well. */
+	BOOST_CHECK(tp.Post(boost::bind(&PostAfterStop, &tp, &state)));
+
+	tp.Stop();
+
+	BOOST_CHECK(!tp.Post(boost::bind(&Utility::Sleep, 0)));
+
+	boost::mutex::scoped_lock lock(state.Mutex);
+	state.Stopped = true;
+	state.CV.notify_all();
+
+	while (!state.Done)
+		state.CV.wait(lock);
+
+	BOOST_CHECK(!state.Posted);
+}
+
+/* Compares the pools' throughput against each other and has no pass/fail
+ * criteria, so ctest skips it: --run_test=base_threadpool/throughput */
+BOOST_AUTO_TEST_CASE(throughput)
+{
+	MeasureThroughput<BaselineThreadPool>("Baseline", 100000);
+	MeasureThroughput<ThreadPool>("ThreadPool", 100000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -22,6 +22,7 @@
 #include "base/application.h"
 #include <boost/test/unit_test.hpp>
 #include <boost/foreach.hpp>
+#include <vector>
 
 using namespace icinga;
 
@@ -89,4 +90,43 @@ BOOST_AUTO_TEST_CASE(scope)
 	BOOST_CHECK(counter >= 4 && counter <= 6);
 }
 
+/* Schedules a million timers to report how long that takes. Not registered
+ * with ctest; use --run_test=base_timer/schedule. */
+BOOST_AUTO_TEST_CASE(schedule)
+{
+	const int count = 1000000;
+
+	std::vector<Timer::Ptr> timers;
+	timers.reserve(count);
+
+	for (int i = 0; i < count; i++) {
+		Timer::Ptr timer = make_shared<Timer>();
+		timer->SetInterval(300 + i % 3600);
+		timers.push_back(timer);
+	}
+
+	double start = Utility::GetTime();
+
+	BOOST_FOREACH(const Timer::Ptr& timer, timers)
+		timer->Start();
+
+	double started = Utility::GetTime();
+
+	BOOST_FOREACH(const Timer::Ptr& timer, timers)
+		timer->Reschedule(started + 60 + Utility::Random() % 86400);
+
+	double rescheduled = Utility::GetTime();
+
+	BOOST_CHECK(timers[0]->GetNext() >= started + 60);
+
+	BOOST_FOREACH(const Timer::Ptr& timer, timers)
+		timer->Stop();
+
+	double stopped = Utility::GetTime();
+
+	BOOST_TEST_MESSAGE("Timer: start: " << (started - start) * 1000 << "ms; "
+	    << "reschedule: " << (rescheduled - started) * 1000 << "ms; "
+	    << "stop: " << (stopped - rescheduled) * 1000 << "ms (" << count << " timers)");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
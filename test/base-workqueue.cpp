@@ -0,0 +1,80 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "base/workqueue.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/bind.hpp>
+
+using namespace icinga;
+
+static boost::mutex l_CountMutex;
+static int l_Count;
+
+static void IncrementCount(void)
+{
+	boost::mutex::scoped_lock lock(l_CountMutex);
+	l_Count++;
+}
+
+static void ThrowException(void)
+{
+	BOOST_THROW_EXCEPTION(std::runtime_error("Work item failed."));
+}
+
+BOOST_AUTO_TEST_SUITE(base_workqueue)
+
+BOOST_AUTO_TEST_CASE(parallel)
+{
+	l_Count = 0;
+
+	ParallelWorkQueue upq;
+
+	for (int i = 0; i < 1000; i++)
+		upq.Enqueue(&IncrementCount);
+
+	upq.Join();
+
+	BOOST_CHECK(l_Count == 1000);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_exception)
+{
+	l_Count = 0;
+
+	ParallelWorkQueue upq;
+
+	for (int i = 0; i < 100; i++)
+		upq.Enqueue(&IncrementCount);
+
+	upq.Enqueue(&ThrowException);
+
+	for (int i = 0; i < 100; i++)
+		upq.Enqueue(&IncrementCount);
+
+	BOOST_CHECK_THROW(upq.Join(), std::runtime_error);
+
+	/* The other work items are still executed. */
+	BOOST_CHECK(l_Count == 200);
+
+	/* The exception is only rethrown once. */
+	upq.Join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,162 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "checker/checkableheap.h"
+#include "icinga/host.h"
+#include "base/utility.h"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+
+using namespace icinga;
+
+static std::vector<Checkable::Ptr> MakeCheckables(int count)
+{
+	std::vector<Checkable::Ptr> checkables;
+
+	for (int i = 0; i < count; i++)
+		checkables.push_back(make_shared<Host>());
+
+	return checkables;
+}
+
+BOOST_AUTO_TEST_SUITE(checker_checkableheap)
+
+BOOST_AUTO_TEST_CASE(push)
+{
+	std::vector<Checkable::Ptr> checkables = MakeCheckables(3);
+	CheckableHeap heap;
+
+	BOOST_CHECK(heap.IsEmpty());
+
+	heap.Push(checkables[0], 30);
+	heap.Push(checkables[1], 10);
+	heap.Push(checkables[2], 20);
+
+	BOOST_CHECK(!heap.IsEmpty());
+	BOOST_CHECK_EQUAL(heap.GetLength(), 3);
+	BOOST_CHECK(heap.GetTop() == checkables[1]);
+	BOOST_CHECK_EQUAL(heap.GetTopKey(), 10);
+
+	for (size_t i = 0; i < checkables.size(); i++)
+		BOOST_CHECK(heap.Contains(checkables[i]));
+
+	BOOST_CHECK(!heap.Contains(make_shared<Host>()));
+}
+
+BOOST_AUTO_TEST_CASE(update)
+{
+	std::vector<Checkable::Ptr> checkables = MakeCheckables(4);
+	CheckableHeap heap;
+
+	for (int i = 0; i < 4; i++)
+		heap.Push(checkables[i], 10 * (i + 1));
+
+	/* Pushing a checkable which is already in the heap moves it up... */
+	heap.Push(checkables[3], 5);
+	BOOST_CHECK_EQUAL(heap.GetLength(), 4);
+	BOOST_CHECK(heap.GetTop() == checkables[3]);
+	BOOST_CHECK_EQUAL(heap.GetTopKey(), 5);
+
+	/* ...or down. */
+	heap.Push(checkables[3], 100);
+	BOOST_CHECK_EQUAL(heap.GetLength(), 4);
+	BOOST_CHECK(heap.GetTop() == checkables[0]);
+
+	heap.Push(checkables[0], 25);
+	BOOST_CHECK(heap.GetTop() == checkables[1]);
+
+	BOOST_CHECK(heap.Pop() == checkables[1]);
+	BOOST_CHECK(heap.Pop() == checkables[0]);
+	BOOST_CHECK(heap.Pop() == checkables[2]);
+	BOOST_CHECK(heap.Pop() == checkables[3]);
+	BOOST_CHECK(heap.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(remove)
+{
+	std::vector<Checkable::Ptr> checkables = MakeCheckables(5);
+	CheckableHeap heap;
+
+	for (int i = 0; i < 5; i++)
+		heap.Push(checkables[i], i);
+
+	/* the top, an inner and the last entry */
+	BOOST_CHECK(heap.Remove(checkables[0]));
+	BOOST_CHECK(heap.Remove(checkables[2]));
+	BOOST_CHECK(heap.Remove(checkables[4]));
+	BOOST_CHECK(!heap.Remove(checkables[4]));
+
+	BOOST_CHECK_EQUAL(heap.GetLength(), 2);
+	BOOST_CHECK(!heap.Contains(checkables[0]));
+	BOOST_CHECK(!heap.Contains(checkables[2]));
+
+	BOOST_CHECK(heap.Pop() == checkables[1]);
+	BOOST_CHECK(heap.Pop() == checkables[3]);
+	BOOST_CHECK(heap.IsEmpty());
+
+	/* removed checkables can be added again */
+	heap.Push(checkables[0], 1);
+	BOOST_CHECK(heap.GetTop() == checkables[0]);
+}
+
+BOOST_AUTO_TEST_CASE(pop)
+{
+	const int count = 1000;
+	std::vector<Checkable::Ptr> checkables = MakeCheckables(count);
+	std::vector<double> keys;
+	CheckableHeap heap;
+
+	for (int i = 0; i < count; i++) {
+		double key = Utility::Random() % 10000;
+		heap.Push(checkables[i], key);
+		keys.push_back(key);
+	}
+
+	/* update and remove some of them so the heap is shuffled some more */
+	for (int i = 0; i < count; i += 10) {
+		keys[i] = Utility::Random() % 10000;
+		heap.Push(checkables[i], keys[i]);
+	}
+
+	for (int i = 5; i < count; i += 50) {
+		heap.Remove(checkables[i]);
+		keys[i] = -1;
+	}
+
+	std::vector<double> expected;
+
+	for (int i = 0; i < count; i++) {
+		if (keys[i] >= 0)
+			expected.push_back(keys[i]);
+	}
+
+	std::sort(expected.begin(), expected.end());
+
+	BOOST_REQUIRE_EQUAL(heap.GetLength(), expected.size());
+
+	for (size_t i = 0; i < expected.size(); i++) {
+		BOOST_CHECK_EQUAL(heap.GetTopKey(), expected[i]);
+		heap.Pop();
+	}
+
+	BOOST_CHECK(heap.IsEmpty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
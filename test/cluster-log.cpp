@@ -0,0 +1,246 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "cluster/clusterlog.h"
+#include "remote/jsonrpc.h"
+#include "base/stdiostream.h"
+#include "base/zlibstream.h"
+#include "base/serializer.h"
+#include "base/netstring.h"
+#include "base/convert.h"
+#include "base/utility.h"
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+using namespace icinga;
+
+/* More than two index intervals' worth of records. */
+#define LOGRECORDS 2500
+
+static String GetMessage(int i)
+{
+	return "{\"jsonrpc\":\"2.0\",\"method\":\"cluster::HeartBeat\",\"params\":{\"i\":" + Convert::ToString(i) + "}}";
+}
+
+/**
+ * Writes a log segment with records whose timestamps start at 1000.
+ */
+static String WriteSegment(int count)
+{
+	String path = "cluster-log-" + Utility::NewUniqueID();
+
+	ClusterLogWriter writer;
+	BOOST_REQUIRE(writer.Open(path));
+
+	for (int i = 0; i < count; i++)
+		writer.Write(1000 + i, "node" + Convert::ToString(i % 2), Empty, GetMessage(i));
+
+	writer.Close();
+
+	return path;
+}
+
+static void RemoveSegment(const String& path)
+{
+	(void) remove(path.CStr());
+	(void) remove((path + ".idx").CStr());
+}
+
+/**
+ * Replaces a file's contents with the first length bytes.
+ */
+static void TruncateFile(const String& path, size_t length)
+{
+	std::ifstream ifp(path.CStr(), std::ifstream::in | std::ifstream::binary);
+	std::ostringstream buf;
+	buf << ifp.rdbuf();
+	ifp.close();
+
+	std::string data = buf.str();
+	BOOST_REQUIRE(data.size() >= length);
+
+	std::ofstream ofp(path.CStr(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+	ofp.write(data.c_str(), length);
+}
+
+static size_t GetFileSize(const String& path)
+{
+	std::ifstream fp(path.CStr(), std::ifstream::in | std::ifstream::binary);
+	fp.seekg(0, std::ifstream::end);
+	return fp.tellg();
+}
+
+/**
+ * Reads all records from a segment and checks that they're consecutive.
+ *
+ * @returns the number of records.
+ */
+static int ReadSegment(const String& path, double peer_ts, int first)
+{
+	ClusterLogReader reader(path, peer_ts);
+	ClusterLogRecord record;
+	int count = 0;
+
+	while (reader.ReadRecord(record)) {
+		int i = first + count;
+
+		BOOST_CHECK_EQUAL(record.Timestamp, 1000 + i);
+		BOOST_CHECK(record.Source == "node" + Convert::ToString(i % 2));
+		BOOST_CHECK(!record.Security);
+		BOOST_CHECK(*record.Message == JsonRpc::EncodeMessage(GetMessage(i)));
+
+		count++;
+	}
+
+	return count;
+}
+
+BOOST_AUTO_TEST_SUITE(cluster_log)
+
+BOOST_AUTO_TEST_CASE(replay)
+{
+	String path = WriteSegment(LOGRECORDS);
+
+	std::vector<ClusterLogIndexEntry> index;
+	BOOST_REQUIRE(ClusterLogReader::LoadIndex(path, index));
+
+	/* One entry per 1000 records and one for the end of the segment. */
+	BOOST_REQUIRE_EQUAL(index.size(), 4);
+	BOOST_CHECK_EQUAL(index[0].Offset, 0);
+	BOOST_CHECK_EQUAL(index[1].Timestamp, 2000);
+	BOOST_CHECK_EQUAL(index[3].Timestamp, 1000 + LOGRECORDS - 1);
+
+	BOOST_CHECK_EQUAL(ReadSegment(path, 0, 0), LOGRECORDS);
+
+	/* Reading starts at the last index entry before the peer's position. */
+	BOOST_CHECK_EQUAL(ReadSegment(path, 3100, 2000), LOGRECORDS - 2000);
+	BOOST_CHECK_EQUAL(ReadSegment(path, 2000, 0), LOGRECORDS);
+
+	RemoveSegment(path);
+}
+
+BOOST_AUTO_TEST_CASE(append)
+{
+	String path = WriteSegment(10);
+
+	/* Reopening a segment continues the index at the right offset. */
+	ClusterLogWriter writer;
+	BOOST_REQUIRE(writer.Open(path));
+	writer.Write(1010, "node0", Empty, GetMessage(10));
+	writer.Close();
+
+	std::vector<ClusterLogIndexEntry> index;
+	BOOST_REQUIRE(ClusterLogReader::LoadIndex(path, index));
+	BOOST_REQUIRE_EQUAL(index.size(), 4);
+	BOOST_CHECK_EQUAL(index[2].Timestamp, 1010);
+
+	ClusterLogReader reader(path, 1010);
+	ClusterLogRecord record;
+	BOOST_REQUIRE(reader.ReadRecord(record));
+	BOOST_CHECK_EQUAL(record.Timestamp, 1010);
+	BOOST_CHECK(!reader.ReadRecord(record));
+
+	RemoveSegment(path);
+}
+
+BOOST_AUTO_TEST_CASE(truncated)
+{
+	String path = WriteSegment(10);
+
+	TruncateFile(path, GetFileSize(path) - 3);
+
+	/* The incomplete record is dropped, the others are replayed. */
+	BOOST_CHECK_EQUAL(ReadSegment(path, 0, 0), 9);
+
+	RemoveSegment(path);
+}
+
+BOOST_AUTO_TEST_CASE(index_missing)
+{
+	String path = WriteSegment(10);
+
+	(void) remove((path + ".idx").CStr());
+
+	std::vector<ClusterLogIndexEntry> index;
+	BOOST_CHECK(!ClusterLogReader::LoadIndex(path, index));
+
+	/* Segments without an index are read from the start. */
+	BOOST_CHECK_EQUAL(ReadSegment(path, 1005, 0), 10);
+
+	RemoveSegment(path);
+}
+
+BOOST_AUTO_TEST_CASE(index_torn)
+{
+	String path = WriteSegment(LOGRECORDS);
+	String indexPath = path + ".idx";
+	size_t size = GetFileSize(indexPath);
+
+	/* Incomplete entries are ignored. */
+	TruncateFile(indexPath, size - 1);
+
+	std::vector<ClusterLogIndexEntry> index;
+	BOOST_REQUIRE(ClusterLogReader::LoadIndex(path, index));
+	BOOST_CHECK_EQUAL(index.size(), 3);
+	BOOST_CHECK_EQUAL(ReadSegment(path, 3100, 2000), LOGRECORDS - 2000);
+
+	/* A damaged header means there is no index. */
+	TruncateFile(indexPath, 5);
+
+	index.clear();
+	BOOST_CHECK(!ClusterLogReader::LoadIndex(path, index));
+	BOOST_CHECK_EQUAL(ReadSegment(path, 3100, 0), LOGRECORDS);
+
+	RemoveSegment(path);
+}
+
+BOOST_AUTO_TEST_CASE(legacy)
+{
+	String path = "cluster-log-" + Utility::NewUniqueID();
+
+	/* Older versions wrote compressed segments containing one JSON
+	 * dictionary per record and no index. */
+	std::fstream *fp = new std::fstream(path.CStr(), std::fstream::out | std::fstream::trunc | std::fstream::binary);
+	StdioStream::Ptr logStream = make_shared<StdioStream>(fp, true);
+#ifdef HAVE_BIOZLIB
+	ZlibStream::Ptr stream = make_shared<ZlibStream>(logStream);
+#else /* HAVE_BIOZLIB */
+	Stream::Ptr stream = logStream;
+#endif /* HAVE_BIOZLIB */
+
+	for (int i = 0; i < 10; i++) {
+		Dictionary::Ptr pmessage = make_shared<Dictionary>();
+		pmessage->Set("timestamp", 1000 + i);
+		pmessage->Set("source", "node" + Convert::ToString(i % 2));
+		pmessage->Set("message", GetMessage(i));
+
+		NetString::WriteStringToStream(stream, JsonSerialize(pmessage));
+	}
+
+	stream->Close();
+
+	BOOST_CHECK_EQUAL(ReadSegment(path, 0, 0), 10);
+
+	RemoveSegment(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
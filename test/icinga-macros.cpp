@@ -0,0 +1,119 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "icinga/macroprocessor.h"
+#include "icinga/perfdatavalue.h"
+#include "icinga/checkresult.h"
+#include "base/dictionary.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+using namespace icinga;
+
+static Value Resolve(const String& str, const String& name, const Object::Ptr& object, String *missingMacro = NULL)
+{
+	MacroProcessor::ResolverList resolvers;
+	resolvers.push_back(std::make_pair(name, object));
+
+	return MacroProcessor::ResolveMacros(str, resolvers, CheckResult::Ptr(), missingMacro);
+}
+
+static void ResolveFields(const PerfdataValue::Ptr& pv, const CheckResult::Ptr& cr, bool *result)
+{
+	for (int i = 0; i < 1000; i++) {
+		if (Resolve("$obj.value$", "obj", pv) != "42" || Resolve("$obj.output$", "obj", cr) != "OK") {
+			*result = false;
+			return;
+		}
+	}
+
+	*result = true;
+}
+
+BOOST_AUTO_TEST_SUITE(icinga_macros)
+
+BOOST_AUTO_TEST_CASE(literals)
+{
+	Dictionary::Ptr vars = make_shared<Dictionary>();
+
+	BOOST_CHECK(Resolve("no macros", "obj", vars) == "no macros");
+	BOOST_CHECK(Resolve("$$5", "obj", vars) == "$5");
+	BOOST_CHECK_THROW(Resolve("$unterminated", "obj", vars), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(dictionary)
+{
+	Dictionary::Ptr nested = make_shared<Dictionary>();
+	nested->Set("bar", "baz");
+
+	Dictionary::Ptr vars = make_shared<Dictionary>();
+	vars->Set("foo", nested);
+	vars->Set("num", 7);
+
+	BOOST_CHECK(Resolve("x $obj.foo.bar$ y $num$ z", "obj", vars) == "x baz y 7 z");
+
+	/* The compiled template is shared, resolving it again gives the same result. */
+	BOOST_CHECK(Resolve("x $obj.foo.bar$ y $num$ z", "obj", vars) == "x baz y 7 z");
+
+	String missing;
+	Resolve("$obj.foo.invalid$", "obj", vars, &missing);
+	BOOST_CHECK(missing == "obj.foo.invalid");
+
+	missing = "";
+	Resolve("$other.num$", "obj", vars, &missing);
+	BOOST_CHECK(missing == "other.num");
+}
+
+BOOST_AUTO_TEST_CASE(fields)
+{
+	PerfdataValue::Ptr pv = make_shared<PerfdataValue>(42);
+	CheckResult::Ptr cr = make_shared<CheckResult>();
+	cr->SetOutput("OK");
+
+	/* The same template is resolved for resolvers of different types. */
+	for (int i = 0; i < 3; i++) {
+		BOOST_CHECK(Resolve("$obj.value$", "obj", pv) == "42");
+		BOOST_CHECK(Resolve("$obj.output$", "obj", cr) == "OK");
+
+		String missing;
+		Resolve("$obj.value$", "obj", cr, &missing);
+		BOOST_CHECK(missing == "obj.value");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(threads)
+{
+	PerfdataValue::Ptr pv = make_shared<PerfdataValue>(42);
+	CheckResult::Ptr cr = make_shared<CheckResult>();
+	cr->SetOutput("OK");
+
+	bool results[4];
+	boost::thread_group threads;
+
+	for (int i = 0; i < 4; i++)
+		threads.create_thread(boost::bind(&ResolveFields, pv, cr, &results[i]));
+
+	threads.join_all();
+
+	for (int i = 0; i < 4; i++)
+		BOOST_CHECK(results[i]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -18,6 +18,8 @@
  ******************************************************************************/
 
 #include "icinga/pluginutility.cpp"
+#include "icinga/checkresult.h"
+#include "base/utility.h"
 #include <boost/test/unit_test.hpp>
 
 using namespace icinga;
@@ -133,4 +135,116 @@ BOOST_AUTO_TEST_CASE(multi)
 	BOOST_CHECK(pd->Get("test::b") == 4);
 }
 
+BOOST_AUTO_TEST_CASE(records)
+{
+	PerfdataRecordList records;
+	BOOST_CHECK(PluginUtility::ParsePerfdataRecords("'hello world'=1000ms;200;;0 test::a=3 b=4c", records));
+	BOOST_CHECK(records.size() == 3);
+
+	BOOST_CHECK(records[0].Label == "hello world");
+	BOOST_CHECK(records[0].Value == 1);
+	BOOST_CHECK(String(records[0].Unit) == "seconds");
+	BOOST_CHECK(records[0].Flags == (PerfdataHasWarn | PerfdataHasMin));
+	BOOST_CHECK(records[0].Warn == 0.2);
+	BOOST_CHECK(records[0].Min == 0);
+
+	BOOST_CHECK(records[1].Label == "test::a");
+	BOOST_CHECK(records[1].Flags == PerfdataPlain);
+
+	BOOST_CHECK(records[2].Label == "test::b");
+	BOOST_CHECK(records[2].Value == 4);
+	BOOST_CHECK(records[2].Counter);
+
+	Dictionary::Ptr pd = PluginUtility::ParsePerfdata("test=123456B;1000;2000;3000;4000 x=1");
+	BOOST_CHECK(PluginUtility::ParsePerfdataRecords(pd, records));
+	BOOST_CHECK(records.size() == 2);
+	BOOST_CHECK(records[0].Label == "test");
+	BOOST_CHECK(String(records[0].Unit) == "bytes");
+	BOOST_CHECK(records[0].Flags == (PerfdataHasWarn | PerfdataHasCrit | PerfdataHasMin | PerfdataHasMax));
+	BOOST_CHECK(records[0].Max == 4000);
+	BOOST_CHECK(records[1].Flags == PerfdataPlain);
+
+	BOOST_CHECK(!PluginUtility::ParsePerfdataRecords("test=123456;10%;20%", records));
+	BOOST_CHECK(PluginUtility::FormatPerfdata("test=1000ms") == "test=1s");
+	BOOST_CHECK(PluginUtility::FormatPerfdata("test=1,23456") == "test=1,23456");
+}
+
+BOOST_AUTO_TEST_CASE(check_output)
+{
+	std::pair<String, Value> co = PluginUtility::ParseCheckOutput("DISK OK|/=1000B;2000;3000\nmore|/var=50B");
+	BOOST_CHECK(co.first == "DISK OK\nmore");
+
+	/* The performance data keeps its serialized form. */
+	BOOST_REQUIRE(co.second.IsObjectType<Dictionary>());
+
+	Dictionary::Ptr pd = co.second;
+	BOOST_CHECK(pd->GetLength() == 2);
+	BOOST_CHECK(pd->Get("/").IsObjectType<PerfdataValue>());
+
+	CheckResult::Ptr cr = make_shared<CheckResult>();
+	cr->SetPerformanceData(co.second);
+
+	shared_ptr<const PerfdataRecordList> records = cr->GetPerfdataRecords();
+	BOOST_REQUIRE(records->size() == 2);
+	BOOST_CHECK(cr->GetPerfdataRecords() == records);
+	BOOST_CHECK((*records)[0].Label == "/");
+	BOOST_CHECK((*records)[0].Value == 1000);
+	BOOST_CHECK((*records)[0].Flags == (PerfdataHasWarn | PerfdataHasCrit));
+
+	/* Invalid performance data is kept as a string. */
+	co = PluginUtility::ParseCheckOutput("OK|test=1,23456");
+	BOOST_CHECK(co.second == "test=1,23456");
+}
+
+/* Only prints timings and isn't run by default, use
+ * --run_test=icinga_perfdata/benchmark. */
+BOOST_AUTO_TEST_CASE(benchmark)
+{
+	/* Performance data as returned by commonly used plugins. */
+	const char *corpus[] = {
+		"time=0.002451s;;;0.000000 size=8434B;;;0",
+		"rta=0.080000ms;100.000000;200.000000;0.000000 pl=0%;5;10;0",
+		"load1=0.160;5.000;10.000;0; load5=0.210;4.000;6.000;0; load15=0.160;3.000;4.000;0;",
+		"/=2643MB;5948;6692;0;7436 /boot=68MB;88;99;0;110 /home=69357MB;253404;285079;0;316755 /var/log=818MB;970;1091;0;1213",
+		"users=1;20;50;0",
+		"procs=181;250;400;0",
+		"swap=2047MB;0;0;0;2047",
+		"'C:\\ %'=45%;80;90 'C:\\'=90.5GB;160;180;0;200 'D:\\ %'=12%;80;90 'D:\\'=36.2GB;240;270;0;300",
+		"disk::used=2643MB;5948;6692;0;7436 free=4793MB memory::used=1024MB total=4096MB",
+		"active=3 reading=0 writing=1 waiting=2 requests=1834c accepts=211c handled=211c"
+	};
+
+	const int rounds = 20000;
+	const int count = sizeof(corpus) / sizeof(corpus[0]);
+	int metrics = 0;
+
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < rounds; i++) {
+		for (int k = 0; k < count; k++) {
+			Value pd = PluginUtility::ParsePerfdata(corpus[k]);
+			BOOST_REQUIRE(pd.IsObjectType<Dictionary>());
+		}
+	}
+
+	double legacy = Utility::GetTime() - start;
+
+	PerfdataRecordList records;
+
+	start = Utility::GetTime();
+
+	for (int i = 0; i < rounds; i++) {
+		for (int k = 0; k < count; k++) {
+			BOOST_REQUIRE(PluginUtility::ParsePerfdataRecords(corpus[k], records));
+			metrics += records.size();
+		}
+	}
+
+	double compact = Utility::GetTime() - start;
+
+	BOOST_TEST_MESSAGE("Perfdata: " << metrics << " metrics; "
+	    << "Dictionary: " << metrics / legacy << " metrics/s; "
+	    << "records: " << metrics / compact << " metrics/s");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,337 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "livestatus/connection.h"
+#include "livestatus/listener.h"
+#include "base/unixsocket.h"
+#include "base/serializer.h"
+#include "base/utility.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <cstdio>
+#ifndef _WIN32
+#	include <sys/socket.h>
+#	include <poll.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+#ifndef _WIN32
+#define MAXREQUESTSIZE 4096
+
+static void IgnoreNotify(const LivestatusConnection::Ptr&)
+{ }
+
+/**
+ * Creates a connection for one end of a socket pair.
+ *
+ * @param clientFD Receives the client's end of the socket pair.
+ */
+static LivestatusConnection::Ptr CreateConnection(int& clientFD)
+{
+	int fds[2];
+	BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+	Socket::Ptr socket = make_shared<Socket>(fds[0]);
+	socket->MakeNonBlocking();
+
+	clientFD = fds[1];
+
+	return make_shared<LivestatusConnection>(socket, MAXREQUESTSIZE, &IgnoreNotify);
+}
+
+static void SendString(int fd, const String& data)
+{
+	BOOST_REQUIRE(send(fd, data.CStr(), data.GetLength(), 0) == static_cast<ssize_t>(data.GetLength()));
+}
+
+/**
+ * Reads whatever the other end has sent so far.
+ *
+ * @param eof Set to true if the other end has closed the connection.
+ */
+static String ReceiveString(int fd, int timeout, bool *eof = NULL)
+{
+	String result;
+
+	if (eof)
+		*eof = false;
+
+	for (;;) {
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		if (poll(&pfd, 1, timeout) <= 0)
+			break;
+
+		char buffer[4096];
+		ssize_t rc = recv(fd, buffer, sizeof(buffer), 0);
+
+		if (rc <= 0) {
+			if (eof)
+				*eof = true;
+
+			break;
+		}
+
+		result += String(buffer, buffer + rc);
+
+		/* Only wait for the first chunk. */
+		timeout = 0;
+	}
+
+	return result;
+}
+
+struct WriterState
+{
+	boost::mutex Mutex;
+	bool Done;
+	bool Failed;
+
+	WriterState(void)
+		: Done(false), Failed(false)
+	{ }
+
+	bool IsDone(void)
+	{
+		boost::mutex::scoped_lock lock(Mutex);
+		return Done;
+	}
+};
+
+static void WriteResponse(const LivestatusConnection::Ptr& connection, WriterState *state)
+{
+	bool failed = false;
+
+	try {
+		connection->Write("x", 1);
+	} catch (const std::exception&) {
+		failed = true;
+	}
+
+	boost::mutex::scoped_lock lock(state->Mutex);
+	state->Done = true;
+	state->Failed = failed;
+}
+
+BOOST_AUTO_TEST_SUITE(livestatus_connection)
+
+BOOST_AUTO_TEST_CASE(pipelining)
+{
+	int fd;
+	LivestatusConnection::Ptr connection = CreateConnection(fd);
+
+	SendString(fd, "GET status\nColumns: program_version\n\nGET hosts\n\n\n");
+	BOOST_CHECK(connection->ProcessInput());
+
+	std::vector<String> lines;
+	BOOST_REQUIRE(connection->BeginRequest(lines));
+	BOOST_REQUIRE(lines.size() == 2);
+	BOOST_CHECK(lines[0] == "GET status");
+	BOOST_CHECK(lines[1] == "Columns: program_version");
+
+	/* Requests are executed one at a time and no more input is read
+	 * while requests are pending. */
+	BOOST_CHECK(!connection->BeginRequest(lines));
+	BOOST_CHECK(!connection->WantsRead());
+
+	connection->Write("1\n", 2);
+	BOOST_CHECK(connection->WantsWrite());
+	connection->EndRequest(true);
+
+	BOOST_REQUIRE(connection->BeginRequest(lines));
+	BOOST_REQUIRE(lines.size() == 1);
+	BOOST_CHECK(lines[0] == "GET hosts");
+
+	connection->Write("2\n", 2);
+	connection->EndRequest(true);
+
+	/* The empty line ended the session, but the output hasn't been sent yet. */
+	BOOST_CHECK(!connection->BeginRequest(lines));
+	BOOST_CHECK(!connection->IsFinished());
+
+	BOOST_CHECK(connection->ProcessOutput());
+	BOOST_CHECK(connection->IsFinished());
+	BOOST_CHECK(ReceiveString(fd, 1000) == "1\n2\n");
+
+	connection->Shutdown();
+
+	bool eof;
+	ReceiveString(fd, 1000, &eof);
+	BOOST_CHECK(eof);
+
+	close(fd);
+}
+
+BOOST_AUTO_TEST_CASE(request_size)
+{
+	int fd;
+	LivestatusConnection::Ptr connection = CreateConnection(fd);
+
+	/* The limit applies to each request. */
+	String filter = "Filter: name = " + String(MAXREQUESTSIZE / 2, 'x') + "\n";
+	SendString(fd, "GET hosts\n" + filter + "\nGET hosts\n" + filter + "\n");
+	BOOST_CHECK(connection->ProcessInput());
+
+	std::vector<String> lines;
+	BOOST_CHECK(connection->BeginRequest(lines));
+	connection->EndRequest(true);
+	BOOST_CHECK(connection->BeginRequest(lines));
+	connection->EndRequest(true);
+
+	/* Requests which are too large are rejected even before they're complete. */
+	SendString(fd, "GET hosts\n" + filter + filter);
+	BOOST_CHECK(!connection->ProcessInput());
+
+	connection->Shutdown();
+	close(fd);
+}
+
+BOOST_AUTO_TEST_CASE(half_close)
+{
+	int fd;
+	LivestatusConnection::Ptr connection = CreateConnection(fd);
+
+	/* The last request doesn't need to be terminated by an empty line
+	 * if the client shuts down its end of the connection. */
+	SendString(fd, "GET status\nColumns: program_version");
+	BOOST_REQUIRE(shutdown(fd, SHUT_WR) == 0);
+
+	BOOST_CHECK(connection->ProcessInput());
+	BOOST_CHECK(connection->ProcessInput());
+	BOOST_CHECK(!connection->WantsRead());
+
+	std::vector<String> lines;
+	BOOST_REQUIRE(connection->BeginRequest(lines));
+	BOOST_REQUIRE(lines.size() == 2);
+	BOOST_CHECK(lines[1] == "Columns: program_version");
+
+	connection->Write("2.0\n", 4);
+	connection->EndRequest(false);
+
+	BOOST_CHECK(!connection->IsFinished());
+	BOOST_CHECK(connection->ProcessOutput());
+	BOOST_CHECK(connection->IsFinished());
+
+	BOOST_CHECK(ReceiveString(fd, 1000) == "2.0\n");
+
+	connection->Shutdown();
+	close(fd);
+}
+
+BOOST_AUTO_TEST_CASE(backpressure)
+{
+	int fd;
+	LivestatusConnection::Ptr connection = CreateConnection(fd);
+
+	/* Fill the send buffer up to the high watermark. */
+	String data(1024 * 1024, 'x');
+	connection->Write(data.CStr(), data.GetLength());
+
+	WriterState state;
+	boost::thread thread(boost::bind(&WriteResponse, connection, &state));
+
+	Utility::Sleep(0.2);
+	BOOST_CHECK(!state.IsDone());
+
+	/* Writing resumes once the client has read some of the data. */
+	size_t received = 0;
+	double start = Utility::GetTime();
+
+	while (!state.IsDone() && Utility::GetTime() - start < 10) {
+		BOOST_CHECK(connection->ProcessOutput());
+		received += ReceiveString(fd, 10).GetLength();
+	}
+
+	thread.join();
+
+	BOOST_CHECK(state.Done);
+	BOOST_CHECK(!state.Failed);
+	BOOST_CHECK(received > 0);
+
+	/* Blocked writers fail once the connection is closed. */
+	connection->Write(data.CStr(), data.GetLength());
+
+	WriterState state2;
+	boost::thread thread2(boost::bind(&WriteResponse, connection, &state2));
+
+	Utility::Sleep(0.2);
+	BOOST_CHECK(!state2.IsDone());
+
+	connection->Shutdown();
+	thread2.join();
+
+	BOOST_CHECK(state2.Failed);
+
+	close(fd);
+}
+
+BOOST_AUTO_TEST_CASE(max_connections)
+{
+	String path = "livestatus-" + Utility::NewUniqueID();
+
+	Dictionary::Ptr config = make_shared<Dictionary>();
+	config->Set("socket_type", "unix");
+	config->Set("socket_path", path);
+	config->Set("max_connections", 1);
+	config->Set("query_threads", 1);
+
+	/* The listener's threads keep running until the process exits. */
+	static LivestatusListener::Ptr listener;
+	listener = make_shared<LivestatusListener>();
+	Deserialize(listener, config, false, FAConfig);
+	listener->Activate();
+
+	UnixSocket::Ptr client1 = make_shared<UnixSocket>();
+	client1->Connect(path);
+	SendString(client1->GetFD(), "GET status\nColumns: change_sequence\nKeepAlive: on\n\n");
+	BOOST_CHECK(!ReceiveString(client1->GetFD(), 10000).IsEmpty());
+
+	/* The first client is still connected. */
+	UnixSocket::Ptr client2 = make_shared<UnixSocket>();
+	client2->Connect(path);
+
+	bool eof;
+	BOOST_CHECK(ReceiveString(client2->GetFD(), 10000, &eof).IsEmpty());
+	BOOST_CHECK(eof);
+
+	/* An empty line ends the first client's session and frees its slot. */
+	SendString(client1->GetFD(), "\n");
+	ReceiveString(client1->GetFD(), 10000, &eof);
+	BOOST_CHECK(eof);
+
+	UnixSocket::Ptr client3 = make_shared<UnixSocket>();
+	client3->Connect(path);
+	SendString(client3->GetFD(), "GET status\nColumns: change_sequence\n\n");
+	BOOST_CHECK(!ReceiveString(client3->GetFD(), 10000).IsEmpty());
+
+	client1->Close();
+	client2->Close();
+	client3->Close();
+
+	(void) remove(path.CStr());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif /* _WIN32 */
@@ -0,0 +1,217 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "livestatus/logutility.h"
+#include "livestatus/logindex.h"
+#include "base/utility.h"
+#include "base/convert.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace icinga;
+
+static String GetLogLine(int i, time_t ts)
+{
+	std::ostringstream msgbuf;
+	msgbuf << "[" << ts << "] ";
+
+	String host = "host-" + Convert::ToString(i % 1000);
+	String service = "service-" + Convert::ToString(i % 20);
+
+	switch (i % 5) {
+		case 0:
+			msgbuf << "SERVICE ALERT: " << host << ";" << service << ";CRITICAL;HARD;3;connection refused";
+			break;
+		case 1:
+			msgbuf << "HOST ALERT: " << host << ";DOWN;SOFT;1;PING CRITICAL - Packet loss = 100%";
+			break;
+		case 2:
+			msgbuf << "SERVICE NOTIFICATION: admin;" << host << ";" << service << ";CRITICAL;notify-by-email;connection refused";
+			break;
+		case 3:
+			msgbuf << "CURRENT SERVICE STATE: " << host << ";" << service << ";OK;HARD;1;all fine";
+			break;
+		default:
+			msgbuf << "EXTERNAL COMMAND: SCHEDULE_FORCED_SVC_CHECK;" << host << ";" << service << ";" << ts;
+			break;
+	}
+
+	return msgbuf.str();
+}
+
+static String WriteLogFile(const String& name, int first, int count, time_t ts)
+{
+	String path = name + "-" + Utility::NewUniqueID() + ".log";
+
+	std::ofstream fp;
+	fp.open(path.CStr(), std::ofstream::out | std::ofstream::trunc);
+
+	for (int i = first; i < first + count; i++)
+		fp << GetLogLine(i, ts + i / 10) << "\n";
+
+	fp.close();
+
+	return path;
+}
+
+static void RemoveLogFile(const String& path)
+{
+	(void) remove(path.CStr());
+	(void) remove(LogIndex::GetIndexPath(path).CStr());
+}
+
+BOOST_AUTO_TEST_SUITE(livestatus_log)
+
+BOOST_AUTO_TEST_CASE(parseline)
+{
+	std::vector<String> lines;
+
+	for (int i = 0; i < 5; i++)
+		lines.push_back(GetLogLine(i, 1379025342));
+
+	lines.push_back("[1379025342] HOST NOTIFICATION: admin;host-1;DOWN;notify-by-email;down");
+	lines.push_back("[1379025342] SERVICE FLAPPING ALERT: host-1;service-1;STARTED; flapping");
+	lines.push_back("[1379025342] PASSIVE HOST CHECK: host-1;0;up");
+	lines.push_back("[1379025342] HOST ALERT: host-1;DOWN");
+	lines.push_back("[1379025342] Caught SIGTERM, exiting");
+	lines.push_back("[1379025342] LOG VERSION: 2.0");
+
+	BOOST_FOREACH(const String& line, lines) {
+		LogLineInfo info;
+		BOOST_REQUIRE(LogUtility::ParseLine(line.CStr(), line.GetLength(), info));
+
+		Dictionary::Ptr attrs = LogUtility::GetAttributes(line);
+
+		BOOST_CHECK_EQUAL(info.Time, static_cast<long>(attrs->Get("time")));
+		BOOST_CHECK_EQUAL(String(info.Type, info.Type + info.TypeLength), String(attrs->Get("type")));
+		BOOST_CHECK_EQUAL(String(info.HostName, info.HostName + info.HostNameLength), String(attrs->Get("host_name")));
+		BOOST_CHECK_EQUAL(String(info.ServiceDescription, info.ServiceDescription + info.ServiceDescriptionLength),
+		    String(attrs->Get("service_description")));
+	}
+
+	LogLineInfo info;
+	BOOST_CHECK(!LogUtility::ParseLine("[1379025", 8, info));
+}
+
+BOOST_AUTO_TEST_CASE(index)
+{
+	String path = WriteLogFile("livestatus-log", 0, 10000, 1379025342);
+
+	LogIndex::Ptr index = LogIndex::GetByPath(path);
+
+	std::vector<LogIndexEntry> entries;
+	index->Search(0, 2000000000, "", "", "", entries);
+	BOOST_CHECK_EQUAL(entries.size(), 10000);
+
+	entries.clear();
+	index->Search(0, 2000000000, "host-40", "", "SERVICE ALERT", entries);
+	BOOST_CHECK_EQUAL(entries.size(), 10);
+
+	/* lines are appended to the log file while the index exists */
+	{
+		std::ofstream fp;
+		fp.open(path.CStr(), std::ofstream::out | std::ofstream::app);
+		fp << GetLogLine(42000, 1379025342 + 5000) << "\n";
+	}
+
+	entries.clear();
+	index = LogIndex::GetByPath(path);
+	index->Search(1379025342 + 5000, 2000000000, "host-0", "service-0", "", entries);
+	BOOST_REQUIRE_EQUAL(entries.size(), 1);
+	BOOST_CHECK_EQUAL(entries[0].LineNumber, 10000);
+
+	RemoveLogFile(path);
+}
+
+/* Writes at least 64MB of log files into the current directory, so it
+ * has to be requested with --run_test=livestatus_log/benchmark. */
+BOOST_AUTO_TEST_CASE(benchmark)
+{
+	/* Set ICINGA2_LOG_BENCHMARK_MB=10240 for a 10 GB archive set. */
+	const char *size_env = getenv("ICINGA2_LOG_BENCHMARK_MB");
+	double total_mb = size_env ? Convert::ToDouble(size_env) : 64;
+
+	const int lines_per_file = 200000;
+	const time_t start_ts = 1379025342;
+
+	std::vector<String> files;
+	double written = 0;
+
+	for (int i = 0; written < total_mb * 1024 * 1024; i++) {
+		String path = WriteLogFile("livestatus-log-benchmark", i * lines_per_file, lines_per_file, start_ts);
+
+		std::ifstream fp(path.CStr(), std::ifstream::in | std::ifstream::binary);
+		fp.seekg(0, std::ifstream::end);
+		written += fp.tellg();
+
+		files.push_back(path);
+	}
+
+	/* the old way: read every line and parse it into a dictionary */
+	double start = Utility::GetTime();
+
+	{
+		std::ifstream fp;
+		fp.open(files[0].CStr(), std::ifstream::in);
+
+		while (fp.good()) {
+			std::string line;
+			std::getline(fp, line);
+
+			if (!line.empty())
+				LogUtility::GetAttributes(line);
+		}
+	}
+
+	double legacy_duration = Utility::GetTime() - start;
+
+	start = Utility::GetTime();
+
+	BOOST_FOREACH(const String& path, files) {
+		LogIndex::GetByPath(path);
+	}
+
+	double index_duration = Utility::GetTime() - start;
+
+	start = Utility::GetTime();
+	size_t matches = 0;
+
+	BOOST_FOREACH(const String& path, files) {
+		std::vector<LogIndexEntry> entries;
+		LogIndex::GetByPath(path)->Search(start_ts, start_ts + lines_per_file / 20, "host-40", "", "SERVICE ALERT", entries);
+		matches += entries.size();
+	}
+
+	double search_duration = Utility::GetTime() - start;
+
+	BOOST_TEST_MESSAGE("Compat log archives: " << written / 1024 / 1024 << " MB in " << files.size() << " files");
+	BOOST_TEST_MESSAGE("Line-by-line parsing: " << written / files.size() / 1024 / 1024 / legacy_duration << " MB/s");
+	BOOST_TEST_MESSAGE("Indexing: " << written / 1024 / 1024 / index_duration << " MB/s");
+	BOOST_TEST_MESSAGE("Indexed search: " << matches << " matches in " << search_duration * 1000 << "ms");
+
+	BOOST_FOREACH(const String& path, files) {
+		RemoveLogFile(path);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
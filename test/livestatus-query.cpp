@@ -0,0 +1,447 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "livestatus/table.h"
+#include "livestatus/query.h"
+#include "livestatus/changetracker.h"
+#include "livestatus/logindex.h"
+#include "livestatus/sumaggregator.h"
+#include "livestatus/avgaggregator.h"
+#include "livestatus/stdaggregator.h"
+#include "livestatus/minaggregator.h"
+#include "livestatus/maxaggregator.h"
+#include "livestatus/countaggregator.h"
+#include "livestatus/attributefilter.h"
+#include "icinga/externalcommandprocessor.h"
+#include "base/fifo.h"
+#include "base/utility.h"
+#include "base/convert.h"
+#include "base/serializer.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#ifndef _WIN32
+#	include <sys/stat.h>
+#else /* _WIN32 */
+#	include <direct.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+/* More than one scan partition's worth of rows. */
+#define LOGROWS 5000
+
+static int GetAttempt(int i)
+{
+	return (i * 37) % 101;
+}
+
+/**
+ * Creates a compat log directory whose icinga.log contains LOGROWS
+ * service alerts.
+ */
+static String WriteLogDir(void)
+{
+	String path = "livestatus-query-" + Utility::NewUniqueID();
+
+#ifndef _WIN32
+	(void) mkdir(path.CStr(), 0700);
+#else /* _WIN32 */
+	(void) _mkdir(path.CStr());
+#endif /* _WIN32 */
+
+	std::ofstream fp;
+	fp.open((path + "/icinga.log").CStr(), std::ofstream::out | std::ofstream::trunc);
+
+	for (int i = 0; i < LOGROWS; i++)
+		fp << "[" << 1379025342 + i / 10 << "] SERVICE ALERT: host-" << i % 7 << ";service-" << i % 3
+		   << ";CRITICAL;HARD;" << GetAttempt(i) << ";connection refused\n";
+
+	fp.close();
+
+	return path;
+}
+
+static void RemoveLogDir(const String& path)
+{
+	String file = path + "/icinga.log";
+
+	(void) remove(file.CStr());
+	(void) remove(LogIndex::GetIndexPath(file).CStr());
+
+#ifndef _WIN32
+	(void) rmdir(path.CStr());
+#else /* _WIN32 */
+	(void) _rmdir(path.CStr());
+#endif /* _WIN32 */
+}
+
+static Array::Ptr ExecuteJsonQuery(std::vector<String> lines, const String& compat_log_path)
+{
+	lines.push_back("OutputFormat: json");
+
+	FIFO::Ptr fifo = make_shared<FIFO>();
+	make_shared<Query>(lines, compat_log_path)->Execute(fifo);
+
+	std::vector<char> response(fifo->GetAvailableBytes());
+	BOOST_REQUIRE(!response.empty());
+	fifo->Read(&response[0], response.size());
+
+	return JsonDeserialize(String(response.begin(), response.end()));
+}
+
+static void SendExternalCommand(void)
+{
+	Utility::Sleep(0.1);
+
+	ExternalCommandProcessor::OnNewExternalCommand(Utility::GetTime(), "ENABLE_NOTIFICATIONS", std::vector<String>());
+}
+
+static void CountTriggers(int *count)
+{
+	(*count)++;
+}
+
+BOOST_AUTO_TEST_SUITE(livestatus_query)
+
+BOOST_AUTO_TEST_CASE(schema)
+{
+	Table::Ptr services1 = Table::GetByName("services");
+	Table::Ptr services2 = Table::GetByName("services");
+
+	BOOST_REQUIRE(services1 && services2);
+	BOOST_CHECK(services1 != services2);
+
+	BOOST_CHECK(services1->GetColumnNames() == services2->GetColumnNames());
+
+	int index = services1->GetColumnIndex("host_name");
+	BOOST_CHECK(&services1->GetColumnByIndex(index) == &services2->GetColumnByIndex(index));
+	BOOST_CHECK(&services1->GetColumn("host_name") == &services1->GetColumnByIndex(index));
+
+	BOOST_CHECK_THROW(services1->GetColumnIndex("invalid"), std::invalid_argument);
+
+	BOOST_CHECK(!Table::GetByName("invalid"));
+}
+
+/* Measures query setup time only; run it explicitly with
+ * --run_test=livestatus_query/benchmark. */
+BOOST_AUTO_TEST_CASE(benchmark)
+{
+	const char *columns[] = {
+		"host_name", "description", "state", "state_type", "plugin_output",
+		"last_check", "next_check", "acknowledged", "scheduled_downtime_depth"
+	};
+
+	const int count = 10000;
+
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < count; i++) {
+		Table::Ptr table = Table::GetByName("services");
+
+		BOOST_FOREACH(const char *column, columns) {
+			table->GetColumnIndex(column);
+		}
+	}
+
+	double duration = Utility::GetTime() - start;
+
+	BOOST_TEST_MESSAGE("Livestatus query setup: " << duration / count * 1000000 << "us/query");
+}
+
+BOOST_AUTO_TEST_CASE(profile)
+{
+	std::vector<String> lines;
+	lines.push_back("GET status");
+	lines.push_back("Columns: change_sequence");
+	lines.push_back("ResponseHeader: fixed16");
+
+	int queries = Query::GetQueries();
+
+	FIFO::Ptr fifo = make_shared<FIFO>();
+	Query::Ptr query = make_shared<Query>(lines, "");
+	query->Execute(fifo);
+
+	const QueryProfile& profile = query->GetProfile();
+	BOOST_CHECK_EQUAL(profile.RowsScanned, 1);
+	BOOST_CHECK_EQUAL(profile.RowsMatched, 1);
+	BOOST_CHECK_EQUAL(profile.BytesSent, fifo->GetAvailableBytes());
+	BOOST_CHECK(profile.Request == "GET status\nColumns: change_sequence\nResponseHeader: fixed16\n");
+
+	BOOST_CHECK_EQUAL(Query::GetQueries(), queries + 1);
+}
+
+BOOST_AUTO_TEST_CASE(fixed16)
+{
+	std::vector<String> lines;
+	lines.push_back("GET status");
+	lines.push_back("Columns: change_sequence program_version");
+	lines.push_back("ResponseHeader: fixed16");
+
+	FIFO::Ptr fifo = make_shared<FIFO>();
+	make_shared<Query>(lines, "")->Execute(fifo);
+
+	std::vector<char> response(fifo->GetAvailableBytes());
+	BOOST_REQUIRE(response.size() > 16);
+	fifo->Read(&response[0], response.size());
+
+	String header(&response[0], &response[0] + 16);
+	BOOST_CHECK(header.SubStr(0, 3) == "200");
+	BOOST_CHECK(header[15] == '\n');
+
+	String length = header.SubStr(3, 12);
+	length.Trim();
+	BOOST_CHECK_EQUAL(Convert::ToLong(length), static_cast<long>(response.size() - 16));
+}
+
+BOOST_AUTO_TEST_CASE(partitions)
+{
+	String path = WriteLogDir();
+
+	/* Rows are returned in the order they were read in, no matter how many
+	 * partitions they were scanned in. */
+	std::vector<String> lines;
+	lines.push_back("GET log");
+	lines.push_back("Columns: lineno attempt");
+	lines.push_back("Filter: attempt >= 50");
+
+	Array::Ptr result = ExecuteJsonQuery(lines, path);
+
+	int expected = 0;
+
+	for (int i = 0; i < LOGROWS; i++) {
+		if (GetAttempt(i) >= 50)
+			expected++;
+	}
+
+	BOOST_REQUIRE_EQUAL(result->GetLength(), expected);
+
+	long last = -1;
+
+	for (int i = 0; i < expected; i++) {
+		Array::Ptr row = result->Get(i);
+		long lineno = row->Get(0);
+
+		BOOST_CHECK(lineno > last);
+		BOOST_CHECK(static_cast<int>(row->Get(1)) >= 50);
+		last = lineno;
+	}
+
+	RemoveLogDir(path);
+}
+
+BOOST_AUTO_TEST_CASE(merge)
+{
+	String path = WriteLogDir();
+
+	Table::Ptr table = Table::GetByName("log", path, 0, static_cast<unsigned long>(Utility::GetTime()));
+	std::vector<Value> rows = table->FilterRows(Filter::Ptr());
+	BOOST_REQUIRE_EQUAL(rows.size(), LOGROWS);
+
+	Filter::Ptr filter = make_shared<AttributeFilter>("attempt", ">=", "50");
+	filter->Bind(table);
+
+	std::vector<Aggregator::Ptr> aggregators;
+	aggregators.push_back(make_shared<SumAggregator>("attempt"));
+	aggregators.push_back(make_shared<AvgAggregator>("attempt"));
+	aggregators.push_back(make_shared<StdAggregator>("attempt"));
+	aggregators.push_back(make_shared<MinAggregator>("attempt"));
+	aggregators.push_back(make_shared<MaxAggregator>("attempt"));
+	aggregators.push_back(make_shared<CountAggregator>());
+	aggregators.back()->SetFilter(filter);
+
+	/* single-threaded */
+	BOOST_FOREACH(const Value& row, rows) {
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, aggregators) {
+			aggregator->Apply(table, row);
+		}
+	}
+
+	/* three uneven partitions, each with its own clones which are merged afterwards */
+	std::vector<Aggregator::Ptr> merged;
+
+	BOOST_FOREACH(const Aggregator::Ptr& aggregator, aggregators) {
+		merged.push_back(aggregator->Clone());
+	}
+
+	size_t bounds[] = { 0, 1000, 1024 + 1000, rows.size() };
+
+	for (int p = 0; p < 3; p++) {
+		std::vector<Aggregator::Ptr> partition;
+
+		BOOST_FOREACH(const Aggregator::Ptr& aggregator, aggregators) {
+			partition.push_back(aggregator->Clone());
+		}
+
+		for (size_t i = bounds[p]; i < bounds[p + 1]; i++) {
+			BOOST_FOREACH(const Aggregator::Ptr& aggregator, partition) {
+				aggregator->Apply(table, rows[i]);
+			}
+		}
+
+		for (size_t i = 0; i < merged.size(); i++)
+			merged[i]->Merge(partition[i]);
+	}
+
+	/* the query scans the rows in as many partitions as there are CPUs */
+	std::vector<String> lines;
+	lines.push_back("GET log");
+	lines.push_back("Stats: sum attempt");
+	lines.push_back("Stats: avg attempt");
+	lines.push_back("Stats: std attempt");
+	lines.push_back("Stats: min attempt");
+	lines.push_back("Stats: max attempt");
+	lines.push_back("Stats: attempt >= 50");
+
+	Array::Ptr result = ExecuteJsonQuery(lines, path);
+	BOOST_REQUIRE_EQUAL(result->GetLength(), 1);
+	Array::Ptr stats = result->Get(0);
+	BOOST_REQUIRE_EQUAL(stats->GetLength(), aggregators.size());
+
+	for (size_t i = 0; i < aggregators.size(); i++) {
+		double expected = aggregators[i]->GetResult();
+
+		BOOST_CHECK_CLOSE(merged[i]->GetResult(), expected, 0.0001);
+		BOOST_CHECK_CLOSE(static_cast<double>(stats->Get(i)), expected, 0.0001);
+	}
+
+	BOOST_CHECK_EQUAL(aggregators[3]->GetResult(), 0);
+	BOOST_CHECK_EQUAL(aggregators[4]->GetResult(), 100);
+
+	RemoveLogDir(path);
+}
+
+BOOST_AUTO_TEST_CASE(group_by)
+{
+	String path = WriteLogDir();
+
+	std::vector<String> lines;
+	lines.push_back("GET log");
+	lines.push_back("Columns: host_name");
+	lines.push_back("Stats: sum attempt");
+	lines.push_back("Stats: max attempt");
+	lines.push_back("Stats: attempt >= 50");
+
+	Array::Ptr result = ExecuteJsonQuery(lines, path);
+
+	/* host-0 is seen first, then host-1 etc. */
+	BOOST_REQUIRE_EQUAL(result->GetLength(), 7);
+
+	for (int host = 0; host < 7; host++) {
+		double sum = 0, max = 0, count = 0;
+
+		for (int i = host; i < LOGROWS; i += 7) {
+			int attempt = GetAttempt(i);
+
+			sum += attempt;
+
+			if (attempt > max)
+				max = attempt;
+
+			if (attempt >= 50)
+				count++;
+		}
+
+		Array::Ptr row = result->Get(host);
+		BOOST_REQUIRE_EQUAL(row->GetLength(), 4);
+
+		BOOST_CHECK_EQUAL(String(row->Get(0)), "host-" + Convert::ToString(host));
+		BOOST_CHECK_EQUAL(static_cast<double>(row->Get(1)), sum);
+		BOOST_CHECK_EQUAL(static_cast<double>(row->Get(2)), max);
+		BOOST_CHECK_EQUAL(static_cast<double>(row->Get(3)), count);
+	}
+
+	RemoveLogDir(path);
+}
+
+BOOST_AUTO_TEST_CASE(wait)
+{
+	std::vector<String> lines;
+	lines.push_back("GET status");
+	lines.push_back("Columns: change_sequence");
+	lines.push_back("WaitTrigger: program");
+	lines.push_back("WaitTimeout: 100");
+
+	unsigned long sequence = ChangeTracker::GetSequence();
+
+	FIFO::Ptr fifo = make_shared<FIFO>();
+
+	double start = Utility::GetTime();
+	Query::Ptr query = make_shared<Query>(lines, "");
+	BOOST_CHECK(query->WaitForChange(fifo));
+	BOOST_CHECK(Utility::GetTime() - start >= 0.1);
+	BOOST_CHECK(!query->NeedsWait());
+
+	/* The query returns as soon as the trigger fires. */
+	lines[3] = "WaitTimeout: 30000";
+
+	boost::thread thread(&SendExternalCommand);
+
+	start = Utility::GetTime();
+	query = make_shared<Query>(lines, "");
+	BOOST_CHECK(query->WaitForChange(fifo));
+	BOOST_CHECK(Utility::GetTime() - start < 10);
+
+	thread.join();
+
+	BOOST_CHECK(ChangeTracker::GetSequence() > sequence);
+
+	query->Execute(fifo);
+	BOOST_CHECK(fifo->GetAvailableBytes() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(wait_parked)
+{
+	std::vector<String> lines;
+	lines.push_back("GET status");
+	lines.push_back("Columns: change_sequence");
+	lines.push_back("WaitTrigger: program");
+	lines.push_back("WaitTimeout: 30000");
+
+	/* The listener parks queries which need to wait and checks
+	 * IsWaitOver() whenever a trigger fires. */
+	Query::Ptr query = make_shared<Query>(lines, "");
+	BOOST_CHECK(query->NeedsWait());
+	BOOST_CHECK(query->GetWaitDeadline() > Utility::GetTime());
+	BOOST_CHECK(!query->IsWaitOver(Utility::GetTime()));
+
+	int triggered = 0;
+	boost::signals2::connection handler = ChangeTracker::OnTriggered.connect(boost::bind(&CountTriggers, &triggered));
+
+	ExternalCommandProcessor::OnNewExternalCommand(Utility::GetTime(), "ENABLE_NOTIFICATIONS", std::vector<String>());
+
+	handler.disconnect();
+
+	BOOST_CHECK(triggered > 0);
+	BOOST_CHECK(query->IsWaitOver(Utility::GetTime()));
+	BOOST_CHECK(!query->NeedsWait());
+
+	/* The deadline makes the wait end as well. */
+	lines[3] = "WaitTimeout: 1";
+
+	query = make_shared<Query>(lines, "");
+	BOOST_CHECK(query->NeedsWait());
+	BOOST_CHECK(query->IsWaitOver(Utility::GetTime() + 1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,254 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+
+#include "remote/endpoint.h"
+#include "remote/jsonrpc.h"
+#include "cluster/clusterlistener.h"
+#include "base/fifo.h"
+#include "base/netstring.h"
+#include "base/objectlock.h"
+#include "base/serializer.h"
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+using namespace icinga;
+
+/**
+ * A stream which blocks writers until it is released or closed. Data
+ * which was written after the stream was released can be read back
+ * from the FIFO.
+ */
+class StalledStream : public Stream
+{
+public:
+	DECLARE_PTR_TYPEDEFS(StalledStream);
+
+	StalledStream(void)
+		: m_Data(make_shared<FIFO>()), m_Writers(0), m_Released(false), m_Closed(false)
+	{ }
+
+	virtual size_t Read(void *, size_t)
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		while (!m_Closed)
+			m_CV.wait(lock);
+
+		return 0;
+	}
+
+	virtual void Write(const void *buffer, size_t count)
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		m_Writers++;
+		m_CV.notify_all();
+
+		while (!m_Released && !m_Closed)
+			m_CV.wait(lock);
+
+		if (m_Closed)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Stream was closed."));
+
+		m_Data->Write(buffer, count);
+	}
+
+	virtual void Close(void)
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		m_Closed = true;
+		m_CV.notify_all();
+	}
+
+	virtual bool IsEof(void) const
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		return m_Closed;
+	}
+
+	void Release(void)
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		m_Released = true;
+		m_CV.notify_all();
+	}
+
+	void WaitForWriter(void)
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+
+		while (m_Writers == 0)
+			m_CV.wait(lock);
+	}
+
+	FIFO::Ptr GetData(void) const
+	{
+		return m_Data;
+	}
+
+private:
+	mutable boost::mutex m_Mutex;
+	boost::condition_variable m_CV;
+	FIFO::Ptr m_Data;
+	int m_Writers;
+	bool m_Released;
+	bool m_Closed;
+};
+
+static shared_ptr<const String> EncodeTestMessage(int i, size_t size)
+{
+	Dictionary::Ptr message = make_shared<Dictionary>();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "test::Message");
+	message->Set("ts", i);
+	message->Set("params", String(size, 'x'));
+
+	return make_shared<String>(JsonRpc::EncodeMessage(message));
+}
+
+static void WaitForSendQueue(const Endpoint::Ptr& endpoint)
+{
+	endpoint->WaitForSendQueue(0);
+}
+
+/**
+ * Checks whether WaitForSendQueue() returns within a few seconds after
+ * the specified function was called.
+ */
+static bool WaitReturnsAfter(const Endpoint::Ptr& endpoint, const boost::function<void (void)>& callback)
+{
+	boost::thread waiter(boost::bind(&WaitForSendQueue, endpoint));
+
+	/* The waiter must not return while the writer is stuck. */
+	if (waiter.timed_join(boost::posix_time::milliseconds(100)))
+		return false;
+
+	callback();
+
+	return waiter.timed_join(boost::posix_time::seconds(5));
+}
+
+BOOST_AUTO_TEST_SUITE(remote_endpoint)
+
+BOOST_AUTO_TEST_CASE(accounting)
+{
+	Endpoint::Ptr endpoint = make_shared<Endpoint>();
+	StalledStream::Ptr stream = make_shared<StalledStream>();
+
+	/* Messages for endpoints which aren't connected are dropped. */
+	endpoint->SendEncodedMessage(EncodeTestMessage(0, 100));
+	BOOST_CHECK(endpoint->GetSendQueueLength() == 0);
+	BOOST_CHECK(endpoint->GetSendQueueBytes() == 0);
+
+	endpoint->SetClient(stream);
+
+	size_t bytes = 0;
+
+	for (int i = 0; i < 3; i++) {
+		shared_ptr<const String> data = EncodeTestMessage(i, 100 * (i + 1));
+		bytes += data->GetLength();
+		endpoint->SendEncodedMessage(data);
+	}
+
+	/* The message the writer is working on still counts towards the
+	 * queue's size until it has been written. */
+	stream->WaitForWriter();
+	BOOST_CHECK(endpoint->GetSendQueueLength() == 2);
+	BOOST_CHECK(endpoint->GetSendQueueBytes() == bytes);
+
+	stream->Release();
+	endpoint->WaitForSendQueue(0);
+	BOOST_CHECK(endpoint->IsConnected());
+	BOOST_CHECK(endpoint->GetSendQueueLength() == 0);
+	BOOST_CHECK(endpoint->GetSendQueueBytes() == 0);
+
+	/* The messages are written in the order they were queued. */
+	for (int i = 0; i < 3; i++) {
+		Dictionary::Ptr message = JsonRpc::ReadMessage(stream->GetData());
+		BOOST_CHECK(message->Get("ts") == i);
+	}
+
+	endpoint->SetClient(Stream::Ptr());
+}
+
+BOOST_AUTO_TEST_CASE(high_watermark)
+{
+	Dictionary::Ptr config = make_shared<Dictionary>();
+	config->Set("send_queue_high_watermark", 1024);
+	config->Set("send_queue_low_watermark", 256);
+
+	/* The catch-up callback might still reference the listener after
+	 * the test case has finished. */
+	static ClusterListener::Ptr listener;
+	listener = make_shared<ClusterListener>();
+	Deserialize(listener, config, false, FAConfig);
+
+	Endpoint::Ptr endpoint = make_shared<Endpoint>();
+	StalledStream::Ptr stream = make_shared<StalledStream>();
+	endpoint->SetClient(stream);
+
+	{
+		ObjectLock olock(endpoint);
+
+		endpoint->SendEncodedMessage(EncodeTestMessage(0, 512));
+		BOOST_CHECK(!listener->CheckSendQueue(endpoint));
+		BOOST_CHECK(!endpoint->GetSyncing());
+
+		endpoint->SendEncodedMessage(EncodeTestMessage(1, 512));
+		BOOST_CHECK(endpoint->GetSendQueueBytes() > 1024);
+		BOOST_CHECK(listener->CheckSendQueue(endpoint));
+		BOOST_CHECK(endpoint->GetSyncing());
+	}
+
+	/* Closing the stream makes the writer thread drop the connection
+	 * which also ends the catch-up callback's wait. */
+	BOOST_CHECK(WaitReturnsAfter(endpoint, boost::bind(&StalledStream::Close, stream)));
+}
+
+BOOST_AUTO_TEST_CASE(disconnect)
+{
+	Endpoint::Ptr endpoint = make_shared<Endpoint>();
+
+	/* The writer thread notices that the stream was closed. */
+	StalledStream::Ptr stream = make_shared<StalledStream>();
+	endpoint->SetClient(stream);
+	endpoint->SendEncodedMessage(EncodeTestMessage(0, 100));
+
+	BOOST_CHECK(WaitReturnsAfter(endpoint, boost::bind(&StalledStream::Close, stream)));
+	BOOST_CHECK(!endpoint->IsConnected());
+	BOOST_CHECK(endpoint->GetSendQueueBytes() == 0);
+
+	/* The connection is replaced while the writer is stuck. */
+	stream = make_shared<StalledStream>();
+	endpoint->SetClient(stream);
+	endpoint->SendEncodedMessage(EncodeTestMessage(1, 100));
+
+	BOOST_CHECK(WaitReturnsAfter(endpoint, boost::bind(&Endpoint::SetClient, endpoint, Stream::Ptr())));
+	BOOST_CHECK(!endpoint->IsConnected());
+	BOOST_CHECK(endpoint->GetSendQueueBytes() == 0);
+	BOOST_CHECK(stream->IsEof());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
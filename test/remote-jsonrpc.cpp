@@ -0,0 +1,148 @@
+/******************************************************************************
+ * Icinga 2                                                                   *
+ * Copyright (C) 2012-2014 Icinga Development Team (http://www.icinga.org)    *
+ *                                                                            *
+ * This program is free software; you can redistribute it and/or              *
+ * modify it under the terms of the GNU General Public License                *
+ * as published by the Free Software Foundation; either version 2             *
+ * of the License, or (at your option) any later version.                     *
+ *                                                                            *
+ * This program is distributed in the hope that it will be useful,            *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with this program; if not, write to the Free Software Foundation     *
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.             *
+ ******************************************************************************/
+
+#include "remote/jsonrpc.h"
+#include "base/fifo.h"
+#include "base/serializer.h"
+#include "base/objectlock.h"
+#include "base/convert.h"
+#include "base/utility.h"
+#include <boost/test/unit_test.hpp>
+
+using namespace icinga;
+
+static String GetCheckResultMessage(int i)
+{
+	Dictionary::Ptr cr = make_shared<Dictionary>();
+	cr->Set("state", i % 4);
+	cr->Set("output", "PING OK - Packet loss = 0%, RTA = 0.42 ms");
+	cr->Set("performance_data_raw", "rta=0.420000ms;100.000000;500.000000;0.000000 pl=0%;5;10;0");
+	cr->Set("schedule_start", 1379025342 + i);
+	cr->Set("schedule_end", 1379025342 + i);
+	cr->Set("execution_start", 1379025342 + i);
+	cr->Set("execution_end", 1379025342 + i);
+	cr->Set("check_source", "icinga-node-1");
+
+	Dictionary::Ptr params = make_shared<Dictionary>();
+	params->Set("type", "Service");
+	params->Set("checkable", "host-" + Convert::ToString(i % 1000) + "!service-" + Convert::ToString(i % 20));
+	params->Set("check_result", cr);
+
+	Dictionary::Ptr message = make_shared<Dictionary>();
+	message->Set("jsonrpc", "2.0");
+	message->Set("method", "cluster::CheckResult");
+	message->Set("params", params);
+	message->Set("ts", 1379025342 + i);
+
+	return JsonSerialize(message);
+}
+
+BOOST_AUTO_TEST_SUITE(remote_jsonrpc)
+
+BOOST_AUTO_TEST_CASE(batch)
+{
+	std::vector<String> messages;
+
+	for (int i = 0; i < 10; i++)
+		messages.push_back(GetCheckResultMessage(i));
+
+	for (int compress = 0; compress < 2; compress++) {
+		FIFO::Ptr fifo = make_shared<FIFO>();
+		JsonRpc::SendEncodedMessage(fifo, JsonRpc::EncodeMessage(JsonRpc::EncodeBatch("cluster::Batch", messages, compress)));
+
+		Dictionary::Ptr message = JsonRpc::ReadMessage(fifo);
+		BOOST_CHECK(message->Get("method") == "cluster::Batch");
+
+		Array::Ptr result = JsonRpc::DecodeBatch(message->Get("params"));
+		BOOST_REQUIRE(result->GetLength() == messages.size());
+
+		for (int i = 0; i < 10; i++)
+			BOOST_CHECK(JsonSerialize(result->Get(i)) == messages[i]);
+	}
+
+	Dictionary::Ptr params = make_shared<Dictionary>();
+	params->Set("compression", "lzma");
+	params->Set("messages", "");
+	BOOST_CHECK_THROW(JsonRpc::DecodeBatch(params), std::invalid_argument);
+}
+
+/* Reports encoding throughput for batched messages. Run it with
+ * --run_test=remote_jsonrpc/benchmark, it isn't registered with ctest. */
+BOOST_AUTO_TEST_CASE(benchmark)
+{
+	/* 100k check results per minute, batched with the default batch window of 0.1 seconds */
+	const int count = 100000;
+	const int batch_size = count / 60 / 10;
+
+	std::vector<String> messages;
+
+	for (int i = 0; i < count; i++)
+		messages.push_back(GetCheckResultMessage(i));
+
+	for (int mode = 0; mode < 3; mode++) {
+		FIFO::Ptr fifo = make_shared<FIFO>();
+		double bytes = 0;
+		int frames = 0;
+
+		double start = Utility::GetTime();
+
+		if (mode == 0) {
+			for (int i = 0; i < count; i++) {
+				String data = JsonRpc::EncodeMessage(messages[i]);
+				JsonRpc::SendEncodedMessage(fifo, data);
+				bytes += data.GetLength();
+				frames++;
+			}
+		} else {
+			for (int i = 0; i < count; i += batch_size) {
+				std::vector<String> batch(messages.begin() + i, messages.begin() + std::min(i + batch_size, count));
+				String data = JsonRpc::EncodeMessage(JsonRpc::EncodeBatch("cluster::Batch", batch, mode == 2));
+				JsonRpc::SendEncodedMessage(fifo, data);
+				bytes += data.GetLength();
+				frames++;
+			}
+		}
+
+		double encode_duration = Utility::GetTime() - start;
+
+		NetStringContext context;
+		int received = 0;
+
+		start = Utility::GetTime();
+
+		for (int i = 0; i < frames; i++) {
+			Dictionary::Ptr message = JsonRpc::ReadMessage(fifo, context);
+
+			if (mode == 0)
+				received++;
+			else
+				received += JsonRpc::DecodeBatch(message->Get("params"))->GetLength();
+		}
+
+		double decode_duration = Utility::GetTime() - start;
+
+		BOOST_CHECK_EQUAL(received, count);
+
+		const char *names[] = { "Unbatched", "Batched", "Batched (zlib)" };
+		BOOST_TEST_MESSAGE(names[mode] << ": " << frames << " frames, " << bytes / 1024 / 1024 << " MB on the wire, "
+		    << count / encode_duration << " messages/s sent, " << count / decode_duration << " messages/s received");
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()